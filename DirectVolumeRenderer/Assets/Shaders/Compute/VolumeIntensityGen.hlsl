@@ -1,4 +1,5 @@
 Texture3D<float4> _InputBuffer : register(t0);
+Texture3D<float> _GradientBuffer : register(t2);
 RWTexture3D<float> _Result : register(u0);
 
 Texture2D _AlbedoTransfer 		: register(t1);
@@ -8,11 +9,18 @@ cbuffer VolumeData : register(b0)
 {
 	float3 _VolumeDimensions;
 	float3 _VoxelsPerCell;
+	float  _IntensityScale;
+	float4 _IntensityMask;
 };
 
 float ReadPixel(uint x, uint y, uint z)
 {
-	return _InputBuffer.Load(int4(x,y,z, 0)).w;
+	return dot(_InputBuffer.Load(int4(x,y,z, 0)), _IntensityMask);
+}
+
+float ReadGradient(uint x, uint y, uint z)
+{
+	return _GradientBuffer.Load(int4(x,y,z, 0));
 }
 
 void WritePixel(uint3 id, float data)
@@ -23,28 +31,51 @@ void WritePixel(uint3 id, float data)
 [numthreads(8, 8, 8)]
 void CSMain(uint3 id : SV_DispatchThreadID )
 {
-	// Get start of voxel cube to compute
+	// Get start of voxel cube to compute, the grid is rounded up so drop threads past it
 	uint3 volumePos = _VoxelsPerCell * id;
+	if (any(volumePos >= (uint3)_VolumeDimensions))
+	{
+		return;
+	}
 	
-	// Get min and max bounding points
+	// Get min and max bounding points, the last cell stops at the volume's edge
 	float3 minVolumePos = max(volumePos, float3(0,0,0));
-	float3 maxVolumePos = min(volumePos + _VoxelsPerCell, _VolumeDimensions);
+	float3 maxVolumePos = min(volumePos + _VoxelsPerCell, _VolumeDimensions - 1);
 	
-	// Find the maz iso value for this chunk of the volume!
+	// Intensity range and largest gradient of this chunk of the volume!
 	int Width = maxVolumePos.x, Height = maxVolumePos.y, Depth = maxVolumePos.z;
-	float fmax = -1000;
+	float minIntensity = 1;
+	float maxIntensity = 0;
+	float maxGradient = 0;
 	for (int z = minVolumePos.z; z <= Depth; z++)
 	{
 		for (int y = minVolumePos.y; y <= Height; y++)
 		{
 			for (int x = minVolumePos.x; x <= Width; x++)
 			{	
-				// Find max alpha of the chunk
-				float4 microfacet = _AlbedoTransfer.SampleLevel(_AlbedoSampler, float2(ReadPixel(x, y, z), 0), 0);
-				fmax = max(fmax, microfacet.w);
+				float intensity = ReadPixel(x, y, z);
+				minIntensity = min(minIntensity, intensity);
+				maxIntensity = max(maxIntensity, intensity);
+				maxGradient = max(maxGradient, ReadGradient(x, y, z));
 			}
 		}
 	}
 
+	// The transfer's gradient ramp never falls as the magnitude rises, so the row of the
+	// largest gradient bounds the whole cell. Max alpha over the intensity span of that row.
+	uint2 lutSize;
+	_AlbedoTransfer.GetDimensions(lutSize.x, lutSize.y);
+	// Back to the stored values first so the bins agree with VolumeOccupancy::Classify.
+	uint scale = uint(_IntensityScale);
+	uint row   = min(uint(maxGradient * 255 + 0.5) * lutSize.y / 255, lutSize.y - 1);
+	uint first = min(uint(minIntensity * _IntensityScale + 0.5) * lutSize.x / scale, lutSize.x - 1);
+	uint last  = min(uint(maxIntensity * _IntensityScale + 0.5) * lutSize.x / scale, lutSize.x - 1);
+	
+	float fmax = 0;
+	for (uint i = first; i <= last; i++)
+	{
+		fmax = max(fmax, _AlbedoTransfer.Load(int3(i, row, 0)).w);
+	}
+
 	WritePixel(id, fmax);
-}
\ No newline at end of file
+}
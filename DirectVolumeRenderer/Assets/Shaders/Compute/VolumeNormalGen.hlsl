@@ -2,6 +2,7 @@
 
 Texture3D<uint> _InputBuffer : register(t0);
 RWTexture3D<uint4> _Result : register(u0);
+RWTexture3D<uint> _Magnitude : register(u1);
 
 cbuffer VolumeData : register(b0)
 {
@@ -24,6 +25,14 @@ void WritePixel(uint3 id, float3 normal, uint w)
 [numthreads(8, 8, 8)]
 void CSMain(uint3 id : SV_DispatchThreadID )
 {
+	// Dispatch rounds up to whole groups, skip the threads past the edge
+	uint3 size;
+	_Result.GetDimensions(size.x, size.y, size.z);
+	if (any(id >= size))
+	{
+		return;
+	}
+
 	// Fetch neighbours and Normalize intensity values
 	float3 s1; float3 s2;
 	s1.x = ReadPixel(id.x - 1, id.y, id.z);
@@ -36,6 +45,9 @@ void CSMain(uint3 id : SV_DispatchThreadID )
 	// Normalize vector and map back to image range (0 - 255)
 	float3 normal = (normalize(s2 - s1) * 0.5 + 0.5) * 255;
 	
+	// Gradient magnitude per voxel as a fraction of the data range, the store clamps at 255
+	_Magnitude[id] = length(s2 - s1) * 0.5 / _Range * 255;
+	
 	// Remap the data to be 0-255 using the data range clamp at either end
 	WritePixel(id, normal, ((ReadPixel(id.x, id.y, id.z) - _MinValue) / _Range) * _InitialMax);
 	//WritePixel(id, normal, ReadPixel(id.x, id.y, id.z) * 255);
@@ -0,0 +1,60 @@
+// Transfer function independent half of the occupancy grid, run once per volume.
+// Each cell gets its intensity range as stored values (0-255, 0-65535 for a 16 bit volume)
+// and largest gradient as a byte, the CPU then classifies cells against any transfer function without touching voxels.
+
+Texture3D<float4> _InputBuffer : register(t0);
+Texture3D<float> _GradientBuffer : register(t2);
+RWTexture3D<uint4> _Result : register(u0);
+
+cbuffer VolumeData : register(b0)
+{
+	float3 _VolumeDimensions;
+	float3 _VoxelsPerCell;
+	float  _IntensityScale;
+	float4 _IntensityMask;
+};
+
+uint ReadPixel(uint x, uint y, uint z)
+{
+	return uint(dot(_InputBuffer.Load(int4(x,y,z, 0)), _IntensityMask) * _IntensityScale + 0.5);
+}
+
+uint ReadGradient(uint x, uint y, uint z)
+{
+	return uint(_GradientBuffer.Load(int4(x,y,z, 0)) * 255 + 0.5);
+}
+
+[numthreads(8, 8, 8)]
+void CSMain(uint3 id : SV_DispatchThreadID )
+{
+	// Same cell bounds as VolumeIntensityGen, the far face is shared for the interpolation.
+	// The grid is rounded up, so drop threads past it and clamp the last cell to the volume.
+	uint3 volumePos = _VoxelsPerCell * id;
+	if (any(volumePos >= (uint3)_VolumeDimensions))
+	{
+		return;
+	}
+	
+	float3 minVolumePos = max(volumePos, float3(0,0,0));
+	float3 maxVolumePos = min(volumePos + _VoxelsPerCell, _VolumeDimensions - 1);
+	
+	int Width = maxVolumePos.x, Height = maxVolumePos.y, Depth = maxVolumePos.z;
+	uint minIntensity = 65535;
+	uint maxIntensity = 0;
+	uint maxGradient = 0;
+	for (int z = minVolumePos.z; z <= Depth; z++)
+	{
+		for (int y = minVolumePos.y; y <= Height; y++)
+		{
+			for (int x = minVolumePos.x; x <= Width; x++)
+			{	
+				uint intensity = ReadPixel(x, y, z);
+				minIntensity = min(minIntensity, intensity);
+				maxIntensity = max(maxIntensity, intensity);
+				maxGradient = max(maxGradient, ReadGradient(x, y, z));
+			}
+		}
+	}
+
+	_Result[id] = uint4(minIntensity, maxIntensity, maxGradient, 0);
+}
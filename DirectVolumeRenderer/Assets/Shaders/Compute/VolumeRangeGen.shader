@@ -0,0 +1,5 @@
+<Shader>
+	<Shaders>
+		<ShaderPath type="CS" source="Assets/Shaders/Compute/VolumeRangeGen.hlsl" entry="CSMain"/>
+	</Shaders>
+</Shader>
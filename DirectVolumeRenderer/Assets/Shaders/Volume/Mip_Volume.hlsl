@@ -1,4 +1,5 @@
 #include "..\globals.hlsl"
+#include "VolumeLayout.hlsl"
 
 Texture3D _VolumeMap     : register(t4);
 Texture3D _OccupancyMap     : register(t5);
@@ -100,7 +101,7 @@ float4 frag(v2f i) : SV_TARGET
 	float mip;
 	for(int j = 0; j < _Iterations; j++)
 	{
-        voxel = _VolumeMap.SampleLevel(_VolumeSampler, p, 0).rgba;
+        voxel = SampleVoxel(_VolumeMap, _VolumeSampler, p);
 		
 		if(voxel.w > _Hounsfield)
 		{
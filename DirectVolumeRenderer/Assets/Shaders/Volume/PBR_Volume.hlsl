@@ -1,14 +1,29 @@
 #include "..\globals.hlsl"
+#include "VolumeLayout.hlsl"
 
 Texture3D _VolumeMap      : register(t4);
 Texture2D _AlbedoTransfer : register(t5);
 Texture2D _SurfaceTransfer : register(t6);
 Texture2D _NoiseText      : register(t7);
+Texture3D _GradientMap    : register(t8);
+#ifdef SPLIT_LAYOUT
+Texture3D _NormalMap      : register(t9);
+Texture2D _PreIntegratedTransfer : register(t10);
+#else
+Texture2D _PreIntegratedTransfer : register(t9);
+#endif
 
 SamplerState _VolumeSampler  	  : register(s4);
 SamplerState _AlbedoSampler 	  : register(s5);
 SamplerState _SurfaceSampler 	  : register(s6);
 SamplerState _NoiseSampler   	  : register(s7);
+SamplerState _GradientSampler 	  : register(s8);
+#ifdef SPLIT_LAYOUT
+SamplerState _NormalSampler 	  : register(s9);
+SamplerState _PreIntegratedSampler : register(s10);
+#else
+SamplerState _PreIntegratedSampler : register(s9);
+#endif
 
 static const int MAX_SAMPLES = 800;	
 
@@ -18,6 +33,7 @@ cbuffer PerMaterial : register(b3)
 	float3 _StepSize;
 	float  _Iterations;
 	float3 _VolumeSize;
+	float  _PreIntegrated;	// 1 when _StepSize is the table's segment and albedo comes from it
 };
 
 struct AppData
@@ -106,6 +122,17 @@ struct Ray
 	float  Length;
 };
 
+// Un-premultiplied colour and opacity of the segment between two samples. The table's entries sit on
+// intensities 0 to 1 inclusive, texel centres are half a texel in.
+float4 PreIntegratedAlbedo(float front, float back)
+{
+	float2 size;
+	_PreIntegratedTransfer.GetDimensions(size.x, size.y);
+	float2 uv = (float2(back, front) * (size - 1.0) + 0.5) / size;
+	float4 segment = _PreIntegratedTransfer.SampleLevel(_PreIntegratedSampler, uv, 0);
+	return float4(segment.a > 0 ? segment.rgb / segment.a : 0, segment.a);
+}
+
 Ray GetRay(float3 origin, float3 dir, const float3 boxMin, const float3 boxMax)
 {
 	Ray ray;
@@ -141,12 +168,28 @@ float4 frag(v2f i) : SV_TARGET
 	float random = frac(sin(i.position.x * 12.9898 + i.position.y * 78.233) * 43758.5453);
 	float3 p = rayStart + (stepDelta * random);
 	int iteractions = length((rayEnd - rayStart) * _VolumeSize) / _StepSize;
+	float front = -1; // Previous sample's intensity for the pre-integrated segment, none before the first
 	// need a way to determine how many samples should be run.
 	for(int j = 0; j < iteractions; ++j)
 	{
 		// Sample origional volume with p
-		float4 voxel = _VolumeMap.SampleLevel(_VolumeSampler, p, 0).rgba;
-		float4 albedo = _AlbedoTransfer.SampleLevel(_AlbedoSampler, float2(voxel.w, 0), 0);
+#ifdef SPLIT_LAYOUT
+		float4 voxel = SampleVoxel(_VolumeMap, _VolumeSampler, _NormalMap, _NormalSampler, p);
+#else
+		float4 voxel = SampleVoxel(_VolumeMap, _VolumeSampler, p);
+#endif
+		float4 albedo;
+		if (_PreIntegrated > 0)
+		{
+			// The first sample has no segment behind it, the diagonal is the sample alone.
+			albedo = PreIntegratedAlbedo(front < 0 ? voxel.w : front, voxel.w);
+			front = voxel.w;
+		}
+		else
+		{
+			float gradient = _GradientMap.SampleLevel(_GradientSampler, p, 0).r;
+			albedo = _AlbedoTransfer.SampleLevel(_AlbedoSampler, float2(voxel.w, gradient), 0);
+		}
 			
 		// Run shading if intensity is high enough.
 		if(albedo.w > _Hounsfield)
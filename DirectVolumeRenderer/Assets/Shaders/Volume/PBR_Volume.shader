@@ -5,10 +5,13 @@
 		<Property name="AlbedoTransfer" type="Texture"/>
 		<Property name="SurfaceTransfer" type="Texture"/>
 		<Property name="Noise" type="Texture"/>
+		<Property name="GradientMap" type="Texture"/>
+		<Property name="PreIntegratedTransfer" type="Texture"/>
 		<Property name="Hounsfield" type="Float" min="0" max="1.0"/>
 		<Property name="StepSize" type="Vector3"/>
 		<Property name="Iterations" type="Float" min="0" max="1.0"/>
 		<Property name="VolumeDims" type="Vector3"/>
+		<Property name="PreIntegrated" type="Float" min="0" max="1.0"/>
 	</Properties>
 	
 	<RenderState>
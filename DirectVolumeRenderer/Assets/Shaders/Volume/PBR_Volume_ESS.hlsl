@@ -1,16 +1,25 @@
 #include "..\globals.hlsl"
+#include "VolumeLayout.hlsl"
 
 Texture3D _VolumeMap      : register(t4);
 Texture3D _OccupancyMap   : register(t5);
 Texture2D _AlbedoTransfer : register(t6);
 Texture2D _SurfaceTransfer : register(t7);
 Texture2D _NoiseText      : register(t8);
+Texture3D _GradientMap    : register(t9);
+#ifdef SPLIT_LAYOUT
+Texture3D _NormalMap      : register(t10);
+#endif
 
 SamplerState _VolumeSampler  	  : register(s4);
 SamplerState _OccupancyMapSampler : register(s5);
 SamplerState _AlbedoSampler 	  : register(s6);
 SamplerState _SurfaceSampler 	  : register(s7);
 SamplerState _NoiseSampler   	  : register(s8);
+SamplerState _GradientSampler 	  : register(s9);
+#ifdef SPLIT_LAYOUT
+SamplerState _NormalSampler 	  : register(s10);
+#endif
 
 static const int MAX_SAMPLES = 800;	
 
@@ -125,130 +134,148 @@ Ray GetRay(float3 origin, float3 dir, const float3 boxMin, const float3 boxMax)
 	return ray;
 }
 
-// 3D-DDA -Na Method Fast GPU 
+// Shaded and premultiplied sample at p (volume texture space), alpha 0 below the threshold.
+float4 ShadeSample(float3 p, float3 worldPos, float3 L)
+{
+#ifdef SPLIT_LAYOUT
+	float4 voxel = SampleVoxel(_VolumeMap, _VolumeSampler, _NormalMap, _NormalSampler, p);
+#else
+	float4 voxel = SampleVoxel(_VolumeMap, _VolumeSampler, p);
+#endif
+
+	float gradient = _GradientMap.SampleLevel(_GradientSampler, p, 0).r;
+	float4 albedo = _AlbedoTransfer.SampleLevel(_AlbedoSampler, float2(voxel.w, gradient), 0);
+	if(albedo.w < _Hounsfield)
+	{
+		return float4(0,0,0,0);
+	}
+
+	float2 surface 	  = _SurfaceTransfer.SampleLevel(_SurfaceSampler, float2(voxel.w, 0), 0).rg;
+	float metalness   = surface.r;
+	float roughness   = surface.g;
+	float3 N          = mul(_NormalWorld, float4((2.0 * voxel.rgb - 1.0f), 0.0f)).xyz;
+	N *= -1;
+
+	float3 V     = normalize(_CameraPosWorld - worldPos);
+	float3 VR    = normalize(reflect(-V, N));
+	float3 H     = normalize(L + V);
+	float  NdotL = max(dot(N, L),0);
+	float  NdotV = max(dot(N, V),0);
+	float  NdotH = max(dot(N, H),0);
+	float  VdotH = max(dot(V, H),0);
+
+	float3 F0 = lerp(Fdielectric , albedo.xyz, metalness);
+	float  D  = DistributionGGX(NdotH, roughness);
+	float  G  = GeometrySchlickSmith(NdotL, NdotV, roughness);
+	float3 F  = FresnelSchlick(VdotH, F0);
+
+	//--Diffuse and Specular--
+	float3 KD = lerp(float3(1, 1, 1) - F, float3(0, 0, 0), metalness);
+	float3 diffuseBDRF 	= KD * albedo.xyz;
+	float3 specularBRDF = CookTorranceBRDF(NdotL, NdotV, D, G, F);
+	float3 directLighting = (diffuseBDRF + specularBRDF) * NdotL;
+
+	//--Enviromental Lighting--
+	float3 irradiance = _IrradianceMap.SampleLevel(_IrradianceSample, N, 0).rgb;
+	F = FresnelSchlick(NdotV, F0);
+	KD = lerp(1.0 - F, 0.0, metalness);
+
+	float3 diffuseIBL = KD * albedo.xyz * irradiance;
+	float3 specularIrradiance = _SpecularEnvMap.SampleLevel(_SpecularEnvSample, VR, roughness * GetSpecularMipLevels()).rgb;
+	float2 ambientSpec = _SpecularBRDFLUT.SampleLevel(_SpecularBRDFLUTSampe, float2(NdotV, roughness), 0).rg;
+	float3 specularIBL = (F0 * ambientSpec.x + ambientSpec.y) * specularIrradiance;
+	float3 ambientLighting = diffuseIBL + specularIBL;
+
+	//--Finalize color--
+	float4 src = float4(directLighting + ambientLighting, albedo.w);
+	src.rgb *= src.a;
+	return src;
+}
+
+// Hierarchical 3D-DDA over the occupancy mip chain, each mip the max of the one below (see
+// OccupancyTraversal, the CPU reference). An empty node is crossed in one step and the walk
+// tries the next mip up, an occupied one drops a level until it is a cell, which is marched.
 float4 frag(v2f i) : SV_TARGET
 {
 	Ray ray = GetRay(_CameraPosLocal, normalize(i.vertex.xyz - _CameraPosLocal), float3(-1,-1,-1), float3(1,1,1));
-	
-	float4 src   = float4(0,0,0,0);
+
 	float4 color = float4(0,0,0,0);
-	float3 L     = -normalize(float3(0,0,1)); 
-	
-	//--DDA--
+	float3 L     = -normalize(float3(0,0,1));
+
+	// Ray in cells, t runs along ray.Dir from ray.Start to ray.Length like the texture space ray.
 	float3 rayStart  = ray.Start * _OccupancySize;
-	float3 rayEnd  	 = ray.End 	 * _OccupancySize;
 	float3 rayDir 	 = ray.Dir	 * _OccupancySize;
-	float3 stepDelta = ray.Dir 	 * _StepSize;
-	float  previousT;
-	
-	float3 t = float3(4294967295,4294967295,4294967295);
-	float3 deltaT = float3(4294967295,4294967295,4294967295);
-	float3 voxelIncr = float3(0,0,0);
-	float3 stepDir = float3(0,0,0);
-	
-	// Current voxel were starting on
-	int3 currentV = int3(rayStart.x, rayStart.y, rayStart.z);
-	int3 lastVoxel = int3(rayEnd.x, rayEnd.y, rayEnd.z);
-	
-	if(all(rayDir) != 0)
-	{
-		stepDir = (rayDir < 0)? -1 : 1;
-		deltaT = (1.0f /rayDir) * stepDir;
-		t = ((currentV + stepDir) - rayStart) / rayDir;
-	}
-	
-	// This seems more reliable than checking if we left the volume for some reason?
-	int iteractions = abs(length(rayEnd - rayStart) * 1.25f);
-	for(int j = 0; j <= iteractions; ++j)
+	float  stepLength = max(length(ray.Dir * _StepSize), Epsilon);
+
+	// _OccupancySize is the volume's extent in cells, the grid rounds it up so the last cell can stick out past it.
+	uint width, height, depth, mips;
+	_OccupancyMap.GetDimensions(0, width, height, depth, mips);
+	int3 gridSize = int3(width, height, depth);
+	int  maxLevel = (int)mips - 1;
+
+	int3 cell = clamp(int3(floor(rayStart)), 0, gridSize - 1);
+	float tEntry = 0.0f;
+	int level = maxLevel;
+
+	// A ray crosses at most sqrt(3) cells per unit length, two fetches a cell at worst (up a level
+	// and back down), plus the first descent.
+	int maxNodes = (int)(length(ray.End * _OccupancySize - rayStart) * 4.0f) + 2 * (int)mips + 4;
+	[loop]
+	for(int j = 0; j < maxNodes; ++j)
 	{
-		// Finds shortest axis its the next t intersection
-		voxelIncr.x = (t.x <= t.y) && (t.x <= t.z);
-		voxelIncr.y = (t.y <= t.x) && (t.y <= t.z);
-		voxelIncr.z = (t.z <= t.x) && (t.z <= t.y);
-		
-		// cache previousT, probably a more effecint way?
-		previousT = t.x * voxelIncr.x + t.y * voxelIncr.y + t.z * voxelIncr.z;
-		// Increment T by delta on the axis with next intersect
-		t += voxelIncr * deltaT;
-		// Move to the next voxel
-		currentV += voxelIncr * stepDir;
-
-		// Get intensity of voxel at the current voxel, normalize currentV to do so!
-		float intensity = _OccupancyMap.SampleLevel(_OccupancyMapSampler, abs(currentV/_OccupancySize), 0).r;
-
-		// Run shading if intensity is high enough.
-		if(intensity >= _Hounsfield)
-		{	
-			// Try find start and end + a step amount?
-			float3 start = (ray.Start + (previousT * ray.Dir));
-			float3 end = (ray.Start + (t * ray.Dir));
-			
-			// Doesnt quite work yet, works using magic number repalce with statistical
-			// method!
-			int innerVoxelSteps = abs(ceil(length(end - start)/_StepSize));
-			
-			for(int j = 0; j <= innerVoxelSteps; ++j)
+		// The last texel on an axis also covers the cells an odd halving dropped.
+		int3 mipSize = max(gridSize >> level, 1);
+		int3 node = min(cell >> level, mipSize - 1);
+		bool occupied = _OccupancyMap.Load(int4(node, level)).r >= _Hounsfield;
+		if(occupied && level > 0)
+		{
+			level--;
+			continue;
+		}
+
+		// Leave the node through its nearest face.
+		int3 lo = node << level;
+		int3 hi = (node == mipSize - 1) ? gridSize : (node + 1) << level;
+		float3 face = (rayDir > 0) ? float3(hi) : float3(lo);
+		float3 tFace = (rayDir != 0) ? (face - rayStart) / rayDir : 3.402823466e+38f;
+		float tExit = min(tFace.x, min(tFace.y, tFace.z));
+
+		// Samples sit on one step grid along the whole ray, so cells next to each other neither repeat nor skip one.
+		if(occupied)
+		{
+			float tStop = min(tExit, ray.Length);
+			[loop]
+			for(float tSample = ceil(tEntry / stepLength) * stepLength; tSample < tStop; tSample += stepLength)
 			{
-				// Sample origional volume with p
-				float4 voxel = _VolumeMap.SampleLevel(_VolumeSampler, start, 0).rgba;
-				
-				float4 albedo = _AlbedoTransfer.SampleLevel(_AlbedoSampler, float2(voxel.w, 0), 0);
-				
-				if(albedo.w >= _Hounsfield)
+				float4 src = ShadeSample(ray.Start + ray.Dir * tSample, i.worldPos.xyz, L);
+				color = (1.0f - color.a) * src + color;
+
+				// Break as alpha is diminishing returns
+				if(color.a > 0.95f)
 				{
-					float2 surface 	  = _SurfaceTransfer.SampleLevel(_SurfaceSampler, float2(voxel.w, 0), 0).rg;
-					float metalness   = surface.r;
-					float roughness   = surface.g;
-					float3 N          = mul(_NormalWorld, float4((2.0 * voxel.rgb - 1.0f), 0.0f)).xyz;
-					N *= -1;
-					
-					float3 V     = normalize(_CameraPosWorld - i.worldPos.xyz);
-					float3 VR    = normalize(reflect(-V, N));
-					float3 H     = normalize(L + V);
-					float  NdotL = max(dot(N, L),0);
-					float  NdotV = max(dot(N, V),0);
-					float  NdotH = max(dot(N, H),0);
-					float  VdotH = max(dot(V, H),0);
-				
-					float3 F0 = lerp(Fdielectric , albedo.xyz, metalness);
-					float  D  = DistributionGGX(NdotH, roughness);
-					float  G  = GeometrySchlickSmith(NdotL, NdotV, roughness);
-					float3 F  = FresnelSchlick(VdotH, F0);	
-				
-					//--Diffuse and Specular--
-					float3 KD = lerp(float3(1, 1, 1) - F, float3(0, 0, 0), metalness);	
-					float3 diffuseBDRF 	= KD * albedo.xyz;
-					float3 specularBRDF = CookTorranceBRDF(NdotL, NdotV, D, G, F);
-					float3 directLighting = (diffuseBDRF + specularBRDF) * NdotL;
-					
-					//--Enviromental Lighting--
-					float3 irradiance = _IrradianceMap.SampleLevel(_IrradianceSample, N, 0).rgb;
-					F = FresnelSchlick(NdotV, F0);
-					KD = lerp(1.0 - F, 0.0, metalness);
-					
-					float3 diffuseIBL = KD * albedo.xyz * irradiance;
-					float3 specularIrradiance = _SpecularEnvMap.SampleLevel(_SpecularEnvSample, VR, roughness * GetSpecularMipLevels()).rgb;
-					float2 ambientSpec = _SpecularBRDFLUT.SampleLevel(_SpecularBRDFLUTSampe, float2(NdotV, roughness), 0).rg;
-					float3 specularIBL = (F0 * ambientSpec.x + ambientSpec.y) * specularIrradiance;
-					float3 ambientLighting = diffuseIBL + specularIBL;
-				
-					//--Finalize color--
-					src = float4(directLighting + ambientLighting, albedo.w);
-					src.rgb *= src.a;
-					color = (1.0f - color.a)*src + color;
-					
-					// Break as alpha is diminishing returns
-					if(color.a > 0.95f)
-					{
-						// We have to return color here, as breaking would only break inner loop!
-						return color;
-					}
+					return color;
 				}
-				
-				// Step position by some fixed amount
-				start += stepDelta;
 			}
 		}
+
+		if(tExit >= ray.Length)
+		{
+			break;
+		}
+
+		// Next node, stepped on the exit axis and found from the exit point within the node on the others.
+		int3 exitAxis = int3(tFace.x == tExit, tFace.y == tExit && tFace.x != tExit, tFace.z == tExit && tFace.x != tExit && tFace.y != tExit);
+		int3 stepped = (rayDir > 0) ? hi : lo - 1;
+		int3 inside = clamp(int3(floor(rayStart + rayDir * tExit)), lo, hi - 1);
+		cell = exitAxis ? stepped : inside;
+		if(any(cell < 0) || any(cell >= gridSize))
+		{
+			break;
+		}
+
+		tEntry = tExit;
+		// Try a bigger node next, the walk comes back down if it isn't empty.
+		level = min(level + 1, maxLevel);
 	}
 	return color;
-}
\ No newline at end of file
+}
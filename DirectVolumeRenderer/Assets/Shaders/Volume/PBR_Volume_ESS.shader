@@ -6,6 +6,7 @@
 		<Property name="AlbedoTransfer" type="Texture"/>
 		<Property name="SurfaceTransfer" type="Texture"/>
 		<Property name="Noise" type="Texture"/>
+		<Property name="GradientMap" type="Texture"/>
 		<Property name="StepSize" type="Vector3"/>
 		<Property name="Hounsfield" type="Float" min="0" max="1.0"/>
 		<Property name="VolumeDims" type="Vector3"/>
@@ -0,0 +1,3 @@
+// Alpha_Volume over the split layout, intensity in its own R8/R16 texture (see VolumeLayout.hlsl).
+#define SPLIT_LAYOUT
+#include "..\Alpha_Volume.hlsl"
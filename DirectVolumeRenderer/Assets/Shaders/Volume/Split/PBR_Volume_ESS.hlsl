@@ -0,0 +1,3 @@
+// PBR_Volume_ESS over the split layout, intensity in its own R8/R16 texture (see VolumeLayout.hlsl).
+#define SPLIT_LAYOUT
+#include "..\PBR_Volume_ESS.hlsl"
@@ -0,0 +1,64 @@
+// How a voxel is stored. Packed (default): one RGBA8 texture, normal * 0.5 + 0.5 in rgb and
+// intensity in alpha. SPLIT_LAYOUT: intensity alone in an R8 or R16 texture and the normal
+// octahedral encoded in a separate R8G8 one (see OctahedralNormals.h), so a 16 bit scan keeps
+// all of its precision. Either way a sample comes back packed, the shading code is the same.
+
+// Unit normal from the two octahedral bytes, 0-1 unorm as sampled.
+float3 DecodeOctahedral(float2 e)
+{
+	e = e * 2.0 - 1.0;
+	float3 n = float3(e.x, e.y, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0)
+	{
+		n.xy = (1.0 - abs(n.yx)) * float2(n.x >= 0 ? 1.0 : -1.0, n.y >= 0 ? 1.0 : -1.0);
+	}
+	return normalize(n);
+}
+
+// Intensity in w, rgb undefined.
+float4 SampleVoxel(Texture3D volume, SamplerState volumeSampler, float3 p)
+{
+#ifdef SPLIT_LAYOUT
+	return float4(0, 0, 0, volume.SampleLevel(volumeSampler, p, 0).r);
+#else
+	return volume.SampleLevel(volumeSampler, p, 0);
+#endif
+}
+
+// Trilinear blend of the decoded normals around p, corners outside the volume add 0. Filtering the
+// encoded bytes instead would blend across the octahedral folds, so the corners are loaded and decoded
+// one by one (the normal sampler goes unused). Not renormalized, like the packed layout's filtered rgb.
+float3 SampleOctahedral(Texture3D normals, float3 p)
+{
+	uint3 size;
+	normals.GetDimensions(size.x, size.y, size.z);
+	float3 texel = p * size - 0.5;
+	float3 low = floor(texel);
+	float3 t = texel - low;
+	int3 base = (int3)low;
+
+	float3 normal = 0;
+	[unroll]
+	for (int i = 0; i < 8; i++)
+	{
+		int3 offset = int3(i & 1, (i >> 1) & 1, i >> 2);
+		int3 corner = base + offset;
+		float3 w = offset ? t : 1.0 - t;
+		if (all(corner >= 0) && all(corner < (int3)size))
+		{
+			normal += w.x * w.y * w.z * DecodeOctahedral(normals.Load(int4(corner, 0)).rg);
+		}
+	}
+	return normal;
+}
+
+// Normal * 0.5 + 0.5 in rgb, intensity in w.
+float4 SampleVoxel(Texture3D volume, SamplerState volumeSampler, Texture3D normals, SamplerState normalSampler, float3 p)
+{
+#ifdef SPLIT_LAYOUT
+	float3 normal = SampleOctahedral(normals, p);
+	return float4(normal * 0.5 + 0.5, volume.SampleLevel(volumeSampler, p, 0).r);
+#else
+	return volume.SampleLevel(volumeSampler, p, 0);
+#endif
+}
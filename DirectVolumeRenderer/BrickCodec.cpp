@@ -0,0 +1,340 @@
+#include "BrickCodec.h"
+#include <cstring>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace
+{
+	const Byte   MethodRaw = 0;
+	const Byte   MethodRice = 1;
+	const Uint32 BlockSize = 64;
+	const Uint32 ParamBits = 5;
+	const Uint32 ZeroBlock = 31;	 // Parameter value marking a block of zero residuals
+	const Uint32 EscapeLength = 24; // Unary runs this long are followed by the raw value
+
+	inline Uint32 TrailingZeros(Uint64 value)
+	{
+#if defined(_MSC_VER)
+		unsigned long index;
+		if (_BitScanForward(&index, (unsigned long)value)) { return index; }
+		_BitScanForward(&index, (unsigned long)(value >> 32));
+		return index + 32;
+#else
+		return (Uint32)__builtin_ctzll(value);
+#endif
+	}
+
+	// LSB first bit packer.
+	struct BitWriter
+	{
+		std::vector<Byte>& out;
+		Uint64 bits = 0;
+		Uint32 count = 0;
+
+		BitWriter(std::vector<Byte>& buffer) : out(buffer) {}
+
+		// value must fit in n bits, n <= 32
+		void Write(Uint32 value, Uint32 n)
+		{
+			bits |= (Uint64)value << count;
+			count += n;
+			while (count >= 8)
+			{
+				out.push_back((Byte)bits);
+				bits >>= 8;
+				count -= 8;
+			}
+		}
+
+		void Flush()
+		{
+			if (count > 0)
+			{
+				out.push_back((Byte)bits);
+			}
+			bits = 0;
+			count = 0;
+		}
+	};
+
+	struct BitReader
+	{
+		const Byte* data = nullptr;
+		Uint64 size = 0;
+		Uint64 position = 0;
+		Uint64 bits = 0;
+		Uint32 count = 0;
+
+		// Keeps at least 57 bits buffered, reads past the end give zeros and are caught by Overrun.
+		void Refill()
+		{
+			while (count <= 56)
+			{
+				Uint64 byte = position < size ? data[position] : 0;
+				bits |= byte << count;
+				position++;
+				count += 8;
+			}
+		}
+
+		Uint32 Read(Uint32 n)
+		{
+			Refill();
+			Uint32 value = (Uint32)(bits & ((1ull << n) - 1));
+			bits >>= n;
+			count -= n;
+			return value;
+		}
+
+		// Counts ones up to the terminating zero, stops at EscapeLength without consuming a zero.
+		Uint32 ReadUnary()
+		{
+			Refill();
+			Uint64 inverted = ~bits;
+			Uint32 ones = inverted ? TrailingZeros(inverted) : 64;
+			if (ones >= EscapeLength)
+			{
+				bits >>= EscapeLength;
+				count -= EscapeLength;
+				return EscapeLength;
+			}
+
+			bits >>= ones + 1;
+			count -= ones + 1;
+			return ones;
+		}
+
+		bool Overrun()const
+		{
+			return position - count / 8 > size;
+		}
+	};
+
+	// Median edge detector, picks the left or above neighbour across edges and the plane fit otherwise.
+	inline Uint32 Predict(Uint32 a, Uint32 b, Uint32 c)
+	{
+		Uint32 lo = a < b ? a : b;
+		Uint32 hi = a < b ? b : a;
+		if (c >= hi) { return lo; }
+		if (c <= lo) { return hi; }
+		return a + b - c;
+	}
+
+	// Samples are worked on as unsigned, signed data is flipped on the sign bit so its order is kept.
+	template<typename T>
+	inline Uint32 PredictAt(const T* v, Uint32 x, Uint32 y, Uint32 z, Uint32 size, Uint32 bias)
+	{
+		Uint64 i = ((Uint64)z * size + y) * size + x;
+		if (x > 0 && y > 0)
+		{
+			return Predict(v[i - 1] ^ bias, v[i - size] ^ bias, v[i - size - 1] ^ bias);
+		}
+		if (x > 0) { return v[i - 1] ^ bias; }
+		if (y > 0) { return v[i - size] ^ bias; }
+		if (z > 0) { return v[i - (Uint64)size * size] ^ bias; }
+		return 0;
+	}
+
+	template<typename T>
+	void EncodeRice(const T* voxels, Uint32 size, Uint32 bias, std::vector<Byte>& out)
+	{
+		const Uint32 sampleBits = sizeof(T) * 8;
+		const Uint32 mask = (1u << sampleBits) - 1;
+		const Uint32 signShift = sampleBits - 1;
+
+		Uint64 count = (Uint64)size * size * size;
+		std::vector<Uint32> residuals((size_t)count);
+
+		Uint64 i = 0;
+		for (Uint32 z = 0; z < size; z++)
+		{
+			for (Uint32 y = 0; y < size; y++)
+			{
+				for (Uint32 x = 0; x < size; x++, i++)
+				{
+					Uint32 delta = ((voxels[i] ^ bias) - PredictAt(voxels, x, y, z, size, bias)) & mask;
+					// Zigzag so small negative residuals become small codes.
+					Uint32 sign = (delta >> signShift) ? mask : 0;
+					residuals[(size_t)i] = ((delta << 1) ^ sign) & mask;
+				}
+			}
+		}
+
+		BitWriter writer(out);
+		for (Uint64 begin = 0; begin < count; begin += BlockSize)
+		{
+			Uint64 end = begin + BlockSize < count ? begin + BlockSize : count;
+
+			Uint64 sum = 0;
+			for (Uint64 j = begin; j < end; j++)
+			{
+				sum += residuals[(size_t)j];
+			}
+
+			if (sum == 0)
+			{
+				writer.Write(ZeroBlock, ParamBits);
+				continue;
+			}
+
+			// Rice parameter near log2 of the mean residual.
+			Uint32 k = 0;
+			while (k < sampleBits - 1 && ((end - begin) << (k + 1)) <= sum)
+			{
+				k++;
+			}
+
+			writer.Write(k, ParamBits);
+			for (Uint64 j = begin; j < end; j++)
+			{
+				Uint32 value = residuals[(size_t)j];
+				Uint32 quotient = value >> k;
+				if (quotient >= EscapeLength)
+				{
+					writer.Write((1u << EscapeLength) - 1, EscapeLength);
+					writer.Write(value, sampleBits);
+				}
+				else
+				{
+					// quotient ones and a terminating zero
+					writer.Write((1u << quotient) - 1, quotient + 1);
+					if (k > 0)
+					{
+						writer.Write(value & ((1u << k) - 1), k);
+					}
+				}
+			}
+		}
+		writer.Flush();
+	}
+
+	template<typename T>
+	bool DecodeRice(const Byte* data, Uint64 byteCount, Uint32 size, Uint32 bias, T* voxels)
+	{
+		const Uint32 sampleBits = sizeof(T) * 8;
+		const Uint32 mask = (1u << sampleBits) - 1;
+
+		BitReader reader;
+		reader.data = data;
+		reader.size = byteCount;
+
+		Uint64 count = (Uint64)size * size * size;
+		Uint64 i = 0;
+		Uint32 x = 0, y = 0, z = 0;
+		while (i < count)
+		{
+			Uint64 end = i + BlockSize < count ? i + BlockSize : count;
+			Uint32 k = reader.Read(ParamBits);
+			if (k != ZeroBlock && k >= sampleBits)
+			{
+				return false;
+			}
+
+			for (; i < end; i++)
+			{
+				Uint32 value = 0;
+				if (k != ZeroBlock)
+				{
+					Uint32 quotient = reader.ReadUnary();
+					if (quotient == EscapeLength)
+					{
+						value = reader.Read(sampleBits);
+					}
+					else
+					{
+						value = (quotient << k) | (k > 0 ? reader.Read(k) : 0);
+					}
+				}
+
+				Uint32 delta = (value >> 1) ^ (0u - (value & 1));
+				voxels[i] = (T)(((PredictAt(voxels, x, y, z, size, bias) + delta) & mask) ^ bias);
+
+				if (++x == size)
+				{
+					x = 0;
+					if (++y == size)
+					{
+						y = 0;
+						z++;
+					}
+				}
+			}
+
+			if (reader.Overrun())
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	Uint32 SignBias(SurfaceFormat format)
+	{
+		switch (format)
+		{
+		case SurfaceFormat::R8_Sint:	return 0x80;
+		case SurfaceFormat::R16_Sint:	return 0x8000;
+		default:						return 0;
+		}
+	}
+}
+
+namespace BrickCodec
+{
+	void Encode(const Byte* voxels, Uint32 size, SurfaceFormat format, std::vector<Byte>& out)
+	{
+		Uint32 bpv = BytesPerBlock(format);
+		Uint64 rawBytes = (Uint64)size * size * size * bpv;
+		size_t start = out.size();
+
+		out.push_back(MethodRice);
+		if (bpv == 2)
+		{
+			EncodeRice((const Uint16*)voxels, size, SignBias(format), out);
+		}
+		else
+		{
+			EncodeRice((const Uint8*)voxels, size, SignBias(format), out);
+		}
+
+		// Noise doesn't compress, store it as is rather than grow it.
+		if (out.size() - start > rawBytes + 1)
+		{
+			out.resize(start);
+			out.push_back(MethodRaw);
+			out.insert(out.end(), voxels, voxels + rawBytes);
+		}
+	}
+
+	bool Decode(const Byte* data, Uint64 byteCount, Uint32 size, SurfaceFormat format, Byte* voxels)
+	{
+		if (byteCount == 0)
+		{
+			return false;
+		}
+
+		Uint32 bpv = BytesPerBlock(format);
+		Uint64 rawBytes = (Uint64)size * size * size * bpv;
+
+		if (data[0] == MethodRaw)
+		{
+			if (byteCount - 1 < rawBytes) { return false; }
+			memcpy(voxels, data + 1, (size_t)rawBytes);
+			return true;
+		}
+
+		if (data[0] != MethodRice)
+		{
+			return false;
+		}
+
+		if (bpv == 2)
+		{
+			return DecodeRice(data + 1, byteCount - 1, size, SignBias(format), (Uint16*)voxels);
+		}
+
+		return DecodeRice(data + 1, byteCount - 1, size, SignBias(format), (Uint8*)voxels);
+	}
+}
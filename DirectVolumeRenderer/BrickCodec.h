@@ -0,0 +1,22 @@
+//Note:
+/*
+	Lossless codec for a single brick of 8 or 16 bit voxels. Each voxel is predicted
+	from its neighbours in the slice (LOCO-I median predictor), the residuals are
+	zigzagged and Rice coded in blocks of 64 with a per block parameter, so air and
+	smooth tissue shrink to a few bits per voxel. Bricks decode independently.
+*/
+
+#pragma once
+#include "Graphics/Graphics.h"
+#include "System/Types.h"
+#include <vector>
+
+enum class BrickCompression { None = 0, Rice = 1 };
+
+namespace BrickCodec
+{
+	// Appends the encoded brick (size^3 voxels) to out, falls back to a raw copy if coding doesn't pay off.
+	void Encode(const Byte* voxels, Uint32 size, SurfaceFormat format, std::vector<Byte>& out);
+	// Decodes size^3 voxels into voxels, false if the data is corrupt.
+	bool Decode(const Byte* data, Uint64 byteCount, Uint32 size, SurfaceFormat format, Byte* voxels);
+}
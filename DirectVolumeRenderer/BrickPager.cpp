@@ -0,0 +1,243 @@
+#include "BrickPager.h"
+#include "System/Logger.h"
+#include <algorithm>
+
+BrickPager::BrickPager()
+{
+	ResetStats();
+}
+
+BrickPager::~BrickPager()
+{
+	Release();
+}
+
+void BrickPager::Initialize(const VolumeBricks* bricks, Uint64 budgetBytes, Uint32 prefetchThreads)
+{
+	Release();
+
+	m_Bricks = bricks;
+	m_Budget = budgetBytes;
+	m_Prefetcher.Initialize(prefetchThreads > 0 ? prefetchThreads : 1);
+	ResetStats();
+}
+
+void BrickPager::Release()
+{
+	// Let queued prefetches finish before the cache goes away.
+	m_Prefetcher.Shutdown();
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	m_Cache.clear();
+	m_Lru.clear();
+	m_ResidentBytes = 0;
+	m_Bricks = nullptr;
+}
+
+bool BrickPager::IsValid() const
+{
+	return m_Bricks && m_Bricks->IsValid();
+}
+
+BrickRef BrickPager::Acquire(Uint32 index)
+{
+	if (IsValid() == false || index >= m_Bricks->GetBrickCount())
+	{
+		return nullptr;
+	}
+
+	return Load(index, false);
+}
+
+void BrickPager::Prefetch(Uint32 index)
+{
+	if (IsValid() == false || index >= m_Bricks->GetBrickCount())
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		if (m_Cache.find(index) != m_Cache.end())
+		{
+			return;
+		}
+	}
+
+	m_Prefetcher.Submit([this, index]() { Load(index, true); });
+}
+
+void BrickPager::ForEachBrick(const std::function<void(const BrickData&)>& job)
+{
+	if (IsValid() == false)
+	{
+		return;
+	}
+
+	ThreadPool& pool = ThreadPool::Instance();
+	Uint32 count = m_Bricks->GetBrickCount();
+	Uint32 lookAhead = pool.GetThreadCount() + 1;
+
+	// Grain of one brick so chunks are claimed in order and the prefetch stays ahead.
+	pool.ParallelFor(count, [&](Uint64 begin, Uint64 end)
+	{
+		for (Uint64 i = begin; i < end; i++)
+		{
+			if (i + lookAhead < count)
+			{
+				Prefetch((Uint32)(i + lookAhead));
+			}
+
+			BrickRef brick = Acquire((Uint32)i);
+			if (brick)
+			{
+				job(*brick);
+			}
+		}
+	}, 1);
+}
+
+void BrickPager::SetBudget(Uint64 budgetBytes)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	m_Budget = budgetBytes;
+	EvictFor(0);
+}
+
+Uint64 BrickPager::GetBudget() const
+{
+	return m_Budget;
+}
+
+const VolumeBricks* BrickPager::GetBricks() const
+{
+	return m_Bricks;
+}
+
+BrickPagerStats BrickPager::GetStats() const
+{
+	BrickPagerStats stats;
+	stats.Hits = m_Hits;
+	stats.Misses = m_Misses;
+	stats.Evictions = m_Evictions;
+	stats.Prefetches = m_Prefetches;
+	stats.Overcommits = m_Overcommits;
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	stats.ResidentBytes = m_ResidentBytes;
+	stats.PeakBytes = m_PeakBytes;
+	stats.BudgetBytes = m_Budget;
+	stats.ResidentBricks = (Uint32)m_Cache.size();
+	return stats;
+}
+
+void BrickPager::ResetStats()
+{
+	m_Hits = 0;
+	m_Misses = 0;
+	m_Evictions = 0;
+	m_Prefetches = 0;
+	m_Overcommits = 0;
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	m_PeakBytes = m_ResidentBytes;
+}
+
+std::shared_ptr<BrickData> BrickPager::Load(Uint32 index, bool prefetch)
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+
+	std::unordered_map<Uint32, CacheEntry>::iterator it = m_Cache.find(index);
+	if (it != m_Cache.end())
+	{
+		if (prefetch)
+		{
+			return it->second.Data;
+		}
+
+		// Another thread may still be reading it in.
+		m_LoadSignal.wait(lock, [this, index]()
+		{
+			std::unordered_map<Uint32, CacheEntry>::iterator found = m_Cache.find(index);
+			return found == m_Cache.end() || found->second.Loading == false;
+		});
+
+		it = m_Cache.find(index);
+		if (it != m_Cache.end())
+		{
+			m_Hits++;
+			m_Lru.splice(m_Lru.begin(), m_Lru, it->second.LruPosition);
+			return it->second.Data;
+		}
+	}
+
+	if (prefetch)
+	{
+		m_Prefetches++;
+	}
+	else
+	{
+		m_Misses++;
+	}
+
+	Uint64 byteCount = m_Bricks->GetPaddedBrickByteCount();
+	EvictFor(byteCount);
+
+	// Reserve the slot now, the entry is skipped by eviction until the read is done.
+	std::shared_ptr<BrickData> data = std::make_shared<BrickData>();
+	data->Index = index;
+	m_Lru.push_front(index);
+	CacheEntry& entry = m_Cache[index];
+	entry.Data = data;
+	entry.LruPosition = m_Lru.begin();
+	entry.Loading = true;
+	m_ResidentBytes += byteCount;
+	m_PeakBytes = std::max(m_PeakBytes, m_ResidentBytes);
+	lock.unlock();
+
+	data->Voxels.resize((size_t)byteCount);
+	bool loaded = m_Bricks->ReadBrick(index, &data->Voxels[0]);
+
+	lock.lock();
+	it = m_Cache.find(index);
+	it->second.Loading = false;
+	if (loaded == false)
+	{
+		LogError("Failed to page in brick " + std::to_string(index));
+		m_Lru.erase(it->second.LruPosition);
+		m_Cache.erase(it);
+		m_ResidentBytes -= byteCount;
+		data.reset();
+	}
+	m_LoadSignal.notify_all();
+
+	return data;
+}
+
+void BrickPager::EvictFor(Uint64 byteCount)
+{
+	Uint64 brickBytes = m_Bricks ? m_Bricks->GetPaddedBrickByteCount() : 0;
+
+	std::list<Uint32>::iterator it = m_Lru.end();
+	while (m_ResidentBytes + byteCount > m_Budget && it != m_Lru.begin())
+	{
+		--it;
+		CacheEntry& entry = m_Cache[*it];
+
+		// Only the cache holds an unpinned brick.
+		if (entry.Loading || entry.Data.use_count() > 1)
+		{
+			continue;
+		}
+
+		m_Cache.erase(*it);
+		it = m_Lru.erase(it);
+		m_ResidentBytes -= brickBytes;
+		m_Evictions++;
+	}
+
+	if (byteCount > 0 && m_ResidentBytes + byteCount > m_Budget)
+	{
+		m_Overcommits++;
+	}
+}
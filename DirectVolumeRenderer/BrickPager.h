@@ -0,0 +1,95 @@
+//Note:
+/*
+	Serves bricks from a VolumeBricks file through a fixed size cache, so passes over
+	the volume only need the bricks they are touching in memory. Least recently used
+	bricks are evicted once the budget is hit, a brick is pinned while any caller holds
+	its BrickRef. The budget is only overshot if every resident brick is pinned.
+*/
+
+#pragma once
+#include "VolumeBricks.h"
+#include "System/ThreadPool.h"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+struct BrickData
+{
+	Uint32			  Index = 0;
+	std::vector<Byte> Voxels; // Padded brick, see VolumeBricks::GetPaddedBrickSize
+};
+
+typedef std::shared_ptr<const BrickData> BrickRef;
+
+struct BrickPagerStats
+{
+	Uint64 Hits = 0;
+	Uint64 Misses = 0;
+	Uint64 Evictions = 0;
+	Uint64 Prefetches = 0;
+	Uint64 Overcommits = 0; // Loads that went over budget because everything was pinned
+	Uint64 ResidentBytes = 0;
+	Uint64 PeakBytes = 0;		// Most resident at once since the counters were reset
+	Uint64 BudgetBytes = 0;
+	Uint32 ResidentBricks = 0;
+};
+
+class BrickPager
+{
+private:
+	struct CacheEntry
+	{
+		std::shared_ptr<BrickData> Data;
+		std::list<Uint32>::iterator LruPosition;
+		bool Loading = true;
+	};
+
+	const VolumeBricks*					   m_Bricks = nullptr;
+	Uint64								   m_Budget = 0;
+	Uint64								   m_ResidentBytes = 0;
+	Uint64								   m_PeakBytes = 0;
+	std::unordered_map<Uint32, CacheEntry> m_Cache;
+	std::list<Uint32>					   m_Lru; // Front is most recently used
+	mutable std::mutex					   m_Mutex;
+	std::condition_variable				   m_LoadSignal;
+	ThreadPool							   m_Prefetcher;
+
+	std::atomic<Uint64> m_Hits;
+	std::atomic<Uint64> m_Misses;
+	std::atomic<Uint64> m_Evictions;
+	std::atomic<Uint64> m_Prefetches;
+	std::atomic<Uint64> m_Overcommits;
+
+public:
+	BrickPager();
+	~BrickPager();
+
+public:
+	void Initialize(const VolumeBricks* bricks, Uint64 budgetBytes, Uint32 prefetchThreads = 2);
+	void Release();
+	bool IsValid()const;
+
+	// Blocks until the brick is resident, it stays pinned until the returned ref is dropped.
+	BrickRef Acquire(Uint32 index);
+	// Queues the brick on the prefetch threads and returns straight away.
+	void	 Prefetch(Uint32 index);
+	// Visits every brick on the shared thread pool, prefetching ahead of the workers.
+	void	 ForEachBrick(const std::function<void(const BrickData&)>& job);
+
+	void			SetBudget(Uint64 budgetBytes);
+	Uint64			GetBudget()const;
+	const VolumeBricks* GetBricks()const;
+	BrickPagerStats GetStats()const;
+	void			ResetStats();
+
+private:
+	// Returns the cached or freshly loaded brick, prefetch loads don't count as misses.
+	std::shared_ptr<BrickData> Load(Uint32 index, bool prefetch);
+	// Caller holds m_Mutex.
+	void EvictFor(Uint64 byteCount);
+};
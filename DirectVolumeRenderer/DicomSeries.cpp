@@ -0,0 +1,568 @@
+#include "DicomSeries.h"
+#include "System/File.h"
+#include "System/Logger.h"
+#include "System/MappedFile.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <type_traits>
+
+namespace
+{
+	const Uint32 UndefinedLength = 0xFFFFFFFF;
+	const Uint32 MaxSequenceDepth = 16;
+
+	const Uint32 TagTransferSyntax		 = 0x00020010;
+	const Uint32 TagSliceThickness		 = 0x00180050;
+	const Uint32 TagSeriesUID			 = 0x0020000E;
+	const Uint32 TagInstanceNumber		 = 0x00200013;
+	const Uint32 TagImagePosition		 = 0x00200032;
+	const Uint32 TagImageOrientation	 = 0x00200037;
+	const Uint32 TagSamplesPerPixel		 = 0x00280002;
+	const Uint32 TagRows				 = 0x00280010;
+	const Uint32 TagColumns				 = 0x00280011;
+	const Uint32 TagPixelSpacing		 = 0x00280030;
+	const Uint32 TagBitsAllocated		 = 0x00280100;
+	const Uint32 TagBitsStored			 = 0x00280101;
+	const Uint32 TagPixelRepresentation	 = 0x00280103;
+	const Uint32 TagRescaleIntercept	 = 0x00281052;
+	const Uint32 TagRescaleSlope		 = 0x00281053;
+	const Uint32 TagPixelData			 = 0x7FE00010;
+	const Uint32 TagItem				 = 0xFFFEE000;
+	const Uint32 TagItemEnd				 = 0xFFFEE00D;
+	const Uint32 TagSequenceEnd			 = 0xFFFEE0DD;
+
+	const char* ImplicitLittleEndian = "1.2.840.10008.1.2";
+	const char* ExplicitLittleEndian = "1.2.840.10008.1.2.1";
+
+	struct DicomElement
+	{
+		Uint32 Tag = 0;
+		Uint32 Length = 0;
+		Uint64 Offset = 0; // Start of the value
+	};
+
+	// Explicit VRs with a 4 byte length after two reserved bytes.
+	bool IsLongVR(char a, char b)
+	{
+		static const char* longVRs[] = { "OB", "OD", "OF", "OL", "OV", "OW", "SQ", "SV", "UC", "UN", "UR", "UT", "UV" };
+		for (const char* vr : longVRs)
+		{
+			if (vr[0] == a && vr[1] == b) { return true; }
+		}
+		return false;
+	}
+
+	// Walks little endian data elements over a mapped file.
+	struct DicomReader
+	{
+		const Byte* data = nullptr;
+		Uint64 size = 0;
+		Uint64 position = 0;
+		bool explicitVR = true;
+
+		Uint16 ReadU16(Uint64 at)const { return (Uint16)(data[at] | (data[at + 1] << 8)); }
+		Uint32 ReadU32(Uint64 at)const { return (Uint32)ReadU16(at) | ((Uint32)ReadU16(at + 2) << 16); }
+		Uint16 PeekGroup()const { return position + 2 <= size ? ReadU16(position) : 0; }
+
+		bool Next(DicomElement& element)
+		{
+			if (position + 8 > size) { return false; }
+
+			Uint16 group = ReadU16(position);
+			element.Tag = ((Uint32)group << 16) | ReadU16(position + 2);
+
+			// The meta group is always explicit, items and delimiters never carry a VR.
+			if ((explicitVR || group == 0x0002) && group != 0xFFFE)
+			{
+				if (IsLongVR((char)data[position + 4], (char)data[position + 5]))
+				{
+					if (position + 12 > size) { return false; }
+					element.Length = ReadU32(position + 8);
+					position += 12;
+				}
+				else
+				{
+					element.Length = ReadU16(position + 6);
+					position += 8;
+				}
+			}
+			else
+			{
+				element.Length = ReadU32(position + 4);
+				position += 8;
+			}
+
+			element.Offset = position;
+			return element.Length == UndefinedLength || element.Offset + element.Length <= size;
+		}
+
+		// Steps over a value, undefined length sequences are walked item by item to their delimiter.
+		bool Skip(const DicomElement& element, Uint32 depth = 0)
+		{
+			if (element.Length != UndefinedLength)
+			{
+				position = element.Offset + element.Length;
+				return true;
+			}
+
+			if (depth > MaxSequenceDepth) { return false; }
+
+			DicomElement item;
+			while (Next(item))
+			{
+				if (item.Tag == TagSequenceEnd) { return true; }
+				if (item.Tag != TagItem) { return false; }
+
+				if (item.Length != UndefinedLength)
+				{
+					position = item.Offset + item.Length;
+					continue;
+				}
+
+				DicomElement inner;
+				bool itemEnded = false;
+				while (Next(inner))
+				{
+					if (inner.Tag == TagItemEnd) { itemEnded = true; break; }
+					if (Skip(inner, depth + 1) == false) { return false; }
+				}
+
+				if (itemEnded == false) { return false; }
+			}
+
+			return false;
+		}
+
+		std::string ReadString(const DicomElement& element)const
+		{
+			if (element.Length == UndefinedLength) { return ""; }
+
+			std::string value((const char*)data + element.Offset, (size_t)element.Length);
+			while (value.empty() == false && (value.back() == ' ' || value.back() == '\0'))
+			{
+				value.pop_back();
+			}
+			return value;
+		}
+
+		Uint32 ReadShort(const DicomElement& element)const
+		{
+			return element.Length >= 2 && element.Length != UndefinedLength ? ReadU16(element.Offset) : 0;
+		}
+	};
+
+	// Decimal/integer strings hold backslash separated values, returns how many were read.
+	Uint32 ParseNumbers(const std::string& text, double* values, Uint32 count)
+	{
+		const char* cursor = text.c_str();
+		Uint32 parsed = 0;
+		while (parsed < count && *cursor != '\0')
+		{
+			char* end = nullptr;
+			double value = strtod(cursor, &end);
+			if (end == cursor) { break; }
+
+			values[parsed++] = value;
+			cursor = end;
+			while (*cursor == ' ') { cursor++; }
+			if (*cursor != '\\') { break; }
+			cursor++;
+		}
+		return parsed;
+	}
+
+	struct DicomHeader
+	{
+		DicomSlice	Slice;
+		std::string	SeriesUID;
+		bool		HasPosition = false;
+		double		Orientation[6] = { 1, 0, 0, 0, 1, 0 };
+		double		PixelSpacing[2] = { 1, 1 };	// Row spacing (y), column spacing (x)
+		double		SliceThickness = 0;
+		Uint32		Rows = 0;
+		Uint32		Columns = 0;
+		Uint32		SamplesPerPixel = 1;
+		Uint32		BitsAllocated = 0;
+		Uint32		BitsStored = 0;
+		Uint32		PixelRepresentation = 0;
+	};
+
+	bool ReadHeader(const std::string& filePath, DicomHeader& header)
+	{
+		MappedFile file;
+		if (file.Open(filePath.c_str(), MappedAccess::Random) == false)
+		{
+			return false;
+		}
+
+		DicomReader reader;
+		reader.data = file.GetData();
+		reader.size = file.GetSize();
+
+		if (reader.size >= 132 && memcmp(reader.data + 128, "DICM", 4) == 0)
+		{
+			reader.position = 132;
+
+			std::string syntax = ImplicitLittleEndian;
+			DicomElement element;
+			while (reader.PeekGroup() == 0x0002 && reader.Next(element))
+			{
+				if (element.Tag == TagTransferSyntax)
+				{
+					syntax = reader.ReadString(element);
+				}
+				if (reader.Skip(element) == false) { return false; }
+			}
+
+			if (syntax == ExplicitLittleEndian)
+			{
+				reader.explicitVR = true;
+			}
+			else if (syntax == ImplicitLittleEndian)
+			{
+				reader.explicitVR = false;
+			}
+			else
+			{
+				LogWarning("Unsupported DICOM transfer syntax " + syntax + ": " + filePath);
+				return false;
+			}
+		}
+		else
+		{
+			// No preamble, old style bare dataset which is implicit VR. It should open on an identifying group element.
+			reader.explicitVR = false;
+			if (reader.size < 8 || reader.ReadU16(0) != 0x0008)
+			{
+				return false;
+			}
+		}
+
+		DicomElement element;
+		while (reader.Next(element))
+		{
+			switch (element.Tag)
+			{
+			case TagSeriesUID:			header.SeriesUID = reader.ReadString(element); break;
+			case TagInstanceNumber:		header.Slice.InstanceNumber = atoi(reader.ReadString(element).c_str()); break;
+			case TagImagePosition:		header.HasPosition = ParseNumbers(reader.ReadString(element), header.Slice.Position, 3) == 3; break;
+			case TagImageOrientation:	ParseNumbers(reader.ReadString(element), header.Orientation, 6); break;
+			case TagPixelSpacing:		ParseNumbers(reader.ReadString(element), header.PixelSpacing, 2); break;
+			case TagSliceThickness:		ParseNumbers(reader.ReadString(element), &header.SliceThickness, 1); break;
+			case TagSamplesPerPixel:	header.SamplesPerPixel = reader.ReadShort(element); break;
+			case TagRows:				header.Rows = reader.ReadShort(element); break;
+			case TagColumns:			header.Columns = reader.ReadShort(element); break;
+			case TagBitsAllocated:		header.BitsAllocated = reader.ReadShort(element); break;
+			case TagBitsStored:			header.BitsStored = reader.ReadShort(element); break;
+			case TagPixelRepresentation:header.PixelRepresentation = reader.ReadShort(element); break;
+			case TagRescaleIntercept:
+			{
+				double value = 0;
+				ParseNumbers(reader.ReadString(element), &value, 1);
+				header.Slice.RescaleIntercept = (float)value;
+				break;
+			}
+			case TagRescaleSlope:
+			{
+				double value = 1;
+				ParseNumbers(reader.ReadString(element), &value, 1);
+				header.Slice.RescaleSlope = (float)value;
+				break;
+			}
+			case TagPixelData:
+				if (element.Length == UndefinedLength)
+				{
+					LogWarning("Compressed (encapsulated) DICOM pixel data isn't supported: " + filePath);
+					return false;
+				}
+
+				header.Slice.FilePath = filePath;
+				header.Slice.PixelOffset = element.Offset;
+				header.Slice.PixelBytes = element.Length;
+				if (header.BitsStored == 0) { header.BitsStored = header.BitsAllocated; }
+				return header.Rows > 0 && header.Columns > 0;
+			default:
+				break;
+			}
+
+			if (reader.Skip(element) == false) { return false; }
+		}
+
+		return false;
+	}
+
+	// Clears bits above BitsStored (old overlay planes), signed data is sign extended then offset to unsigned.
+	template<typename T>
+	void FixStoredBits(T* voxels, Uint64 count, Uint32 bitsStored, bool isSigned)
+	{
+		typedef typename std::conditional<sizeof(T) == 2, Int16, Int8>::type Signed;
+		const Uint32 shift = sizeof(T) * 8 - bitsStored;
+		const T bias = (T)(1u << (sizeof(T) * 8 - 1));
+
+		if (isSigned)
+		{
+			for (Uint64 i = 0; i < count; i++)
+			{
+				voxels[i] = (T)((T)((Signed)(voxels[i] << shift) >> shift) ^ bias);
+			}
+		}
+		else if (shift > 0)
+		{
+			for (Uint64 i = 0; i < count; i++)
+			{
+				voxels[i] = (T)(voxels[i] & ((1u << bitsStored) - 1));
+			}
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------------
+
+bool DicomSeries::Open(const std::string& filePath)
+{
+	Release();
+
+	DicomHeader first;
+	if (ReadHeader(filePath, first) == false)
+	{
+		LogError("Not a supported DICOM image: " + filePath);
+		return false;
+	}
+
+	Uint32 bpv = first.BitsAllocated / 8;
+	if (first.SamplesPerPixel != 1 || (first.BitsAllocated != 8 && first.BitsAllocated != 16) || first.BitsStored > first.BitsAllocated)
+	{
+		LogError("Only single channel 8 or 16 bit DICOM is supported: " + filePath);
+		return false;
+	}
+
+	// Headers across the whole folder in parallel, most of the cost is opening files.
+	std::string directory = filePath.substr(0, filePath.find_last_of("/\\") + 1);
+	std::vector<std::string> files = File::GetFiles(directory.empty() ? "." : directory);
+	std::vector<DicomHeader> headers(files.size());
+	std::vector<Byte> valid(files.size(), 0);
+
+	ThreadPool::Instance().ParallelFor(files.size(), [&](Uint64 begin, Uint64 end)
+	{
+		for (Uint64 i = begin; i < end; i++)
+		{
+			valid[(size_t)i] = ReadHeader(files[(size_t)i], headers[(size_t)i]) ? 1 : 0;
+		}
+	}, 1);
+
+	Uint64 sliceBytes = (Uint64)first.Rows * first.Columns * bpv;
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		const DicomHeader& header = headers[i];
+		if (valid[i] == 0 || header.SeriesUID != first.SeriesUID)
+		{
+			continue;
+		}
+
+		if (header.Rows != first.Rows || header.Columns != first.Columns || header.BitsAllocated != first.BitsAllocated ||
+			header.PixelRepresentation != first.PixelRepresentation || header.Slice.PixelBytes < sliceBytes)
+		{
+			LogWarning("Skipping DICOM slice that doesn't match its series: " + header.Slice.FilePath);
+			continue;
+		}
+
+		m_Slices.push_back(header.Slice);
+		m_LastWriteTime = std::max(m_LastWriteTime, BaseFile::LastWriteTime(header.Slice.FilePath));
+	}
+
+	if (m_Slices.empty())
+	{
+		LogError("No slices found for DICOM series: " + first.SeriesUID);
+		return false;
+	}
+
+	// Order along the slice normal (row x column direction), instance number when positions are missing.
+	const double* o = first.Orientation;
+	double normal[3] = { o[1] * o[5] - o[2] * o[4], o[2] * o[3] - o[0] * o[5], o[0] * o[4] - o[1] * o[3] };
+	for (DicomSlice& slice : m_Slices)
+	{
+		slice.SortKey = first.HasPosition ? slice.Position[0] * normal[0] + slice.Position[1] * normal[1] + slice.Position[2] * normal[2] : slice.InstanceNumber;
+	}
+
+	std::sort(m_Slices.begin(), m_Slices.end(), [](const DicomSlice& a, const DicomSlice& b)
+	{
+		return a.SortKey != b.SortKey ? a.SortKey < b.SortKey : a.InstanceNumber < b.InstanceNumber;
+	});
+
+	m_SeriesUID = first.SeriesUID;
+	m_Width = first.Columns;
+	m_Height = first.Rows;
+	m_BitsStored = first.BitsStored;
+	m_Format = bpv == 2 ? SurfaceFormat::R16_Uint : SurfaceFormat::R8_Uint;
+	m_Signed = first.PixelRepresentation != 0;
+
+	// Slice spacing from the positions, SliceThickness can overlap or leave gaps.
+	double sliceSpacing = first.SliceThickness > 0 ? first.SliceThickness : 1.0;
+	if (first.HasPosition && m_Slices.size() > 1)
+	{
+		double extent = m_Slices.back().SortKey - m_Slices.front().SortKey;
+		if (extent > 0)
+		{
+			sliceSpacing = extent / (m_Slices.size() - 1);
+		}
+
+		for (size_t i = 1; i < m_Slices.size(); i++)
+		{
+			double gap = m_Slices[i].SortKey - m_Slices[i - 1].SortKey;
+			if (std::fabs(gap - sliceSpacing) > sliceSpacing * 0.01)
+			{
+				LogWarning("DICOM series has uneven or duplicate slice positions, using the mean spacing: " + m_SeriesUID);
+				break;
+			}
+		}
+	}
+
+	m_Spacing = Vector3((float)first.PixelSpacing[1], (float)first.PixelSpacing[0], (float)sliceSpacing);
+
+	m_RescaleSlope = m_Slices.front().RescaleSlope;
+	m_RescaleIntercept = m_Slices.front().RescaleIntercept;
+	for (const DicomSlice& slice : m_Slices)
+	{
+		if (slice.RescaleSlope != m_RescaleSlope || slice.RescaleIntercept != m_RescaleIntercept)
+		{
+			LogWarning("DICOM rescale varies per slice, using the first slice's: " + m_SeriesUID);
+			break;
+		}
+	}
+
+	// Signed data is stored offset to unsigned, fold the offset into the intercept.
+	if (m_Signed)
+	{
+		m_RescaleIntercept -= m_RescaleSlope * (bpv == 2 ? 32768.0f : 128.0f);
+	}
+
+	return true;
+}
+
+void DicomSeries::Release()
+{
+	m_SeriesUID.clear();
+	m_Slices.clear();
+	m_Width = m_Height = m_BitsStored = 0;
+	m_Format = SurfaceFormat::Unkown;
+	m_Signed = false;
+	m_Spacing = Vector3(1, 1, 1);
+	m_RescaleSlope = 1.0f;
+	m_RescaleIntercept = 0.0f;
+	m_LastWriteTime = 0;
+}
+
+bool DicomSeries::IsValid() const
+{
+	return m_Slices.empty() == false;
+}
+
+bool DicomSeries::ReadVolume(Byte* volume, const ProgressCallback& progress) const
+{
+	return ReadSlices(volume, 0, (Uint32)m_Slices.size(), progress);
+}
+
+bool DicomSeries::ReadSlices(Byte* data, Uint32 first, Uint32 count, const ProgressCallback& progress) const
+{
+	if (IsValid() == false || first > m_Slices.size() || count > m_Slices.size() - first)
+	{
+		return false;
+	}
+
+	Uint32 bpv = BytesPerBlock(m_Format);
+	Uint64 sliceVoxels = (Uint64)m_Width * m_Height;
+	Uint64 sliceBytes = sliceVoxels * bpv;
+	std::atomic<bool> failed(false);
+	std::atomic<bool> cancelled(false);
+	std::atomic<Uint32> done(0);
+
+	// Each slice lands in its own part of the volume, so they copy in parallel with no staging.
+	ThreadPool::Instance().ParallelFor(count, [&](Uint64 begin, Uint64 end)
+	{
+		for (Uint64 i = begin; i < end && cancelled == false; i++)
+		{
+			const DicomSlice& slice = m_Slices[(size_t)(first + i)];
+			MappedFile file;
+			if (file.Open(slice.FilePath.c_str(), MappedAccess::Sequential) == false || slice.PixelOffset + sliceBytes > file.GetSize())
+			{
+				LogError("Failed to read DICOM slice: " + slice.FilePath);
+				failed = true;
+				continue;
+			}
+
+			Byte* dst = data + i * sliceBytes;
+			memcpy(dst, file.GetData() + slice.PixelOffset, (size_t)sliceBytes);
+
+			if (bpv == 2)
+			{
+				FixStoredBits((Uint16*)dst, sliceVoxels, m_BitsStored, m_Signed);
+			}
+			else
+			{
+				FixStoredBits((Uint8*)dst, sliceVoxels, m_BitsStored, m_Signed);
+			}
+
+			if (progress && progress((float)++done / count) == false)
+			{
+				cancelled = true;
+			}
+		}
+	}, 1);
+
+	return failed == false && cancelled == false;
+}
+
+//-----------------------------------------------------------------------------------
+
+Uint32 DicomSeries::GetWidth() const
+{
+	return m_Width;
+}
+
+Uint32 DicomSeries::GetHeight() const
+{
+	return m_Height;
+}
+
+Uint32 DicomSeries::GetDepth() const
+{
+	return (Uint32)m_Slices.size();
+}
+
+SurfaceFormat DicomSeries::GetFormat() const
+{
+	return m_Format;
+}
+
+Vector3 DicomSeries::GetSpacing() const
+{
+	return m_Spacing;
+}
+
+float DicomSeries::GetRescaleSlope() const
+{
+	return m_RescaleSlope;
+}
+
+float DicomSeries::GetRescaleIntercept() const
+{
+	return m_RescaleIntercept;
+}
+
+const std::string& DicomSeries::GetSeriesUID() const
+{
+	return m_SeriesUID;
+}
+
+Uint64 DicomSeries::GetLastWriteTime() const
+{
+	return m_LastWriteTime;
+}
+
+const DicomSlice& DicomSeries::GetSlice(Uint32 index) const
+{
+	return m_Slices[index];
+}
@@ -0,0 +1,70 @@
+//Note:
+/*
+	Reads a DICOM series straight into a volume. Every file in the folder of the one
+	picked is checked and those with the same SeriesInstanceUID become slices, sorted
+	along the slice normal by ImagePositionPatient. Only uncompressed little endian
+	transfer syntaxes (implicit and explicit VR) are handled, single channel 8/16 bit.
+	Headers are parsed up front, pixel data is copied out of the mapped files later.
+	Signed data is offset to unsigned, as the volume shaders read uint, and the
+	rescale intercept absorbs the offset so modality values come out unchanged.
+*/
+
+#pragma once
+#include "Graphics/Graphics.h"
+#include "Math/Vector3.h"
+#include "System/ThreadPool.h"
+#include <string>
+#include <vector>
+
+struct DicomSlice
+{
+	std::string FilePath;
+	double		Position[3] = { 0, 0, 0 };	// ImagePositionPatient, mm
+	double		SortKey = 0;				// Distance along the slice normal
+	int			InstanceNumber = 0;
+	Uint64		PixelOffset = 0;			// File offset of the PixelData value
+	Uint64		PixelBytes = 0;
+	float		RescaleSlope = 1.0f;
+	float		RescaleIntercept = 0.0f;
+};
+
+class DicomSeries
+{
+private:
+	std::string				m_SeriesUID;
+	std::vector<DicomSlice>	m_Slices;
+	Uint32					m_Width = 0;	// Columns
+	Uint32					m_Height = 0;	// Rows
+	Uint32					m_BitsStored = 0;
+	SurfaceFormat			m_Format = SurfaceFormat::Unkown;
+	bool					m_Signed = false; // Stored signed, offset to unsigned on read
+	Vector3					m_Spacing = Vector3(1, 1, 1);
+	float					m_RescaleSlope = 1.0f;
+	float					m_RescaleIntercept = 0.0f;
+	Uint64					m_LastWriteTime = 0;
+
+public:
+	// Finds and sorts the series filePath belongs to, only headers are read.
+	bool Open(const std::string& filePath);
+	void Release();
+	bool IsValid()const;
+
+	// Decodes every slice into volume (Width * Height * Depth voxels) in parallel.
+	bool ReadVolume(Byte* volume, const ProgressCallback& progress = nullptr)const;
+	// The slices [first, first + count) only, data must hold count * Width * Height voxels.
+	bool ReadSlices(Byte* data, Uint32 first, Uint32 count, const ProgressCallback& progress = nullptr)const;
+
+	Uint32				GetWidth()const;
+	Uint32				GetHeight()const;
+	Uint32				GetDepth()const;
+	SurfaceFormat		GetFormat()const;
+	// Voxel size in mm, z comes from the slice positions rather than SliceThickness.
+	Vector3				GetSpacing()const;
+	// Stored value * slope + intercept gives the modality value, i.e Hounsfield units for CT.
+	float				GetRescaleSlope()const;
+	float				GetRescaleIntercept()const;
+	const std::string&	GetSeriesUID()const;
+	// Newest write time over every slice, for cache invalidation.
+	Uint64				GetLastWriteTime()const;
+	const DicomSlice&	GetSlice(Uint32 index)const;
+};
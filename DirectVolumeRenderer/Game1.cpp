@@ -66,6 +66,7 @@ void Game1::FixedUpdate()
 void Game1::Update(float deltaTime)
 {
 	m_Camera->Update(deltaTime);
+	m_VolumeComponent->Update(deltaTime);
 }
 
 void Game1::Draw()
@@ -0,0 +1,204 @@
+#include "OccupancyTraversal.h"
+#include "Math/Random.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace
+{
+	// The last texel on an axis also covers the cells an odd halving dropped.
+	Uint32 NodeIndex(Int64 cell, Uint32 level, Uint32 size)
+	{
+		return std::min((Uint32)(cell >> level), size - 1);
+	}
+
+	// Walks the ray over a size[0] x size[1] x size[2] grid. visit(cell, lo, hi, occupied) is asked
+	// for the run of cells [lo, hi) the walk can cross in one step from cell, and returns
+	// false when it only changed its own state (a level) and wants to be asked again.
+	template<typename Visit>
+	OccupancyTraversal::TraceResult Walk(const Int64 size[3], const Vector3& origin, const Vector3& direction, Visit visit)
+	{
+		OccupancyTraversal::TraceResult result;
+		const double o[3] = { origin.x, origin.y, origin.z };
+		const double d[3] = { direction.x, direction.y, direction.z };
+
+		// Clip to the grid, slab test in double so the reference isn't the thing in question.
+		double t0 = 0.0, t1 = DBL_MAX;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			if (d[axis] == 0.0)
+			{
+				if (o[axis] < 0.0 || o[axis] >= (double)size[axis]) { return result; }
+				continue;
+			}
+
+			double ta = -o[axis] / d[axis];
+			double tb = ((double)size[axis] - o[axis]) / d[axis];
+			t0 = std::max(t0, std::min(ta, tb));
+			t1 = std::min(t1, std::max(ta, tb));
+		}
+
+		if (t0 >= t1)
+		{
+			return result;
+		}
+
+		Int64 cell[3];
+		for (int axis = 0; axis < 3; axis++)
+		{
+			Int64 c = (Int64)std::floor(o[axis] + d[axis] * t0);
+			cell[axis] = std::min(std::max(c, (Int64)0), size[axis] - 1);
+		}
+
+		double entryT = t0;
+		while (true)
+		{
+			Int64 lo[3], hi[3];
+			bool occupied = false;
+			result.Fetches++;
+			if (visit(cell, lo, hi, occupied) == false)
+			{
+				continue;
+			}
+
+			if (occupied)
+			{
+				Uint64 index = ((Uint64)cell[2] * size[1] + cell[1]) * size[0] + cell[0];
+				result.Occupied++;
+				result.Hash = (result.Hash ^ (index + 1)) * 1099511628211ull;
+			}
+
+			// Leave the run through its nearest face.
+			int exitAxis = -1;
+			double exitT = DBL_MAX;
+			for (int axis = 0; axis < 3; axis++)
+			{
+				if (d[axis] == 0.0) { continue; }
+
+				double face = (double)(d[axis] > 0.0 ? hi[axis] : lo[axis]);
+				double t = (face - o[axis]) / d[axis];
+				if (t < exitT)
+				{
+					exitT = t;
+					exitAxis = axis;
+				}
+			}
+
+			result.Steps++;
+			if (occupied)
+			{
+				result.OccupiedSpan += std::min(exitT, t1) - entryT;
+			}
+			entryT = exitT;
+
+			if (exitAxis < 0)
+			{
+				break;
+			}
+
+			for (int axis = 0; axis < 3; axis++)
+			{
+				if (axis == exitAxis)
+				{
+					cell[axis] = d[axis] > 0.0 ? hi[axis] : lo[axis] - 1;
+				}
+				else
+				{
+					Int64 c = (Int64)std::floor(o[axis] + d[axis] * exitT);
+					cell[axis] = std::min(std::max(c, lo[axis]), hi[axis] - 1);
+				}
+			}
+
+			if (cell[exitAxis] < 0 || cell[exitAxis] >= size[exitAxis])
+			{
+				break;
+			}
+		}
+
+		return result;
+	}
+}
+
+OccupancyTraversal::TraceResult OccupancyTraversal::Trace(const std::vector<TextureLevel>& levels, const Vector3& origin, const Vector3& direction,
+														  Byte threshold, Uint32 maxLevel)
+{
+	if (levels.empty())
+	{
+		return TraceResult();
+	}
+
+	maxLevel = std::min(maxLevel, (Uint32)levels.size() - 1);
+	const Int64 size[3] = { (Int64)levels[0].width, (Int64)levels[0].height, (Int64)levels[0].depth };
+
+	// Rays mostly start in empty space, so start at the top and come down.
+	Uint32 level = maxLevel;
+	return Walk(size, origin, direction, [&](const Int64 cell[3], Int64 lo[3], Int64 hi[3], bool& occupied)
+	{
+		const TextureLevel& node = levels[level];
+		const Uint32 nodeSize[3] = { node.width, node.height, node.depth };
+		Uint32 n[3];
+		for (int axis = 0; axis < 3; axis++)
+		{
+			n[axis] = NodeIndex(cell[axis], level, nodeSize[axis]);
+		}
+
+		occupied = node.ptr[((Uint64)n[2] * node.height + n[1]) * node.width + n[0]] >= threshold;
+		if (occupied && level > 0)
+		{
+			level--;
+			return false;
+		}
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			lo[axis] = (Int64)n[axis] << level;
+			hi[axis] = (n[axis] == nodeSize[axis] - 1) ? size[axis] : ((Int64)n[axis] + 1) << level;
+		}
+
+		// Try a bigger node next, the walk comes back down if it isn't empty.
+		if (level < maxLevel)
+		{
+			level++;
+		}
+		return true;
+	});
+}
+
+OccupancyTraversal::TraceResult OccupancyTraversal::TraceDistance(const TextureLevel& distance, const Vector3& origin, const Vector3& direction)
+{
+	if (distance.ptr == nullptr)
+	{
+		return TraceResult();
+	}
+
+	const Int64 size[3] = { (Int64)distance.width, (Int64)distance.height, (Int64)distance.depth };
+	return Walk(size, origin, direction, [&](const Int64 cell[3], Int64 lo[3], Int64 hi[3], bool& occupied)
+	{
+		// Every cell less than the distance away on all axes is empty, an occupied cell is a run of one.
+		Int64 value = distance.ptr[((Uint64)cell[2] * distance.height + cell[1]) * distance.width + cell[0]];
+		occupied = value == 0;
+		Int64 reach = std::max(value, (Int64)1);
+		for (int axis = 0; axis < 3; axis++)
+		{
+			lo[axis] = std::max(cell[axis] - (reach - 1), (Int64)0);
+			hi[axis] = std::min(cell[axis] + reach, size[axis]);
+		}
+		return true;
+	});
+}
+
+void OccupancyTraversal::MakeRays(const Vector3& size, Uint32 count, Uint32 seed, std::vector<Vector3>& origins, std::vector<Vector3>& directions)
+{
+	Vector3 centre = size * 0.5f;
+	float radius = std::max(size.x, std::max(size.y, size.z)) * 2.0f;
+	Random random(seed);
+
+	origins.resize(count);
+	directions.resize(count);
+	for (Uint32 i = 0; i < count; i++)
+	{
+		origins[i] = centre + random.PointOnSphere(radius);
+		Vector3 target(random.Range(0.0f, size.x), random.Range(0.0f, size.y), random.Range(0.0f, size.z));
+		directions[i] = Vector3::Normalize(target - origins[i]);
+	}
+}
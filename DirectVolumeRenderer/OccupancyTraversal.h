@@ -0,0 +1,39 @@
+//Note:
+/*
+	Reference CPU walks of the occupancy mip chain and distance field, not used for
+	drawing. Trace is the walk PBR_Volume_ESS does over the mip chain on the GPU, the
+	benchmarks count its steps against the plain cell by cell DDA and the distance walk.
+	Rays are in cell units, the grid spans [0, cells) on each axis. A node is empty
+	when its max is below the threshold, an empty node is skipped in one step and the
+	walk goes up a level, an occupied one goes down until it reaches a cell. Every walk
+	must reach the same occupied cells in the same order, which Occupied and Hash check.
+*/
+
+#pragma once
+#include "Content/Texture.h"
+#include "Math/Vector3.h"
+#include <vector>
+
+namespace OccupancyTraversal
+{
+	struct TraceResult
+	{
+		Uint32 Steps = 0;		// Nodes stepped across, empty or not, at any level
+		Uint32 Fetches = 0;		// Occupancy reads including the ones made going down a level
+		Uint32 Occupied = 0;	// Level 0 cells at or above the threshold
+		Uint64 Hash = 0;		// Order dependent hash of the occupied cells
+		double OccupiedSpan = 0;// Ray parameter spent inside occupied cells, voxels for a unit voxel space direction
+	};
+
+	// maxLevel 0 is the plain DDA, otherwise up to that mip (clamped to the chain).
+	TraceResult Trace(const std::vector<TextureLevel>& levels, const Vector3& origin, const Vector3& direction,
+					  Byte threshold, Uint32 maxLevel);
+
+	// Over the distance field from VolumeOccupancy, a cell at distance n skips the empty
+	// cube n - 1 cells each way in one step. Occupied means any opacity, threshold 1 above.
+	TraceResult TraceDistance(const TextureLevel& distance, const Vector3& origin, const Vector3& direction);
+
+	// Unit length rays from a sphere around a box of the given size aimed at points inside it,
+	// the same set for the same seed.
+	void MakeRays(const Vector3& size, Uint32 count, Uint32 seed, std::vector<Vector3>& origins, std::vector<Vector3>& directions);
+}
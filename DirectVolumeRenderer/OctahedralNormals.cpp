@@ -0,0 +1,248 @@
+#include "OctahedralNormals.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define OCTAHEDRAL_SIMD
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#define OCTAHEDRAL_TARGET(isa)
+#else
+#define OCTAHEDRAL_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+namespace
+{
+	// [-1, 1] to a unorm byte, rounded. Both ends stay inside 0 and 255 so there's no clamp.
+	inline Dword ToUnorm(float value)
+	{
+		return (Dword)((value * 0.5f + 0.5f) * 255.0f + 0.5f);
+	}
+
+	inline float FromUnorm(Dword value)
+	{
+		return (float)value * (2.0f / 255.0f) - 1.0f;
+	}
+
+	void EncodeScalar(const float* x, const float* y, const float* z, Uint64 begin, Uint64 end, Word* out)
+	{
+		for (Uint64 i = begin; i < end; i++)
+		{
+			out[i] = OctahedralNormals::EncodeOne(x[i], y[i], z[i]);
+		}
+	}
+
+	void DecodeScalar(const Word* in, Uint64 begin, Uint64 end, float* x, float* y, float* z)
+	{
+		for (Uint64 i = begin; i < end; i++)
+		{
+			OctahedralNormals::DecodeOne(in[i], x[i], y[i], z[i]);
+		}
+	}
+
+#if defined(OCTAHEDRAL_SIMD)
+	// Same steps as EncodeOne, the sign tricks are what copysign and fabs do.
+	OCTAHEDRAL_TARGET("sse4.1") Uint64 EncodeSSE41(const float* x, const float* y, const float* z, Uint64 count, Word* out)
+	{
+		const __m128 sign = _mm_set1_ps(-0.0f);
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 half = _mm_set1_ps(0.5f);
+		const __m128 scale = _mm_set1_ps(255.0f);
+
+		Uint64 i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 nx = _mm_loadu_ps(x + i);
+			__m128 ny = _mm_loadu_ps(y + i);
+			__m128 nz = _mm_loadu_ps(z + i);
+
+			__m128 sum = _mm_add_ps(_mm_add_ps(_mm_andnot_ps(sign, nx), _mm_andnot_ps(sign, ny)), _mm_andnot_ps(sign, nz));
+			__m128 inverse = _mm_and_ps(_mm_div_ps(one, sum), _mm_cmpgt_ps(sum, zero));
+			__m128 u = _mm_mul_ps(nx, inverse);
+			__m128 v = _mm_mul_ps(ny, inverse);
+
+			__m128 fold = _mm_cmplt_ps(nz, zero);
+			__m128 foldU = _mm_or_ps(_mm_sub_ps(one, _mm_andnot_ps(sign, v)), _mm_and_ps(sign, u));
+			__m128 foldV = _mm_or_ps(_mm_sub_ps(one, _mm_andnot_ps(sign, u)), _mm_and_ps(sign, v));
+			u = _mm_blendv_ps(u, foldU, fold);
+			v = _mm_blendv_ps(v, foldV, fold);
+
+			__m128i a = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(u, half), half), scale), half));
+			__m128i b = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(v, half), half), scale), half));
+			__m128i texels = _mm_or_si128(a, _mm_slli_epi32(b, 8));
+			_mm_storel_epi64((__m128i*)(out + i), _mm_packus_epi32(texels, texels));
+		}
+		return i;
+	}
+
+	OCTAHEDRAL_TARGET("sse4.1") Uint64 DecodeSSE41(const Word* in, Uint64 count, float* x, float* y, float* z)
+	{
+		const __m128 sign = _mm_set1_ps(-0.0f);
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 toUnit = _mm_set1_ps(2.0f / 255.0f);
+		const __m128i low = _mm_set1_epi32(255);
+
+		Uint64 i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128i texels = _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i*)(in + i)));
+			__m128 u = _mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(texels, low)), toUnit), one);
+			__m128 v = _mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(texels, 8)), toUnit), one);
+
+			__m128 w = _mm_sub_ps(_mm_sub_ps(one, _mm_andnot_ps(sign, u)), _mm_andnot_ps(sign, v));
+			__m128 t = _mm_max_ps(_mm_sub_ps(zero, w), zero);
+			u = _mm_sub_ps(u, _mm_or_ps(t, _mm_and_ps(sign, u)));
+			v = _mm_sub_ps(v, _mm_or_ps(t, _mm_and_ps(sign, v)));
+
+			__m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(u, u), _mm_mul_ps(v, v)), _mm_mul_ps(w, w)));
+			__m128 inverse = _mm_div_ps(one, length);
+			_mm_storeu_ps(x + i, _mm_mul_ps(u, inverse));
+			_mm_storeu_ps(y + i, _mm_mul_ps(v, inverse));
+			_mm_storeu_ps(z + i, _mm_mul_ps(w, inverse));
+		}
+		return i;
+	}
+
+	// No FMA on purpose, it would round differently to the scalar path.
+	OCTAHEDRAL_TARGET("avx2") Uint64 EncodeAVX2(const float* x, const float* y, const float* z, Uint64 count, Word* out)
+	{
+		const __m256 sign = _mm256_set1_ps(-0.0f);
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 one = _mm256_set1_ps(1.0f);
+		const __m256 half = _mm256_set1_ps(0.5f);
+		const __m256 scale = _mm256_set1_ps(255.0f);
+
+		Uint64 i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256 nx = _mm256_loadu_ps(x + i);
+			__m256 ny = _mm256_loadu_ps(y + i);
+			__m256 nz = _mm256_loadu_ps(z + i);
+
+			__m256 sum = _mm256_add_ps(_mm256_add_ps(_mm256_andnot_ps(sign, nx), _mm256_andnot_ps(sign, ny)), _mm256_andnot_ps(sign, nz));
+			__m256 inverse = _mm256_and_ps(_mm256_div_ps(one, sum), _mm256_cmp_ps(sum, zero, _CMP_GT_OQ));
+			__m256 u = _mm256_mul_ps(nx, inverse);
+			__m256 v = _mm256_mul_ps(ny, inverse);
+
+			__m256 fold = _mm256_cmp_ps(nz, zero, _CMP_LT_OQ);
+			__m256 foldU = _mm256_or_ps(_mm256_sub_ps(one, _mm256_andnot_ps(sign, v)), _mm256_and_ps(sign, u));
+			__m256 foldV = _mm256_or_ps(_mm256_sub_ps(one, _mm256_andnot_ps(sign, u)), _mm256_and_ps(sign, v));
+			u = _mm256_blendv_ps(u, foldU, fold);
+			v = _mm256_blendv_ps(v, foldV, fold);
+
+			__m256i a = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(u, half), half), scale), half));
+			__m256i b = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(v, half), half), scale), half));
+			__m256i texels = _mm256_or_si256(a, _mm256_slli_epi32(b, 8));
+			_mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi32(_mm256_castsi256_si128(texels), _mm256_extracti128_si256(texels, 1)));
+		}
+		return i;
+	}
+
+	OCTAHEDRAL_TARGET("avx2") Uint64 DecodeAVX2(const Word* in, Uint64 count, float* x, float* y, float* z)
+	{
+		const __m256 sign = _mm256_set1_ps(-0.0f);
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 one = _mm256_set1_ps(1.0f);
+		const __m256 toUnit = _mm256_set1_ps(2.0f / 255.0f);
+		const __m256i low = _mm256_set1_epi32(255);
+
+		Uint64 i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256i texels = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(in + i)));
+			__m256 u = _mm256_sub_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(texels, low)), toUnit), one);
+			__m256 v = _mm256_sub_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(texels, 8)), toUnit), one);
+
+			__m256 w = _mm256_sub_ps(_mm256_sub_ps(one, _mm256_andnot_ps(sign, u)), _mm256_andnot_ps(sign, v));
+			__m256 t = _mm256_max_ps(_mm256_sub_ps(zero, w), zero);
+			u = _mm256_sub_ps(u, _mm256_or_ps(t, _mm256_and_ps(sign, u)));
+			v = _mm256_sub_ps(v, _mm256_or_ps(t, _mm256_and_ps(sign, v)));
+
+			__m256 length = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(u, u), _mm256_mul_ps(v, v)), _mm256_mul_ps(w, w)));
+			__m256 inverse = _mm256_div_ps(one, length);
+			_mm256_storeu_ps(x + i, _mm256_mul_ps(u, inverse));
+			_mm256_storeu_ps(y + i, _mm256_mul_ps(v, inverse));
+			_mm256_storeu_ps(z + i, _mm256_mul_ps(w, inverse));
+		}
+		return i;
+	}
+#endif
+}
+
+//-----------------------------------------------------------------------------------
+
+Word OctahedralNormals::EncodeOne(float x, float y, float z)
+{
+	float sum = (std::fabs(x) + std::fabs(y)) + std::fabs(z);
+	float inverse = sum > 0.0f ? 1.0f / sum : 0.0f;
+	float u = x * inverse;
+	float v = y * inverse;
+
+	// Lower half folds out over the edges of the diamond.
+	if (z < 0.0f)
+	{
+		float foldU = std::copysign(1.0f - std::fabs(v), u);
+		float foldV = std::copysign(1.0f - std::fabs(u), v);
+		u = foldU;
+		v = foldV;
+	}
+	return (Word)(ToUnorm(u) | (ToUnorm(v) << 8));
+}
+
+void OctahedralNormals::DecodeOne(Word texel, float& x, float& y, float& z)
+{
+	float u = FromUnorm(texel & 255u);
+	float v = FromUnorm((Dword)texel >> 8);
+	float w = (1.0f - std::fabs(u)) - std::fabs(v);
+
+	// Outside the diamond is the lower half, fold it back.
+	float t = std::max(0.0f - w, 0.0f);
+	u -= std::copysign(t, u);
+	v -= std::copysign(t, v);
+
+	float inverse = 1.0f / std::sqrt((u * u + v * v) + w * w);
+	x = u * inverse;
+	y = v * inverse;
+	z = w * inverse;
+}
+
+void OctahedralNormals::Encode(const float* x, const float* y, const float* z, Uint64 count, Word* out)
+{
+	Encode(x, y, z, count, out, VolumeStatistics::GetSimdLevel());
+}
+
+void OctahedralNormals::Encode(const float* x, const float* y, const float* z, Uint64 count, Word* out, SimdLevel level)
+{
+	Uint64 done = 0;
+	switch (std::min(level, VolumeStatistics::GetSimdLevel()))
+	{
+#if defined(OCTAHEDRAL_SIMD)
+	case SimdLevel::AVX2:	done = EncodeAVX2(x, y, z, count, out); break;
+	case SimdLevel::SSE41:	done = EncodeSSE41(x, y, z, count, out); break;
+#endif
+	default:				break;
+	}
+	EncodeScalar(x, y, z, done, count, out);
+}
+
+void OctahedralNormals::Decode(const Word* in, Uint64 count, float* x, float* y, float* z)
+{
+	Decode(in, count, x, y, z, VolumeStatistics::GetSimdLevel());
+}
+
+void OctahedralNormals::Decode(const Word* in, Uint64 count, float* x, float* y, float* z, SimdLevel level)
+{
+	Uint64 done = 0;
+	switch (std::min(level, VolumeStatistics::GetSimdLevel()))
+	{
+#if defined(OCTAHEDRAL_SIMD)
+	case SimdLevel::AVX2:	done = DecodeAVX2(in, count, x, y, z); break;
+	case SimdLevel::SSE41:	done = DecodeSSE41(in, count, x, y, z); break;
+#endif
+	default:				break;
+	}
+	DecodeScalar(in, done, count, x, y, z);
+}
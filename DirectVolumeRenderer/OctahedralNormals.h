@@ -0,0 +1,28 @@
+//Note:
+/*
+	Unit normals in 16 bits, octahedral mapping: the direction is projected onto the
+	octahedron |x| + |y| + |z| = 1, the lower half folded out over the corners and the
+	square that makes read as two 8 bit unorms (R8G8, x in the low byte). Worst case
+	error is under a degree against the float normal, the same ballpark as the three
+	bytes of the packed RGB8 layout for two thirds of the memory.
+	A zero vector comes out as the centre texel, which decodes to +z.
+	Encode and Decode run on AVX2 or SSE4.1 (picked at runtime, scalar otherwise) and
+	give the same bits at every level, the rounding and the order of operations match.
+*/
+
+#pragma once
+#include "VolumeStatistics.h"
+
+namespace OctahedralNormals
+{
+	// Direction needn't be unit length.
+	Word EncodeOne(float x, float y, float z);
+	// Unit length.
+	void DecodeOne(Word texel, float& x, float& y, float& z);
+
+	// Structure of arrays, count of each.
+	void Encode(const float* x, const float* y, const float* z, Uint64 count, Word* out);
+	void Encode(const float* x, const float* y, const float* z, Uint64 count, Word* out, SimdLevel level);
+	void Decode(const Word* in, Uint64 count, float* x, float* y, float* z);
+	void Decode(const Word* in, Uint64 count, float* x, float* y, float* z, SimdLevel level);
+}
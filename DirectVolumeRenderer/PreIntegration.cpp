@@ -0,0 +1,514 @@
+#include "PreIntegration.h"
+#include "System/ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define PREINTEGRATION_SIMD
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#define PREINTEGRATION_TARGET(isa)
+#else
+#define PREINTEGRATION_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+namespace
+{
+	const float Log2e = 1.44269504f;
+	// 2^f on [0, 1), Taylor terms of e^(f ln 2) to the 6th, under 2e-5 relative error.
+	const float Exp2C1 = 0.693147181f;
+	const float Exp2C2 = 0.240226507f;
+	const float Exp2C3 = 0.0555041087f;
+	const float Exp2C4 = 0.00961812911f;
+	const float Exp2C5 = 0.00133335581f;
+	const float Exp2C6 = 0.000154035304f;
+
+	// Extinction integrated from sample 0 up to each sample, trapezoid rule, so a segment's is a difference of two.
+	struct SummedTables
+	{
+		std::vector<float> Tau;		// Extinction per base step at each sample
+		std::vector<float> T;		// Extinction up to each sample
+	};
+
+	SummedTables MakeTables(const float* opacity, Uint32 size)
+	{
+		SummedTables tables;
+		tables.Tau.resize(size);
+		for (Uint32 i = 0; i < size; i++)
+		{
+			tables.Tau[i] = (float)-std::log(1.0 - std::min(std::max(opacity[i], 0.0f), PreIntegration::MaxOpacity));
+		}
+
+		// Summed in double, a float running sum would drift over a few thousand samples.
+		tables.T.assign(size, 0.0f);
+		double t = 0;
+		for (Uint32 i = 1; i < size; i++)
+		{
+			t += 0.5 * ((double)tables.Tau[i - 1] + tables.Tau[i]);
+			tables.T[i] = (float)t;
+		}
+		return tables;
+	}
+
+	// e^x for x <= 0, as 2^n * 2^f. The vector versions do the same operations in the same order.
+	inline float Exp(float x)
+	{
+		float y = std::max(x * Log2e, -126.0f);
+		float n = std::floor(y);
+		float f = y - n;
+		float p = Exp2C6;
+		p = p * f + Exp2C5;
+		p = p * f + Exp2C4;
+		p = p * f + Exp2C3;
+		p = p * f + Exp2C2;
+		p = p * f + Exp2C1;
+		p = p * f + 1.0f;
+
+		int bits = ((int)n + 127) << 23;
+		float scale;
+		memcpy(&scale, &bits, sizeof(scale));
+		return p * scale;
+	}
+
+	inline Dword ToByte(float value)
+	{
+		return (Dword)std::min(std::max(value * 255.0f + 0.5f, 0.0f), 255.0f);
+	}
+
+	inline void StoreTexel(Byte* row, Uint32 x, Dword texel)
+	{
+		memcpy(row + (size_t)x * 4, &texel, sizeof(texel));
+	}
+
+	// Diagonals a block, the widest vector.
+	const Uint32 BlockLanes = 8;
+	// Pieces a unit is composited in, extinction and colour taken at each piece's middle.
+	const Uint32 UnitPieces = 8;
+
+	// The unit intervals [i, i + 1] between samples, padded with empty ones past the last sample so a
+	// diagonal can run on past the table's edge without a bounds check. Piece arrays are [piece][unit].
+	struct UnitTables
+	{
+		std::vector<float> T;							// SummedTables::T, held at the last sample past the end
+		std::vector<float> PieceTau[UnitPieces];		// Extinction per base step over the piece, times its length
+		std::vector<float> PieceColor[UnitPieces][3];
+	};
+
+	UnitTables MakeUnits(const SummedTables& tables, const float* color, Uint32 size)
+	{
+		size_t padded = (size_t)size * 2 + BlockLanes;
+		UnitTables units;
+		units.T.assign(padded, tables.T[size - 1]);
+		for (Uint32 i = 0; i < size; i++)
+		{
+			units.T[i] = tables.T[i];
+		}
+
+		for (Uint32 piece = 0; piece < UnitPieces; piece++)
+		{
+			float w = (piece + 0.5f) / UnitPieces;
+			units.PieceTau[piece].assign(padded, 0.0f);
+			for (Uint32 c = 0; c < 3; c++)
+			{
+				units.PieceColor[piece][c].assign(padded, 0.0f);
+			}
+
+			for (Uint32 i = 0; i + 1 < size; i++)
+			{
+				units.PieceTau[piece][i] = (tables.Tau[i] + (tables.Tau[i + 1] - tables.Tau[i]) * w) * (1.0f / UnitPieces);
+				for (Uint32 c = 0; c < 3; c++)
+				{
+					float c0 = color[(size_t)i * 3 + c];
+					float c1 = color[(size_t)(i + 1) * 3 + c];
+					units.PieceColor[piece][c][i] = c0 + (c1 - c0) * w;
+				}
+			}
+		}
+		return units;
+	}
+
+	// Where a diagonal's entry lands, the reversed tables' (front, back) is the table's (size - 1 - front, size - 1 - back).
+	inline void StoreEntry(Byte* table, Uint32 size, bool reversed, Uint32 front, Uint32 back, Dword texel)
+	{
+		Uint32 row = reversed ? size - 1 - front : front;
+		Uint32 column = reversed ? size - 1 - back : back;
+		StoreTexel(table + (size_t)row * size * 4, column, texel);
+	}
+
+	// A segment that stays on one sample, no mean to take.
+	Dword DiagonalEntry(const SummedTables& tables, const float* color, Uint32 front, float negScale)
+	{
+		float alpha = 1.0f - Exp(negScale * tables.Tau[front]);
+		const float* c = color + (size_t)front * 3;
+		return ToByte(alpha * c[0]) | (ToByte(alpha * c[1]) << 8) | (ToByte(alpha * c[2]) << 16) | (ToByte(alpha) << 24);
+	}
+
+	// Unit's premultiplied colour and transmittance composited front to back over its pieces at negK extinction scale.
+	inline float UnitEmission(const UnitTables& units, Uint32 unit, float negK, float rgb[3])
+	{
+		float through = 1.0f;
+		rgb[0] = rgb[1] = rgb[2] = 0.0f;
+		for (Uint32 piece = 0; piece < UnitPieces; piece++)
+		{
+			float t = Exp(negK * units.PieceTau[piece][unit]);
+			float w = through * (1.0f - t);
+			for (Uint32 c = 0; c < 3; c++)
+			{
+				rgb[c] = rgb[c] + w * units.PieceColor[piece][c][unit];
+			}
+			through = through * t;
+		}
+		return through;
+	}
+
+	// The entries back - front = distance, walked from the last front down to 0. The segment from front is the one
+	// from front + 1 losing its far unit and gaining unit front ahead of it, behind which it's attenuated, so each
+	// entry is O(1) from the one before and the colour is composited with the segment's own attenuation.
+	// inverse holds 1 / distance per distance, the vector versions do the same operations in the same order.
+	void BuildDiagonalScalar(const UnitTables& units, Uint32 size, Uint32 distance, const float* inverse, float negScale, bool reversed, Byte* table)
+	{
+		float negK = negScale * inverse[distance];
+		float rgb[3] = { 0.0f, 0.0f, 0.0f };
+		for (Uint32 front = size - 1; front-- > 0;)
+		{
+			Uint32 back = front + distance;
+			float gained[3], lost[3];
+			float t = UnitEmission(units, front, negK, gained);
+			UnitEmission(units, back, negK, lost);
+			float through = Exp(negK * (units.T[back] - units.T[front + 1]));
+			for (Uint32 c = 0; c < 3; c++)
+			{
+				rgb[c] = gained[c] + t * std::max(rgb[c] - through * lost[c], 0.0f);
+			}
+
+			if (back < size)
+			{
+				float alpha = 1.0f - Exp(negK * (units.T[back] - units.T[front]));
+				Dword texel = ToByte(rgb[0]) | (ToByte(rgb[1]) << 8) | (ToByte(rgb[2]) << 16) | (ToByte(alpha) << 24);
+				StoreEntry(table, size, reversed, front, back, texel);
+			}
+		}
+	}
+
+#if defined(PREINTEGRATION_SIMD)
+	PREINTEGRATION_TARGET("sse4.1") inline __m128 Exp4(__m128 x)
+	{
+		__m128 y = _mm_max_ps(_mm_mul_ps(x, _mm_set1_ps(Log2e)), _mm_set1_ps(-126.0f));
+		__m128 n = _mm_floor_ps(y);
+		__m128 f = _mm_sub_ps(y, n);
+		__m128 p = _mm_set1_ps(Exp2C6);
+		p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(Exp2C5));
+		p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(Exp2C4));
+		p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(Exp2C3));
+		p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(Exp2C2));
+		p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(Exp2C1));
+		p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(1.0f));
+
+		__m128i bits = _mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(n), _mm_set1_epi32(127)), 23);
+		return _mm_mul_ps(p, _mm_castsi128_ps(bits));
+	}
+
+	PREINTEGRATION_TARGET("sse4.1") inline __m128i ToByte4(__m128 value)
+	{
+		value = _mm_add_ps(_mm_mul_ps(value, _mm_set1_ps(255.0f)), _mm_set1_ps(0.5f));
+		return _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(value, _mm_setzero_ps()), _mm_set1_ps(255.0f)));
+	}
+
+	// UnitEmission on 4 units from unit, one a lane, each at its own lane of negK.
+	PREINTEGRATION_TARGET("sse4.1") inline __m128 UnitEmission4(const UnitTables& units, Uint32 unit, __m128 negK, __m128 rgb[3])
+	{
+		const __m128 one = _mm_set1_ps(1.0f);
+		__m128 through = one;
+		rgb[0] = rgb[1] = rgb[2] = _mm_setzero_ps();
+		for (Uint32 piece = 0; piece < UnitPieces; piece++)
+		{
+			__m128 t = Exp4(_mm_mul_ps(negK, _mm_loadu_ps(&units.PieceTau[piece][unit])));
+			__m128 w = _mm_mul_ps(through, _mm_sub_ps(one, t));
+			for (Uint32 c = 0; c < 3; c++)
+			{
+				rgb[c] = _mm_add_ps(rgb[c], _mm_mul_ps(w, _mm_loadu_ps(&units.PieceColor[piece][c][unit])));
+			}
+			through = _mm_mul_ps(through, t);
+		}
+		return through;
+	}
+
+	// The front unit is the same for every lane, broadcast.
+	PREINTEGRATION_TARGET("sse4.1") inline __m128 FrontEmission4(const UnitTables& units, Uint32 unit, __m128 negK, __m128 rgb[3])
+	{
+		const __m128 one = _mm_set1_ps(1.0f);
+		__m128 through = one;
+		rgb[0] = rgb[1] = rgb[2] = _mm_setzero_ps();
+		for (Uint32 piece = 0; piece < UnitPieces; piece++)
+		{
+			__m128 t = Exp4(_mm_mul_ps(negK, _mm_set1_ps(units.PieceTau[piece][unit])));
+			__m128 w = _mm_mul_ps(through, _mm_sub_ps(one, t));
+			for (Uint32 c = 0; c < 3; c++)
+			{
+				rgb[c] = _mm_add_ps(rgb[c], _mm_mul_ps(w, _mm_set1_ps(units.PieceColor[piece][c][unit])));
+			}
+			through = _mm_mul_ps(through, t);
+		}
+		return through;
+	}
+
+	// BuildDiagonalScalar on 4 diagonals from distance, one a lane.
+	PREINTEGRATION_TARGET("sse4.1") void BuildDiagonalsSSE41(const UnitTables& units, Uint32 size, Uint32 distance, const float* inverse, float negScale, bool reversed, Byte* table)
+	{
+		const __m128 negK = _mm_mul_ps(_mm_set1_ps(negScale), _mm_loadu_ps(inverse + distance));
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 zero = _mm_setzero_ps();
+		__m128 rgb[3] = { zero, zero, zero };
+		alignas(16) Dword texels[4];
+		for (Uint32 front = size - 1; front-- > 0;)
+		{
+			Uint32 back = front + distance;
+			__m128 gained[3], lost[3];
+			__m128 t = FrontEmission4(units, front, negK, gained);
+			UnitEmission4(units, back, negK, lost);
+			__m128 backT = _mm_loadu_ps(&units.T[back]);
+			__m128 through = Exp4(_mm_mul_ps(negK, _mm_sub_ps(backT, _mm_set1_ps(units.T[front + 1]))));
+			for (Uint32 c = 0; c < 3; c++)
+			{
+				rgb[c] = _mm_add_ps(gained[c], _mm_mul_ps(t, _mm_max_ps(_mm_sub_ps(rgb[c], _mm_mul_ps(through, lost[c])), zero)));
+			}
+
+			if (back < size)
+			{
+				__m128 alpha = _mm_sub_ps(one, Exp4(_mm_mul_ps(negK, _mm_sub_ps(backT, _mm_set1_ps(units.T[front])))));
+				__m128i texel = _mm_slli_epi32(ToByte4(alpha), 24);
+				for (Uint32 c = 0; c < 3; c++)
+				{
+					texel = _mm_or_si128(texel, _mm_slli_epi32(ToByte4(rgb[c]), (int)c * 8));
+				}
+				_mm_store_si128((__m128i*)texels, texel);
+				for (Uint32 lane = 0; lane < 4 && back + lane < size; lane++)
+				{
+					StoreEntry(table, size, reversed, front, back + lane, texels[lane]);
+				}
+			}
+		}
+	}
+
+	PREINTEGRATION_TARGET("avx2") inline __m256 Exp8(__m256 x)
+	{
+		__m256 y = _mm256_max_ps(_mm256_mul_ps(x, _mm256_set1_ps(Log2e)), _mm256_set1_ps(-126.0f));
+		__m256 n = _mm256_floor_ps(y);
+		__m256 f = _mm256_sub_ps(y, n);
+		__m256 p = _mm256_set1_ps(Exp2C6);
+		p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(Exp2C5));
+		p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(Exp2C4));
+		p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(Exp2C3));
+		p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(Exp2C2));
+		p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(Exp2C1));
+		p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(1.0f));
+
+		__m256i bits = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvttps_epi32(n), _mm256_set1_epi32(127)), 23);
+		return _mm256_mul_ps(p, _mm256_castsi256_ps(bits));
+	}
+
+	PREINTEGRATION_TARGET("avx2") inline __m256i ToByte8(__m256 value)
+	{
+		value = _mm256_add_ps(_mm256_mul_ps(value, _mm256_set1_ps(255.0f)), _mm256_set1_ps(0.5f));
+		return _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(value, _mm256_setzero_ps()), _mm256_set1_ps(255.0f)));
+	}
+
+	// UnitEmission on 8 units from unit, one a lane, each at its own lane of negK.
+	PREINTEGRATION_TARGET("avx2") inline __m256 UnitEmission8(const UnitTables& units, Uint32 unit, __m256 negK, __m256 rgb[3])
+	{
+		const __m256 one = _mm256_set1_ps(1.0f);
+		__m256 through = one;
+		rgb[0] = rgb[1] = rgb[2] = _mm256_setzero_ps();
+		for (Uint32 piece = 0; piece < UnitPieces; piece++)
+		{
+			__m256 t = Exp8(_mm256_mul_ps(negK, _mm256_loadu_ps(&units.PieceTau[piece][unit])));
+			__m256 w = _mm256_mul_ps(through, _mm256_sub_ps(one, t));
+			for (Uint32 c = 0; c < 3; c++)
+			{
+				rgb[c] = _mm256_add_ps(rgb[c], _mm256_mul_ps(w, _mm256_loadu_ps(&units.PieceColor[piece][c][unit])));
+			}
+			through = _mm256_mul_ps(through, t);
+		}
+		return through;
+	}
+
+	// The front unit is the same for every lane, broadcast.
+	PREINTEGRATION_TARGET("avx2") inline __m256 FrontEmission8(const UnitTables& units, Uint32 unit, __m256 negK, __m256 rgb[3])
+	{
+		const __m256 one = _mm256_set1_ps(1.0f);
+		__m256 through = one;
+		rgb[0] = rgb[1] = rgb[2] = _mm256_setzero_ps();
+		for (Uint32 piece = 0; piece < UnitPieces; piece++)
+		{
+			__m256 t = Exp8(_mm256_mul_ps(negK, _mm256_set1_ps(units.PieceTau[piece][unit])));
+			__m256 w = _mm256_mul_ps(through, _mm256_sub_ps(one, t));
+			for (Uint32 c = 0; c < 3; c++)
+			{
+				rgb[c] = _mm256_add_ps(rgb[c], _mm256_mul_ps(w, _mm256_set1_ps(units.PieceColor[piece][c][unit])));
+			}
+			through = _mm256_mul_ps(through, t);
+		}
+		return through;
+	}
+
+	// BuildDiagonalScalar on 8 diagonals from distance, one a lane.
+	PREINTEGRATION_TARGET("avx2") void BuildDiagonalsAVX2(const UnitTables& units, Uint32 size, Uint32 distance, const float* inverse, float negScale, bool reversed, Byte* table)
+	{
+		const __m256 negK = _mm256_mul_ps(_mm256_set1_ps(negScale), _mm256_loadu_ps(inverse + distance));
+		const __m256 one = _mm256_set1_ps(1.0f);
+		const __m256 zero = _mm256_setzero_ps();
+		__m256 rgb[3] = { zero, zero, zero };
+		alignas(32) Dword texels[8];
+		for (Uint32 front = size - 1; front-- > 0;)
+		{
+			Uint32 back = front + distance;
+			__m256 gained[3], lost[3];
+			__m256 t = FrontEmission8(units, front, negK, gained);
+			UnitEmission8(units, back, negK, lost);
+			__m256 backT = _mm256_loadu_ps(&units.T[back]);
+			__m256 through = Exp8(_mm256_mul_ps(negK, _mm256_sub_ps(backT, _mm256_set1_ps(units.T[front + 1]))));
+			for (Uint32 c = 0; c < 3; c++)
+			{
+				rgb[c] = _mm256_add_ps(gained[c], _mm256_mul_ps(t, _mm256_max_ps(_mm256_sub_ps(rgb[c], _mm256_mul_ps(through, lost[c])), zero)));
+			}
+
+			if (back < size)
+			{
+				__m256 alpha = _mm256_sub_ps(one, Exp8(_mm256_mul_ps(negK, _mm256_sub_ps(backT, _mm256_set1_ps(units.T[front])))));
+				__m256i texel = _mm256_slli_epi32(ToByte8(alpha), 24);
+				for (Uint32 c = 0; c < 3; c++)
+				{
+					texel = _mm256_or_si256(texel, _mm256_slli_epi32(ToByte8(rgb[c]), (int)c * 8));
+				}
+				_mm256_store_si256((__m256i*)texels, texel);
+				for (Uint32 lane = 0; lane < 8 && back + lane < size; lane++)
+				{
+					StoreEntry(table, size, reversed, front, back + lane, texels[lane]);
+				}
+			}
+		}
+	}
+#endif
+}
+
+void PreIntegration::Build(const float* color, const float* opacity, Uint32 size, float stepScale, Byte* table, Uint32 maxThreads)
+{
+	Build(color, opacity, size, stepScale, table, maxThreads, VolumeStatistics::GetSimdLevel());
+}
+
+void PreIntegration::Build(const float* color, const float* opacity, Uint32 size, float stepScale, Byte* table, Uint32 maxThreads, SimdLevel level)
+{
+	if (size == 0 || color == nullptr || opacity == nullptr || table == nullptr)
+	{
+		return;
+	}
+
+	// Back behind front is front behind back on the samples reversed.
+	std::vector<float> reversedColor((size_t)size * 3);
+	std::vector<float> reversedOpacity(size);
+	for (Uint32 i = 0; i < size; i++)
+	{
+		memcpy(&reversedColor[(size_t)i * 3], color + (size_t)(size - 1 - i) * 3, sizeof(float) * 3);
+		reversedOpacity[i] = opacity[size - 1 - i];
+	}
+
+	SummedTables tables = MakeTables(opacity, size);
+	const UnitTables units[2] = { MakeUnits(tables, color, size),
+								   MakeUnits(MakeTables(&reversedOpacity[0], size), &reversedColor[0], size) };
+	const float negScale = -stepScale;
+	level = std::min(level, VolumeStatistics::GetSimdLevel());
+
+	std::vector<float> inverse((size_t)size + BlockLanes);
+	for (Uint32 distance = 1; distance < inverse.size(); distance++)
+	{
+		inverse[distance] = 1.0f / (float)distance;
+	}
+
+	// Blocks of BlockLanes diagonals from distance 1, each way.
+	Uint64 blocks = (size - 1 + BlockLanes - 1) / BlockLanes;
+	ThreadPool::Instance().ParallelFor(blocks * 2, [&](Uint64 begin, Uint64 end)
+	{
+		for (Uint64 block = begin; block < end; block++)
+		{
+			bool reversed = block >= blocks;
+			const UnitTables& unit = units[reversed ? 1 : 0];
+			Uint32 first = 1 + (Uint32)(block % blocks) * BlockLanes;
+			switch (level)
+			{
+#if defined(PREINTEGRATION_SIMD)
+			case SimdLevel::AVX2:
+				BuildDiagonalsAVX2(unit, size, first, &inverse[0], negScale, reversed, table);
+				break;
+			case SimdLevel::SSE41:
+				BuildDiagonalsSSE41(unit, size, first, &inverse[0], negScale, reversed, table);
+				BuildDiagonalsSSE41(unit, size, first + 4, &inverse[0], negScale, reversed, table);
+				break;
+#endif
+			default:
+				for (Uint32 distance = first; distance < first + BlockLanes && distance < size; distance++)
+				{
+					BuildDiagonalScalar(unit, size, distance, &inverse[0], negScale, reversed, table);
+				}
+				break;
+			}
+		}
+	}, 1, maxThreads);
+
+	for (Uint32 front = 0; front < size; front++)
+	{
+		StoreTexel(table + (size_t)front * size * 4, front, DiagonalEntry(tables, color, front, negScale));
+	}
+}
+
+void PreIntegration::BuildReference(const float* color, const float* opacity, Uint32 size, float stepScale, float* table, Uint32 subSteps, Uint32 maxThreads)
+{
+	if (size == 0 || color == nullptr || opacity == nullptr || table == nullptr)
+	{
+		return;
+	}
+
+	subSteps = std::max(subSteps, (Uint32)1);
+	std::vector<double> tau(size);
+	for (Uint32 i = 0; i < size; i++)
+	{
+		tau[i] = -std::log(1.0 - std::min(std::max((double)opacity[i], 0.0), (double)MaxOpacity));
+	}
+
+	// Extinction and colour linear between samples, as the summed tables integrate them.
+	ThreadPool::Instance().ParallelFor(size, [&](Uint64 begin, Uint64 end)
+	{
+		for (Uint32 front = (Uint32)begin; front < end; front++)
+		{
+			for (Uint32 back = 0; back < size; back++)
+			{
+				double rgb[3] = { 0, 0, 0 };
+				double alpha = 0;
+				for (Uint32 step = 0; step < subSteps; step++)
+				{
+					double s = front + ((double)back - front) * (step + 0.5) / subSteps;
+					Uint32 i0 = std::min((Uint32)s, size - 1);
+					Uint32 i1 = std::min(i0 + 1, size - 1);
+					double w = s - i0;
+
+					double extinction = tau[i0] + (tau[i1] - tau[i0]) * w;
+					double a = 1.0 - std::exp(-stepScale * extinction / subSteps);
+					for (Uint32 c = 0; c < 3; c++)
+					{
+						double value = color[(size_t)i0 * 3 + c] + ((double)color[(size_t)i1 * 3 + c] - color[(size_t)i0 * 3 + c]) * w;
+						rgb[c] += (1.0 - alpha) * a * value;
+					}
+					alpha += (1.0 - alpha) * a;
+				}
+
+				float* texel = table + ((size_t)front * size + back) * 4;
+				texel[0] = (float)rgb[0];
+				texel[1] = (float)rgb[1];
+				texel[2] = (float)rgb[2];
+				texel[3] = (float)alpha;
+			}
+		}
+	}, 1, maxThreads);
+}
@@ -0,0 +1,35 @@
+//Note:
+/*
+	Pre-integrated transfer function: a 2D table giving the colour and opacity of a
+	whole ray segment from the intensity it enters at (front) to the one it leaves at
+	(back), so a low sample rate doesn't slice thin features into slabs. Opacity is per
+	base step like the transfer LUT, stepScale is the segment length in base steps.
+	Opacity comes from a summed extinction table, O(1) an entry and exact for extinction
+	linear between samples (Engel et al. 2001). Colour is composited front to back with
+	the segment's own attenuation: each unit between two samples in pieces, and along a
+	diagonal (fixed back - front, so a fixed extinction scale) an entry is the next one
+	down the diagonal gaining its front unit and losing its back one, O(1) an entry too.
+	Diagonals run across the pool, 8 (AVX2) or 4 (SSE4.1) a vector (picked at runtime,
+	scalar otherwise) with the same bits at every level.
+	BuildReference composites every segment in small pieces instead, what Build is
+	checked against.
+*/
+
+#pragma once
+#include "VolumeStatistics.h"
+
+namespace PreIntegration
+{
+	// Opacity is clamped below this, full opacity has no finite extinction.
+	static const float MaxOpacity = 0.9999f;
+
+	// color is size RGB triples, opacity size values, both sampled evenly over the intensity range.
+	// table is size * size RGBA8 texels with colour premultiplied, row front and column back.
+	// maxThreads 0 uses the whole pool.
+	void Build(const float* color, const float* opacity, Uint32 size, float stepScale, Byte* table, Uint32 maxThreads = 0);
+	void Build(const float* color, const float* opacity, Uint32 size, float stepScale, Byte* table, Uint32 maxThreads, SimdLevel level);
+
+	// Same layout as Build in floats, each segment composited front to back in subSteps pieces.
+	void BuildReference(const float* color, const float* opacity, Uint32 size, float stepScale, float* table,
+						Uint32 subSteps = 256, Uint32 maxThreads = 0);
+}
@@ -2,12 +2,15 @@
 #include "Math/Vector4.h"
 #include "Math/Mathf.h"
 #include "Content/Texture.h"
+#include "PreIntegration.h"
 #include "Application/Application.h"
 #include "System/File.h"
 #include "UI/ImGui_Interface.h"
 #include <memory>
 #include <vector>
 #include <algorithm>
+#include <cstring>
+#include <cmath>
 #include <iostream>
 
 struct TransferNode
@@ -65,7 +68,7 @@ struct TransferNode
 	}
 
 	// Return interpolated node
-	static TransferNode Lerp(TransferNode& n1, TransferNode& n2, float t)
+	static TransferNode Lerp(const TransferNode& n1, const TransferNode& n2, float t)
 	{
 		float minusT = (1.0f - t);
 		TransferNode node;
@@ -88,20 +91,58 @@ struct TransferNode
 // Add cubic if get time, this is a bad approximation
 // But Exposure render does the same thing.
 // Dont hardcode strings, change when works!
+// The diffuse LUT is 2D, intensity across and gradient magnitude down. Gradient opacity
+// scales each node's opacity by a ramp over the magnitude, so flat interiors fade out
+// and boundaries stay. The ramp only ever rises with magnitude, which lets the occupancy
+// grid check a cell against its largest gradient alone.
 class TransferFunction
 {
+public:
+	// LUT widths, one bin per stored value of 8 bit data, finer for 16 bit intensity. A bin
+	// is 4 bytes a gradient row, 1 MB for the diffuse LUT at 4096 and 4 MB at the most D3D11
+	// allows a texture row (16384), so a full 65536 bins doesn't fit in one and isn't offered.
+	// Bin b sits at node intensity b * 255 / (bins - 1), the first and last bins on 0 and 255.
+	static const Uint32 IntensityBins = 256;
+	static const Uint32 HighResolutionBins = 4096;
+	static const Uint32 MaxIntensityBins = 16384;
+	static const Uint32 GradientBins = 64;
+	// Sample spacings, in base steps, the diffuse LUT is also kept opacity corrected for.
+	static const Uint32 StepSlots = 4;
+	// Samples a side of the pre-integrated table, 256 KB of RGBA8.
+	static const Uint32 PreIntegratedSize = 256;
+
 private:
 	// Reduce to a single Texture2D with point sampling?
 	std::shared_ptr<Texture>  m_Diffuse;
 	std::shared_ptr<Texture>  m_Surface;
 	std::vector<TransferNode> m_Nodes;
+	std::vector<TransferNode> m_BakedNodes;	// As of the last bake, an edit rebakes only the bins between the nodes it left alone
+	std::vector<float>		  m_Opacity;	// Per intensity bin, before the gradient ramp
+	std::shared_ptr<Texture>  m_PreIntegrated;	// Only while a step scale is set
+	float					  m_StepMultipliers[StepSlots] = { 0.5f, 1.0f, 2.0f, 4.0f };
+	Byte					  m_AlphaCorrection[StepSlots][256];	// Stored alpha to alpha at the slot's spacing
+	std::shared_ptr<Texture>  m_CorrectedDiffuse[StepSlots];	// Null for a spacing of 1, that's m_Diffuse
+	float					  m_PreIntegratedScale = 0.0f;
+	Uint32					  m_IntensityBins = IntensityBins;
 	std::string m_FilePath;
+	bool  m_UseGradient = false;
+	float m_GradientLow = 0.02f;	// Magnitudes as a fraction of the data range per voxel
+	float m_GradientHigh = 0.1f;
 	int m_DraggingNode = -1;
 	int m_SelectedNode = -1;
 	bool m_CanvasClicked = false;
 	bool m_Dirty = false;
 	bool m_MouseDownPrevious = false;
 	bool m_Interacting = false;
+	// Bins whose opacity changed since ClearDirtyRange, first > last when none have.
+	Uint32 m_DirtyFirst = 0;
+	Uint32 m_DirtyLast = IntensityBins - 1;	// Every bin to start with
+	bool  m_BakedGradient = false;	// The ramp the last bake used, a change to it touches every bin
+	float m_BakedGradientLow = 0.0f;
+	float m_BakedGradientHigh = 0.0f;
+	Uint32 m_BakedFirst = 0;	// Bins the last bake wrote and uploaded
+	Uint32 m_BakedLast = 0;
+	Uint64 m_BakedBytes = 0;	// Uploaded by the last bake, the corrected slots and pre-integrated table included
 
 public:
 	void Initialize(std::string path)
@@ -126,6 +167,14 @@ public:
 			int nodeCount = file.ReadDword();
 			m_Nodes.resize(nodeCount);
 			file.ReadBuffer((Byte*)&m_Nodes[0], nodeCount * sizeof(TransferNode));
+
+			// Gradient settings follow the nodes, older files stop at the nodes.
+			if (file.Tell() < file.GetSize())
+			{
+				m_UseGradient = file.ReadDword() != 0;
+				m_GradientLow = file.ReadFloat();
+				m_GradientHigh = file.ReadFloat();
+			}
 			file.Close();
 		}
 		else
@@ -140,19 +189,12 @@ public:
 		if (m_Diffuse == nullptr)
 		{
 			m_Diffuse = std::make_shared<Texture>();
-			m_Diffuse->Create2D(255, 1, 1, false, BufferUsage::Dynamic, SurfaceFormat::R8G8B8A8_Unorm);
-			m_Diffuse->SetFilter(FilterMode::MinMagMipPoint);
-		}
-
-		if (m_Surface == nullptr)
-		{
 			m_Surface = std::make_shared<Texture>();
-			m_Surface->Create2D(255, 1, 1, false, BufferUsage::Dynamic, SurfaceFormat::R8G8_Unorm);
-			m_Surface->SetFilter(FilterMode::MinMagMipPoint);
+			CreateTextures();
 		}
 
 		// Do an initial generation pass?
-		GenerateTransferFunction();
+		GenerateTransferFunction(true);
 	}
 
 	void SaveTransfer(std::string filePath = "")
@@ -170,6 +212,9 @@ public:
 			int nodeCount = (int)m_Nodes.size();
 			file.WriteDword(nodeCount);
 			file.WriteBuffer((Byte*)&m_Nodes[0], nodeCount * sizeof(TransferNode));
+			file.WriteDword(m_UseGradient ? 1 : 0);
+			file.WriteFloat(m_GradientLow);
+			file.WriteFloat(m_GradientHigh);
 			file.Close();
 		}
 	}
@@ -189,48 +234,289 @@ public:
 		m_Nodes.push_back(node);
 	}
 
+	const std::vector<TransferNode>& GetNodes()const
+	{
+		return m_Nodes;
+	}
+
+	// Replaces every node, sorted by intensity. The next GenerateTransferFunction rebakes what moved.
+	void SetNodes(const std::vector<TransferNode>& nodes)
+	{
+		m_Nodes = nodes;
+		std::sort(m_Nodes.begin(), m_Nodes.end(), &TransferNode::Sorter);
+	}
+
 	Uint32 SegmentCount()const
 	{
 		return ((Uint32)m_Nodes.size() - 1);
 	}
 
-	// Computes the textures for the transfer
-	void GenerateTransferFunction()
+	bool UsesGradient()const
+	{
+		return m_UseGradient;
+	}
+
+	// Opacity per intensity bin before the gradient ramp, as baked into the diffuse LUT.
+	const std::vector<float>& GetOpacity()const
+	{
+		return m_Opacity;
+	}
+
+	Uint32 GetIntensityBins()const
+	{
+		return m_IntensityBins;
+	}
+
+	// Rebakes both LUTs at a new width, materials holding them see the new textures.
+	void SetIntensityBins(Uint32 bins)
+	{
+		bins = std::min(std::max(bins, (Uint32)IntensityBins), (Uint32)MaxIntensityBins);
+		if (bins == m_IntensityBins)
+		{
+			return;
+		}
+
+		m_IntensityBins = bins;
+		if (m_Diffuse)
+		{
+			m_Diffuse->Release();
+			m_Surface->Release();
+			CreateTextures();
+
+			// A different width, every bin counts as changed.
+			m_Opacity.clear();
+			GenerateTransferFunction(true);
+		}
+	}
+
+	// Bins and bytes the last GenerateTransferFunction wrote and uploaded.
+	Uint32 GetBakedBinCount()const
+	{
+		return m_BakedLast - m_BakedFirst + 1;
+	}
+
+	Uint64 GetBakedBytes()const
+	{
+		return m_BakedBytes;
+	}
+
+	// Opacity is per base step, a sample every multiplier steps needs alpha' = 1 - (1 - alpha)^multiplier
+	// to look the same. Each slot keeps the diffuse LUT corrected for its multiplier, redone with the
+	// columns of every bake, so switching spacing is only a texture swap.
+	float GetStepMultiplier(Uint32 slot)const
+	{
+		return m_StepMultipliers[slot];
+	}
+
+	// Re-derives one slot for another spacing: a 256 entry table and a lookup per LUT texel, no rebake.
+	void SetStepMultiplier(Uint32 slot, float multiplier)
+	{
+		if (slot >= StepSlots || multiplier <= 0.0f)
+		{
+			return;
+		}
+
+		// Before the first Load, CreateTextures makes it.
+		m_StepMultipliers[slot] = multiplier;
+		if (m_Diffuse == nullptr)
+		{
+			return;
+		}
+
+		CreateCorrected(slot);
+		if (m_CorrectedDiffuse[slot])
+		{
+			CorrectColumns(slot, 0, m_IntensityBins - 1, true);
+		}
+	}
+
+	// The slot whose spacing is nearest multiplier.
+	Uint32 FindStepSlot(float multiplier)const
+	{
+		Uint32 best = 0;
+		for (Uint32 slot = 1; slot < StepSlots; slot++)
+		{
+			if (std::fabs(m_StepMultipliers[slot] - multiplier) < std::fabs(m_StepMultipliers[best] - multiplier))
+			{
+				best = slot;
+			}
+		}
+		return best;
+	}
+
+	// Same layout as GetDiffuseTransfer with the slot's spacing in the alpha.
+	std::shared_ptr<Texture> GetCorrectedDiffuse(Uint32 slot)
+	{
+		return m_CorrectedDiffuse[slot] ? m_CorrectedDiffuse[slot] : m_Diffuse;
+	}
+
+	// Bakes the pre-integrated table for segments stepScale base steps long, and keeps it up to date
+	// with every bake after. 0 drops it. Gradient opacity isn't in it, it's over intensity alone.
+	void SetPreIntegration(float stepScale)
+	{
+		m_PreIntegratedScale = std::max(stepScale, 0.0f);
+		if (m_PreIntegratedScale == 0.0f)
+		{
+			m_PreIntegrated = nullptr;
+			return;
+		}
+
+		if (m_PreIntegrated == nullptr)
+		{
+			m_PreIntegrated = std::make_shared<Texture>();
+			m_PreIntegrated->Create2D(PreIntegratedSize, PreIntegratedSize, 1, false, BufferUsage::Default, SurfaceFormat::R8G8B8A8_Unorm);
+			m_PreIntegrated->SetFilter(FilterMode::MinMagMipLinear);
+			m_PreIntegrated->SetWrapMode(WrapMode::Clamp);
+		}
+		BakePreIntegrated();
+	}
+
+	float GetPreIntegrationScale()const
+	{
+		return m_PreIntegratedScale;
+	}
+
+	// Row front intensity, column back, colour premultiplied. Null unless SetPreIntegration was given a step scale.
+	std::shared_ptr<Texture> GetPreIntegratedTransfer()
+	{
+		return m_PreIntegrated;
+	}
+
+	// Colour (RGB triples) and opacity at size even steps over 0 to 255, what the pre-integrated table is built from.
+	void GetIntegrationSamples(Uint32 size, std::vector<float>& color, std::vector<float>& opacity)const
 	{
+		color.resize((size_t)size * 3);
+		opacity.resize(size);
+		size_t segment = 0;
+		for (Uint32 i = 0; i < size; i++)
+		{
+			TransferNode node = Evaluate(i * 255.0f / std::max(size - 1, (Uint32)1), segment);
+			color[(size_t)i * 3] = node.R;
+			color[(size_t)i * 3 + 1] = node.G;
+			color[(size_t)i * 3 + 2] = node.B;
+			opacity[i] = node.GetOpacity();
+		}
+	}
+
+	// Opacity scale for a row of the diffuse LUT, never falls as the row goes up.
+	float GetGradientWeight(Uint32 row)const
+	{
+		if (m_UseGradient == false)
+		{
+			return 1.0f;
+		}
+
+		float magnitude = (row + 0.5f) / GradientBins;
+		if (m_GradientHigh <= m_GradientLow)
+		{
+			return magnitude >= m_GradientLow ? 1.0f : 0.0f;
+		}
+		return Mathf::Clamp((magnitude - m_GradientLow) / (m_GradientHigh - m_GradientLow), 0.0f, 1.0f);
+	}
+
+	// Computes the textures for the transfer. Only the bins between the nodes an edit left
+	// alone are rebaked and uploaded, a ramp or width change (or full) redoes them all.
+	void GenerateTransferFunction(bool full = false)
+	{
+		bool rampChanged = m_BakedGradient != m_UseGradient || m_BakedGradientLow != m_GradientLow || m_BakedGradientHigh != m_GradientHigh;
+		full = full || rampChanged || m_Opacity.size() != m_IntensityBins;
+
+		Uint32 first = 0;
+		Uint32 last = m_IntensityBins - 1;
+		if (!full && !GetChangedBins(first, last))
+		{
+			m_BakedBytes = 0;
+			return;
+		}
+
 		Byte* colorData = m_Diffuse->GetData();
 		Byte* surfaceData = m_Surface->GetData();
 
-		// Go throguh each node, accept last one as theres no lerp for it!
-		int pixel = 0;
-		for (Uint32 i = 0; i < m_Nodes.size() - 1; i++)
+		std::vector<float> previous;
+		if (full)
+		{
+			previous.swap(m_Opacity);
+			m_Opacity.assign(m_IntensityBins, 0.0f);
+		}
+		else
+		{
+			previous.assign(m_Opacity.begin() + first, m_Opacity.begin() + last + 1);
+		}
+
+		// Fills the first row, the gradient rows are copies with the opacity ramped.
+		// Node intensities are 0 to 255 whatever the width, a wider LUT gives each segment more bins.
+		size_t segment = 0;
+		for (Uint32 x = first; x <= last; x++)
 		{
-			// How many iso values between these nodes, for t value!
-			Uint32 steps = (Uint32)(m_Nodes[(size_t)i + 1].GetIntensity() - m_Nodes[i].GetIntensity());
+			TransferNode node = Evaluate(x * 255.0f / (m_IntensityBins - 1), segment);
+
+			colorData[x * 4] = (Byte)(node.R * 255);
+			colorData[x * 4 + 1] = (Byte)(node.G * 255);
+			colorData[x * 4 + 2] = (Byte)(node.B * 255);
+			m_Opacity[x] = node.GetOpacity();
 
-			for (Uint32 j = 0; j < steps; j++)
+			// Two channels, R8G8
+			surfaceData[x * 2]	   = (Byte)(node.Metallic * 255);
+			surfaceData[x * 2 + 1] = (Byte)(node.Roughness * 255);
+		}
+
+		Uint32 count = last - first + 1;
+		for (Uint32 row = GradientBins; row-- > 0;)
+		{
+			float weight = GetGradientWeight(row);
+			Byte* rowData = colorData + (size_t)row * m_IntensityBins * 4;
+			if (row != 0)
 			{
-				int colorIndex = pixel * 4;
-				int metalIndex = pixel * 2;
-
-				float t = (float)j / (float)(steps - 1);
-				TransferNode node = TransferNode::Lerp(m_Nodes[i], m_Nodes[(size_t)i + 1], t);
-
-				colorData[colorIndex] = (Byte)(node.R * 255);
-				colorData[colorIndex + 1] = (Byte)(node.G * 255);
-				colorData[colorIndex + 2] = (Byte)(node.B * 255);
-				colorData[colorIndex + 3] = (Byte)(node.GetOpacity() * 255);
-
-				surfaceData[metalIndex]		= (Byte)(node.Metallic * 255);
-				surfaceData[metalIndex + 1] = (Byte)(node.Roughness * 255);
-				surfaceData[metalIndex + 2] = 0;
-				surfaceData[metalIndex + 3] = 255;
-				pixel++;
+				memcpy(rowData + (size_t)first * 4, colorData + (size_t)first * 4, (size_t)count * 4);
 			}
+
+			for (Uint32 x = first; x <= last; x++)
+			{
+				rowData[x * 4 + 3] = (Byte)(m_Opacity[x] * weight * 255);
+			}
+		}
+
+		// Widen the dirty span by what this bake changed.
+		for (Uint32 x = first; x <= last; x++)
+		{
+			if (full ? (previous.size() != m_IntensityBins || rampChanged || previous[x] != m_Opacity[x]) : previous[x - first] != m_Opacity[x])
+			{
+				bool clean = m_DirtyFirst > m_DirtyLast;
+				m_DirtyFirst = clean ? x : std::min(m_DirtyFirst, x);
+				m_DirtyLast = clean ? x : std::max(m_DirtyLast, x);
+			}
+		}
+		m_BakedGradient = m_UseGradient;
+		m_BakedGradientLow = m_GradientLow;
+		m_BakedGradientHigh = m_GradientHigh;
+		m_BakedNodes = m_Nodes;
+		m_BakedFirst = first;
+		m_BakedLast = last;
+		m_BakedBytes = (Uint64)count * (GradientBins * 4 + 2);
+
+		if (m_PreIntegrated)
+		{
+			BakePreIntegrated();
+			m_BakedBytes += (Uint64)PreIntegratedSize * PreIntegratedSize * 4;
+		}
+
+		for (Uint32 slot = 0; slot < StepSlots; slot++)
+		{
+			CorrectColumns(slot, first, last, full);
+			m_BakedBytes += m_CorrectedDiffuse[slot] ? (Uint64)count * GradientBins * 4 : 0;
 		}
 
-		// Update the new data to the GPU
-		m_Diffuse->Apply(true);
-		m_Surface->Apply(true);
+		// Update the new data to the GPU, a partial bake sends just its columns.
+		if (full)
+		{
+			m_Diffuse->Apply(true);
+			m_Surface->Apply(true);
+		}
+		else
+		{
+			m_Diffuse->ApplyRegion(first, 0, count, GradientBins);
+			m_Surface->ApplyRegion(first, 0, count, 1);
+		}
 		m_Dirty = false;
 		//--for the thesis screenshots--
 		//m_Diffuse->SaveToFile("Assets/diffuse.png");
@@ -245,7 +531,8 @@ public:
 		if (ImGui::CollapsingHeader("Transfer Function"))
 		{
 			ImGui::Separator();
-			ImGui::Image(m_Diffuse->GetTextureResource()->m_SRV, ImVec2(ImGui::GetContentRegionAvail().x, 16), ImVec2(0, 0.0f), ImVec2(1, 0.5f));
+			// Gradient rows drawn bottom up, they are all the same without gradient opacity.
+			ImGui::Image(m_Diffuse->GetTextureResource()->m_SRV, ImVec2(ImGui::GetContentRegionAvail().x, m_UseGradient ? 64.0f : 16.0f), ImVec2(0, 1.0f), ImVec2(1, 0.0f));
 			ImGui::Image(m_Surface->GetTextureResource()->m_SRV, ImVec2(ImGui::GetContentRegionAvail().x, 16), ImVec2(0, 0.5f), ImVec2(1, 1));
 
 			ImVec2 canvasSize = ImGui::GetContentRegionAvail(); // avliable space
@@ -422,6 +709,37 @@ public:
 				}
 			}
 
+			if (ImGui::Checkbox("Gradient Opacity", &m_UseGradient))
+			{
+				m_Dirty = true;
+			}
+
+			if (m_UseGradient && ImGui::DragFloatRange2("Gradient Ramp", &m_GradientLow, &m_GradientHigh, 0.001f, 0.0f, 1.0f))
+			{
+				m_Dirty = true;
+			}
+
+			// Wider than 256 only resolves more for 16 bit intensity.
+			const Uint32 widths[] = { 256, 1024, 4096, 16384 };
+			const char* widthNames[] = { "256", "1024", "4096", "16384" };
+			int width = 0;
+			while (width < 3 && widths[width] < m_IntensityBins)
+			{
+				width++;
+			}
+			if (ImGui::Combo("LUT Width", &width, widthNames, 4))
+			{
+				SetIntensityBins(widths[width]);
+				m_Dirty = true;
+			}
+
+			// Segment length in base steps, 0 for no table.
+			float preIntegration = m_PreIntegratedScale;
+			if (ImGui::SliderFloat("Pre-integrated Step", &preIntegration, 0.0f, 4.0f))
+			{
+				SetPreIntegration(preIntegration);
+			}
+
 			// cache mouse
 			m_MouseDownPrevious = io.MouseDown[0];
 
@@ -439,6 +757,39 @@ public:
 		return false;
 	}
 
+	// Bins whose value can differ from the last bake, between the nearest nodes either side of
+	// the edit that kept their place. False when the nodes are as baked.
+	bool GetChangedBins(Uint32& first, Uint32& last)const
+	{
+		size_t count = m_Nodes.size();
+		size_t bakedCount = m_BakedNodes.size();
+		size_t shared = std::min(count, bakedCount);
+
+		size_t prefix = 0;
+		while (prefix < shared && memcmp(&m_Nodes[prefix], &m_BakedNodes[prefix], sizeof(TransferNode)) == 0)
+		{
+			prefix++;
+		}
+
+		if (prefix == count && count == bakedCount)
+		{
+			return false;
+		}
+
+		size_t suffix = 0;
+		while (suffix < shared - prefix && memcmp(&m_Nodes[count - 1 - suffix], &m_BakedNodes[bakedCount - 1 - suffix], sizeof(TransferNode)) == 0)
+		{
+			suffix++;
+		}
+
+		// Nodes [prefix, count - suffix) are new or moved, the segments out to their unchanged neighbours follow them.
+		Uint32 low = prefix > 0 ? m_Nodes[prefix - 1].GetIntensity() : 0;
+		Uint32 high = suffix > 0 ? m_Nodes[count - suffix].GetIntensity() : 255;
+		first = low * (m_IntensityBins - 1) / 255;
+		last = std::min((high * (m_IntensityBins - 1) + 254) / 255, m_IntensityBins - 1);
+		return true;
+	}
+
 	int GetNodeOverlap(Vector2 mousePosition, Vector2 viewScale, Vector2 viewOffset)
 	{
 		for (int i = 0; i < m_Nodes.size(); i++)
@@ -459,4 +810,135 @@ public:
 	{
 		return m_Interacting;
 	}
+
+	// The intensity bins whose opacity changed since the last ClearDirtyRange, false if none.
+	// Stays valid across several bakes in one drag, so whoever consumes it can skip frames.
+	bool GetDirtyRange(Uint32& first, Uint32& last)const
+	{
+		if (m_DirtyFirst > m_DirtyLast)
+		{
+			return false;
+		}
+
+		first = m_DirtyFirst;
+		last = m_DirtyLast;
+		return true;
+	}
+
+	void ClearDirtyRange()
+	{
+		m_DirtyFirst = m_IntensityBins;
+		m_DirtyLast = 0;
+	}
+
+private:
+	// The nodes lerped at a node space intensity. segment carries the search over between calls
+	// with rising intensities, start it at 0. Before the first node or past the last gives that node.
+	TransferNode Evaluate(float intensity, size_t& segment)const
+	{
+		const size_t lastSegment = m_Nodes.size() - 2;
+		while (segment < lastSegment && intensity >= m_Nodes[segment + 1].GetIntensity())
+		{
+			segment++;
+		}
+
+		const TransferNode& n1 = m_Nodes[segment];
+		const TransferNode& n2 = m_Nodes[segment + 1];
+		float span = (float)n2.GetIntensity() - (float)n1.GetIntensity();
+		float t = span > 0.0f ? Mathf::Clamp((intensity - n1.GetIntensity()) / span, 0.0f, 1.0f) : 1.0f;
+		return TransferNode::Lerp(n1, n2, t);
+	}
+
+	// The whole table on every bake, partial ones too. An entry covers every bin between its front
+	// and back sample, so an edit to any bin reaches most of the table and a narrower rebuild
+	// would save little. About 3 ms with AVX2 and a 256 KB upload, counted in GetBakedBytes.
+	void BakePreIntegrated()
+	{
+		std::vector<float> color;
+		std::vector<float> opacity;
+		GetIntegrationSamples(PreIntegratedSize, color, opacity);
+		PreIntegration::Build(&color[0], &opacity[0], PreIntegratedSize, m_PreIntegratedScale, m_PreIntegrated->GetData());
+		m_PreIntegrated->Apply(true);
+	}
+
+	// The slot's alpha table and, unless its spacing is 1, its LUT at the current width (contents left to CorrectColumns).
+	void CreateCorrected(Uint32 slot)
+	{
+		float multiplier = m_StepMultipliers[slot];
+		for (Uint32 alpha = 0; alpha < 256; alpha++)
+		{
+			float corrected = 1.0f - std::pow(1.0f - alpha / 255.0f, multiplier);
+			m_AlphaCorrection[slot][alpha] = (Byte)Mathf::Clamp(corrected * 255.0f + 0.5f, 0.0f, 255.0f);
+		}
+
+		if (multiplier == 1.0f)
+		{
+			m_CorrectedDiffuse[slot] = nullptr;
+			return;
+		}
+
+		if (m_CorrectedDiffuse[slot] == nullptr)
+		{
+			m_CorrectedDiffuse[slot] = std::make_shared<Texture>();
+		}
+		else
+		{
+			m_CorrectedDiffuse[slot]->Release();
+		}
+		m_CorrectedDiffuse[slot]->Create2D(m_IntensityBins, GradientBins, 1, false, BufferUsage::Default, SurfaceFormat::R8G8B8A8_Unorm);
+		m_CorrectedDiffuse[slot]->SetFilter(FilterMode::MinMagMipPoint);
+		m_CorrectedDiffuse[slot]->SetWrapMode(WrapMode::Clamp);
+	}
+
+	// Copies the diffuse LUT's columns [first, last] into the slot's with the alpha corrected, and uploads them.
+	void CorrectColumns(Uint32 slot, Uint32 first, Uint32 last, bool full)
+	{
+		Texture* corrected = m_CorrectedDiffuse[slot].get();
+		if (corrected == nullptr)
+		{
+			return;
+		}
+
+		const Byte* table = m_AlphaCorrection[slot];
+		const Byte* source = m_Diffuse->GetData();
+		Byte* target = corrected->GetData();
+		for (Uint32 row = 0; row < GradientBins; row++)
+		{
+			size_t offset = ((size_t)row * m_IntensityBins + first) * 4;
+			const Byte* from = source + offset;
+			Byte* to = target + offset;
+			for (Uint32 x = first; x <= last; x++, from += 4, to += 4)
+			{
+				to[0] = from[0];
+				to[1] = from[1];
+				to[2] = from[2];
+				to[3] = table[from[3]];
+			}
+		}
+
+		if (full)
+		{
+			corrected->Apply(true);
+		}
+		else
+		{
+			corrected->ApplyRegion(first, 0, last - first + 1, GradientBins);
+		}
+	}
+
+	// Default usage with the CPU copy kept, so an edit can update a few columns in place.
+	void CreateTextures()
+	{
+		m_Diffuse->Create2D(m_IntensityBins, GradientBins, 1, false, BufferUsage::Default, SurfaceFormat::R8G8B8A8_Unorm);
+		m_Diffuse->SetFilter(FilterMode::MinMagMipPoint);
+		m_Diffuse->SetWrapMode(WrapMode::Clamp);
+		m_Surface->Create2D(m_IntensityBins, 1, 1, false, BufferUsage::Default, SurfaceFormat::R8G8_Unorm);
+		m_Surface->SetFilter(FilterMode::MinMagMipPoint);
+		m_Surface->SetWrapMode(WrapMode::Clamp);
+
+		for (Uint32 slot = 0; slot < StepSlots; slot++)
+		{
+			CreateCorrected(slot);
+		}
+	}
 };
\ No newline at end of file
@@ -0,0 +1,1732 @@
+#include "VolumeBenchmark.h"
+#include "VolumeComponent.h"
+#include "DicomSeries.h"
+#include "OccupancyTraversal.h"
+#include "OctahedralNormals.h"
+#include "PreIntegration.h"
+#include "VolumeNormals.h"
+#include "VolumePyramid.h"
+#include "VolumeRaycaster.h"
+#include "VolumeSidecar.h"
+#include "VolumeStatistics.h"
+#include "System/File.h"
+#include "System/Logger.h"
+#include "System/ThreadPool.h"
+#include "UI/ImGui_Interface.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+	// Distinct per offset so a block read from the wrong place never matches.
+	void FillMarker(Byte* data, Uint64 byteCount, Uint64 offset)
+	{
+		for (Uint64 i = 0; i < byteCount; ++i)
+		{
+			Uint64 position = offset + i;
+			data[i] = (Byte)((position ^ (position >> 13) ^ (position >> 32)) * 2654435761ull >> 24);
+		}
+	}
+
+	double SecondsSince(std::chrono::high_resolution_clock::time_point start)
+	{
+		return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+	// DecodeOctahedral on two byte values, filtered (fractional) ones included.
+	void DecodeBytes(double u, double v, double n[3])
+	{
+		u = u * (2.0 / 255.0) - 1.0;
+		v = v * (2.0 / 255.0) - 1.0;
+		n[0] = u;
+		n[1] = v;
+		n[2] = 1.0 - std::fabs(u) - std::fabs(v);
+		if (n[2] < 0.0)
+		{
+			n[0] = (1.0 - std::fabs(v)) * (u >= 0.0 ? 1.0 : -1.0);
+			n[1] = (1.0 - std::fabs(u)) * (v >= 0.0 ? 1.0 : -1.0);
+		}
+	}
+
+	double DegreesBetween(const double a[3], const double b[3])
+	{
+		double lengths = std::sqrt((a[0] * a[0] + a[1] * a[1] + a[2] * a[2]) * (b[0] * b[0] + b[1] * b[1] + b[2] * b[2]));
+		double cosine = lengths > 0.0 ? (a[0] * b[0] + a[1] * b[1] + a[2] * b[2]) / lengths : 1.0;
+		return std::acos(std::min(std::max(cosine, -1.0), 1.0)) * (180.0 / 3.14159265358979323846);
+	}
+
+	struct FilteredError
+	{
+		Uint64 Count = 0;
+		double Mean[3] = {};	// Packed RGB8, octahedral blended then decoded, decoded then blended
+		double Max[3] = {};
+	};
+
+	// Angular error of trilinearly filtered normals at pseudo random points between interior voxels, against the
+	// blend of the corners' unit float gradients. Corners without a gradient are skipped.
+	FilteredError MeasureFilteredError(const Byte* volume, Uint32 width, Uint32 height, Uint32 depth, SurfaceFormat format,
+									   const Byte* packed, const Word* octahedral, Uint64 samples)
+	{
+		FilteredError error;
+		if (width < 4 || height < 4 || depth < 4)
+		{
+			return error;
+		}
+
+		bool wide = BytesPerBlock(format) == 2;
+		auto read = [&](Uint64 index) { return wide ? (double)((const Word*)volume)[index] : (double)volume[index]; };
+		Uint64 row = width;
+		Uint64 slice = (Uint64)width * height;
+		Uint64 state = 0x9E3779B97F4A7C15ull;
+		auto random = [&]() { state = state * 6364136223846793005ull + 1442695040888963407ull; return (double)(state >> 11) * (1.0 / 9007199254740992.0); };
+
+		for (Uint64 sample = 0; sample < samples; sample++)
+		{
+			// Low corner in [1, size - 3] so every corner's central difference stays inside.
+			Uint64 x = 1 + (Uint64)(random() * (width - 3));
+			Uint64 y = 1 + (Uint64)(random() * (height - 3));
+			Uint64 z = 1 + (Uint64)(random() * (depth - 3));
+			double t[3] = { random(), random(), random() };
+
+			double reference[3] = {}, rgb[3] = {}, bytes[2] = {}, decoded[3] = {};
+			bool complete = true;
+			for (int i = 0; i < 8 && complete; i++)
+			{
+				int dx = i & 1, dy = (i >> 1) & 1, dz = i >> 2;
+				double weight = (dx ? t[0] : 1.0 - t[0]) * (dy ? t[1] : 1.0 - t[1]) * (dz ? t[2] : 1.0 - t[2]);
+				Uint64 index = (z + dz) * slice + (y + dy) * row + x + dx;
+				double gradient[3] = { read(index + 1) - read(index - 1), read(index + row) - read(index - row), read(index + slice) - read(index - slice) };
+				double length = std::sqrt(gradient[0] * gradient[0] + gradient[1] * gradient[1] + gradient[2] * gradient[2]);
+				complete = length > 0.0;
+
+				float n[3];
+				OctahedralNormals::DecodeOne(octahedral[index], n[0], n[1], n[2]);
+				for (int axis = 0; axis < 3; axis++)
+				{
+					reference[axis] += weight * gradient[axis] / std::max(length, 1e-30);
+					rgb[axis] += weight * (packed[index * 4 + axis] * (2.0 / 255.0) - 1.0);
+					decoded[axis] += weight * n[axis];
+				}
+				bytes[0] += weight * (octahedral[index] & 0xFF);
+				bytes[1] += weight * (octahedral[index] >> 8);
+			}
+
+			if (complete == false)
+			{
+				continue;
+			}
+
+			double blended[3];
+			DecodeBytes(bytes[0], bytes[1], blended);
+			const double degrees[3] = { DegreesBetween(reference, rgb), DegreesBetween(reference, blended), DegreesBetween(reference, decoded) };
+			for (int method = 0; method < 3; method++)
+			{
+				error.Mean[method] += degrees[method];
+				error.Max[method] = std::max(error.Max[method], degrees[method]);
+			}
+			error.Count++;
+		}
+
+		for (int method = 0; method < 3; method++)
+		{
+			error.Mean[method] /= std::max(error.Count, (Uint64)1);
+		}
+		return error;
+	}
+
+	void PutWord(std::vector<Byte>& out, Uint32 value)
+	{
+		out.push_back((Byte)value);
+		out.push_back((Byte)(value >> 8));
+	}
+
+	// One little endian data element, the value padded to an even length. The meta group is explicit VR either way.
+	void PutElement(std::vector<Byte>& out, bool explicitVR, Uint32 tag, const char* vr, const void* value, Uint32 length)
+	{
+		const bool binary = vr[0] == 'O';
+		const Uint32 padded = (length + 1) & ~1u;
+		PutWord(out, tag >> 16);
+		PutWord(out, tag & 0xFFFF);
+		if (explicitVR || (tag >> 16) == 0x0002)
+		{
+			out.push_back((Byte)vr[0]);
+			out.push_back((Byte)vr[1]);
+			if (binary)
+			{
+				PutWord(out, 0);
+				PutWord(out, padded);
+				PutWord(out, padded >> 16);
+			}
+			else
+			{
+				PutWord(out, padded);
+			}
+		}
+		else
+		{
+			PutWord(out, padded);
+			PutWord(out, padded >> 16);
+		}
+
+		out.insert(out.end(), (const Byte*)value, (const Byte*)value + length);
+		if (padded != length)
+		{
+			out.push_back(binary || (vr[0] == 'U' && vr[1] == 'I') ? 0 : ' ');
+		}
+	}
+
+	void PutString(std::vector<Byte>& out, bool explicitVR, Uint32 tag, const char* vr, const std::string& value)
+	{
+		PutElement(out, explicitVR, tag, vr, value.c_str(), (Uint32)value.size());
+	}
+
+	void PutShort(std::vector<Byte>& out, bool explicitVR, Uint32 tag, Uint32 value)
+	{
+		const Byte bytes[2] = { (Byte)value, (Byte)(value >> 8) };
+		PutElement(out, explicitVR, tag, "US", bytes, 2);
+	}
+
+	struct DicomCase
+	{
+		const char* Name;
+		bool		ExplicitVR;
+		Uint32		BitsAllocated;
+		Uint32		BitsStored;
+		bool		Signed;
+		double		Slope;
+		double		Intercept;
+	};
+
+	// Stored value of a voxel in the slice at position index z, within BitsStored and its sign.
+	Int64 DicomValue(const DicomCase& test, Uint32 z, Uint64 voxel)
+	{
+		const Int64 levels = 1ll << test.BitsStored;
+		const Int64 value = (Int64)((z * 211 + voxel * 17) % (Uint64)levels);
+		return test.Signed ? value - levels / 2 : value;
+	}
+}
+
+void VolumeBenchmark::OnGui(VolumeComponent& volume)
+{
+	if (ImGui::Begin("Benchmarks"))
+	{
+		bool hasBricks = volume.m_VolumeBricks.IsValid();
+
+		if (ImGui::Button("Brick Codec") && hasBricks)
+		{
+			RunBrickCodec(volume.m_VolumeBricks);
+		}
+
+		ImGui::SameLine();
+		if (ImGui::Button("Statistics") && hasBricks)
+		{
+			RunStatistics(volume.m_VolumeBricks);
+		}
+
+		ImGui::SameLine();
+		if (ImGui::Button("Normals") && hasBricks)
+		{
+			RunNormals(volume);
+		}
+
+		ImGui::SameLine();
+		if (ImGui::Button("Compact Normals") && hasBricks)
+		{
+			RunCompactNormals(volume.m_VolumeBricks);
+		}
+
+		ImGui::SameLine();
+		if (ImGui::Button("Sidecar") && hasBricks)
+		{
+			RunSidecar(volume.m_VolumeBricks, volume.m_OccupancyGenerator.GetCellSize());
+		}
+
+		ImGui::SameLine();
+		if (ImGui::Button("Occupancy") && volume.m_VolumeMap)
+		{
+			RunOccupancy(volume);
+		}
+
+		ImGui::SameLine();
+		if (ImGui::Button("Intensity Precision") && volume.m_VolumeMap)
+		{
+			RunIntensityPrecision(volume);
+		}
+
+		ImGui::SameLine();
+		if (ImGui::Button("Transfer Edit") && volume.m_VolumeMap)
+		{
+			RunTransferEdit(volume);
+		}
+
+		ImGui::SameLine();
+		if (ImGui::Button("Pre-integration") && volume.m_VolumeMap)
+		{
+			RunPreIntegration(volume.m_TransferFunction);
+		}
+
+		ImGui::SameLine();
+		if (ImGui::Button("Opacity Correction") && volume.m_VolumeMap)
+		{
+			RunOpacityCorrection(volume.m_TransferFunction);
+		}
+
+		ImGui::SameLine();
+		if (ImGui::Button("Traversal") && volume.m_VolumeMap)
+		{
+			RunTraversal(volume);
+		}
+
+		ImGui::SameLine();
+		if (ImGui::Button("CPU Raycaster") && hasBricks && volume.m_VolumeMap)
+		{
+			RunRaycaster(volume);
+		}
+
+		ImGui::SameLine();
+		if (ImGui::Button("Paging") && hasBricks && volume.m_BrickPager.IsValid())
+		{
+			RunPaging(volume);
+		}
+
+		ImGui::SameLine();
+		if (ImGui::Button("Large File"))
+		{
+			RunLargeFile();
+		}
+
+		ImGui::SameLine();
+		if (ImGui::Button("DICOM"))
+		{
+			RunDicom();
+		}
+
+		ImGui::SameLine();
+		if (ImGui::Button("Clear"))
+		{
+			Clear();
+		}
+
+		if (hasBricks == false)
+		{
+			ImGui::Text("Load a volume to run benchmarks.");
+		}
+
+		ImGui::Separator();
+		for (const std::string& line : m_Results)
+		{
+			ImGui::TextUnformatted(line.c_str());
+		}
+	}
+	ImGui::End();
+}
+
+void VolumeBenchmark::Clear()
+{
+	m_Results.clear();
+}
+
+void VolumeBenchmark::RunBrickCodec(const VolumeBricks& bricks)
+{
+	char line[256];
+	Uint64 volumeBytes = (Uint64)bricks.GetWidth() * bricks.GetHeight() * bricks.GetDepth() * BytesPerBlock(bricks.GetFormat());
+	Uint64 paddedBytes = bricks.GetPaddedBrickByteCount() * bricks.GetBrickCount();
+	Uint64 storedBytes = bricks.GetStoredByteCount();
+
+	snprintf(line, sizeof(line), "Brick Codec: %u bricks, %.1f MB raw, %.1f MB stored", bricks.GetBrickCount(),
+		volumeBytes / (1024.0 * 1024.0), storedBytes / (1024.0 * 1024.0));
+	Report(line);
+	snprintf(line, sizeof(line), "  ratio %.2fx vs raw, %.2fx vs padded bricks",
+		(double)volumeBytes / storedBytes, (double)paddedBytes / storedBytes);
+	Report(line);
+
+	std::vector<Byte> volume((size_t)volumeBytes);
+	for (Uint32 threads : ThreadCounts())
+	{
+		// Best of three, the first pass also pulls the file into the OS cache.
+		double best = 1e30;
+		for (int run = 0; run < 3; run++)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			bricks.ReadVolume(&volume[0], threads);
+			best = std::min(best, SecondsSince(start));
+		}
+
+		snprintf(line, sizeof(line), "  %2u threads: %8.2f ms  %6.2f GB/s decoded", threads, best * 1000.0, volumeBytes / best / 1e9);
+		Report(line);
+	}
+}
+
+void VolumeBenchmark::RunStatistics(const VolumeBricks& bricks)
+{
+	char line[256];
+	Uint64 voxelCount = (Uint64)bricks.GetWidth() * bricks.GetHeight() * bricks.GetDepth();
+	Uint64 volumeBytes = voxelCount * BytesPerBlock(bricks.GetFormat());
+
+	std::vector<Byte> volume((size_t)volumeBytes);
+	bricks.ReadVolume(&volume[0]);
+
+	VolumeStats stats = VolumeStatistics::Scan(&volume[0], voxelCount, bricks.GetFormat());
+	snprintf(line, sizeof(line), "Statistics: %.1f MB, min %.1f max %.1f mean %.2f std dev %.2f, %u bins",
+		volumeBytes / (1024.0 * 1024.0), stats.Min, stats.Max, stats.Mean, std::sqrt(stats.Variance), (Uint32)stats.Histogram.size());
+	Report(line);
+
+	Uint32 best = (Uint32)VolumeStatistics::GetSimdLevel();
+	for (Uint32 level = 0; level <= best; level++)
+	{
+		for (Uint32 threads : ThreadCounts())
+		{
+			double fastest = 1e30;
+			for (int run = 0; run < 3; run++)
+			{
+				auto start = std::chrono::high_resolution_clock::now();
+				VolumeStatistics::Scan(&volume[0], voxelCount, bricks.GetFormat(), threads, (SimdLevel)level);
+				fastest = std::min(fastest, SecondsSince(start));
+			}
+
+			snprintf(line, sizeof(line), "  %-6s %2u threads: %8.2f ms  %6.2f GB/s", VolumeStatistics::GetSimdName((SimdLevel)level),
+				threads, fastest * 1000.0, volumeBytes / fastest / 1e9);
+			Report(line);
+		}
+	}
+}
+
+void VolumeBenchmark::RunNormals(VolumeComponent& component)
+{
+	char line[256];
+	const VolumeBricks& bricks = component.m_VolumeBricks;
+	Uint32 width = bricks.GetWidth();
+	Uint32 height = bricks.GetHeight();
+	Uint32 depth = bricks.GetDepth();
+	SurfaceFormat format = bricks.GetFormat();
+	Uint64 voxelCount = (Uint64)width * height * depth;
+
+	if (VolumeNormals::IsSupported(format) == false)
+	{
+		Report("Normals: volume format not supported");
+		return;
+	}
+
+	std::vector<Byte> volume((size_t)(voxelCount * BytesPerBlock(format)));
+	bricks.ReadVolume(&volume[0]);
+	DataRange range = VolumeGenerator::GetDataRange(bricks.GetRange(), format);
+
+	std::vector<Byte> reference((size_t)voxelCount * 4);
+	std::vector<Byte> referenceMagnitude((size_t)voxelCount);
+	auto start = std::chrono::high_resolution_clock::now();
+	VolumeNormals::GenerateReference(&volume[0], width, height, depth, format, range, &reference[0], &referenceMagnitude[0]);
+	double referenceTime = SecondsSince(start);
+
+	snprintf(line, sizeof(line), "Normals: %ux%ux%u, reference %8.2f ms  %7.1f Mvoxels/s", width, height, depth,
+		referenceTime * 1000.0, voxelCount / referenceTime / 1e6);
+	Report(line);
+
+	std::vector<Byte> result((size_t)voxelCount * 4);
+	std::vector<Byte> magnitude((size_t)voxelCount);
+	Uint32 best = (Uint32)VolumeStatistics::GetSimdLevel();
+	for (Uint32 level = 0; level <= best; level++)
+	{
+		for (Uint32 threads : ThreadCounts())
+		{
+			double fastest = 1e30;
+			for (int run = 0; run < 3; run++)
+			{
+				start = std::chrono::high_resolution_clock::now();
+				VolumeNormals::Generate(&volume[0], width, height, depth, format, range, &result[0], &magnitude[0], threads, (SimdLevel)level);
+				fastest = std::min(fastest, SecondsSince(start));
+			}
+
+			Uint64 mismatches = 0;
+			for (size_t i = 0; i < result.size(); i++)
+			{
+				mismatches += result[i] != reference[i];
+			}
+			for (size_t i = 0; i < magnitude.size(); i++)
+			{
+				mismatches += magnitude[i] != referenceMagnitude[i];
+			}
+
+			snprintf(line, sizeof(line), "  %-6s %2u threads: %8.2f ms  %7.1f Mvoxels/s  %s", VolumeStatistics::GetSimdName((SimdLevel)level),
+				threads, fastest * 1000.0, voxelCount / fastest / 1e6, mismatches == 0 ? "matches" : "MISMATCH");
+			Report(line);
+
+			if (mismatches != 0)
+			{
+				LogWarning("Normals: " + std::to_string(mismatches) + " bytes differ from the reference");
+			}
+		}
+	}
+
+	// The compute shader the CPU path stands in for, through the loader's own call and readback.
+	std::shared_ptr<Texture> source = std::make_shared<Texture>();
+	source->Create3D(width, height, depth, BufferUsage::Immutable, format);
+	memcpy(source->GetData(), &volume[0], volume.size());
+	source->Apply();
+
+	std::shared_ptr<Texture> gpuMagnitude;
+	start = std::chrono::high_resolution_clock::now();
+	std::shared_ptr<Texture> gpu = component.m_VolumeGenerator.GenerateVolume(source, bricks.GetRange(), &gpuMagnitude);
+	double gpuTime = SecondsSince(start);
+	source->Release();
+
+	// A voxel differs when any of its normal, intensity or magnitude bytes do.
+	const Byte* gpuResult = gpu->GetData();
+	const Byte* gpuMagnitudes = gpuMagnitude->GetData();
+	Uint64 mismatchedVoxels = 0;
+	int largest = 0;
+	for (Uint64 voxel = 0; voxel < voxelCount; voxel++)
+	{
+		int difference = std::abs((int)gpuMagnitudes[voxel] - (int)referenceMagnitude[(size_t)voxel]);
+		for (Uint32 channel = 0; channel < 4; channel++)
+		{
+			size_t i = (size_t)voxel * 4 + channel;
+			difference = std::max(difference, std::abs((int)gpuResult[i] - (int)reference[i]));
+		}
+		mismatchedVoxels += difference != 0;
+		largest = std::max(largest, difference);
+	}
+	gpu->Release();
+	gpuMagnitude->Release();
+
+	snprintf(line, sizeof(line), "  GPU compute:        %8.2f ms  %7.1f Mvoxels/s  %s", gpuTime * 1000.0, voxelCount / gpuTime / 1e6,
+		mismatchedVoxels == 0 ? "matches" : "MISMATCH");
+	Report(line);
+
+	if (mismatchedVoxels != 0)
+	{
+		snprintf(line, sizeof(line), "  GPU compute: %llu of %llu voxels differ, by up to %d", (unsigned long long)mismatchedVoxels,
+			(unsigned long long)voxelCount, largest);
+		Report(line);
+		LogWarning("Normals: " + std::to_string(mismatchedVoxels) + " voxels from the compute shader differ from the reference");
+	}
+}
+
+void VolumeBenchmark::RunCompactNormals(const VolumeBricks& bricks)
+{
+	char line[256];
+	Uint32 width = bricks.GetWidth();
+	Uint32 height = bricks.GetHeight();
+	Uint32 depth = bricks.GetDepth();
+	SurfaceFormat format = bricks.GetFormat();
+	Uint64 voxelCount = (Uint64)width * height * depth;
+
+	if (VolumeNormals::IsSupported(format) == false)
+	{
+		Report("Compact Normals: volume format not supported");
+		return;
+	}
+
+	std::vector<Byte> volume((size_t)(voxelCount * BytesPerBlock(format)));
+	bricks.ReadVolume(&volume[0]);
+	DataRange range = VolumeGenerator::GetDataRange(bricks.GetRange(), format);
+
+	// Gradient magnitude is the same R8 volume either way, left out of both.
+	Uint64 packedBytes = voxelCount * 4;
+	Uint64 compactBytes = voxelCount * (BytesPerBlock(format) + sizeof(Word));
+	snprintf(line, sizeof(line), "Compact Normals: packed RGBA8 %.1f MB, intensity + octahedral %.1f MB (%.0f%%), normals %.1f -> %.1f MB",
+		packedBytes / (1024.0 * 1024.0), compactBytes / (1024.0 * 1024.0), 100.0 * compactBytes / packedBytes,
+		voxelCount * 3 / (1024.0 * 1024.0), voxelCount * 2 / (1024.0 * 1024.0));
+	Report(line);
+
+	std::vector<Byte> packed((size_t)voxelCount * 4);
+	std::vector<Byte> intensity((size_t)(voxelCount * BytesPerBlock(format)));
+	std::vector<Word> normals((size_t)voxelCount);
+	std::vector<Word> scalarNormals;
+
+	// Whole pool, best of three.
+	Uint32 best = (Uint32)VolumeStatistics::GetSimdLevel();
+	for (Uint32 level = 0; level <= best; level++)
+	{
+		double packedTime = 1e30, compactTime = 1e30;
+		for (int run = 0; run < 3; run++)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			VolumeNormals::Generate(&volume[0], width, height, depth, format, range, &packed[0], nullptr, 0, (SimdLevel)level);
+			packedTime = std::min(packedTime, SecondsSince(start));
+
+			start = std::chrono::high_resolution_clock::now();
+			VolumeNormals::GenerateCompact(&volume[0], width, height, depth, format, range, &intensity[0], &normals[0], nullptr, 0, (SimdLevel)level);
+			compactTime = std::min(compactTime, SecondsSince(start));
+		}
+
+		// Every level must encode to the same bits.
+		bool matches = true;
+		if (level == 0)
+		{
+			scalarNormals = normals;
+		}
+		else
+		{
+			matches = normals == scalarNormals;
+		}
+
+		snprintf(line, sizeof(line), "  %-6s generate packed %7.1f  compact %7.1f Mvoxels/s  %s", VolumeStatistics::GetSimdName((SimdLevel)level),
+			voxelCount / packedTime / 1e6, voxelCount / compactTime / 1e6, matches ? "matches" : "MISMATCH");
+		Report(line);
+	}
+
+	// The codec alone on a slice of the volume's normals.
+	Uint64 codecCount = std::min(voxelCount, (Uint64)1 << 22);
+	std::vector<float> x((size_t)codecCount), y((size_t)codecCount), z((size_t)codecCount);
+	std::vector<Word> encoded((size_t)codecCount);
+	for (Uint32 level = 0; level <= best; level++)
+	{
+		double decodeTime = 1e30, encodeTime = 1e30;
+		for (int run = 0; run < 3; run++)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			OctahedralNormals::Decode(&normals[0], codecCount, &x[0], &y[0], &z[0], (SimdLevel)level);
+			decodeTime = std::min(decodeTime, SecondsSince(start));
+
+			start = std::chrono::high_resolution_clock::now();
+			OctahedralNormals::Encode(&x[0], &y[0], &z[0], codecCount, &encoded[0], (SimdLevel)level);
+			encodeTime = std::min(encodeTime, SecondsSince(start));
+		}
+
+		snprintf(line, sizeof(line), "  %-6s 1 thread: encode %7.1f  decode %7.1f Mnormals/s", VolumeStatistics::GetSimdName((SimdLevel)level),
+			codecCount / encodeTime / 1e6, codecCount / decodeTime / 1e6);
+		Report(line);
+	}
+
+	VolumeNormals::NormalError packedError, octahedralError;
+	VolumeNormals::MeasureError(&volume[0], width, height, depth, format, &packed[0], &normals[0], packedError, octahedralError);
+	snprintf(line, sizeof(line), "  error vs float gradient over %llu voxels: packed RGB8 mean %.3f max %.3f deg, octahedral mean %.3f max %.3f deg",
+		(unsigned long long)octahedralError.Count, packedError.MeanDegrees, packedError.MaxDegrees, octahedralError.MeanDegrees, octahedralError.MaxDegrees);
+	Report(line);
+
+	// Between voxels, where the sampler filters. Blending the octahedral bytes crosses the folds, decoding each corner first doesn't.
+	FilteredError filtered = MeasureFilteredError(&volume[0], width, height, depth, format, &packed[0], &normals[0], (Uint64)1 << 20);
+	snprintf(line, sizeof(line), "  filtered over %llu samples: packed RGB8 mean %.3f max %.3f, octahedral blend then decode mean %.3f max %.3f, "
+		"decode then blend mean %.3f max %.3f deg", (unsigned long long)filtered.Count, filtered.Mean[0], filtered.Max[0], filtered.Mean[1],
+		filtered.Max[1], filtered.Mean[2], filtered.Max[2]);
+	Report(line);
+}
+
+void VolumeBenchmark::RunSidecar(const VolumeBricks& bricks, const Uint32 cellSize[3])
+{
+	char line[256];
+	if (VolumeNormals::IsSupported(bricks.GetFormat()) == false)
+	{
+		Report("Sidecar: volume format not supported");
+		return;
+	}
+
+	std::shared_ptr<Texture> source = std::make_shared<Texture>();
+	source->Create3D(bricks.GetWidth(), bricks.GetHeight(), bricks.GetDepth(), BufferUsage::Immutable, bricks.GetFormat());
+	bricks.ReadVolume(source->GetData());
+
+	Uint64 voxelCount = (Uint64)source->GetWidth() * source->GetHeight() * source->GetDepth();
+	Uint64 byteCount = voxelCount * BytesPerBlock(source->GetFormat());
+	snprintf(line, sizeof(line), "Sidecar: %.1f MB of voxels", byteCount / (1024.0 * 1024.0));
+	Report(line);
+
+	Uint64 hash = 0;
+	double hashTime = 0;	// Whole pool, the last count
+	for (Uint32 threads : ThreadCounts())
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		Uint64 threadHash = VolumeSidecar::HashContent(source->GetData(), byteCount, threads);
+		hashTime = SecondsSince(start);
+
+		snprintf(line, sizeof(line), "  hash %2u threads:  %8.2f ms  %6.2f GB/s  %s", threads, hashTime * 1000.0, byteCount / hashTime / 1e9,
+			hash == 0 || threadHash == hash ? "matches" : "MISMATCH");
+		Report(line);
+		hash = threadHash;
+	}
+
+	// Everything a cold load derives on the worker with the sidecar on (packed layout).
+	auto start = std::chrono::high_resolution_clock::now();
+	VolumeStats stats = VolumeStatistics::Scan(source->GetData(), voxelCount, source->GetFormat());
+	double scanTime = SecondsSince(start);
+
+	std::shared_ptr<Texture> gradient;
+	start = std::chrono::high_resolution_clock::now();
+	std::shared_ptr<Texture> volumeMap = VolumeGenerator::GenerateVolumeCPU(source, Vector2((float)stats.Min, (float)stats.Max), &gradient);
+	double generateTime = SecondsSince(start);
+
+	std::vector<Word> ranges;
+	start = std::chrono::high_resolution_clock::now();
+	VolumeOccupancy::ComputeCellRanges(volumeMap, gradient, cellSize, ranges);
+	double rangeTime = SecondsSince(start);
+
+	double coldTime = scanTime + generateTime + rangeTime;
+	snprintf(line, sizeof(line), "  cold: scan %.2f + gradients %.2f + cell ranges %.2f = %.2f ms", scanTime * 1000.0, generateTime * 1000.0,
+		rangeTime * 1000.0, coldTime * 1000.0);
+	Report(line);
+
+	// A scratch sidecar beside the real one, removed after.
+	std::string path = VolumeSidecar::GetPath(bricks.GetFilePath()) + ".bench";
+	VolumeSidecar sidecar;
+	sidecar.Reset(source, hash);
+	sidecar.SetStats(stats);
+	sidecar.SetCellRanges(cellSize, volumeMap->GetFormat(), ranges);
+	sidecar.SetVolumes(VolumeLayout::Packed, volumeMap, gradient, nullptr);
+
+	start = std::chrono::high_resolution_clock::now();
+	bool saved = sidecar.Save(path);
+	double saveTime = SecondsSince(start);
+
+	VolumeSidecar cached;
+	start = std::chrono::high_resolution_clock::now();
+	bool loaded = saved && cached.Load(path, source, hash);
+	double loadTime = SecondsSince(start);
+	BaseFile::Remove(path);
+
+	bool matches = loaded && cached.GetStats().Min == stats.Min && cached.GetStats().Max == stats.Max &&
+				   cached.GetStats().Histogram == stats.Histogram && cached.HasCellRanges(cellSize, volumeMap->GetFormat()) &&
+				   cached.GetCellRanges() == ranges && cached.HasVolumes(VolumeLayout::Packed) &&
+				   memcmp(cached.GetVolumeMap()->GetData(), volumeMap->GetData(), (size_t)(voxelCount * 4)) == 0 &&
+				   memcmp(cached.GetGradientMap()->GetData(), gradient->GetData(), (size_t)voxelCount) == 0;
+
+	// Just written, so the read is from the file cache, a first start after boot pays the disk too.
+	snprintf(line, sizeof(line), "  warm: hash %.2f + read %.2f ms (%.1fx faster), written in %.2f ms  %s", hashTime * 1000.0, loadTime * 1000.0,
+		coldTime / std::max(hashTime + loadTime, 1e-9), saveTime * 1000.0, matches ? "matches" : "MISMATCH");
+	Report(line);
+}
+
+void VolumeBenchmark::RunOccupancy(VolumeComponent& volume)
+{
+	char line[256];
+	VolumeOccupancy& occupancy = volume.m_OccupancyGenerator;
+	const int runs = 10;
+
+	// The one off part, paid at load.
+	auto start = std::chrono::high_resolution_clock::now();
+	occupancy.BuildCellRanges(volume.m_VolumeMap, volume.m_GradientMap);
+	double buildTime = SecondsSince(start);
+
+	snprintf(line, sizeof(line), "Occupancy: %llu cells, cell ranges built in %.2f ms", (unsigned long long)occupancy.GetCellCount(), buildTime * 1000.0);
+	Report(line);
+
+	// GPU dispatch plus readback, what every edit used to cost.
+	double rescanTime = 0;
+	for (int run = 0; run < runs; run++)
+	{
+		start = std::chrono::high_resolution_clock::now();
+		occupancy.GenerateVolumeGrid(volume.m_VolumeMap, volume.m_GradientMap, volume.m_TransferFunction.GetDiffuseTransfer());
+		rescanTime += SecondsSince(start);
+	}
+
+	std::shared_ptr<Texture> map = occupancy.GetOccupancyTexture();
+	std::vector<Byte> rescan(map->GetData(), map->GetData() + map->GetByteCount());
+	snprintf(line, sizeof(line), "  full rescan:          %8.3f ms per edit", rescanTime / runs * 1000.0);
+	Report(line);
+
+	for (Uint32 threads : ThreadCounts())
+	{
+		double classifyTime = 0;
+		for (int run = 0; run < runs; run++)
+		{
+			start = std::chrono::high_resolution_clock::now();
+			occupancy.Classify(volume.m_TransferFunction, threads);
+			classifyTime += SecondsSince(start);
+		}
+
+		Uint64 mismatches = 0;
+		for (size_t i = 0; i < rescan.size(); i++)
+		{
+			mismatches += map->GetData()[i] != rescan[i];
+		}
+
+		snprintf(line, sizeof(line), "  classify %2u threads:  %8.3f ms per edit  %.0fx  %s", threads, classifyTime / runs * 1000.0,
+			rescanTime / classifyTime, mismatches == 0 ? "matches" : "MISMATCH");
+		Report(line);
+	}
+
+	// A drag edits a few bins, the cells that can see them are found by bucket and redone.
+	// Same transfer function, so the map must come out as it went in.
+	const Uint32 spans[] = { 8, 32, 128 };
+	for (Uint32 span : spans)
+	{
+		Uint32 first = (volume.m_TransferFunction.GetIntensityBins() - span) / 2;
+		Uint64 touched = 0;
+		double reclassifyTime = 0;
+		for (int run = 0; run < runs; run++)
+		{
+			start = std::chrono::high_resolution_clock::now();
+			touched = occupancy.Reclassify(volume.m_TransferFunction, first, first + span - 1);
+			reclassifyTime += SecondsSince(start);
+		}
+
+		Uint64 mismatches = 0;
+		for (size_t i = 0; i < rescan.size(); i++)
+		{
+			mismatches += map->GetData()[i] != rescan[i];
+		}
+
+		snprintf(line, sizeof(line), "  reclassify %3u bins:  %8.3f ms per edit  %5.1f%% of cells  %s", span, reclassifyTime / runs * 1000.0,
+			100.0 * touched / std::max(occupancy.GetCellCount(), (Uint64)1), mismatches == 0 ? "matches" : "MISMATCH");
+		Report(line);
+	}
+}
+
+void VolumeBenchmark::RunIntensityPrecision(VolumeComponent& volume)
+{
+	char line[256];
+	VolumeOccupancy& occupancy = volume.m_OccupancyGenerator;
+	TransferFunction& transfer = volume.m_TransferFunction;
+	if (occupancy.HasCellRanges() == false)
+	{
+		Report("Intensity Precision: no cell ranges");
+		return;
+	}
+
+	// Bytes per voxel on the GPU, the R8 gradient magnitude comes with every layout.
+	std::shared_ptr<Texture> map = volume.m_VolumeMap;
+	Uint64 voxelCount = (Uint64)map->GetWidth() * map->GetHeight() * map->GetDepth();
+	const double mb = 1.0 / (1 << 20);
+	snprintf(line, sizeof(line), "Intensity Precision: %llu voxels, loaded as %s", (unsigned long long)voxelCount,
+		map->GetFormat() == SurfaceFormat::R16_Unorm ? "split 16 bit" : map->GetFormat() == SurfaceFormat::R8_Unorm ? "split 8 bit" : "packed");
+	Report(line);
+	snprintf(line, sizeof(line), "  packed RGBA8 %.1f MB, split R8 + R8G8 %.1f MB, split R16 + R8G8 %.1f MB, gradient R8 %.1f MB on top",
+		voxelCount * 4 * mb, voxelCount * 3 * mb, voxelCount * 4 * mb, voxelCount * mb);
+	Report(line);
+	snprintf(line, sizeof(line), "  cell ranges %.2f MB (%llu cells, 8 bytes each)", occupancy.GetCellCount() * 8 * mb,
+		(unsigned long long)occupancy.GetCellCount());
+	Report(line);
+
+	// The LUT width is all that changes, the cells and their ranges stay as built.
+	const int runs = 10;
+	const Uint32 binCounts[] = { TransferFunction::IntensityBins, TransferFunction::HighResolutionBins, TransferFunction::MaxIntensityBins };
+	Uint32 loadedBins = transfer.GetIntensityBins();
+	for (Uint32 bins : binCounts)
+	{
+		transfer.SetIntensityBins(bins);
+
+		double classifyTime = 0;
+		for (int run = 0; run < runs; run++)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			occupancy.Classify(transfer);
+			classifyTime += SecondsSince(start);
+		}
+
+		Uint64 occupied = 0;
+		std::shared_ptr<Texture> grid = occupancy.GetOccupancyTexture();
+		Uint64 cells = occupancy.GetCellCount();
+		for (Uint64 cell = 0; cell < cells; cell++)
+		{
+			occupied += grid->GetData()[cell] != 0;
+		}
+
+		Uint64 lutBytes = (Uint64)bins * TransferFunction::GradientBins * 4 + (Uint64)bins * 2;
+		snprintf(line, sizeof(line), "  %5u bins: LUT %7.2f MB  classify %8.3f ms  %7.1f Mcells/s  %5.1f%% occupied", bins, lutBytes * mb,
+			classifyTime / runs * 1000.0, cells / (classifyTime / runs) / 1e6, 100.0 * occupied / std::max(cells, (Uint64)1));
+		Report(line);
+	}
+
+	transfer.SetIntensityBins(loadedBins);
+	occupancy.Classify(transfer);
+	transfer.ClearDirtyRange();
+}
+
+void VolumeBenchmark::RunTransferEdit(VolumeComponent& volume)
+{
+	char line[256];
+	TransferFunction& transfer = volume.m_TransferFunction;
+	const std::vector<TransferNode> nodes = transfer.GetNodes();
+	if (nodes.size() < 3)
+	{
+		Report("Transfer Edit: needs a node between the end nodes to drag");
+		return;
+	}
+
+	// Drags the middle node back and forth between its neighbours, as the editor would.
+	const size_t dragged = nodes.size() / 2;
+	const Uint32 low = nodes[dragged - 1].GetIntensity();
+	const Uint32 high = nodes[dragged + 1].GetIntensity();
+	const Uint32 room = high > low + 1 ? high - low - 1 : 1;
+	auto dragTo = [&](int step)
+	{
+		std::vector<TransferNode> edited = nodes;
+		edited[dragged].SetIntensity(std::min(low + 1 + (Uint32)step % room, high));
+		edited[dragged].SetOpacity((step % 10) / 10.0f);
+		transfer.SetNodes(edited);
+	};
+
+	snprintf(line, sizeof(line), "Transfer Edit: node %u of %u, dragged over intensity %u to %u (CPU bake and upload submit, not GPU time)",
+		(Uint32)dragged, (Uint32)nodes.size(), low, high);
+	Report(line);
+
+	const int runs = 100;
+	const Uint32 binCounts[] = { 256, 1024, 4096, 16384 };
+	Uint32 loadedBins = transfer.GetIntensityBins();
+	for (Uint32 bins : binCounts)
+	{
+		transfer.SetIntensityBins(bins);
+
+		double fullTime = 0;
+		for (int run = 0; run < runs; run++)
+		{
+			dragTo(run);
+			auto start = std::chrono::high_resolution_clock::now();
+			transfer.GenerateTransferFunction(true);
+			fullTime += SecondsSince(start);
+		}
+		Uint64 fullBytes = transfer.GetBakedBytes();
+
+		double partialTime = 0;
+		Uint64 partialBins = 0;
+		Uint64 partialBytes = 0;
+		for (int run = 0; run < runs; run++)
+		{
+			dragTo(run + 1);
+			auto start = std::chrono::high_resolution_clock::now();
+			transfer.GenerateTransferFunction();
+			partialTime += SecondsSince(start);
+			partialBins += transfer.GetBakedBinCount();
+			partialBytes += transfer.GetBakedBytes();
+		}
+
+		// A partial bake after a run of them must leave the LUTs as a full one would.
+		std::shared_ptr<Texture> diffuse = transfer.GetDiffuseTransfer();
+		std::shared_ptr<Texture> surface = transfer.GetSurfaceTransfer();
+		std::vector<Byte> diffuseBytes(diffuse->GetData(), diffuse->GetData() + (size_t)bins * TransferFunction::GradientBins * 4);
+		std::vector<Byte> surfaceBytes(surface->GetData(), surface->GetData() + (size_t)bins * 2);
+		transfer.GenerateTransferFunction(true);
+		bool matches = memcmp(diffuseBytes.data(), diffuse->GetData(), diffuseBytes.size()) == 0 &&
+			memcmp(surfaceBytes.data(), surface->GetData(), surfaceBytes.size()) == 0;
+
+		snprintf(line, sizeof(line), "  %5u bins: full %7.3f ms %7.1f KB  partial %7.3f ms %7.1f KB (%6.1f bins)  %5.1fx  %s", bins,
+			fullTime / runs * 1000.0, fullBytes / 1024.0, partialTime / runs * 1000.0, partialBytes / (double)runs / 1024.0,
+			partialBins / (double)runs, fullTime / std::max(partialTime, 1e-9), matches ? "matches" : "MISMATCH");
+		Report(line);
+	}
+
+	transfer.SetNodes(nodes);
+	transfer.SetIntensityBins(loadedBins);
+	transfer.GenerateTransferFunction(true);
+	if (volume.m_OccupancyGenerator.HasCellRanges())
+	{
+		volume.m_OccupancyGenerator.Classify(transfer);
+	}
+	transfer.ClearDirtyRange();
+}
+
+void VolumeBenchmark::RunPreIntegration(const TransferFunction& transfer)
+{
+	char line[256];
+	const Uint32 size = TransferFunction::PreIntegratedSize;
+	std::vector<float> color;
+	std::vector<float> opacity;
+	transfer.GetIntegrationSamples(size, color, opacity);
+
+	// The worst entry the table may be off by, in 1/255. Opacity is exact up to rounding, colour is composited in pieces.
+	const double alphaTolerance = 1.0;
+	const double colorTolerance = 3.0;
+	const Uint32 subSteps = 1024;
+
+	snprintf(line, sizeof(line), "Pre-integration: %ux%u table, errors in 1/255 against compositing %u pieces a segment (pass at alpha %.1f, colour %.1f)",
+		size, size, subSteps, alphaTolerance, colorTolerance);
+	Report(line);
+
+	// Longer segments are fewer samples a ray, 2 and 4 halve and quarter the sample count.
+	const float stepScales[] = { 1.0f, 2.0f, 4.0f };
+	std::vector<Byte> built((size_t)size * size * 4);
+	std::vector<Byte> table((size_t)size * size * 4);
+	std::vector<float> reference((size_t)size * size * 4);
+	for (float stepScale : stepScales)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		PreIntegration::BuildReference(&color[0], &opacity[0], size, stepScale, &reference[0], subSteps);
+		double integrateTime = SecondsSince(start);
+
+		PreIntegration::Build(&color[0], &opacity[0], size, stepScale, &built[0], 1, SimdLevel::Scalar);
+
+		// The table against the integral, and classifying the front sample alone as a plain raymarch does.
+		double tableError[2] = { 0, 0 };
+		double tableMax[2] = { 0, 0 };
+		double pointError[2] = { 0, 0 };
+		double pointMax[2] = { 0, 0 };
+		for (Uint32 front = 0; front < size; front++)
+		{
+			float alpha = 1.0f - std::pow(1.0f - std::min(opacity[front], PreIntegration::MaxOpacity), stepScale);
+			for (Uint32 back = 0; back < size; back++)
+			{
+				size_t index = ((size_t)front * size + back) * 4;
+				for (Uint32 c = 0; c < 4; c++)
+				{
+					Uint32 kind = c == 3 ? 1 : 0;
+					double exact = reference[index + c] * 255.0;
+					double point = (c == 3 ? alpha : alpha * color[(size_t)front * 3 + c]) * 255.0;
+					double error = std::fabs(built[index + c] - exact);
+					tableError[kind] += error;
+					tableMax[kind] = std::max(tableMax[kind], error);
+					pointError[kind] += std::fabs(point - exact);
+					pointMax[kind] = std::max(pointMax[kind], std::fabs(point - exact));
+				}
+			}
+		}
+
+		double entries = (double)size * size;
+		snprintf(line, sizeof(line), "  step x%.0f: reference %8.2f ms", stepScale, integrateTime * 1000.0);
+		Report(line);
+		bool passed = tableMax[1] <= alphaTolerance && tableMax[0] <= colorTolerance;
+		snprintf(line, sizeof(line), "    table  alpha mean %6.2f max %6.2f  colour mean %6.2f max %6.2f  %s", tableError[1] / entries, tableMax[1],
+			tableError[0] / (entries * 3), tableMax[0], passed ? "passes" : "FAILS");
+		Report(line);
+		if (passed == false)
+		{
+			LogWarning("Pre-integration: table off the reference by more than the tolerance at step x" + std::to_string((int)stepScale));
+		}
+		snprintf(line, sizeof(line), "    point  alpha mean %6.2f max %6.2f  colour mean %6.2f max %6.2f", pointError[1] / entries, pointMax[1],
+			pointError[0] / (entries * 3), pointMax[0]);
+		Report(line);
+
+		// Every level and thread count gives the scalar table's bytes.
+		Uint32 best = (Uint32)VolumeStatistics::GetSimdLevel();
+		for (Uint32 level = 0; level <= best; level++)
+		{
+			for (Uint32 threads : ThreadCounts())
+			{
+				double fastest = 1e30;
+				for (int run = 0; run < 5; run++)
+				{
+					start = std::chrono::high_resolution_clock::now();
+					PreIntegration::Build(&color[0], &opacity[0], size, stepScale, &table[0], threads, (SimdLevel)level);
+					fastest = std::min(fastest, SecondsSince(start));
+				}
+
+				bool matches = table == built;
+				snprintf(line, sizeof(line), "    %-6s %2u threads: %8.3f ms  %7.1f Mentries/s  %s", VolumeStatistics::GetSimdName((SimdLevel)level),
+					threads, fastest * 1000.0, entries / fastest / 1e6, matches ? "matches" : "MISMATCH");
+				Report(line);
+			}
+		}
+	}
+}
+
+void VolumeBenchmark::RunOpacityCorrection(TransferFunction& transfer)
+{
+	char line[256];
+	const Uint32 bins = transfer.GetIntensityBins();
+	const Uint32 row = TransferFunction::GradientBins - 1;	// Full gradient weight
+	const float rayLength = 128.0f;							// Base steps to cross every bin once
+
+	// Front to back over a ray whose intensity rises through the whole LUT, a sample every spacing base steps.
+	auto composite = [&](const Byte* lut, float spacing, float rgba[4])
+	{
+		rgba[0] = rgba[1] = rgba[2] = rgba[3] = 0.0f;
+		for (float t = 0.0f; t < rayLength; t += spacing)
+		{
+			Uint32 bin = std::min((Uint32)(t / rayLength * bins), bins - 1);
+			const Byte* texel = lut + ((size_t)row * bins + bin) * 4;
+			float alpha = texel[3] / 255.0f;
+			for (Uint32 c = 0; c < 3; c++)
+			{
+				rgba[c] += (1.0f - rgba[3]) * alpha * texel[c] / 255.0f;
+			}
+			rgba[3] += (1.0f - rgba[3]) * alpha;
+		}
+	};
+
+	float reference[4];
+	composite(transfer.GetDiffuseTransfer()->GetData(), 1.0f, reference);
+	snprintf(line, sizeof(line), "Opacity Correction: %u bins, ray of %.0f base steps, x1 gives %.3f %.3f %.3f alpha %.3f", bins, rayLength,
+		reference[0], reference[1], reference[2], reference[3]);
+	Report(line);
+
+	const int runs = 20;
+	for (Uint32 slot = 0; slot < TransferFunction::StepSlots; slot++)
+	{
+		float multiplier = transfer.GetStepMultiplier(slot);
+		if (multiplier == 1.0f)
+		{
+			continue;
+		}
+
+		// Same spacing back in, so the slot ends as it was.
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int run = 0; run < runs; run++)
+		{
+			transfer.SetStepMultiplier(slot, multiplier);
+		}
+		double deriveTime = SecondsSince(start) / runs;
+
+		float corrected[4];
+		float plain[4];
+		composite(transfer.GetCorrectedDiffuse(slot)->GetData(), multiplier, corrected);
+		composite(transfer.GetDiffuseTransfer()->GetData(), multiplier, plain);
+
+		double correctedError = 0;
+		double plainError = 0;
+		for (Uint32 c = 0; c < 4; c++)
+		{
+			correctedError = std::max(correctedError, (double)std::fabs(corrected[c] - reference[c]) * 255.0);
+			plainError = std::max(plainError, (double)std::fabs(plain[c] - reference[c]) * 255.0);
+		}
+
+		snprintf(line, sizeof(line), "  x%-4.2g re-derive %7.3f ms  %6.0f samples  corrected off by %6.2f/255, uncorrected %6.2f/255",
+			multiplier, deriveTime * 1000.0, std::ceil(rayLength / multiplier), correctedError, plainError);
+		Report(line);
+	}
+}
+
+void VolumeBenchmark::RunTraversal(VolumeComponent& volume)
+{
+	char line[256];
+	std::vector<TextureLevel> levels = volume.m_OccupancyGenerator.GetLevels();
+	if (levels.empty())
+	{
+		Report("Traversal: no occupancy map");
+		return;
+	}
+
+	// Same test as the ESS shader, occupancy >= iso value.
+	Byte threshold = (Byte)std::min(std::ceil(volume.m_VolumeData.IsoValue * 255.0f), 255.0f);
+	const Uint32 rayCount = 65536;
+
+	// The same rays for every level.
+	std::vector<Vector3> origins, directions;
+	Vector3 size((float)levels[0].width, (float)levels[0].height, (float)levels[0].depth);
+	OccupancyTraversal::MakeRays(size, rayCount, 1234, origins, directions);
+
+	snprintf(line, sizeof(line), "Traversal: %ux%ux%u cells, %u mips, threshold %u, %u rays", levels[0].width, levels[0].height,
+		levels[0].depth, (Uint32)levels.size(), (Uint32)threshold, rayCount);
+	Report(line);
+
+	Uint64 plainSteps = 0;
+	std::vector<OccupancyTraversal::TraceResult> plain(rayCount);
+	for (Uint32 maxLevel = 0; maxLevel < levels.size(); maxLevel++)
+	{
+		Uint64 steps = 0, fetches = 0, mismatches = 0;
+		auto start = std::chrono::high_resolution_clock::now();
+		for (Uint32 i = 0; i < rayCount; i++)
+		{
+			OccupancyTraversal::TraceResult result = OccupancyTraversal::Trace(levels, origins[i], directions[i], threshold, maxLevel);
+			steps += result.Steps;
+			fetches += result.Fetches;
+
+			if (maxLevel == 0)
+			{
+				plain[i] = result;
+			}
+			else
+			{
+				mismatches += result.Occupied != plain[i].Occupied || result.Hash != plain[i].Hash;
+			}
+		}
+		double time = SecondsSince(start);
+
+		if (maxLevel == 0)
+		{
+			plainSteps = steps;
+		}
+
+		snprintf(line, sizeof(line), "  up to mip %u (%3u cells): %7.2f steps  %7.2f fetches per ray  %5.1f%% of plain  %7.2f ms  %s",
+			maxLevel, 1u << maxLevel, (double)steps / rayCount, (double)fetches / rayCount, 100.0 * steps / std::max(plainSteps, (Uint64)1),
+			time * 1000.0, mismatches == 0 ? "matches" : "MISMATCH");
+		Report(line);
+	}
+
+	// Distance field, rebuilt per thread count as a transfer edit would.
+	const VolumeOccupancy& occupancy = volume.m_OccupancyGenerator;
+	std::vector<Byte> field;
+	for (Uint32 threads : ThreadCounts())
+	{
+		double best = 1e30;
+		for (int run = 0; run < 3; run++)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			occupancy.BuildDistanceField(field, threads);
+			best = std::min(best, SecondsSince(start));
+		}
+
+		snprintf(line, sizeof(line), "  distance field %2u threads: %8.2f ms", threads, best * 1000.0);
+		Report(line);
+	}
+
+	// Against the plain DDA at the distance field's own threshold, any opacity.
+	TextureLevel distance;
+	distance.ptr = &field[0];
+	distance.width = levels[0].width;
+	distance.height = levels[0].height;
+	distance.depth = levels[0].depth;
+	distance.byteCount = field.size();
+	Uint64 anySteps = 0, distanceSteps = 0, mismatches = 0;
+	auto start = std::chrono::high_resolution_clock::now();
+	for (Uint32 i = 0; i < rayCount; i++)
+	{
+		OccupancyTraversal::TraceResult result = OccupancyTraversal::TraceDistance(distance, origins[i], directions[i]);
+		OccupancyTraversal::TraceResult reference = OccupancyTraversal::Trace(levels, origins[i], directions[i], 1, 0);
+		distanceSteps += result.Steps;
+		anySteps += reference.Steps;
+		mismatches += result.Occupied != reference.Occupied || result.Hash != reference.Hash;
+	}
+	double time = SecondsSince(start);
+
+	snprintf(line, sizeof(line), "  distance field: %7.2f steps per ray, plain %7.2f at threshold 1, %5.1f%% of plain  %7.2f ms  %s",
+		(double)distanceSteps / rayCount, (double)anySteps / rayCount, 100.0 * distanceSteps / std::max(anySteps, (Uint64)1),
+		time * 1000.0, mismatches == 0 ? "matches" : "MISMATCH");
+	Report(line);
+}
+
+void VolumeBenchmark::RunRaycaster(VolumeComponent& volume)
+{
+	char line[256];
+	const VolumeBricks& bricks = volume.m_VolumeBricks;
+	Uint32 width = bricks.GetWidth();
+	Uint32 height = bricks.GetHeight();
+	Uint32 depth = bricks.GetDepth();
+	SurfaceFormat format = bricks.GetFormat();
+	Uint64 voxelCount = (Uint64)width * height * depth;
+
+	std::vector<TextureLevel> levels = volume.m_OccupancyGenerator.GetLevels();
+	if (VolumeNormals::IsSupported(format) == false || levels.empty())
+	{
+		Report("CPU Raycaster: volume format not supported or no occupancy map");
+		return;
+	}
+
+	// The GPU copies aren't kept on the CPU, the same volume is generated again from the bricks.
+	std::vector<Byte> source((size_t)(voxelCount * BytesPerBlock(format)));
+	bricks.ReadVolume(&source[0]);
+	DataRange range = VolumeGenerator::GetDataRange(bricks.GetRange(), format);
+
+	RaycastVolume scene;
+	scene.Width = width;
+	scene.Height = height;
+	scene.Depth = depth;
+	scene.Layout = volume.m_MaterialLayout;
+
+	std::vector<Byte> packed, intensity, magnitude((size_t)voxelCount);
+	std::vector<Word> normals;
+	if (scene.Layout == VolumeLayout::Packed)
+	{
+		packed.resize((size_t)voxelCount * 4);
+		VolumeNormals::Generate(&source[0], width, height, depth, format, range, &packed[0], &magnitude[0]);
+		scene.Packed = &packed[0];
+	}
+	else
+	{
+		intensity.resize((size_t)(voxelCount * BytesPerBlock(format)));
+		normals.resize((size_t)voxelCount);
+		VolumeNormals::GenerateCompact(&source[0], width, height, depth, format, range, &intensity[0], &normals[0], &magnitude[0]);
+		scene.Intensity = &intensity[0];
+		scene.Wide = BytesPerBlock(format) == 2;
+		scene.Normals = &normals[0];
+	}
+	source.clear();
+	source.shrink_to_fit();
+
+	TransferFunction& transfer = volume.m_TransferFunction;
+	scene.Gradient = &magnitude[0];
+	scene.Occupancy = levels[0];
+	memcpy(scene.CellSize, volume.m_OccupancyGenerator.GetCellSize(), sizeof(scene.CellSize));
+	scene.Diffuse = transfer.GetDiffuseTransfer()->GetData();
+	scene.Surface = transfer.GetSurfaceTransfer()->GetData();
+	scene.IntensityBins = transfer.GetIntensityBins();
+	scene.GradientBins = TransferFunction::GradientBins;
+
+	VolumeRaycaster raycaster;
+	if (raycaster.SetVolume(scene) == false)
+	{
+		Report("CPU Raycaster: volume views incomplete");
+		return;
+	}
+
+	const Uint32 imageSize = 512;
+	const char* methods[] = { "MIP", "Alpha", "PBR", "PBR_ESS" };
+	RaycastCamera camera;
+	RaycastSettings settings;
+	settings.IsoValue = volume.m_VolumeData.IsoValue;
+	settings.AlphaAmount = volume.m_VolumeData.AlphaAmount;
+
+	snprintf(line, sizeof(line), "CPU Raycaster: %ux%ux%u %s, %ux%u image, %u bins, %u pool threads", width, height, depth,
+		scene.Layout == VolumeLayout::Packed ? "packed" : "split", imageSize, imageSize, scene.IntensityBins, ThreadPool::Instance().GetThreadCount() + 1);
+	Report(line);
+
+	// Best of three on the whole pool, each method per SIMD level against one ray at a time.
+	std::vector<float> image, scalarImage;
+	Uint32 best = (Uint32)VolumeStatistics::GetSimdLevel();
+	for (Uint32 method = 0; method < 4; method++)
+	{
+		settings.Method = (VolumeMethod)method;
+		double scalarTime = 0;
+		for (Uint32 level = 0; level <= best; level++)
+		{
+			RaycastStats fastest;
+			fastest.Seconds = 1e30;
+			for (int run = 0; run < 3; run++)
+			{
+				RaycastStats stats = raycaster.Render(camera, settings, imageSize, imageSize, image, (SimdLevel)level);
+				if (stats.Seconds < fastest.Seconds)
+				{
+					fastest = stats;
+				}
+			}
+
+			// Packets must give the same image as single rays, bit for bit.
+			bool matches = true;
+			if (level == 0)
+			{
+				scalarImage = image;
+				scalarTime = fastest.Seconds;
+			}
+			else
+			{
+				matches = image == scalarImage;
+			}
+
+			snprintf(line, sizeof(line), "  %-7s %-6s %8.2f ms  %7.3f Mrays/s  %8.2f Msamples/s  %7.1f samples/ray  %5.1f%% terminated  %5.2fx  %s",
+				methods[method], VolumeStatistics::GetSimdName((SimdLevel)level), fastest.Seconds * 1000.0, fastest.Rays / fastest.Seconds / 1e6,
+				fastest.Samples / fastest.Seconds / 1e6, (double)fastest.Samples / std::max(fastest.Rays, (Uint64)1),
+				100.0 * fastest.Terminated / std::max(fastest.Rays, (Uint64)1), scalarTime / fastest.Seconds, matches ? "matches" : "MISMATCH");
+			Report(line);
+		}
+	}
+
+	settings.Method = VolumeMethod::PBR;
+	for (Uint32 threads : ThreadCounts())
+	{
+		settings.MaxThreads = threads;
+		double fastest = 1e30;
+		RaycastStats stats;
+		for (int run = 0; run < 3; run++)
+		{
+			stats = raycaster.Render(camera, settings, imageSize, imageSize, image);
+			fastest = std::min(fastest, stats.Seconds);
+		}
+
+		snprintf(line, sizeof(line), "  PBR %-6s %2u threads: %8.2f ms  %7.3f Mrays/s  %8.2f Msamples/s", VolumeStatistics::GetSimdName((SimdLevel)best),
+			threads, fastest * 1000.0, stats.Rays / fastest / 1e6, stats.Samples / fastest / 1e6);
+		Report(line);
+	}
+
+	RunEdgeCell();
+}
+
+void VolumeBenchmark::RunEdgeCell()
+{
+	// 41 voxels in 4 voxel cells is 10.25 cells of volume on an 11 cell grid. An opaque slab at x = 39
+	// sits in cell 9 alone, the walk has to map the ray over the 10.25 cells to find it there.
+	const Uint32 size = 41;
+	const Uint32 cell = 4;
+	const Uint32 cells = (size + cell - 1) / cell;
+	const Uint64 voxelCount = (Uint64)size * size * size;
+	const SurfaceFormat format = SurfaceFormat::R8_Uint;
+
+	std::vector<Byte> source((size_t)voxelCount, 0);
+	for (Uint64 i = 0; i < voxelCount; i++)
+	{
+		source[(size_t)i] = i % size == 39 ? 255 : 0;
+	}
+	std::vector<Byte> packed((size_t)voxelCount * 4), magnitude((size_t)voxelCount);
+	VolumeNormals::Generate(&source[0], size, size, size, format, VolumeGenerator::GetDataRange(Vector2(0, 255), format), &packed[0], &magnitude[0]);
+
+	std::vector<Byte> occupancy((size_t)cells * cells * cells, 0);
+	for (size_t i = 0; i < occupancy.size(); i++)
+	{
+		occupancy[i] = i % cells == 9 ? 255 : 0;
+	}
+
+	// Opaque white over the top half of the intensities, at every gradient.
+	const Uint32 bins = TransferFunction::IntensityBins;
+	std::vector<Byte> diffuse((size_t)bins * TransferFunction::GradientBins * 4, 0);
+	std::vector<Byte> surface((size_t)bins * 2, 128);
+	for (size_t texel = 0; texel < (size_t)bins * TransferFunction::GradientBins; texel++)
+	{
+		memset(&diffuse[texel * 4], texel % bins >= bins / 2 ? 255 : 0, 4);
+	}
+
+	RaycastVolume scene;
+	scene.Width = size;
+	scene.Height = size;
+	scene.Depth = size;
+	scene.Packed = &packed[0];
+	scene.Gradient = &magnitude[0];
+	scene.Occupancy.ptr = &occupancy[0];
+	scene.Occupancy.width = cells;
+	scene.Occupancy.height = cells;
+	scene.Occupancy.depth = cells;
+	scene.Occupancy.byteCount = occupancy.size();
+	scene.CellSize[0] = scene.CellSize[1] = scene.CellSize[2] = cell;
+	scene.Diffuse = &diffuse[0];
+	scene.Surface = &surface[0];
+	scene.IntensityBins = bins;
+	scene.GradientBins = TransferFunction::GradientBins;
+
+	VolumeRaycaster raycaster;
+	raycaster.SetVolume(scene);
+
+	// Looking down +x at the slab, PBR marches every step so it's what ESS should agree with.
+	const Uint32 imageSize = 64;
+	RaycastCamera camera;
+	camera.Position = Vector3(-3, 0, 0);
+	RaycastSettings settings;
+	settings.Jitter = false;
+	std::vector<float> pbr, ess;
+	settings.Method = VolumeMethod::PBR;
+	raycaster.Render(camera, settings, imageSize, imageSize, pbr);
+	settings.Method = VolumeMethod::PBR_ESS;
+	raycaster.Render(camera, settings, imageSize, imageSize, ess);
+
+	// A pixel PBR finds the slab in and ESS walks past.
+	Uint32 missed = 0;
+	for (size_t pixel = 0; pixel < pbr.size(); pixel += 4)
+	{
+		if (pbr[pixel + 3] >= 0.5f && ess[pixel + 3] < 0.5f * pbr[pixel + 3])
+		{
+			missed++;
+		}
+	}
+
+	size_t centre = ((size_t)(imageSize / 2) * imageSize + imageSize / 2) * 4 + 3;
+	char line[256];
+	snprintf(line, sizeof(line), "  ESS edge cell (%u^3, %u voxel cells, slab at x = 39): centre alpha PBR %d PBR_ESS %d, %u pixels missed  %s",
+		size, cell, (int)(pbr[centre] * 255.0f + 0.5f), (int)(ess[centre] * 255.0f + 0.5f), missed,
+		pbr[centre] >= 0.5f && missed == 0 ? "matches" : "MISMATCH");
+	Report(line);
+}
+
+void VolumeBenchmark::Report(const std::string& line)
+{
+	LogInfo(line);
+	m_Results.push_back(line);
+}
+
+std::vector<Uint32> VolumeBenchmark::ThreadCounts()
+{
+	Uint32 maxThreads = ThreadPool::Instance().GetThreadCount() + 1;
+	std::vector<Uint32> counts;
+	for (Uint32 count = 1; count < maxThreads; count *= 2)
+	{
+		counts.push_back(count);
+	}
+	counts.push_back(maxThreads);
+	return counts;
+}
+
+void VolumeBenchmark::RunPaging(VolumeComponent& volume)
+{
+	char line[256];
+	const VolumeBricks& bricks = volume.m_VolumeBricks;
+	BrickPager& pager = volume.m_BrickPager;
+	SurfaceFormat format = bricks.GetFormat();
+	if (VolumeNormals::IsSupported(format) == false)
+	{
+		Report("Paging: volume format not supported");
+		return;
+	}
+
+	std::shared_ptr<Texture> source = std::make_shared<Texture>();
+	source->Create3D(bricks.GetWidth(), bricks.GetHeight(), bricks.GetDepth(), BufferUsage::Immutable, format);
+	bricks.ReadVolume(source->GetData());
+	Uint64 voxelCount = (Uint64)source->GetWidth() * source->GetHeight() * source->GetDepth();
+	const Uint32* cellSize = volume.m_OccupancyGenerator.GetCellSize();
+
+	snprintf(line, sizeof(line), "Paging: %u bricks of %u, %.1f MB budget", bricks.GetBrickCount(), bricks.GetBrickSize(),
+		pager.GetBudget() / (1024.0 * 1024.0));
+	Report(line);
+	pager.ResetStats();
+
+	// Statistics, integer formats must match exactly.
+	VolumeStats dense = VolumeStatistics::Scan(source->GetData(), voxelCount, format);
+	auto start = std::chrono::high_resolution_clock::now();
+	VolumeStats paged = VolumeStatistics::Scan(pager);
+	double scanTime = SecondsSince(start);
+	bool statsMatch = paged.Min == dense.Min && paged.Max == dense.Max && paged.Count == dense.Count && paged.Histogram == dense.Histogram &&
+					  std::abs(paged.Mean - dense.Mean) <= 1e-9 * std::max(std::abs(dense.Mean), 1.0) &&
+					  std::abs(paged.Variance - dense.Variance) <= 1e-9 * std::max(dense.Variance, 1.0);
+	snprintf(line, sizeof(line), "  statistics:  %8.2f ms  %s", scanTime * 1000.0, statsMatch ? "matches" : "MISMATCH");
+	Report(line);
+
+	// Pyramid, every level of both reductions.
+	VolumePyramid densePyramid;
+	densePyramid.Build(source);
+	VolumePyramid pagedPyramid;
+	start = std::chrono::high_resolution_clock::now();
+	bool pyramidMatch = pagedPyramid.Build(pager) && pagedPyramid.GetLevelCount() == densePyramid.GetLevelCount();
+	double pyramidTime = SecondsSince(start);
+	for (Uint32 level = 1; pyramidMatch && level < densePyramid.GetLevelCount(); level++)
+	{
+		pyramidMatch = pagedPyramid.GetLevel(level).Intensity == densePyramid.GetLevel(level).Intensity &&
+					   pagedPyramid.GetLevel(level).Occupancy == densePyramid.GetLevel(level).Occupancy;
+	}
+	snprintf(line, sizeof(line), "  pyramid:     %8.2f ms  %s", pyramidTime * 1000.0, pyramidMatch ? "matches" : "MISMATCH");
+	Report(line);
+
+	// Both layouts, the cell ranges from the paged pass against ComputeCellRanges over the dense result.
+	Vector2 range((float)dense.Min, (float)dense.Max);
+	for (Uint32 layout = 0; layout < 2; layout++)
+	{
+		std::shared_ptr<Texture> denseVolume, denseNormals, denseGradient, pagedVolume, pagedNormals, pagedGradient;
+		std::vector<Word> denseRanges, pagedRanges;
+		double generateTime = 0;
+		if (layout == (Uint32)VolumeLayout::Split)
+		{
+			VolumeGenerator::GenerateCompactVolumeCPU(source, range, denseVolume, denseNormals, &denseGradient);
+			start = std::chrono::high_resolution_clock::now();
+			VolumeGenerator::GenerateCompactVolumeCPU(pager, range, pagedVolume, pagedNormals, &pagedGradient, cellSize, &pagedRanges);
+			generateTime = SecondsSince(start);
+		}
+		else
+		{
+			denseVolume = VolumeGenerator::GenerateVolumeCPU(source, range, &denseGradient);
+			start = std::chrono::high_resolution_clock::now();
+			pagedVolume = VolumeGenerator::GenerateVolumeCPU(pager, range, &pagedGradient, cellSize, &pagedRanges);
+			generateTime = SecondsSince(start);
+		}
+		VolumeOccupancy::ComputeCellRanges(denseVolume, denseGradient, cellSize, denseRanges);
+
+		bool volumeMatch = memcmp(pagedVolume->GetData(), denseVolume->GetData(), (size_t)denseVolume->GetByteCount()) == 0 &&
+						   memcmp(pagedGradient->GetData(), denseGradient->GetData(), (size_t)denseGradient->GetByteCount()) == 0 &&
+						   (denseNormals == nullptr || memcmp(pagedNormals->GetData(), denseNormals->GetData(), (size_t)denseNormals->GetByteCount()) == 0);
+		bool rangesMatch = pagedRanges == denseRanges;
+		snprintf(line, sizeof(line), "  %-6s gradients + cell ranges: %8.2f ms  volumes %s, ranges %s", layout == 0 ? "packed" : "split",
+			generateTime * 1000.0, volumeMatch ? "match" : "MISMATCH", rangesMatch ? "match" : "MISMATCH");
+		Report(line);
+	}
+
+	BrickPagerStats stats = pager.GetStats();
+	snprintf(line, sizeof(line), "  pager: peak %.1f MB of %.1f MB, %llu hits, %llu misses, %llu prefetched, %llu evicted",
+		stats.PeakBytes / (1024.0 * 1024.0), stats.BudgetBytes / (1024.0 * 1024.0), (unsigned long long)stats.Hits,
+		(unsigned long long)stats.Misses, (unsigned long long)stats.Prefetches, (unsigned long long)stats.Evictions);
+	Report(line);
+}
+
+void VolumeBenchmark::RunLargeFile()
+{
+	char line[256];
+
+	// 2048 x 2048 x 1025 R8, 4 MiB past 4 GiB so every count and offset needs the upper 32 bits.
+	const Uint32 width = 2048;
+	const Uint32 height = 2048;
+	const Uint32 depth = 1025;
+	const Uint64 byteCount = (Uint64)width * height * depth;
+	const Uint64 blockSize = 64 * 1024;
+	const Uint64 offsets[] = { 0, (1ull << 31) - blockSize / 2, (1ull << 32) - blockSize / 2, byteCount - blockSize };
+	const Uint64 holeOffset = 3ull << 30;
+
+	std::string path = "LargeFile.bench.raw";
+	std::string metaPath = path + ".meta";
+	std::vector<Byte> expected(blockSize);
+	std::vector<Byte> read(blockSize);
+
+	// Only the marker blocks are written, the rest stays a hole so the check costs a few hundred KB of disk.
+	auto start = std::chrono::high_resolution_clock::now();
+	BinaryFile output(path.c_str(), FileMode::Write);
+	bool written = output.IsOpen();
+	bool sparse = written && output.SetSparse();
+	for (Uint64 offset : offsets)
+	{
+		FillMarker(expected.data(), blockSize, offset);
+		written = written && output.Seek((Int64)offset) && output.Tell() == offset;
+		written = written && output.WriteBuffer(expected.data(), blockSize);
+	}
+	output.Close();
+	double writeTime = SecondsSince(start);
+
+	File meta(metaPath.c_str(), FileMode::Write);
+	std::string metaText = "Width=" + std::to_string(width) + "\nHeight=" + std::to_string(height) + "\nDepth=" + std::to_string(depth) +
+						   "\nNumDims=3\nFormat=Uint8\n";
+	written = written && meta.IsOpen() && meta.Write(metaText.c_str(), (Uint32)metaText.size());
+	meta.Close();
+
+	if (written == false)
+	{
+		Report("Large File: failed to write " + path);
+		BaseFile::Remove(path);
+		BaseFile::Remove(metaPath);
+		return;
+	}
+
+	// Read back through seek and read.
+	start = std::chrono::high_resolution_clock::now();
+	BinaryFile input(path.c_str(), FileMode::Read);
+	Uint64 fileSize = input.GetSize();
+	bool fileMatches = fileSize == byteCount;
+	for (Uint64 offset : offsets)
+	{
+		FillMarker(expected.data(), blockSize, offset);
+		fileMatches = fileMatches && input.Seek((Int64)offset) && input.ReadBuffer(read.data(), blockSize) &&
+					  memcmp(read.data(), expected.data(), (size_t)blockSize) == 0;
+	}
+	Byte hole = 0xFF;
+	fileMatches = fileMatches && input.Seek((Int64)holeOffset) && input.ReadBuffer(&hole, 1) && hole == 0;
+	input.Close();
+	double readTime = SecondsSince(start);
+
+	snprintf(line, sizeof(line), "Large File: %llu bytes (%.3f GiB), %s, written in %.2f ms", (unsigned long long)byteCount,
+		byteCount / (1024.0 * 1024.0 * 1024.0), sparse ? "sparse" : "not sparse", writeTime * 1000.0);
+	Report(line);
+	snprintf(line, sizeof(line), "  BinaryFile: size %llu, %u blocks read in %.2f ms  %s", (unsigned long long)fileSize,
+		(Uint32)(sizeof(offsets) / sizeof(offsets[0])), readTime * 1000.0, fileMatches ? "matches" : "MISMATCH");
+	Report(line);
+
+	// The same file as a raw volume, mapped rather than read so only the touched pages come in.
+	start = std::chrono::high_resolution_clock::now();
+	Texture texture;
+	texture.LoadFromFile(path, false);
+	double loadTime = SecondsSince(start);
+
+	Uint64 textureBytes = texture.GetByteCount();
+	bool textureMatches = texture.GetData() != nullptr && textureBytes == byteCount &&
+						  texture.GetWidth() == width && texture.GetHeight() == height && texture.GetDepth() == depth;
+	for (Uint64 offset : offsets)
+	{
+		FillMarker(expected.data(), blockSize, offset);
+		textureMatches = textureMatches && memcmp(texture.GetData() + offset, expected.data(), (size_t)blockSize) == 0;
+	}
+	textureMatches = textureMatches && texture.GetData()[holeOffset] == 0;
+
+	snprintf(line, sizeof(line), "  Texture: %u x %u x %u, %llu bytes, %s in %.2f ms  %s", texture.GetWidth(), texture.GetHeight(),
+		texture.GetDepth(), (unsigned long long)textureBytes, texture.IsMapped() ? "mapped" : "read", loadTime * 1000.0,
+		textureMatches ? "matches" : "MISMATCH");
+	Report(line);
+
+	// The mapping keeps the file open.
+	texture.Release();
+
+	BaseFile::Remove(path);
+	BaseFile::Remove(metaPath);
+}
+
+void VolumeBenchmark::RunDicom()
+{
+	char line[256];
+
+	// 7 x 5 so 8 bit slices have an odd byte count and the pixel data gets padded. The slices step 2.5 mm
+	// along an oblique normal, SliceThickness says 5 so spacing has to come from the positions.
+	const Uint32 width = 7;
+	const Uint32 height = 5;
+	const Uint32 depth = 6;
+	const Uint64 sliceVoxels = (Uint64)width * height;
+	const double pixelSpacing[2] = { 0.7, 0.6 };	// Rows (y), columns (x)
+	const double sliceSpacing = 2.5;
+	const double origin[3] = { -10.0, 20.0, 30.0 };
+	const double normal[3] = { 0.0, -0.6, 0.8 };	// Row (1, 0, 0) x column (0, 0.8, 0.6)
+	const DicomCase cases[] =
+	{
+		{ "implicit VR, 8 bit", false, 8, 8, false, 2.0, -100.0 },
+		{ "implicit VR, 16 bit", false, 16, 12, true, 1.0, -1024.0 },
+		{ "explicit VR, 8 bit", true, 8, 7, true, 0.5, 10.0 },
+		{ "explicit VR, 16 bit", true, 16, 16, false, 1.5, -1024.0 },
+	};
+	const Uint32 caseCount = sizeof(cases) / sizeof(cases[0]);
+
+	// Every case is its own series in one folder, Open has to keep to the series of the file it's given.
+	std::string directory = "DicomSeries.bench";
+	if (File::MakeDirectory(directory) == false)
+	{
+		Report("DICOM: failed to create " + directory);
+		return;
+	}
+
+	std::vector<std::string> paths;
+	bool written = true;
+	for (Uint32 c = 0; c < caseCount; c++)
+	{
+		const DicomCase& test = cases[c];
+		const Uint32 bpv = test.BitsAllocated / 8;
+
+		// Written in a shuffled order under shuffled names, with instance numbers that disagree with the positions.
+		std::vector<Uint32> order(depth);
+		for (Uint32 z = 0; z < depth; z++)
+		{
+			order[z] = (z * 5 + c) % depth;
+		}
+
+		for (Uint32 z : order)
+		{
+			std::vector<Byte> file(128, 0);
+			file.insert(file.end(), { 'D', 'I', 'C', 'M' });
+			PutString(file, true, 0x00020010, "UI", test.ExplicitVR ? "1.2.840.10008.1.2.1" : "1.2.840.10008.1.2");
+
+			char text[128];
+			const bool e = test.ExplicitVR;
+			PutString(file, e, 0x00180050, "DS", "5");
+			PutString(file, e, 0x0020000E, "UI", "1.2.826.0.1.3680043.2.1125.9." + std::to_string(c));
+			PutString(file, e, 0x00200013, "IS", std::to_string((z * 5 + 3) % depth + 1));
+			snprintf(text, sizeof(text), "%.4f\\%.4f\\%.4f", origin[0] + z * sliceSpacing * normal[0], origin[1] + z * sliceSpacing * normal[1],
+				origin[2] + z * sliceSpacing * normal[2]);
+			PutString(file, e, 0x00200032, "DS", text);
+			PutString(file, e, 0x00200037, "DS", "1\\0\\0\\0\\0.8\\0.6");
+			PutShort(file, e, 0x00280002, 1);
+			PutShort(file, e, 0x00280010, height);
+			PutShort(file, e, 0x00280011, width);
+			snprintf(text, sizeof(text), "%g\\%g", pixelSpacing[0], pixelSpacing[1]);
+			PutString(file, e, 0x00280030, "DS", text);
+			PutShort(file, e, 0x00280100, test.BitsAllocated);
+			PutShort(file, e, 0x00280101, test.BitsStored);
+			PutShort(file, e, 0x00280103, test.Signed ? 1 : 0);
+			snprintf(text, sizeof(text), "%g", test.Intercept);
+			PutString(file, e, 0x00281052, "DS", text);
+			snprintf(text, sizeof(text), "%g", test.Slope);
+			PutString(file, e, 0x00281053, "DS", text);
+
+			// Bits above BitsStored are set, the reader has to clear them.
+			std::vector<Byte> pixels((size_t)(sliceVoxels * bpv));
+			const Uint32 mask = (1u << test.BitsStored) - 1;
+			for (Uint64 voxel = 0; voxel < sliceVoxels; voxel++)
+			{
+				Uint32 raw = ((Uint32)DicomValue(test, z, voxel) & mask) | (0xFFFFu & ~mask);
+				memcpy(&pixels[(size_t)(voxel * bpv)], &raw, bpv);
+			}
+			PutElement(file, e, 0x7FE00010, bpv == 2 ? "OW" : "OB", pixels.data(), (Uint32)pixels.size());
+
+			std::string path = directory + "/case" + std::to_string(c) + "_" + std::to_string((z * 7 + 2) % depth) + ".dcm";
+			written = BinaryFile::Save(path.c_str(), file.data(), file.size()) && written;
+			paths.push_back(path);
+		}
+	}
+
+	if (written)
+	{
+		snprintf(line, sizeof(line), "DICOM: %u series of %u x %u x %u, slices written shuffled", caseCount, width, height, depth);
+		Report(line);
+	}
+	else
+	{
+		Report("DICOM: failed to write the series to " + directory);
+	}
+
+	for (Uint32 c = 0; c < caseCount && written; c++)
+	{
+		const DicomCase& test = cases[c];
+		const Uint32 bpv = test.BitsAllocated / 8;
+		DicomSeries series;
+		bool opened = series.Open(paths[c * depth]) && series.GetWidth() == width && series.GetHeight() == height && series.GetDepth() == depth &&
+					  series.GetFormat() == (bpv == 2 ? SurfaceFormat::R16_Uint : SurfaceFormat::R8_Uint);
+
+		// Slices in position order, signed values offset to unsigned.
+		std::vector<Byte> volume((size_t)(sliceVoxels * depth * bpv)), expected(volume.size());
+		for (Uint32 z = 0; z < depth; z++)
+		{
+			for (Uint64 voxel = 0; voxel < sliceVoxels; voxel++)
+			{
+				Uint32 value = (Uint32)(DicomValue(test, z, voxel) + (test.Signed ? 1ll << (test.BitsAllocated - 1) : 0));
+				memcpy(&expected[(size_t)((z * sliceVoxels + voxel) * bpv)], &value, bpv);
+			}
+		}
+		bool ordered = opened && series.ReadVolume(volume.data()) && volume == expected;
+
+		Vector3 spacing = series.GetSpacing();
+		bool spaced = opened && std::fabs(spacing.x - pixelSpacing[1]) < 1e-4 && std::fabs(spacing.y - pixelSpacing[0]) < 1e-4 &&
+					  std::fabs(spacing.z - sliceSpacing) < 1e-3;
+
+		// The signed offset is folded into the intercept.
+		double intercept = test.Intercept - (test.Signed ? test.Slope * (1 << (test.BitsAllocated - 1)) : 0.0);
+		bool rescaled = opened && std::fabs(series.GetRescaleSlope() - test.Slope) < 1e-5 &&
+						std::fabs(series.GetRescaleIntercept() - intercept) < 1e-2;
+
+		bool passed = ordered && spaced && rescaled;
+		snprintf(line, sizeof(line), "  %s%s: order %s, spacing %.3f x %.3f x %.3f mm, rescale %g / %g  %s", test.Name, test.Signed ? " signed" : "",
+			ordered ? "ok" : "wrong", spacing.x, spacing.y, spacing.z, series.GetRescaleSlope(), series.GetRescaleIntercept(), passed ? "passes" : "FAILS");
+		Report(line);
+		if (passed == false)
+		{
+			LogWarning(std::string("DICOM: the ") + test.Name + " series doesn't read back as written");
+		}
+	}
+
+	for (const std::string& path : paths)
+	{
+		BaseFile::Remove(path);
+	}
+	File::DeleteDirectory(directory);
+}
@@ -0,0 +1,75 @@
+//Note:
+/*
+	In app benchmarks for the volume pipeline, run from the Benchmarks window
+	against whatever volume is loaded. Results go to the window and the log.
+*/
+
+#pragma once
+#include "System/Types.h"
+#include <string>
+#include <vector>
+
+class TransferFunction;
+class VolumeBricks;
+class VolumeComponent;
+class VolumeBenchmark
+{
+private:
+	std::vector<std::string> m_Results;
+
+public:
+	void OnGui(VolumeComponent& volume);
+	void Clear();
+
+	// Compression ratio of the brick file and full volume decode speed per thread count.
+	void RunBrickCodec(const VolumeBricks& bricks);
+	// Statistics scan speed per SIMD level and thread count, on the volume decoded from the bricks.
+	void RunStatistics(const VolumeBricks& bricks);
+	// CPU gradient speed per SIMD level and thread count, normals and magnitudes checked byte for byte against the scalar reference,
+	// and the reference against VolumeNormalGen.hlsl read back through VolumeGenerator, voxel by voxel.
+	void RunNormals(VolumeComponent& component);
+	// Memory and generate speed of the packed RGBA8 layout against intensity plus octahedral normals,
+	// the octahedral codec alone per SIMD level, and both layouts' angular error against the float gradient, per voxel
+	// and trilinearly filtered between voxels (octahedral blended as bytes then decoded, and decoded per corner then blended).
+	void RunCompactNormals(const VolumeBricks& bricks);
+	// Content hash speed per thread count, and a cold load's derived data (statistics, CPU gradients, cell ranges)
+	// against reading them back from a sidecar, the read back checked against what was derived.
+	void RunSidecar(const VolumeBricks& bricks, const Uint32 cellSize[3]);
+	// Transfer edit to occupancy update latency, full voxel rescan against reclassifying the cell ranges.
+	void RunOccupancy(VolumeComponent& volume);
+	// Memory of each intensity layout and LUT width, and Classify throughput at 256, 4096 and 16384 bins.
+	void RunIntensityPrecision(VolumeComponent& volume);
+	// Transfer LUT latency of one node drag at each width, a full rebake and upload against rebaking
+	// and uploading only the bins between the dragged node's neighbours, checked against a full bake.
+	void RunTransferEdit(VolumeComponent& volume);
+	// Pre-integrated table error against numerically integrating every segment, passing within a tolerance, next to
+	// classifying the front sample alone, at 1, 2 and 4 base steps a segment, and build speed per SIMD level and thread count.
+	void RunPreIntegration(const TransferFunction& transfer);
+	// Re-derive time of each opacity corrected LUT slot, and how far a ray through every bin composited at the
+	// slot's spacing lands from the base spacing, with the corrected LUT and the plain one.
+	void RunOpacityCorrection(TransferFunction& transfer);
+	// Cell steps per ray for the hierarchical occupancy walk against the plain DDA, up to each mip of the chain,
+	// and for the distance field walk, with the distance field's build time per thread count.
+	void RunTraversal(VolumeComponent& volume);
+	// CPU raycaster megarays and samples per second for each method and SIMD level over the whole pool, packets checked
+	// against single rays pixel for pixel, and PBR per thread count, on the volume generated from the bricks in the
+	// loaded layout with the current transfer function.
+	void RunRaycaster(VolumeComponent& volume);
+	// PBR_ESS against PBR on a synthetic 41^3 volume whose only occupied cell is the last whole one,
+	// the grid's partial cell past it has to leave the cell walk where the shader's is.
+	void RunEdgeCell();
+	// Statistics, pyramid, both gradient layouts and the cell ranges made a brick at a time through the component's
+	// BrickPager, checked against the same passes over the decoded volume, with the pager's peak residency.
+	void RunPaging(VolumeComponent& volume);
+	// Round trip of a sparse raw volume just over 4 GiB, written with BinaryFile, read back through BinaryFile and
+	// a mapped Texture, marker blocks either side of the 2 and 4 GiB boundaries compared and the 64 bit sizes checked.
+	void RunLargeFile();
+	// DicomSeries on synthetic series written slice per file in a shuffled order, implicit and explicit VR at 8 and 16 bit,
+	// signed and unsigned, checked for slice order, spacing from ImagePositionPatient and the rescale slope and intercept.
+	void RunDicom();
+
+private:
+	void Report(const std::string& line);
+	// 1, 2, 4 ... up to every pool worker plus the calling thread.
+	static std::vector<Uint32> ThreadCounts();
+};
@@ -0,0 +1,630 @@
+#include "VolumeBricks.h"
+#include "VolumeStatistics.h"
+#include "Math/Mathf.h"
+#include "System/File.h"
+#include "System/Logger.h"
+#include "System/ThreadPool.h"
+#include <cstring>
+#include <atomic>
+
+// Magic, Version, Width, Height, Depth, Format, BrickSize, Apron, Min, Max, BrickCount, Compression
+static const Uint64 HeaderSize = 12 * sizeof(Dword);
+
+const Dword VolumeBricks::Magic;
+const Dword VolumeBricks::Version;
+
+bool VolumeBricks::Build(std::shared_ptr<Texture> source, const std::string& brickPath, Uint32 brickSize, const ProgressCallback& progress)
+{
+	Release();
+
+	const Byte* data = source->GetData();
+	if (data == nullptr)
+	{
+		LogWarning("Volume can't be bricked, needs resident 8 or 16 bit data: " + brickPath);
+		return false;
+	}
+
+	if (SetLayout(source->GetWidth(), source->GetHeight(), source->GetDepth(), source->GetFormat(), brickSize, brickPath) == false)
+	{
+		return false;
+	}
+
+	// Whole volume range first, the brick histograms are binned against it.
+	Uint64 voxelCount = (Uint64)m_Width * m_Height * m_Depth;
+	VolumeStats stats = VolumeStatistics::Scan(data, voxelCount, m_Format);
+	m_Range = Vector2((float)stats.Min, (float)stats.Max);
+
+	// Every layer is already resident.
+	return Write(brickPath, [data](Uint32, Uint32, Uint32& slabFirst)
+	{
+		slabFirst = 0;
+		return data;
+	}, progress);
+}
+
+bool VolumeBricks::Build(Uint32 width, Uint32 height, Uint32 depth, SurfaceFormat format, const SliceReader& read, const std::string& brickPath,
+						 Uint32 brickSize, const ProgressCallback& progress)
+{
+	Release();
+
+	if (SetLayout(width, height, depth, format, brickSize, brickPath) == false)
+	{
+		return false;
+	}
+
+	// One slab holds a brick layer and its apron slices, the range pass reuses it.
+	Uint64 sliceBytes = (Uint64)m_Width * m_Height * BytesPerBlock(m_Format);
+	Uint32 slabSlices = Mathf::Min((int)(m_BrickSize + 2 * m_Apron), (int)m_Depth);
+	std::vector<Byte> slab((size_t)(sliceBytes * slabSlices));
+
+	// The range pass reads the whole source once, counted as the first quarter of the build.
+	bool first = true;
+	for (Uint32 z = 0; z < m_Depth; z += slabSlices)
+	{
+		Uint32 count = Mathf::Min((int)slabSlices, (int)(m_Depth - z));
+		if (read(z, count, &slab[0]) == false)
+		{
+			LogError("Failed to read the volume slices to brick: " + brickPath);
+			Release();
+			return false;
+		}
+
+		VolumeStats stats = VolumeStatistics::Scan(&slab[0], (Uint64)m_Width * m_Height * count, m_Format);
+		m_Range = first ? Vector2((float)stats.Min, (float)stats.Max) :
+						  Vector2(Mathf::Min(m_Range.x, (float)stats.Min), Mathf::Max(m_Range.y, (float)stats.Max));
+		first = false;
+
+		if (progress && progress(0.25f * (z + count) / m_Depth) == false)
+		{
+			Release();
+			return false;
+		}
+	}
+
+	// Apron slices clamp to the volume, so a layer reads one slice either side where there is one.
+	return Write(brickPath, [&](Uint32 layerFirst, Uint32 layerCount, Uint32& slabFirst) -> const Byte*
+	{
+		slabFirst = layerFirst > m_Apron ? layerFirst - m_Apron : 0;
+		Uint32 slabEnd = Mathf::Min((int)(layerFirst + layerCount + m_Apron), (int)m_Depth);
+		if (read(slabFirst, slabEnd - slabFirst, &slab[0]) == false)
+		{
+			LogError("Failed to read the volume slices to brick: " + brickPath);
+			return nullptr;
+		}
+		return &slab[0];
+	}, [&](float value)
+	{
+		return progress == nullptr || progress(0.25f + 0.75f * value);
+	});
+}
+
+bool VolumeBricks::SetLayout(Uint32 width, Uint32 height, Uint32 depth, SurfaceFormat format, Uint32 brickSize, const std::string& brickPath)
+{
+	Uint32 bpv = BytesPerBlock(format);
+	if ((bpv != 1 && bpv != 2) || brickSize == 0 || width == 0 || height == 0 || depth == 0)
+	{
+		LogWarning("Volume can't be bricked, needs resident 8 or 16 bit data: " + brickPath);
+		return false;
+	}
+
+	m_Width = width;
+	m_Height = height;
+	m_Depth = depth;
+	m_Format = format;
+	m_BrickSize = brickSize;
+	m_Apron = 1;
+	m_Compression = BrickCompression::Rice;
+	m_BricksX = (m_Width + brickSize - 1) / brickSize;
+	m_BricksY = (m_Height + brickSize - 1) / brickSize;
+	m_BricksZ = (m_Depth + brickSize - 1) / brickSize;
+	return true;
+}
+
+bool VolumeBricks::Write(const std::string& brickPath, const LayerSource& layer, const ProgressCallback& progress)
+{
+	ThreadPool& pool = ThreadPool::Instance();
+
+	BinaryFile file(brickPath.c_str(), FileMode::Write);
+	if (file.IsOpen() == false)
+	{
+		LogError("Failed to create brick file: " + brickPath);
+		Release();
+		return false;
+	}
+
+	m_Bricks.resize((size_t)m_BricksX * m_BricksY * m_BricksZ);
+
+	// Any failure takes the partial file with it, a later load must never find half a brick file.
+	auto abandon = [&]()
+	{
+		file.Close();
+		Release();
+		BaseFile::Remove(brickPath);
+		return false;
+	};
+
+	// Table is written twice, a placeholder now and the real one once the stats are known.
+	Uint64 tableBytes = m_Bricks.size() * sizeof(BrickInfo);
+	bool written = file.WriteDword(Magic) && file.WriteDword(Version) && file.WriteDword(m_Width) && file.WriteDword(m_Height) &&
+				   file.WriteDword(m_Depth) && file.WriteDword((Dword)m_Format) && file.WriteDword(m_BrickSize) && file.WriteDword(m_Apron) &&
+				   file.WriteFloat(m_Range.x) && file.WriteFloat(m_Range.y) && file.WriteDword((Dword)m_Bricks.size()) &&
+				   file.WriteDword((Dword)m_Compression) && file.WriteBuffer((Byte*)&m_Bricks[0], tableBytes);
+	if (written == false)
+	{
+		LogError("Failed to write brick file header: " + brickPath);
+		return abandon();
+	}
+
+	Uint32 padded = GetPaddedBrickSize();
+	Uint64 brickBytes = GetPaddedBrickByteCount();
+	float binScale = (m_Range.y > m_Range.x) ? BRICK_HISTOGRAM_BINS / (m_Range.y - m_Range.x) : 0.0f;
+	Uint64 offset = HeaderSize + tableBytes;
+
+	// A layer's bricks are cooked and encoded in batches across the pool, then written in order.
+	Uint32 brickCount = (Uint32)m_Bricks.size();
+	Uint32 layerBricks = m_BricksX * m_BricksY;
+	Uint32 batchSize = (pool.GetThreadCount() + 1) * 4;
+	std::vector<std::vector<Byte>> encoded(batchSize);
+
+	for (Uint32 bz = 0; bz < m_BricksZ; bz++)
+	{
+		Uint32 layerFirst = bz * m_BrickSize;
+		Uint32 slabFirst = 0;
+		const Byte* slab = layer(layerFirst, Mathf::Min((int)m_BrickSize, (int)(m_Depth - layerFirst)), slabFirst);
+		if (slab == nullptr)
+		{
+			return abandon();
+		}
+
+		Uint32 layerEnd = (bz + 1) * layerBricks;
+		for (Uint32 first = bz * layerBricks; first < layerEnd; first += batchSize)
+		{
+			Uint32 count = Mathf::Min((int)batchSize, (int)(layerEnd - first));
+			pool.ParallelFor(count, [&](Uint64 begin, Uint64 end)
+			{
+				std::vector<Byte> brick((size_t)brickBytes);
+				for (Uint64 i = begin; i < end; i++)
+				{
+					CookBrick(first + (Uint32)i, slab, slabFirst, &brick[0], binScale);
+					encoded[(size_t)i].clear();
+					BrickCodec::Encode(&brick[0], padded, m_Format, encoded[(size_t)i]);
+				}
+			}, 1);
+
+			for (Uint32 i = 0; i < count; i++)
+			{
+				BrickInfo& info = m_Bricks[first + i];
+				info.Offset = offset;
+				info.ByteCount = encoded[i].size();
+
+				if (file.WriteBuffer(&encoded[i][0], info.ByteCount) == false)
+				{
+					LogError("Failed to write brick data: " + brickPath);
+					return abandon();
+				}
+
+				offset += info.ByteCount;
+			}
+
+			if (progress && progress((float)(first + count) / brickCount) == false)
+			{
+				return abandon();
+			}
+		}
+	}
+
+	if (file.Seek((Int64)HeaderSize) == false || file.WriteBuffer((Byte*)&m_Bricks[0], tableBytes) == false)
+	{
+		LogError("Failed to write brick table: " + brickPath);
+		return abandon();
+	}
+	file.Close();
+
+	if (Open(brickPath) == false)
+	{
+		BaseFile::Remove(brickPath);
+		return false;
+	}
+	return true;
+}
+
+void VolumeBricks::CookBrick(Uint32 index, const Byte* slab, Uint32 slabFirst, Byte* brick, float binScale)
+{
+	Uint32 bpv = BytesPerBlock(m_Format);
+	Uint32 padded = GetPaddedBrickSize();
+	Uint64 rowBytes = (Uint64)m_Width * bpv;
+	Uint64 sliceBytes = rowBytes * m_Height;
+
+	Uint32 ox, oy, oz;
+	GetBrickOrigin(index, ox, oy, oz);
+
+	// Gather the padded brick, voxels outside the volume clamp to the edge.
+	int firstX = (int)ox - (int)m_Apron;
+	int beginX = Mathf::Max(firstX, 0);
+	int endX = Mathf::Min(firstX + (int)padded, (int)m_Width);
+	for (Uint32 z = 0; z < padded; z++)
+	{
+		Uint32 sz = (Uint32)Mathf::Clamp((int)(oz + z) - (int)m_Apron, 0, (int)m_Depth - 1);
+		for (Uint32 y = 0; y < padded; y++)
+		{
+			Uint32 sy = (Uint32)Mathf::Clamp((int)(oy + y) - (int)m_Apron, 0, (int)m_Height - 1);
+			const Byte* srcRow = slab + (sz - slabFirst) * sliceBytes + sy * rowBytes;
+			Byte* dstRow = brick + (((size_t)z * padded + y) * padded) * bpv;
+
+			for (int x = firstX; x < beginX; x++)
+			{
+				memcpy(dstRow + (x - firstX) * bpv, srcRow, bpv);
+			}
+
+			memcpy(dstRow + (beginX - firstX) * bpv, srcRow + (Uint64)beginX * bpv, (size_t)(endX - beginX) * bpv);
+
+			for (int x = endX; x < firstX + (int)padded; x++)
+			{
+				memcpy(dstRow + (x - firstX) * bpv, srcRow + rowBytes - bpv, bpv);
+			}
+		}
+	}
+
+	BrickInfo& info = m_Bricks[index];
+	info.Min = SampleValue(brick, 0, m_Format);
+	info.Max = info.Min;
+
+	Uint64 paddedCount = (Uint64)padded * padded * padded;
+	for (Uint64 i = 1; i < paddedCount; i++)
+	{
+		float value = SampleValue(brick, i, m_Format);
+		info.Min = Mathf::Min(info.Min, value);
+		info.Max = Mathf::Max(info.Max, value);
+	}
+
+	// Histogram skips the apron and the clamped overhang on edge bricks.
+	Uint32 coreX = Mathf::Min((int)m_BrickSize, (int)(m_Width - ox));
+	Uint32 coreY = Mathf::Min((int)m_BrickSize, (int)(m_Height - oy));
+	Uint32 coreZ = Mathf::Min((int)m_BrickSize, (int)(m_Depth - oz));
+	memset(info.Histogram, 0, sizeof(info.Histogram));
+	for (Uint32 z = 0; z < coreZ; z++)
+	{
+		for (Uint32 y = 0; y < coreY; y++)
+		{
+			Uint64 row = ((Uint64)(z + m_Apron) * padded + (y + m_Apron)) * padded + m_Apron;
+			for (Uint32 x = 0; x < coreX; x++)
+			{
+				float value = SampleValue(brick, row + x, m_Format);
+				int bin = Mathf::Clamp((int)((value - m_Range.x) * binScale), 0, BRICK_HISTOGRAM_BINS - 1);
+				info.Histogram[bin]++;
+			}
+		}
+	}
+}
+
+bool VolumeBricks::Open(const std::string& brickPath)
+{
+	Release();
+
+	// Bricks are pulled in any order, don't let the OS read ahead.
+	if (m_File.Open(brickPath.c_str(), MappedAccess::Random) == false || m_File.GetSize() < HeaderSize)
+	{
+		m_File.Close();
+		return false;
+	}
+
+	const Byte* ptr = m_File.GetData();
+	Dword header[12];
+	memcpy(header, ptr, sizeof(header));
+
+	if (header[0] != Magic || header[1] != Version)
+	{
+		LogWarning("Brick file is out of date: " + brickPath);
+		m_File.Close();
+		return false;
+	}
+
+	m_Width = header[2];
+	m_Height = header[3];
+	m_Depth = header[4];
+	m_Format = (SurfaceFormat)header[5];
+	m_BrickSize = header[6];
+	m_Apron = header[7];
+	memcpy(&m_Range.x, &header[8], sizeof(float));
+	memcpy(&m_Range.y, &header[9], sizeof(float));
+	Uint32 brickCount = header[10];
+	m_Compression = (BrickCompression)header[11];
+
+	// Build only cooks 8 and 16 bit data.
+	Uint32 bpv = BytesPerBlock(m_Format);
+	if (m_Width == 0 || m_Height == 0 || m_Depth == 0 || (bpv != 1 && bpv != 2) || m_BrickSize == 0 || m_BrickSize > MaxBrickSize ||
+		m_Apron > m_BrickSize || (m_Compression != BrickCompression::None && m_Compression != BrickCompression::Rice))
+	{
+		LogError("Brick file header is corrupt: " + brickPath);
+		m_File.Close();
+		return false;
+	}
+
+	m_BricksX = (m_Width + m_BrickSize - 1) / m_BrickSize;
+	m_BricksY = (m_Height + m_BrickSize - 1) / m_BrickSize;
+	m_BricksZ = (m_Depth + m_BrickSize - 1) / m_BrickSize;
+
+	Uint64 tableBytes = (Uint64)brickCount * sizeof(BrickInfo);
+	if (brickCount == 0 || brickCount != (Uint64)m_BricksX * m_BricksY * m_BricksZ || m_File.GetSize() < HeaderSize + tableBytes)
+	{
+		LogError("Brick file header is corrupt: " + brickPath);
+		m_File.Close();
+		return false;
+	}
+
+	m_Bricks.resize(brickCount);
+	memcpy(&m_Bricks[0], ptr + HeaderSize, (size_t)tableBytes);
+
+	// Every entry, not just the last: bricks are written in order after the table, without gaps
+	// or overlap, and must lie inside the file. Compared by subtraction so huge values can't wrap.
+	const Uint64 fileSize = m_File.GetSize();
+	Uint64 next = HeaderSize + tableBytes;
+	for (const BrickInfo& info : m_Bricks)
+	{
+		if (info.Offset != next || info.ByteCount > fileSize - info.Offset || BrickSizeValid(info) == false)
+		{
+			LogError("Brick file table is corrupt or truncated: " + brickPath);
+			Release();
+			return false;
+		}
+		next = info.Offset + info.ByteCount;
+	}
+
+	m_FilePath = brickPath;
+	return true;
+}
+
+bool VolumeBricks::BrickSizeValid(const BrickInfo& info)const
+{
+	// Stored raw a brick is exactly the padded voxels. Compressed it's a method byte and the encoding,
+	// which falls back to raw when that is smaller, so never more than the voxels plus the byte.
+	if (m_Compression == BrickCompression::None)
+	{
+		return info.ByteCount == GetPaddedBrickByteCount();
+	}
+	return info.ByteCount > 0 && info.ByteCount <= GetPaddedBrickByteCount() + 1;
+}
+
+bool VolumeBricks::Open(const std::string& brickPath, std::shared_ptr<Texture> source)
+{
+	if (Open(brickPath) == false)
+	{
+		return false;
+	}
+
+	if (m_Width != source->GetWidth() || m_Height != source->GetHeight() ||
+		m_Depth != source->GetDepth() || m_Format != source->GetFormat())
+	{
+		LogWarning("Brick file does not match its volume, it will be rebuilt: " + brickPath);
+		Release();
+		return false;
+	}
+
+	return true;
+}
+
+void VolumeBricks::Release()
+{
+	m_File.Close();
+	m_Bricks.clear();
+	m_FilePath.clear();
+	m_BricksX = m_BricksY = m_BricksZ = 0;
+}
+
+bool VolumeBricks::IsValid() const
+{
+	return m_File.IsOpen() && m_Bricks.empty() == false;
+}
+
+bool VolumeBricks::ReadBrick(Uint32 index, Byte* data) const
+{
+	if (IsValid() == false || index >= m_Bricks.size())
+	{
+		return false;
+	}
+
+	const BrickInfo& info = m_Bricks[index];
+	const Byte* stored = m_File.GetData() + info.Offset;
+
+	if (m_Compression == BrickCompression::None)
+	{
+		memcpy(data, stored, (size_t)info.ByteCount);
+		return true;
+	}
+
+	return BrickCodec::Decode(stored, info.ByteCount, GetPaddedBrickSize(), m_Format, data);
+}
+
+bool VolumeBricks::ReadVolume(Byte* data, Uint32 maxThreads, const ProgressCallback& progress) const
+{
+	if (IsValid() == false)
+	{
+		return false;
+	}
+
+	Uint32 bpv = BytesPerBlock(m_Format);
+	Uint32 padded = GetPaddedBrickSize();
+	Uint64 rowBytes = (Uint64)m_Width * bpv;
+	Uint64 sliceBytes = rowBytes * m_Height;
+	std::atomic<bool> failed(false);
+	std::atomic<bool> cancelled(false);
+	std::atomic<Uint32> done(0);
+
+	// Bricks cover disjoint parts of the volume so they decode and scatter in parallel.
+	ThreadPool::Instance().ParallelFor(m_Bricks.size(), [&](Uint64 begin, Uint64 end)
+	{
+		std::vector<Byte> brick((size_t)GetPaddedBrickByteCount());
+		for (Uint64 index = begin; index < end && cancelled == false; index++)
+		{
+			if (ReadBrick((Uint32)index, &brick[0]) == false)
+			{
+				failed = true;
+				continue;
+			}
+
+			Uint32 ox, oy, oz, coreX, coreY, coreZ;
+			GetBrickOrigin((Uint32)index, ox, oy, oz);
+			GetBrickCore((Uint32)index, coreX, coreY, coreZ);
+
+			for (Uint32 z = 0; z < coreZ; z++)
+			{
+				for (Uint32 y = 0; y < coreY; y++)
+				{
+					const Byte* src = &brick[0] + (((Uint64)(z + m_Apron) * padded + (y + m_Apron)) * padded + m_Apron) * bpv;
+					Byte* dst = data + (oz + z) * sliceBytes + (oy + y) * rowBytes + (Uint64)ox * bpv;
+					memcpy(dst, src, (size_t)coreX * bpv);
+				}
+			}
+
+			if (progress && progress((float)++done / m_Bricks.size()) == false)
+			{
+				cancelled = true;
+			}
+		}
+	}, 0, maxThreads);
+
+	if (cancelled)
+	{
+		return false;
+	}
+
+	if (failed)
+	{
+		LogError("Brick file has corrupt bricks: " + m_FilePath);
+		return false;
+	}
+
+	return true;
+}
+
+Uint32 VolumeBricks::GetBrickIndex(Uint32 bx, Uint32 by, Uint32 bz) const
+{
+	return (bz * m_BricksY + by) * m_BricksX + bx;
+}
+
+void VolumeBricks::GetBrickOrigin(Uint32 index, Uint32& x, Uint32& y, Uint32& z) const
+{
+	x = (index % m_BricksX) * m_BrickSize;
+	y = ((index / m_BricksX) % m_BricksY) * m_BrickSize;
+	z = (index / (m_BricksX * m_BricksY)) * m_BrickSize;
+}
+
+void VolumeBricks::GetBrickCore(Uint32 index, Uint32& x, Uint32& y, Uint32& z) const
+{
+	Uint32 ox, oy, oz;
+	GetBrickOrigin(index, ox, oy, oz);
+	x = Mathf::Min((int)m_BrickSize, (int)(m_Width - ox));
+	y = Mathf::Min((int)m_BrickSize, (int)(m_Height - oy));
+	z = Mathf::Min((int)m_BrickSize, (int)(m_Depth - oz));
+}
+
+Uint32 VolumeBricks::GetBrickCount() const
+{
+	return (Uint32)m_Bricks.size();
+}
+
+const BrickInfo& VolumeBricks::GetBrick(Uint32 index) const
+{
+	return m_Bricks[index];
+}
+
+Uint32 VolumeBricks::GetBrickSize() const
+{
+	return m_BrickSize;
+}
+
+Uint32 VolumeBricks::GetPaddedBrickSize() const
+{
+	return m_BrickSize + m_Apron * 2;
+}
+
+Uint32 VolumeBricks::GetApron() const
+{
+	return m_Apron;
+}
+
+Uint64 VolumeBricks::GetPaddedBrickByteCount() const
+{
+	Uint64 padded = GetPaddedBrickSize();
+	return padded * padded * padded * BytesPerBlock(m_Format);
+}
+
+Uint64 VolumeBricks::GetStoredByteCount() const
+{
+	Uint64 total = 0;
+	for (const BrickInfo& info : m_Bricks)
+	{
+		total += info.ByteCount;
+	}
+	return total;
+}
+
+Uint32 VolumeBricks::GetBricksX() const
+{
+	return m_BricksX;
+}
+
+Uint32 VolumeBricks::GetBricksY() const
+{
+	return m_BricksY;
+}
+
+Uint32 VolumeBricks::GetBricksZ() const
+{
+	return m_BricksZ;
+}
+
+Uint32 VolumeBricks::GetWidth() const
+{
+	return m_Width;
+}
+
+Uint32 VolumeBricks::GetHeight() const
+{
+	return m_Height;
+}
+
+Uint32 VolumeBricks::GetDepth() const
+{
+	return m_Depth;
+}
+
+SurfaceFormat VolumeBricks::GetFormat() const
+{
+	return m_Format;
+}
+
+Vector2 VolumeBricks::GetRange() const
+{
+	return m_Range;
+}
+
+std::string VolumeBricks::GetFilePath() const
+{
+	return m_FilePath;
+}
+
+const Byte* VolumeBricks::GetFileData() const
+{
+	return m_File.GetData();
+}
+
+Uint64 VolumeBricks::GetFileSize() const
+{
+	return m_File.GetSize();
+}
+
+float VolumeBricks::SampleValue(const Byte* data, Uint64 index, SurfaceFormat format)
+{
+	switch (format)
+	{
+	case SurfaceFormat::R8_Sint:
+		return (float)((const Int8*)data)[index];
+	case SurfaceFormat::R16_Uint:
+		return (float)((const Uint16*)data)[index];
+	case SurfaceFormat::R16_Sint:
+		return (float)((const Int16*)data)[index];
+	default:
+		return (float)data[index];
+	}
+}
@@ -0,0 +1,121 @@
+//Note:
+/*
+	Cooked ".vbrick" copy of a raw volume. The volume is cut into fixed size bricks,
+	each stored contiguously with a one voxel apron so it can be filtered on its own.
+	A table up front holds every brick's offset, min/max and a small histogram, so
+	statistics only need the header and single bricks can be read on demand.
+	Bricks are stored compressed (BrickCodec) and decode independently.
+	Cooking goes a layer of bricks at a time, so a source that can be read a few slices
+	at a time never has to be whole: it's read once for the range the histograms are
+	binned against, then once more a layer and its apron slices at a time.
+
+	Layout: header dwords, BrickInfo table, brick data (x fastest, then y, then z).
+*/
+
+#pragma once
+#include "BrickCodec.h"
+#include "Content/Texture.h"
+#include "Math/Vector2.h"
+#include "System/MappedFile.h"
+#include "System/ThreadPool.h"
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define BRICK_HISTOGRAM_BINS 16
+
+// Fills slices with count slices from first on, Width * Height voxels each. False stops the build.
+typedef std::function<bool(Uint32 first, Uint32 count, Byte* slices)> SliceReader;
+
+struct BrickInfo
+{
+	Uint64 Offset = 0;		// Absolute file offset of the brick data
+	Uint64 ByteCount = 0;	// Stored (compressed) bytes, apron included
+	float  Min = 0.0f;		// Range covers the apron so it is safe for trilinear lookups
+	float  Max = 0.0f;
+	Uint32 Histogram[BRICK_HISTOGRAM_BINS] = {}; // Core voxels only, binned over the volume range
+};
+
+class VolumeBricks
+{
+public:
+	static const Dword Magic = 0x4B524256; // "VBRK"
+	static const Dword Version = 2;
+	static const Uint32 MaxBrickSize = 256;
+
+private:
+	std::string				m_FilePath;
+	MappedFile				m_File;
+	Uint32					m_Width = 0;
+	Uint32					m_Height = 0;
+	Uint32					m_Depth = 0;
+	SurfaceFormat			m_Format = SurfaceFormat::Unkown;
+	Uint32					m_BrickSize = 32;
+	Uint32					m_Apron = 1;
+	BrickCompression		m_Compression = BrickCompression::Rice;
+	Uint32					m_BricksX = 0;
+	Uint32					m_BricksY = 0;
+	Uint32					m_BricksZ = 0;
+	Vector2					m_Range;
+	std::vector<BrickInfo>	m_Bricks;
+
+public:
+	// Cooks source into brickPath and opens the result, the source data must be resident on the CPU.
+	// A cancelled build removes the partial file.
+	bool Build(std::shared_ptr<Texture> source, const std::string& brickPath, Uint32 brickSize = 32, const ProgressCallback& progress = nullptr);
+	// As above from a source read a layer of bricks at a time, at most brickSize + 2 slices are ever resident.
+	bool Build(Uint32 width, Uint32 height, Uint32 depth, SurfaceFormat format, const SliceReader& read, const std::string& brickPath,
+			   Uint32 brickSize = 32, const ProgressCallback& progress = nullptr);
+	// Opens an existing file, only the header and table are touched.
+	bool Open(const std::string& brickPath);
+	// As above but fails if the file was cooked from a volume with different dims or format.
+	bool Open(const std::string& brickPath, std::shared_ptr<Texture> source);
+	void Release();
+	bool IsValid()const;
+
+	// Decodes a padded brick (GetPaddedBrickSize()^3 voxels) into data.
+	bool ReadBrick(Uint32 index, Byte* data)const;
+	// Reassembles the dense volume on the thread pool, data must hold Width * Height * Depth voxels.
+	bool ReadVolume(Byte* data, Uint32 maxThreads = 0, const ProgressCallback& progress = nullptr)const;
+
+	Uint32			 GetBrickIndex(Uint32 bx, Uint32 by, Uint32 bz)const;
+	void			 GetBrickOrigin(Uint32 index, Uint32& x, Uint32& y, Uint32& z)const;
+	// Core voxels of the brick inside the volume, short of the brick size on the far edges.
+	void			 GetBrickCore(Uint32 index, Uint32& x, Uint32& y, Uint32& z)const;
+	Uint32			 GetBrickCount()const;
+	const BrickInfo& GetBrick(Uint32 index)const;
+	Uint32			 GetBrickSize()const;
+	Uint32			 GetPaddedBrickSize()const;
+	Uint32			 GetApron()const;
+	Uint64			 GetPaddedBrickByteCount()const;
+	Uint64			 GetStoredByteCount()const;
+	Uint32			 GetBricksX()const;
+	Uint32			 GetBricksY()const;
+	Uint32			 GetBricksZ()const;
+	Uint32			 GetWidth()const;
+	Uint32			 GetHeight()const;
+	Uint32			 GetDepth()const;
+	SurfaceFormat	 GetFormat()const;
+	Vector2			 GetRange()const;
+	std::string		 GetFilePath()const;
+	// The whole mapped file as stored, header and table included.
+	const Byte*		 GetFileData()const;
+	Uint64			 GetFileSize()const;
+
+private:
+	// Gives the slices [first, first + count) of the source, the pointer is to slice slabFirst. Null on a failed read.
+	typedef std::function<const Byte*(Uint32 first, Uint32 count, Uint32& slabFirst)> LayerSource;
+	// Sets the dims, format and brick grid a build cooks to, false for formats that can't be bricked.
+	bool SetLayout(Uint32 width, Uint32 height, Uint32 depth, SurfaceFormat format, Uint32 brickSize, const std::string& brickPath);
+	// Writes and opens the file for the layout and m_Range already set, a brick layer at a time from layer.
+	bool Write(const std::string& brickPath, const LayerSource& layer, const ProgressCallback& progress);
+	// Gathers one padded brick from slab (the volume's slices from slabFirst on) and fills in its min/max and histogram.
+	void CookBrick(Uint32 index, const Byte* slab, Uint32 slabFirst, Byte* brick, float binScale);
+	// Whether a table entry's stored size can be a brick of this file.
+	bool BrickSizeValid(const BrickInfo& info)const;
+
+public:
+	// Value of a single voxel as a float, handles the raw meta formats.
+	static float SampleValue(const Byte* data, Uint64 index, SurfaceFormat format);
+};
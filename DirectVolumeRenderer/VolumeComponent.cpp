@@ -6,6 +6,11 @@
 #include "UI/ImGui_Interface.h"
 #include "World/Entity.h"
 #include "System/FileDialog.h"
+#include "System/Logger.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
 
 const char* items[] = { "MIP", "ALPHA", "PBR", "PBR_ESS"};
 const char* itemsMetaFormat[] = {"Uint8", "Uint16"};
@@ -14,29 +19,39 @@ void VolumeComponent::Initialize(GraphicsDevice* graphicsDevice, ContentManager*
 {
 	m_ContentManager = Application::contentManager;
 	m_GraphicsDevice = Application::graphicsDevice;
-	m_VolumeMaterials[(Uint32)VolumeMethod::MIP]	 = std::make_shared<Material>(m_ContentManager->Load<Shader>("Assets/Shaders/Volume/Mip_Volume.shader"));
-	m_VolumeMaterials[(Uint32)VolumeMethod::Alpha]	 = std::make_shared<Material>(m_ContentManager->Load<Shader>("Assets/Shaders/Volume/Alpha_Volume.shader"));
-	m_VolumeMaterials[(Uint32)VolumeMethod::PBR]	 = std::make_shared<Material>(m_ContentManager->Load<Shader>("Assets/Shaders/Volume/PBR_Volume.shader"));
-	m_VolumeMaterials[(Uint32)VolumeMethod::PBR_ESS] = std::make_shared<Material>(m_ContentManager->Load<Shader>("Assets/Shaders/Volume/PBR_Volume_ESS.shader"));
 
 	// Load the cube
 	m_MeshRenderer = m_Entity->AddComponent<MeshRenderer>();
 	m_MeshRenderer->m_Mesh = m_ContentManager->Load<Mesh>("Assets/Models/cube.mesh");
-	m_MeshRenderer->m_Material = m_VolumeMaterials[(Uint32)VolumeMethod::PBR];
+	m_MeshRenderer->m_Enabled = false; // Nothing to draw until the first volume is swapped in
 
 	// load noise used for ray jiggle
 	m_Noise = m_ContentManager->Load<Texture>("Assets/Textures/Noise.png");
 	m_Noise->SetFilter(FilterMode::MinMagMipLinear);
 
+	CreateMaterials(VolumeLayout::Packed);
+
+	// Init our compute shader generators.
+	m_VolumeGenerator.Initialize(m_GraphicsDevice, m_ContentManager, "Assets/Shaders/Compute/VolumeNormalGen.shader");
+	m_OccupancyGenerator.Initialize(m_GraphicsDevice, m_ContentManager, "Assets/Shaders/Compute/VolumeIntensityGen.shader", "Assets/Shaders/Compute/VolumeRangeGen.shader");
+}
+
+void VolumeComponent::CreateMaterials(VolumeLayout layout)
+{
+	// Same shaders either way, the split ones are built with SPLIT_LAYOUT defined.
+	std::string folder = layout == VolumeLayout::Split ? "Assets/Shaders/Volume/Split/" : "Assets/Shaders/Volume/";
+	m_VolumeMaterials[(Uint32)VolumeMethod::MIP]	 = std::make_shared<Material>(m_ContentManager->Load<Shader>(folder + "Mip_Volume.shader"));
+	m_VolumeMaterials[(Uint32)VolumeMethod::Alpha]	 = std::make_shared<Material>(m_ContentManager->Load<Shader>(folder + "Alpha_Volume.shader"));
+	m_VolumeMaterials[(Uint32)VolumeMethod::PBR]	 = std::make_shared<Material>(m_ContentManager->Load<Shader>(folder + "PBR_Volume.shader"));
+	m_VolumeMaterials[(Uint32)VolumeMethod::PBR_ESS] = std::make_shared<Material>(m_ContentManager->Load<Shader>(folder + "PBR_Volume_ESS.shader"));
+	m_MaterialLayout = layout;
+	m_MeshRenderer->m_Material = m_VolumeMaterials[(Uint32)m_VolumeMethod];
+
 	// Bind Noise
 	m_VolumeMaterials[(Uint32)VolumeMethod::MIP]->SetTexture(2, m_Noise);
 	m_VolumeMaterials[(Uint32)VolumeMethod::Alpha]->SetTexture(2, m_Noise);
 	m_VolumeMaterials[(Uint32)VolumeMethod::PBR]->SetTexture(3, m_Noise);
 	m_VolumeMaterials[(Uint32)VolumeMethod::PBR_ESS]->SetTexture(4, m_Noise);
-
-	// Init our compute shader generators.
-	m_VolumeGenerator.Initialize(m_GraphicsDevice, m_ContentManager, "Assets/Shaders/Compute/VolumeNormalGen.shader");
-	m_OccupancyGenerator.Initialize(m_GraphicsDevice, m_ContentManager, "Assets/Shaders/Compute/VolumeIntensityGen.shader");
 }
 
 void VolumeComponent::UpdateMaterial()
@@ -56,14 +71,6 @@ void VolumeComponent::LoadVolume(std::string volumePath)
 		return;
 	}
 
-	if (m_VolumeMap && m_VolumeMap->IsDisposed() == false)
-	{
-		m_VolumeMap->Release();
-		m_VolumeMap.reset();
-	}
-
-	m_OccupancyGenerator.Release();
-
 	//--Get Extension--
 	std::string ext = volumePath.c_str();
 	ext = ext.substr(ext.find_last_of(".") + 1);
@@ -72,42 +79,125 @@ void VolumeComponent::LoadVolume(std::string volumePath)
 		ext[i] = tolower(ext[i]);
 	}
 
-	std::string rawPath = volumePath.substr(0, volumePath.find_last_of("."));
-	std::string volumeTransferPath = rawPath + ".transfer";
+	if (ext != "raw" && ext != "dcm" && VolumeFile::IsVolumeFile(ext) == false)
+	{
+		assert(0 && "Only Raw, DICOM, NRRD and MetaImage Files Supported!");
+		return;
+	}
 
-	if (ext == "raw")
+	VolumeLoadOptions options;
+	options.CpuGradients = m_CpuGradients;
+	options.Layout = m_FullIntensity ? VolumeLayout::Split : VolumeLayout::Packed;
+	options.UseSidecar = m_UseSidecar;
+	options.CacheVolumes = m_CacheVolumes;
+	memcpy(options.CellSize, m_OccupancyGenerator.GetCellSize(), sizeof(options.CellSize));
+	options.BrickBudget = (Uint64)m_BrickBudgetMB << 20;
+	m_VolumeLoader.Start(volumePath, options);
+}
+
+void VolumeComponent::Update(float deltaTime)
+{
+	m_VolumeLoader.Update(m_VolumeGenerator);
+
+	if (m_VolumeLoader.IsReady())
 	{
-		// create a volume texture from raw.
-		std::shared_ptr<Texture> source = m_ContentManager->Load<Texture>(volumePath);
-		//source->SetWrapMode(WrapMode::Clamp);
-		assert(source->IsLoaded() && "Failed to Load Source Texture");
-
-		// Generate volume with normals
-		m_VolumeMap = m_VolumeGenerator.GenerateVolume(source);
-		source->Release();
+		SwapInVolume();
 	}
-	else
+}
+
+void VolumeComponent::SwapInVolume()
+{
+	std::string volumePath = m_VolumeLoader.GetVolumePath();
+	std::string volumeTransferPath = volumePath.substr(0, volumePath.find_last_of(".")) + ".transfer";
+
+	// Everything below lands in the same frame, so the renderer never sees half a volume.
+	if (m_VolumeMap && m_VolumeMap->IsDisposed() == false)
 	{
-		assert(0 && "Only Raw Files Supported, Or .meta file missing!");
+		m_VolumeMap->Release();
+		m_VolumeMap.reset();
 	}
 
+	if (m_GradientMap && m_GradientMap->IsDisposed() == false)
+	{
+		m_GradientMap->Release();
+		m_GradientMap.reset();
+	}
+
+	if (m_NormalMap && m_NormalMap->IsDisposed() == false)
+	{
+		m_NormalMap->Release();
+		m_NormalMap.reset();
+	}
+
+	m_OccupancyGenerator.Release();
+	m_BrickPager.Release();
+	m_VolumeBricks.Release();
+
+	m_VolumeMap = m_VolumeLoader.GetVolumeMap();
+	m_GradientMap = m_VolumeLoader.GetGradientMap();
+	m_NormalMap = m_VolumeLoader.GetNormalMap();
+	VolumeLayout layout = m_VolumeLoader.GetLayout();
+	std::vector<Word> cellRanges = m_VolumeLoader.GetCellRanges();
+	const Uint32* cellSize = m_OccupancyGenerator.GetCellSize();
+	const Uint32* rangeCellSize = m_VolumeLoader.GetCellSize();
+	bool rangesFit = cellRanges.empty() == false && memcmp(cellSize, rangeCellSize, sizeof(Uint32) * 3) == 0;
+	m_VoxelSpacing = m_VolumeLoader.GetSpacing();
+	m_Rescale = m_VolumeLoader.GetRescale();
+	m_VolumeStats = m_VolumeLoader.GetStats();
+	m_VolumePyramid.Release();
+
+	// The loader's passes paged through its own cache, this one serves the Benchmarks window's paged runs.
+	m_LoadPagerStats = m_VolumeLoader.GetPagerStats();
+	if (m_VolumeLoader.GetBricks().IsValid() && m_VolumeBricks.Open(m_VolumeLoader.GetBricks().GetFilePath()))
+	{
+		m_BrickPager.Initialize(&m_VolumeBricks, (Uint64)m_BrickBudgetMB << 20);
+	}
+
+	m_VolumeLoader.Reset();
+	m_MeshRenderer->m_Enabled = true;
+
 	m_VolumeMap->SetWrapMode(WrapMode::Border);
+	m_GradientMap->SetWrapMode(WrapMode::Border);
+	if (m_NormalMap)
+	{
+		// SampleOctahedral loads and decodes each corner itself, blending the encoded bytes is wrong.
+		m_NormalMap->SetWrapMode(WrapMode::Border);
+		m_NormalMap->SetFilter(FilterMode::MinMagMipPoint);
+	}
 
+	if (layout != m_MaterialLayout)
+	{
+		CreateMaterials(layout);
+	}
 
 	//--Initialize the transferFunction--
+	// A 16 bit intensity volume gets at least the wide LUT, 16 stored values a bin instead of 256.
 	m_TransferFunction.Initialize(volumeTransferPath);
+	bool wide = m_VolumeMap->GetFormat() == SurfaceFormat::R16_Unorm;
+	if (wide && m_TransferFunction.GetIntensityBins() < TransferFunction::HighResolutionBins)
+	{
+		m_TransferFunction.SetIntensityBins(TransferFunction::HighResolutionBins);
+	}
 
 	//--Generate intensity grid for Empty Space-Skipping--
-	m_OccupancyGenerator.GenerateVolumeGrid(m_VolumeMap, m_TransferFunction.GetDiffuseTransfer());
+	// Cell ranges once per volume, transfer edits only reclassify the cells. The loader has
+	// them already when it used the sidecar, unless the cell size changed since it started.
+	if (rangesFit)
+	{
+		m_OccupancyGenerator.SetCellRanges(m_VolumeMap, cellRanges);
+	}
+	else
+	{
+		m_OccupancyGenerator.BuildCellRanges(m_VolumeMap, m_GradientMap);
+	}
+	m_OccupancyGenerator.Classify(m_TransferFunction);
+	m_TransferFunction.ClearDirtyRange();
 
 	m_VolumeData.Width = (float)m_VolumeMap->GetWidth();
 	m_VolumeData.Height = (float)m_VolumeMap->GetHeight();
 	m_VolumeData.Depth = (float)m_VolumeMap->GetDepth();
 
 	Vector3 dims = Vector3(m_VolumeData.Width, m_VolumeData.Height, m_VolumeData.Depth);
-	Vector3 occupancyDims = Vector3(ceil(dims.x / m_OccupancyGenerator.VoxelsPerCell().x), 
-									ceil(dims.y / m_OccupancyGenerator.VoxelsPerCell().y), 
-									ceil(dims.z / m_OccupancyGenerator.VoxelsPerCell().z));
 
 	// Calculate the max size and step size to take, its always 1/maxsize
 	float maxSize = (float)Mathf::Max(m_VolumeData.Width, Mathf::Max(m_VolumeData.Height, m_VolumeData.Depth));
@@ -120,7 +210,6 @@ void VolumeComponent::LoadVolume(std::string volumePath)
 	m_VolumeMaterials[(Uint32)VolumeMethod::MIP]->SetTexture(0, m_VolumeMap);
 	m_VolumeMaterials[(Uint32)VolumeMethod::MIP]->SetTexture(1, m_OccupancyGenerator.GetOccupancyTexture());
 	m_VolumeMaterials[(Uint32)VolumeMethod::MIP]->SetVector3("VolumeDims", dims);
-	m_VolumeMaterials[(Uint32)VolumeMethod::MIP]->SetVector3("OccupancyDims", occupancyDims);
 	m_VolumeMaterials[(Uint32)VolumeMethod::MIP]->SetVector3("StepSize", stepSize);
 	m_VolumeMaterials[(Uint32)VolumeMethod::MIP]->SetFloat("Iterations", maxSize);
 
@@ -128,32 +217,75 @@ void VolumeComponent::LoadVolume(std::string volumePath)
 	m_VolumeMaterials[(Uint32)VolumeMethod::Alpha]->SetTexture(0, m_VolumeMap);
 	m_VolumeMaterials[(Uint32)VolumeMethod::Alpha]->SetTexture(1, m_OccupancyGenerator.GetOccupancyTexture());
 	m_VolumeMaterials[(Uint32)VolumeMethod::Alpha]->SetVector3("VolumeDims", dims);
-	m_VolumeMaterials[(Uint32)VolumeMethod::Alpha]->SetVector3("OccupancyDims", occupancyDims);
 	m_VolumeMaterials[(Uint32)VolumeMethod::Alpha]->SetVector3("StepSize", stepSize);
 	m_VolumeMaterials[(Uint32)VolumeMethod::Alpha]->SetFloat("Iterations", maxSize);
 
 	// PBR Vol Textures
 	m_VolumeMaterials[(Uint32)VolumeMethod::PBR]->SetTexture(0, m_VolumeMap);
-	m_VolumeMaterials[(Uint32)VolumeMethod::PBR]->SetTexture(1, m_TransferFunction.GetDiffuseTransfer());
 	m_VolumeMaterials[(Uint32)VolumeMethod::PBR]->SetTexture(2, m_TransferFunction.GetSurfaceTransfer());
+	m_VolumeMaterials[(Uint32)VolumeMethod::PBR]->SetTexture(4, m_GradientMap);
+	if (layout == VolumeLayout::Split)
+	{
+		m_VolumeMaterials[(Uint32)VolumeMethod::PBR]->SetTexture(5, m_NormalMap);
+	}
 	m_VolumeMaterials[(Uint32)VolumeMethod::PBR]->SetVector3("VolumeDims", dims);
-	m_VolumeMaterials[(Uint32)VolumeMethod::PBR]->SetVector3("StepSize", stepSize);
 	m_VolumeMaterials[(Uint32)VolumeMethod::PBR]->SetFloat("Iterations", maxSize);
 
 
 	// PBR ESS
 	m_VolumeMaterials[(Uint32)VolumeMethod::PBR_ESS]->SetTexture(0, m_VolumeMap);
 	m_VolumeMaterials[(Uint32)VolumeMethod::PBR_ESS]->SetTexture(1, m_OccupancyGenerator.GetOccupancyTexture());
-	m_VolumeMaterials[(Uint32)VolumeMethod::PBR_ESS]->SetTexture(2, m_TransferFunction.GetDiffuseTransfer());
 	m_VolumeMaterials[(Uint32)VolumeMethod::PBR_ESS]->SetTexture(3, m_TransferFunction.GetSurfaceTransfer());
+	m_VolumeMaterials[(Uint32)VolumeMethod::PBR_ESS]->SetTexture(5, m_GradientMap);
+	if (layout == VolumeLayout::Split)
+	{
+		m_VolumeMaterials[(Uint32)VolumeMethod::PBR_ESS]->SetTexture(6, m_NormalMap);
+	}
 	m_VolumeMaterials[(Uint32)VolumeMethod::PBR_ESS]->SetVector3("VolumeDims", dims);
-	m_VolumeMaterials[(Uint32)VolumeMethod::PBR_ESS]->SetVector3("OccupancyDims", dims / m_OccupancyGenerator.VoxelsPerCell());
-	m_VolumeMaterials[(Uint32)VolumeMethod::PBR_ESS]->SetVector3("StepSize", stepSize);
 	m_VolumeMaterials[(Uint32)VolumeMethod::PBR_ESS]->SetFloat("Iterations", maxSize);
 
+	m_StepSize = stepSize;
+	UpdateSampleSpacing();
+	UpdateOccupancyDims();
 	UpdateMaterial();
 }
 
+void VolumeComponent::UpdateSampleSpacing()
+{
+	// The transfer driven methods only, the LUT's opacity is what gets corrected.
+	Vector3 stepSize = m_StepSize * m_TransferFunction.GetStepMultiplier(m_StepSlot);
+	std::shared_ptr<Texture> diffuse = m_TransferFunction.GetCorrectedDiffuse(m_StepSlot);
+	m_VolumeMaterials[(Uint32)VolumeMethod::PBR_ESS]->SetTexture(2, diffuse);
+	m_VolumeMaterials[(Uint32)VolumeMethod::PBR_ESS]->SetVector3("StepSize", stepSize);
+
+	// While the transfer has a pre-integrated table PBR steps one of its segments at a time, in place of the
+	// spacing. The table's slot is bound either way, to the diffuse LUT while it goes unused.
+	m_PreIntegratedScale = m_TransferFunction.GetPreIntegrationScale();
+	std::shared_ptr<Texture> preIntegrated = m_TransferFunction.GetPreIntegratedTransfer();
+	if (preIntegrated)
+	{
+		stepSize = m_StepSize * m_PreIntegratedScale;
+	}
+	m_VolumeMaterials[(Uint32)VolumeMethod::PBR]->SetTexture(1, diffuse);
+	m_VolumeMaterials[(Uint32)VolumeMethod::PBR]->SetTexture("PreIntegratedTransfer", preIntegrated ? preIntegrated : diffuse);
+	m_VolumeMaterials[(Uint32)VolumeMethod::PBR]->SetFloat("PreIntegrated", preIntegrated ? 1.0f : 0.0f);
+	m_VolumeMaterials[(Uint32)VolumeMethod::PBR]->SetVector3("StepSize", stepSize);
+}
+
+void VolumeComponent::UpdateOccupancyDims()
+{
+	Vector3 dims = Vector3(m_VolumeData.Width, m_VolumeData.Height, m_VolumeData.Depth);
+	Vector3 voxelsPerCell = m_OccupancyGenerator.VoxelsPerCell();
+	Vector3 occupancyDims = Vector3(ceil(dims.x / voxelsPerCell.x), 
+									ceil(dims.y / voxelsPerCell.y), 
+									ceil(dims.z / voxelsPerCell.z));
+
+	m_VolumeMaterials[(Uint32)VolumeMethod::MIP]->SetVector3("OccupancyDims", occupancyDims);
+	m_VolumeMaterials[(Uint32)VolumeMethod::Alpha]->SetVector3("OccupancyDims", occupancyDims);
+	// The ESS DDA wants the volume's extent in cells, the rounded up grid can be larger.
+	m_VolumeMaterials[(Uint32)VolumeMethod::PBR_ESS]->SetVector3("OccupancyDims", dims / voxelsPerCell);
+}
+
 void VolumeComponent::OnGui()
 {
 	bool dirty = false;
@@ -163,10 +295,13 @@ void VolumeComponent::OnGui()
 		{
 			if (ImGui::Button("Open"))
 			{
-				if (FileDialog::OpenDialog("Raw Files (*.raw)|*.raw", "", m_VolumePath) == DialogResult::Ok)
+				if (FileDialog::OpenDialog("Volume Files (*.raw, *.dcm, *.nrrd, *.mhd)|*.raw;*.dcm;*.nrrd;*.nhdr;*.mha;*.mhd:Raw Files (*.raw)|*.raw:DICOM Files (*.dcm)|*.dcm:NRRD Files (*.nrrd, *.nhdr)|*.nrrd;*.nhdr:MetaImage Files (*.mha, *.mhd)|*.mha;*.mhd", "", m_VolumePath) == DialogResult::Ok)
 				{
+					// DICOM, NRRD and MetaImage carry their own dimensions, only raw needs the meta file.
+					std::string ext = m_VolumePath.substr(m_VolumePath.find_last_of(".") + 1);
+					std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
 					m_VolumeMeta = m_VolumePath + ".meta";
-					if (File::Exists(m_VolumeMeta) == false)
+					if (ext == "raw" && File::Exists(m_VolumeMeta) == false)
 					{
 						m_ShowMetaPop = true;
 					}
@@ -176,6 +311,14 @@ void VolumeComponent::OnGui()
 					}
 				}
 			}
+
+			ImGui::SameLine();
+			ImGui::Checkbox("CPU Gradients", &m_CpuGradients);
+			ImGui::SameLine();
+			ImGui::Checkbox("16-bit Intensity", &m_FullIntensity);
+			ImGui::Checkbox("Sidecar Cache", &m_UseSidecar);
+			ImGui::SameLine();
+			ImGui::Checkbox("Cache Volumes", &m_CacheVolumes);
 		}
 		else
 		{
@@ -225,6 +368,19 @@ void VolumeComponent::OnGui()
 			}
 		}
 
+		if (m_VolumeLoader.IsBusy())
+		{
+			ImGui::ProgressBar(m_VolumeLoader.GetProgress(), ImVec2(-1, 0), m_VolumeLoader.GetStageName());
+			if (ImGui::Button("Cancel Load"))
+			{
+				m_VolumeLoader.Cancel();
+			}
+		}
+		else if (m_VolumeLoader.GetStage() == LoadStage::Failed)
+		{
+			ImGui::Text("Failed to load %s", m_VolumeLoader.GetVolumePath().c_str());
+		}
+
 		//--All the Volume Data stuff--
 		if (ImGui::CollapsingHeader("Volume Data"))
 		{
@@ -261,23 +417,164 @@ void VolumeComponent::OnGui()
 				}
 			}
 
-			if (m_VolumeMethod == VolumeMethod::PBR || m_VolumeMethod == VolumeMethod::PBR_ESS)
+			if (m_VolumeMap)
+			{
+				ImGui::Text("Voxel Spacing: %.3f x %.3f x %.3f mm", m_VoxelSpacing.x, m_VoxelSpacing.y, m_VoxelSpacing.z);
+				ImGui::Text("Rescale: x%.3f %+.1f", m_Rescale.x, m_Rescale.y);
+				ImGui::Text("Values: %.1f to %.1f, mean %.1f, std dev %.1f", m_VolumeStats.Min, m_VolumeStats.Max, m_VolumeStats.Mean, std::sqrt(m_VolumeStats.Variance));
+			}
+
+			// The transfer function is set up with the first volume.
+			if ((m_VolumeMethod == VolumeMethod::PBR || m_VolumeMethod == VolumeMethod::PBR_ESS) && m_VolumeMap)
 			{
 				if (m_TransferFunction.DisplayEditor())
 				{
 					m_RequiresUpdate = true;
 				}
+
+				// The editor's pre-integrated step, a new table or none changes PBR's step and bindings.
+				if (m_TransferFunction.GetPreIntegrationScale() != m_PreIntegratedScale)
+				{
+					UpdateSampleSpacing();
+				}
+
+				// Fewer, further apart samples with the opacity corrected to match.
+				char spacing[16];
+				snprintf(spacing, sizeof(spacing), "x%.2g", m_TransferFunction.GetStepMultiplier(m_StepSlot));
+				if (ImGui::BeginCombo("Sample Spacing", spacing))
+				{
+					for (Uint32 slot = 0; slot < TransferFunction::StepSlots; slot++)
+					{
+						snprintf(spacing, sizeof(spacing), "x%.2g", m_TransferFunction.GetStepMultiplier(slot));
+						if (ImGui::Selectable(spacing, slot == m_StepSlot))
+						{
+							m_StepSlot = slot;
+							UpdateSampleSpacing();
+						}
+					}
+					ImGui::EndCombo();
+				}
+			}
+
+			if (m_VolumeMethod == VolumeMethod::PBR_ESS && m_VolumeMap)
+			{
+				ImGui::InputInt3("Cell Size", m_CellSize);
+				ImGui::SameLine();
+				if (ImGui::Button("Apply##CellSize"))
+				{
+					m_OccupancyGenerator.SetCellSize(Mathf::Max(m_CellSize[0], 1), Mathf::Max(m_CellSize[1], 1), Mathf::Max(m_CellSize[2], 1));
+					m_OccupancyGenerator.BuildCellRanges(m_VolumeMap, m_GradientMap);
+					m_OccupancyGenerator.Classify(m_TransferFunction);
+					m_TransferFunction.ClearDirtyRange();
+					UpdateOccupancyDims();
+				}
+
+				ImGui::SliderInt("Grid Budget (MB)", &m_GridBudgetMB, 1, 1024);
+				if (ImGui::Button("Tune Cell Size"))
+				{
+					Byte threshold = (Byte)Mathf::Min(ceil(m_VolumeData.IsoValue * 255.0f), 255.0f);
+					std::vector<CellSizeTrial> trials = m_OccupancyGenerator.TuneCellSize(m_VolumeMap, m_GradientMap, m_TransferFunction, threshold, (Uint64)m_GridBudgetMB << 20);
+					m_TransferFunction.ClearDirtyRange();
+					for (const CellSizeTrial& trial : trials)
+					{
+						char line[256];
+						snprintf(line, sizeof(line), "Cell size %ux%ux%u: %.2f MB, %s", trial.CellSize[0], trial.CellSize[1], trial.CellSize[2],
+							trial.GridBytes / (1024.0 * 1024.0), trial.OverBudget ? "over budget" : "");
+						if (trial.OverBudget == false)
+						{
+							snprintf(line + strlen(line), sizeof(line) - strlen(line), "%.1f steps + %.1f samples per ray = %.1f%s",
+								trial.StepsPerRay, trial.SampledPerRay, trial.Cost, trial.Chosen ? ", chosen" : "");
+						}
+						LogInfo(line);
+
+						if (trial.Chosen)
+						{
+							m_CellSizeResult = line;
+						}
+					}
+
+					const Uint32* cellSize = m_OccupancyGenerator.GetCellSize();
+					m_CellSize[0] = (int)cellSize[0];
+					m_CellSize[1] = (int)cellSize[1];
+					m_CellSize[2] = (int)cellSize[2];
+					UpdateOccupancyDims();
+				}
+
+				if (m_CellSizeResult.empty() == false)
+				{
+					ImGui::TextUnformatted(m_CellSizeResult.c_str());
+				}
 			}
 
-			if (m_VolumeMethod == VolumeMethod::PBR_ESS && m_RequiresUpdate && m_TransferFunction.IsUserInteracting() == false)
+			// Live while dragging, only the cells the edited bins can reach are redone.
+			if (m_VolumeMethod == VolumeMethod::PBR_ESS && m_RequiresUpdate)
 			{
-				m_OccupancyGenerator.GenerateVolumeGrid(m_VolumeMap, m_TransferFunction.GetDiffuseTransfer());
+				Uint32 first, last;
+				if (m_TransferFunction.GetDirtyRange(first, last))
+				{
+					m_OccupancyGenerator.Reclassify(m_TransferFunction, first, last);
+					m_TransferFunction.ClearDirtyRange();
+				}
 				m_RequiresUpdate = false;
 			}
 		}
+
+		if (ImGui::CollapsingHeader("Brick Cache"))
+		{
+			if (ImGui::SliderInt("Budget (MB)", &m_BrickBudgetMB, 64, 16384))
+			{
+				m_BrickPager.SetBudget((Uint64)m_BrickBudgetMB << 20);
+			}
+
+			// Zero when the load decoded the whole volume (no fresh brick file, or GPU gradients).
+			const BrickPagerStats& load = m_LoadPagerStats;
+			ImGui::Text("Last load: %llu misses, %llu prefetched, %llu evicted", load.Misses, load.Prefetches, load.Evictions);
+			ImGui::Text("Last load peak: %.1f MB of %.1f MB", load.PeakBytes / (1024.0 * 1024.0), load.BudgetBytes / (1024.0 * 1024.0));
+			ImGui::Separator();
+
+			BrickPagerStats stats = m_BrickPager.GetStats();
+			ImGui::Text("Bricks: %u resident of %u", stats.ResidentBricks, m_VolumeBricks.GetBrickCount());
+			ImGui::Text("Resident: %.1f MB, peak %.1f MB", stats.ResidentBytes / (1024.0 * 1024.0), stats.PeakBytes / (1024.0 * 1024.0));
+			ImGui::Text("Hits: %llu  Misses: %llu", stats.Hits, stats.Misses);
+			ImGui::Text("Evictions: %llu  Prefetches: %llu", stats.Evictions, stats.Prefetches);
+			ImGui::Text("Over budget: %llu", stats.Overcommits);
+
+			if (ImGui::Button("Reset Counters"))
+			{
+				m_BrickPager.ResetStats();
+			}
+		}
+
+		if (ImGui::CollapsingHeader("Level of Detail"))
+		{
+			// Built when asked for rather than on every load, a brick at a time from the pager as the
+			// source isn't resident after loading. Nothing draws from it yet.
+			if (m_VolumePyramid.IsValid() == false)
+			{
+				if (m_BrickPager.IsValid() == false)
+				{
+					ImGui::Text("Needs the volume's brick file");
+				}
+				else if (ImGui::Button("Build Pyramid") && m_VolumePyramid.Build(m_BrickPager))
+				{
+					m_VolumePyramid.LogReport();
+				}
+			}
+
+			for (Uint32 level = 0; level < m_VolumePyramid.GetLevelCount(); level++)
+			{
+				Uint32 width, height, depth;
+				m_VolumePyramid.GetLevelSize(level, width, height, depth);
+				ImGui::Text("Level %u: %ux%ux%u  %.1f KB%s", level, width, height, depth,
+					m_VolumePyramid.GetLevelByteCount(level) / 1024.0, level == 0 ? " (source)" : " x2");
+			}
+			ImGui::Text("Pyramid total: %.1f MB", m_VolumePyramid.GetTotalByteCount() / (1024.0 * 1024.0));
+		}
 	}
 	ImGui::End();
 
+	m_Benchmark.OnGui(*this);
+
 	if (dirty)
 	{
 		UpdateMaterial();
@@ -286,5 +583,9 @@ void VolumeComponent::OnGui()
 
 void VolumeComponent::Shutdown()
 {
+	m_VolumeLoader.Cancel();
 	m_TransferFunction.ShutDown();
+	m_BrickPager.Release();
+	m_VolumeBricks.Release();
+	m_VolumePyramid.Release();
 }
\ No newline at end of file
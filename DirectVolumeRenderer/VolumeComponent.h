@@ -5,10 +5,13 @@
 #include "World/Component/MeshRenderer.h"
 #include "VolumeGenerator.h"
 #include "VolumeOccupancy.h"
+#include "VolumeBricks.h"
+#include "VolumePyramid.h"
+#include "VolumeLoader.h"
+#include "BrickPager.h"
+#include "VolumeBenchmark.h"
 #include "TransferFunction.h"
 
-enum class VolumeMethod { MIP, Alpha, PBR, PBR_ESS};
-
 struct VolumeData
 {
 	float Width = 1;
@@ -22,6 +25,8 @@ class VolumeComponent : public Component<VolumeComponent>
 {
 public:
 	std::shared_ptr<Texture> m_VolumeMap;
+	std::shared_ptr<Texture> m_GradientMap;	// R8 gradient magnitude, second transfer axis
+	std::shared_ptr<Texture> m_NormalMap;	// R8G8 octahedral normals, split layout only
 	std::shared_ptr<Texture> m_Noise;
 	TransferFunction m_TransferFunction;
 
@@ -31,9 +36,19 @@ public:
 	std::shared_ptr<MeshRenderer> m_MeshRenderer;
 	std::shared_ptr<Material>	  m_VolumeMaterials[4];
 	VolumeMethod				  m_VolumeMethod = VolumeMethod::PBR;
+	VolumeLayout				  m_MaterialLayout = VolumeLayout::Packed;	// What m_VolumeMaterials were made for
 	VolumeData					  m_VolumeData;
+	Vector3						  m_VoxelSpacing = Vector3(1, 1, 1); // mm, from DICOM
+	Vector2						  m_Rescale = Vector2(1, 0);		 // Stored to modality units, slope/intercept
+	VolumeStats					  m_VolumeStats;					 // Of the stored values, before rescale
 	VolumeGenerator				  m_VolumeGenerator;
 	VolumeOccupancy				  m_OccupancyGenerator;
+	VolumeBricks				  m_VolumeBricks;
+	BrickPager					  m_BrickPager;
+	BrickPagerStats				  m_LoadPagerStats;	// The loader's cache, copied when the volume swaps in
+	VolumePyramid				  m_VolumePyramid;	// Empty until built from the Level of Detail panel
+	VolumeLoader				  m_VolumeLoader;
+	VolumeBenchmark				  m_Benchmark;
 
 private:
 	std::string m_VolumePath;
@@ -42,15 +57,36 @@ private:
 	int dimensions[3];
 	bool m_ShowMetaPop = false;
 	bool m_RequiresUpdate = false;
+	int  m_BrickBudgetMB = 1024;
+	bool m_CpuGradients = false;	// Gradients on the loader's worker instead of the compute shader
+	bool m_FullIntensity = false;	// Split layout, 16 bit data keeps its precision instead of going to 8 bits
+	bool m_UseSidecar = true;		// Derived data from the ".vstats" sidecar when it matches, written when it doesn't
+	bool m_CacheVolumes = false;	// The sidecar keeps the generated textures as well, forces CPU gradients
+	int  m_CellSize[3] = { 4, 4, 4 };
+	int  m_GridBudgetMB = 64;
+	std::string m_CellSizeResult;	// The tuner's pick, shown under the button
+	Vector3 m_StepSize = Vector3(1, 1, 1);	// One base step, 1 / the largest dimension
+	Uint32	m_StepSlot = 1;					// TransferFunction step slot, spacing x1 to start
+	float	m_PreIntegratedScale = 0.0f;	// The transfer's pre-integrated step as PBR was last bound for, 0 for none
 
 public:
 	// Sets up the volume materials
 	void Initialize(GraphicsDevice* graphicsDevice, ContentManager* contentManager);
-	// Loads the volume from raw and bakes, or loads pre-baked texture
+	// Starts loading the volume in the background, the current one keeps drawing until it is ready
 	void LoadVolume(std::string volumePath);
+	// Steps the background load and swaps the volume in once it finishes
+	void Update(float deltaTime);
 	void OnGui();
 	void Shutdown();
 
 private:
 	void UpdateMaterial();
+	// One material per method for the layout, noise bound, and the renderer pointed at the current one
+	void CreateMaterials(VolumeLayout layout);
+	// Takes over the loader's result and rebinds every material in one go
+	void SwapInVolume();
+	// Occupancy grid size on the materials, after the cell size changes
+	void UpdateOccupancyDims();
+	// Step size and the opacity corrected diffuse LUT for the chosen sample spacing on the PBR materials
+	void UpdateSampleSpacing();
 };
\ No newline at end of file
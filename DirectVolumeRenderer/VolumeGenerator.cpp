@@ -1,6 +1,84 @@
 #include "VolumeGenerator.h"
+#include "BrickPager.h"
+#include "VolumeBricks.h"
+#include "VolumeNormals.h"
+#include "VolumeOccupancy.h"
+#include "VolumeStatistics.h"
 #include "Content/ContentManager.h"
-#include "Math/Mathf.h"
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+
+namespace
+{
+	// Copy of a padded brick with every voxel outside the volume zeroed like the shader's out of range Load,
+	// the brick file clamps them, so its core voxels see the same neighbours they would in the whole volume.
+	void ZeroOutside(const VolumeBricks& bricks, const BrickData& brick, std::vector<Byte>& source)
+	{
+		const Uint32 padded = bricks.GetPaddedBrickSize();
+		const Uint32 apron = bricks.GetApron();
+		const Uint32 bpv = BytesPerBlock(bricks.GetFormat());
+		Uint32 ox, oy, oz;
+		bricks.GetBrickOrigin(brick.Index, ox, oy, oz);
+
+		// Padded coordinates from first up to end are inside the volume.
+		Uint32 firstX = ox < apron ? apron - ox : 0, endX = std::min(padded, bricks.GetWidth() - ox + apron);
+		Uint32 firstY = oy < apron ? apron - oy : 0, endY = std::min(padded, bricks.GetHeight() - oy + apron);
+		Uint32 firstZ = oz < apron ? apron - oz : 0, endZ = std::min(padded, bricks.GetDepth() - oz + apron);
+
+		source.assign(brick.Voxels.size(), 0);
+		for (Uint32 z = firstZ; z < endZ; z++)
+		{
+			for (Uint32 y = firstY; y < endY; y++)
+			{
+				Uint64 row = (((Uint64)z * padded + y) * padded + firstX) * bpv;
+				memcpy(&source[(size_t)row], &brick.Voxels[(size_t)row], (size_t)(endX - firstX) * bpv);
+			}
+		}
+	}
+
+	// Copies the core of a padded per voxel result into the whole volume's texture data.
+	void ScatterCore(const VolumeBricks& bricks, Uint32 index, const Byte* result, Uint32 voxelBytes, Byte* volume)
+	{
+		const Uint32 padded = bricks.GetPaddedBrickSize();
+		const Uint32 apron = bricks.GetApron();
+		const Uint64 rowBytes = (Uint64)bricks.GetWidth() * voxelBytes;
+		const Uint64 sliceBytes = rowBytes * bricks.GetHeight();
+		Uint32 ox, oy, oz, coreX, coreY, coreZ;
+		bricks.GetBrickOrigin(index, ox, oy, oz);
+		bricks.GetBrickCore(index, coreX, coreY, coreZ);
+
+		for (Uint32 z = 0; z < coreZ; z++)
+		{
+			for (Uint32 y = 0; y < coreY; y++)
+			{
+				const Byte* src = result + (((Uint64)(z + apron) * padded + (y + apron)) * padded + apron) * voxelBytes;
+				memcpy(volume + (oz + z) * sliceBytes + (oy + y) * rowBytes + (Uint64)ox * voxelBytes, src, (size_t)coreX * voxelBytes);
+			}
+		}
+	}
+
+	// The brick's core as a cell range block over its padded results.
+	CellRangeBlock CoreBlock(const VolumeBricks& bricks, Uint32 index, const Byte* volume, const Byte* magnitude, SurfaceFormat format)
+	{
+		CellRangeBlock block;
+		block.Volume = volume;
+		block.Magnitude = magnitude;
+		block.Format = format;
+
+		Uint32 origin[3], core[3];
+		bricks.GetBrickOrigin(index, origin[0], origin[1], origin[2]);
+		bricks.GetBrickCore(index, core[0], core[1], core[2]);
+		for (Uint32 axis = 0; axis < 3; axis++)
+		{
+			block.Size[axis] = bricks.GetPaddedBrickSize();
+			block.Origin[axis] = (int)origin[axis] - (int)bricks.GetApron();
+			block.Lo[axis] = origin[axis];
+			block.Hi[axis] = origin[axis] + core[axis];
+		}
+		return block;
+	}
+}
 
 void VolumeGenerator::Initialize(GraphicsDevice* device, ContentManager* contentManager, std::string computePath)
 {
@@ -18,7 +96,12 @@ void VolumeGenerator::Initialize(GraphicsDevice* device, ContentManager* content
 	}
 }
 
-std::shared_ptr<Texture> VolumeGenerator::GenerateVolume(std::shared_ptr<Texture> source)
+std::shared_ptr<Texture> VolumeGenerator::GenerateVolume(std::shared_ptr<Texture> source, const VolumeBricks* bricks)
+{
+	return GenerateVolume(source, GetRange(source, bricks));
+}
+
+std::shared_ptr<Texture> VolumeGenerator::GenerateVolume(std::shared_ptr<Texture> source, Vector2 range, std::shared_ptr<Texture>* gradientMap)
 {
 	Uint32 width = source->GetWidth();
 	Uint32 height = source->GetHeight();
@@ -27,20 +110,7 @@ std::shared_ptr<Texture> VolumeGenerator::GenerateVolume(std::shared_ptr<Texture
 	// Bind source
 	source->Bind(0);
 
-	Vector2 range = GetRange(source);
-
-	DataRange dataRange;
-	dataRange._MinValue = range.x;
-	dataRange._MaxValue = range.y;
-	dataRange._Range = (range.y - range.x);
-
-	SurfaceFormat format = source->GetFormat();
-
-	if (BytesPerBlock(format) == 2)
-	{
-		dataRange._InitialValue = 65535;
-	}
-
+	DataRange dataRange = GetDataRange(range, source->GetFormat());
 	m_GraphicsDevice->UpdateBuffer(m_ConstantBuffer, (Byte*)&dataRange, sizeof(DataRange));
 	m_GraphicsDevice->BindConstantBuffer(m_ConstantBuffer, 0);
 
@@ -51,35 +121,225 @@ std::shared_ptr<Texture> VolumeGenerator::GenerateVolume(std::shared_ptr<Texture
 	computeResult.Apply();
 	computeResult.Bind(0, ShaderType::CS);
 
+	Texture magnitudeResult;
+	magnitudeResult.Create3D(width, height, depth, BufferUsage::Default, SurfaceFormat::R8_Uint);
+	magnitudeResult.SetUnorderedAccess();
+	magnitudeResult.Apply();
+	magnitudeResult.Bind(1, ShaderType::CS);
+
 	// Run Compute Shader
 	m_ComputeShader->Bind();
-	m_GraphicsDevice->Dispatch(width / 8, height / 8, depth / 8);
+	// Rounded up, the shader skips the threads past the edge.
+	m_GraphicsDevice->Dispatch((width + 7) / 8, (height + 7) / 8, (depth + 7) / 8);
 
 	std::shared_ptr<Texture> volume = std::make_shared<Texture>();
 	volume->Create3D(width, height, depth, BufferUsage::Immutable, SurfaceFormat::R8G8B8A8_Unorm);
 	computeResult.GetGPUData(volume->GetData(), volume->GetByteCount());
 	volume->Apply();
+	computeResult.Release();
+
+	if (gradientMap)
+	{
+		*gradientMap = std::make_shared<Texture>();
+		(*gradientMap)->Create3D(width, height, depth, BufferUsage::Immutable, SurfaceFormat::R8_Unorm);
+		magnitudeResult.GetGPUData((*gradientMap)->GetData(), (*gradientMap)->GetByteCount());
+		(*gradientMap)->Apply();
+	}
+	magnitudeResult.Release();
+
+	return volume;
+}
+
+std::shared_ptr<Texture> VolumeGenerator::GenerateVolumeCPU(std::shared_ptr<Texture> source, Vector2 range, std::shared_ptr<Texture>* gradientMap, Uint32 maxThreads)
+{
+	Uint32 width = source->GetWidth();
+	Uint32 height = source->GetHeight();
+	Uint32 depth = source->GetDepth();
+
+	std::shared_ptr<Texture> volume = std::make_shared<Texture>();
+	volume->Create3D(width, height, depth, BufferUsage::Immutable, SurfaceFormat::R8G8B8A8_Unorm);
 
+	Byte* magnitude = nullptr;
+	if (gradientMap)
+	{
+		*gradientMap = std::make_shared<Texture>();
+		(*gradientMap)->Create3D(width, height, depth, BufferUsage::Immutable, SurfaceFormat::R8_Unorm);
+		magnitude = (*gradientMap)->GetData();
+	}
+
+	VolumeNormals::Generate(source->GetData(), width, height, depth, source->GetFormat(),
+		GetDataRange(range, source->GetFormat()), volume->GetData(), magnitude, maxThreads);
 	return volume;
 }
 
-Vector2 VolumeGenerator::GetRange(std::shared_ptr<Texture> src) const
+void VolumeGenerator::GenerateCompactVolumeCPU(std::shared_ptr<Texture> source, Vector2 range, std::shared_ptr<Texture>& intensity, std::shared_ptr<Texture>& normals,
+											   std::shared_ptr<Texture>* gradientMap, Uint32 maxThreads)
 {
-	int bpp = BytesPerBlock(src->GetFormat());
-	if (bpp != 2)
+	Uint32 width = source->GetWidth();
+	Uint32 height = source->GetHeight();
+	Uint32 depth = source->GetDepth();
+	bool wide = BytesPerBlock(source->GetFormat()) == 2;
+
+	intensity = std::make_shared<Texture>();
+	intensity->Create3D(width, height, depth, BufferUsage::Immutable, wide ? SurfaceFormat::R16_Unorm : SurfaceFormat::R8_Unorm);
+	normals = std::make_shared<Texture>();
+	normals->Create3D(width, height, depth, BufferUsage::Immutable, SurfaceFormat::R8G8_Unorm);
+
+	Byte* magnitude = nullptr;
+	if (gradientMap)
 	{
-		return Vector2(0, 255);
+		*gradientMap = std::make_shared<Texture>();
+		(*gradientMap)->Create3D(width, height, depth, BufferUsage::Immutable, SurfaceFormat::R8_Unorm);
+		magnitude = (*gradientMap)->GetData();
 	}
 
-	Vector2 range = Vector2(900000, -10000);
-	int length = src->GetWidth() * src->GetHeight() * src->GetDepth();
-	Byte* data = src->GetData();
-	for (size_t i = 0; i < length; i++)
+	VolumeNormals::GenerateCompact(source->GetData(), width, height, depth, source->GetFormat(), GetDataRange(range, source->GetFormat()),
+		intensity->GetData(), (Word*)normals->GetData(), magnitude, maxThreads);
+}
+
+std::shared_ptr<Texture> VolumeGenerator::GenerateVolumeCPU(BrickPager& pager, Vector2 range, std::shared_ptr<Texture>* gradientMap,
+														   const Uint32* cellSize, std::vector<Word>* ranges)
+{
+	if (pager.IsValid() == false)
+	{
+		return nullptr;
+	}
+
+	const VolumeBricks& bricks = *pager.GetBricks();
+	const Uint32 size[3] = { bricks.GetWidth(), bricks.GetHeight(), bricks.GetDepth() };
+	const SurfaceFormat format = bricks.GetFormat();
+	const DataRange dataRange = GetDataRange(range, format);
+	const Uint32 padded = bricks.GetPaddedBrickSize();
+	const Uint64 paddedVoxels = (Uint64)padded * padded * padded;
+
+	std::shared_ptr<Texture> volume = std::make_shared<Texture>();
+	volume->Create3D(size[0], size[1], size[2], BufferUsage::Immutable, SurfaceFormat::R8G8B8A8_Unorm);
+
+	Byte* magnitude = nullptr;
+	if (gradientMap)
+	{
+		*gradientMap = std::make_shared<Texture>();
+		(*gradientMap)->Create3D(size[0], size[1], size[2], BufferUsage::Immutable, SurfaceFormat::R8_Unorm);
+		magnitude = (*gradientMap)->GetData();
+	}
+
+	bool buildRanges = magnitude && cellSize && ranges;
+	if (buildRanges)
+	{
+		VolumeOccupancy::ResetCellRanges(size, cellSize, *ranges);
+	}
+
+	// Bricks are the unit of work, each generates on one thread.
+	std::mutex rangeLock;
+	pager.ForEachBrick([&](const BrickData& brick)
+	{
+		std::vector<Byte> source;
+		ZeroOutside(bricks, brick, source);
+		std::vector<Byte> result((size_t)paddedVoxels * 4);
+		std::vector<Byte> magnitudes(magnitude ? (size_t)paddedVoxels : 0);
+		VolumeNormals::Generate(&source[0], padded, padded, padded, format, dataRange, &result[0], magnitude ? &magnitudes[0] : nullptr, 1);
+
+		ScatterCore(bricks, brick.Index, &result[0], 4, volume->GetData());
+		if (magnitude)
+		{
+			ScatterCore(bricks, brick.Index, &magnitudes[0], 1, magnitude);
+		}
+
+		if (buildRanges)
+		{
+			CellRangeBlock block = CoreBlock(bricks, brick.Index, &result[0], &magnitudes[0], SurfaceFormat::R8G8B8A8_Unorm);
+			VolumeOccupancy::MergeCellRanges(block, size, cellSize, *ranges, rangeLock);
+		}
+	});
+
+	return volume;
+}
+
+void VolumeGenerator::GenerateCompactVolumeCPU(BrickPager& pager, Vector2 range, std::shared_ptr<Texture>& intensity, std::shared_ptr<Texture>& normals,
+											   std::shared_ptr<Texture>* gradientMap, const Uint32* cellSize, std::vector<Word>* ranges)
+{
+	if (pager.IsValid() == false)
+	{
+		return;
+	}
+
+	const VolumeBricks& bricks = *pager.GetBricks();
+	const Uint32 size[3] = { bricks.GetWidth(), bricks.GetHeight(), bricks.GetDepth() };
+	const SurfaceFormat format = bricks.GetFormat();
+	const DataRange dataRange = GetDataRange(range, format);
+	const Uint32 padded = bricks.GetPaddedBrickSize();
+	const Uint64 paddedVoxels = (Uint64)padded * padded * padded;
+	const bool wide = BytesPerBlock(format) == 2;
+	const SurfaceFormat intensityFormat = wide ? SurfaceFormat::R16_Unorm : SurfaceFormat::R8_Unorm;
+	const Uint32 intensityBytes = wide ? 2 : 1;
+
+	intensity = std::make_shared<Texture>();
+	intensity->Create3D(size[0], size[1], size[2], BufferUsage::Immutable, intensityFormat);
+	normals = std::make_shared<Texture>();
+	normals->Create3D(size[0], size[1], size[2], BufferUsage::Immutable, SurfaceFormat::R8G8_Unorm);
+
+	Byte* magnitude = nullptr;
+	if (gradientMap)
+	{
+		*gradientMap = std::make_shared<Texture>();
+		(*gradientMap)->Create3D(size[0], size[1], size[2], BufferUsage::Immutable, SurfaceFormat::R8_Unorm);
+		magnitude = (*gradientMap)->GetData();
+	}
+
+	bool buildRanges = magnitude && cellSize && ranges;
+	if (buildRanges)
+	{
+		VolumeOccupancy::ResetCellRanges(size, cellSize, *ranges);
+	}
+
+	std::mutex rangeLock;
+	pager.ForEachBrick([&](const BrickData& brick)
+	{
+		std::vector<Byte> source;
+		ZeroOutside(bricks, brick, source);
+		std::vector<Byte> values((size_t)paddedVoxels * intensityBytes);
+		std::vector<Word> octahedral((size_t)paddedVoxels);
+		std::vector<Byte> magnitudes(magnitude ? (size_t)paddedVoxels : 0);
+		VolumeNormals::GenerateCompact(&source[0], padded, padded, padded, format, dataRange, &values[0], &octahedral[0],
+			magnitude ? &magnitudes[0] : nullptr, 1);
+
+		ScatterCore(bricks, brick.Index, &values[0], intensityBytes, intensity->GetData());
+		ScatterCore(bricks, brick.Index, (const Byte*)&octahedral[0], 2, normals->GetData());
+		if (magnitude)
+		{
+			ScatterCore(bricks, brick.Index, &magnitudes[0], 1, magnitude);
+		}
+
+		if (buildRanges)
+		{
+			CellRangeBlock block = CoreBlock(bricks, brick.Index, &values[0], &magnitudes[0], intensityFormat);
+			VolumeOccupancy::MergeCellRanges(block, size, cellSize, *ranges, rangeLock);
+		}
+	});
+}
+
+DataRange VolumeGenerator::GetDataRange(Vector2 range, SurfaceFormat format)
+{
+	DataRange dataRange;
+	dataRange._MinValue = range.x;
+	dataRange._MaxValue = range.y;
+	dataRange._Range = (range.y - range.x);
+
+	if (BytesPerBlock(format) == 2)
+	{
+		dataRange._InitialValue = 65535;
+	}
+	return dataRange;
+}
+
+Vector2 VolumeGenerator::GetRange(std::shared_ptr<Texture> src, const VolumeBricks* bricks) const
+{
+	if (bricks && bricks->IsValid())
 	{
-		float value = ((Uint16*)(data))[i];
-		range.x = Mathf::Min(range.x, value);
-		range.y = Mathf::Max(range.y, value);
+		return bricks->GetRange();
 	}
 
-	return range;
+	Uint64 length = (Uint64)src->GetWidth() * src->GetHeight() * src->GetDepth();
+	VolumeStats stats = VolumeStatistics::Scan(src->GetData(), length, src->GetFormat());
+	return Vector2((float)stats.Min, (float)stats.Max);
 }
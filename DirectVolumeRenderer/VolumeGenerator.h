@@ -7,6 +7,16 @@
 #include "Content/Shader.h"
 #include "Content/Texture.h"
 #include <memory>
+#include <vector>
+
+// Packed: RGBA8, normal in rgb and the intensity windowed down to 8 bits in alpha.
+// Split: intensity alone at the source's precision (R8, or R16 for 16 bit data) plus
+// R8G8 octahedral normals, drawn with the shaders under Assets/Shaders/Volume/Split.
+enum class VolumeLayout { Packed, Split };
+
+// How a volume is drawn, a shader each under Assets/Shaders/Volume and the same four on
+// the CPU in VolumeRaycaster.
+enum class VolumeMethod { MIP, Alpha, PBR, PBR_ESS };
 
 struct DataRange
 {
@@ -16,8 +26,10 @@ struct DataRange
 	float _InitialValue = 255;
 };
 
+class BrickPager;
 class ContentManager;
 class GraphicsDevice;
+class VolumeBricks;
 class VolumeGenerator
 {
 private:
@@ -29,6 +41,26 @@ private:
 
 public:
 	void Initialize(GraphicsDevice* device, ContentManager* contentManager, std::string computePath);
-	std::shared_ptr<Texture> GenerateVolume(std::shared_ptr<Texture> src);
-	Vector2 GetRange(std::shared_ptr<Texture> src)const;
+	// Bricks are optional, when valid the range comes from their header instead of a full scan.
+	std::shared_ptr<Texture> GenerateVolume(std::shared_ptr<Texture> src, const VolumeBricks* bricks = nullptr);
+	// As above with a range already worked out, the source must be on the GPU.
+	// gradientMap, when given, gets the R8 gradient magnitude volume (2D transfer functions).
+	std::shared_ptr<Texture> GenerateVolume(std::shared_ptr<Texture> src, Vector2 range, std::shared_ptr<Texture>* gradientMap = nullptr);
+	// Same result on the CPU (VolumeNormals), safe from a worker thread and needs no device.
+	// The source only needs its CPU data, the results are left for the caller to Apply.
+	static std::shared_ptr<Texture> GenerateVolumeCPU(std::shared_ptr<Texture> src, Vector2 range, std::shared_ptr<Texture>* gradientMap = nullptr, Uint32 maxThreads = 0);
+	// The compact layout (VolumeNormals::GenerateCompact) on the CPU: intensity R8_Unorm, or R16_Unorm for
+	// 16 bit sources, and R8G8_Unorm octahedral normals. Left for the caller to Apply like GenerateVolumeCPU.
+	static void GenerateCompactVolumeCPU(std::shared_ptr<Texture> src, Vector2 range, std::shared_ptr<Texture>& intensity, std::shared_ptr<Texture>& normals,
+										 std::shared_ptr<Texture>* gradientMap = nullptr, Uint32 maxThreads = 0);
+	// Both again from the bricks a BrickPager serves, so the source is never resident, same bytes as above.
+	// With a gradientMap, ranges gets ComputeCellRanges' result for cellSize out of the same pass when given.
+	static std::shared_ptr<Texture> GenerateVolumeCPU(BrickPager& pager, Vector2 range, std::shared_ptr<Texture>* gradientMap = nullptr,
+													  const Uint32* cellSize = nullptr, std::vector<Word>* ranges = nullptr);
+	static void GenerateCompactVolumeCPU(BrickPager& pager, Vector2 range, std::shared_ptr<Texture>& intensity, std::shared_ptr<Texture>& normals,
+										 std::shared_ptr<Texture>* gradientMap = nullptr, const Uint32* cellSize = nullptr, std::vector<Word>* ranges = nullptr);
+	// Shader constants for a range, the intensity is scaled up to the format's max before the 8 bit store.
+	static DataRange GetDataRange(Vector2 range, SurfaceFormat format);
+	// CPU only, safe to call from a worker thread. Without bricks this is a full VolumeStatistics scan.
+	Vector2 GetRange(std::shared_ptr<Texture> src, const VolumeBricks* bricks = nullptr)const;
 };
\ No newline at end of file
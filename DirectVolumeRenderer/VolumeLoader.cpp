@@ -0,0 +1,515 @@
+#include "VolumeLoader.h"
+#include "VolumeGenerator.h"
+#include "VolumeOccupancy.h"
+#include "System/File.h"
+#include "System/Logger.h"
+#include <algorithm>
+
+VolumeLoader::VolumeLoader() : m_Stage(LoadStage::Idle), m_Progress(0.0f), m_Cancel(false)
+{
+}
+
+VolumeLoader::~VolumeLoader()
+{
+	Cancel();
+}
+
+void VolumeLoader::Start(const std::string& volumePath, const VolumeLoadOptions& options)
+{
+	Cancel();
+	Reset();
+
+	m_VolumePath = volumePath;
+	m_Options = options;
+	m_CpuGradients = options.CpuGradients || options.Layout == VolumeLayout::Split || (options.UseSidecar && options.CacheVolumes);
+	m_Cancel = false;
+	m_Progress = 0.0f;
+	m_Stage = LoadStage::Read;
+	m_Worker = std::thread(&VolumeLoader::Run, this);
+}
+
+void VolumeLoader::Cancel()
+{
+	if (IsBusy() == false)
+	{
+		Join();
+		return;
+	}
+
+	m_Cancel = true;
+	Join();
+	Reset();
+	m_Stage = LoadStage::Cancelled;
+	LogInfo("Volume load cancelled: " + m_VolumePath);
+}
+
+void VolumeLoader::Update(VolumeGenerator& generator)
+{
+	switch (m_Stage.load())
+	{
+	case LoadStage::Upload:
+		// Worker is done once it hands over.
+		Join();
+		if (m_CpuGradients)
+		{
+			m_VolumeMap->Apply();
+			m_GradientMap->Apply();
+			if (m_NormalMap) { m_NormalMap->Apply(); }
+			Advance(LoadStage::Ready);
+			break;
+		}
+		m_Source->Apply();
+		Advance(LoadStage::Gradient);
+		break;
+	case LoadStage::Gradient:
+		// Still the worker's while it makes the CPU gradients.
+		if (m_CpuGradients) { break; }
+		m_VolumeMap = generator.GenerateVolume(m_Source, m_Range, &m_GradientMap);
+		m_Source->Release();
+		m_Source.reset();
+		Advance(LoadStage::Ready);
+		break;
+	case LoadStage::Failed:
+		Join();
+		break;
+	default:
+		break;
+	}
+}
+
+bool VolumeLoader::Wait()
+{
+	Join();
+	return m_Stage == LoadStage::Upload && m_CpuGradients;
+}
+
+void VolumeLoader::Reset()
+{
+	Join();
+
+	if (m_Source && m_Source->IsDisposed() == false)
+	{
+		m_Source->Release();
+	}
+
+	m_Source.reset();
+	m_VolumeMap.reset();
+	m_GradientMap.reset();
+	m_NormalMap.reset();
+	m_Pager.Release();
+	m_PagerStats = BrickPagerStats();
+	m_Bricks.Release();
+	m_Dicom.Release();
+	m_VolumeFile.Release();
+	m_Stats = VolumeStats();
+	m_Sidecar.Release();
+	m_Progress = 0.0f;
+	m_Stage = LoadStage::Idle;
+}
+
+//-----------------------------------------------------------------------------------
+
+bool VolumeLoader::IsBusy() const
+{
+	LoadStage stage = m_Stage;
+	return stage >= LoadStage::Read && stage <= LoadStage::Gradient;
+}
+
+bool VolumeLoader::IsReady() const
+{
+	return m_Stage == LoadStage::Ready;
+}
+
+LoadStage VolumeLoader::GetStage() const
+{
+	return m_Stage;
+}
+
+const char* VolumeLoader::GetStageName() const
+{
+	switch (m_Stage.load())
+	{
+	case LoadStage::Read:		return "Reading";
+	case LoadStage::Range:		return "Range";
+	case LoadStage::Upload:		return "Upload";
+	case LoadStage::Gradient:	return "Gradient";
+	case LoadStage::Ready:		return "Ready";
+	case LoadStage::Failed:		return "Failed";
+	case LoadStage::Cancelled:	return "Cancelled";
+	default:					return "Idle";
+	}
+}
+
+float VolumeLoader::GetProgress() const
+{
+	return m_Progress;
+}
+
+const std::string& VolumeLoader::GetVolumePath() const
+{
+	return m_VolumePath;
+}
+
+std::shared_ptr<Texture> VolumeLoader::GetVolumeMap() const
+{
+	return m_VolumeMap;
+}
+
+std::shared_ptr<Texture> VolumeLoader::GetGradientMap() const
+{
+	return m_GradientMap;
+}
+
+std::shared_ptr<Texture> VolumeLoader::GetNormalMap() const
+{
+	return m_NormalMap;
+}
+
+VolumeLayout VolumeLoader::GetLayout() const
+{
+	return m_Options.Layout;
+}
+
+const VolumeBricks& VolumeLoader::GetBricks() const
+{
+	return m_Bricks;
+}
+
+const BrickPagerStats& VolumeLoader::GetPagerStats() const
+{
+	return m_PagerStats;
+}
+
+const VolumeStats& VolumeLoader::GetStats() const
+{
+	return m_Stats;
+}
+
+const std::vector<Word>& VolumeLoader::GetCellRanges() const
+{
+	// The compute shader's gradients aren't the worker's bit for bit, ranges taken over the one don't bound the other.
+	static const std::vector<Word> none;
+	return m_CpuGradients ? m_Sidecar.GetCellRanges() : none;
+}
+
+const Uint32* VolumeLoader::GetCellSize() const
+{
+	return m_Options.CellSize;
+}
+
+Vector3 VolumeLoader::GetSpacing() const
+{
+	if (m_Dicom.IsValid())
+	{
+		return m_Dicom.GetSpacing();
+	}
+	return m_VolumeFile.IsValid() ? m_VolumeFile.GetHeader().Spacing : Vector3(1, 1, 1);
+}
+
+Vector2 VolumeLoader::GetRescale() const
+{
+	if (m_Dicom.IsValid())
+	{
+		return Vector2(m_Dicom.GetRescaleSlope(), m_Dicom.GetRescaleIntercept());
+	}
+
+	// Signed NRRD/MetaImage is stored offset to unsigned, the intercept takes it back off.
+	const VolumeFileHeader& header = m_VolumeFile.GetHeader();
+	if (m_VolumeFile.IsValid() && header.Signed)
+	{
+		return Vector2(1, header.Format == SurfaceFormat::R16_Uint ? -32768.0f : -128.0f);
+	}
+	return Vector2(1, 0);
+}
+
+//-----------------------------------------------------------------------------------
+
+void VolumeLoader::Run()
+{
+	if (ReadVolume() == false)
+	{
+		if (m_Cancel == false)
+		{
+			LogError("Failed to load volume: " + m_VolumePath);
+			m_Stage = LoadStage::Failed;
+		}
+		return;
+	}
+
+	if (Advance(LoadStage::Range) == false) { return; }
+	// No source means a fresh brick file on the worker gradient path, every voxel pass pages it instead.
+	bool paged = m_Source == nullptr;
+	if (paged)
+	{
+		m_Pager.Initialize(&m_Bricks, m_Options.BrickBudget);
+	}
+
+	if (m_Options.UseSidecar)
+	{
+		// Hashing runs at memory speed on the pool, far under the scan and gradients a hit saves.
+		// The key is the brick file's bytes whenever there is one (it is mapped, the paged path has nothing
+		// else whole, and it is the smaller), the voxels only when cooking failed. See VolumeSidecar.h.
+		Uint64 hash = m_Bricks.IsValid() ? VolumeSidecar::HashContent(m_Bricks.GetFileData(), m_Bricks.GetFileSize()) :
+			VolumeSidecar::HashContent(m_Source->GetData(), (Uint64)m_Source->GetWidth() * m_Source->GetHeight() * m_Source->GetDepth() *
+				BytesPerBlock(m_Source->GetFormat()));
+		bool hit = paged ? m_Sidecar.Load(m_SidecarPath, m_Bricks.GetWidth(), m_Bricks.GetHeight(), m_Bricks.GetDepth(), m_Bricks.GetFormat(), hash) :
+						   m_Sidecar.Load(m_SidecarPath, m_Source, hash);
+		if (hit)
+		{
+			LogInfo("Volume sidecar hit: " + m_SidecarPath);
+		}
+	}
+
+	// Full scan even with bricks, their header only has the range and the statistics come for free in the same pass.
+	if (m_Sidecar.HasStats())
+	{
+		m_Stats = m_Sidecar.GetStats();
+	}
+	else
+	{
+		m_Stats = paged ? VolumeStatistics::Scan(m_Pager) :
+			VolumeStatistics::Scan(m_Source->GetData(), (Uint64)m_Source->GetWidth() * m_Source->GetHeight() * m_Source->GetDepth(), m_Source->GetFormat());
+		m_Sidecar.SetStats(m_Stats);
+	}
+	m_Range = Vector2((float)m_Stats.Min, (float)m_Stats.Max);
+
+	if (m_CpuGradients)
+	{
+		// Only the gradient volume goes to the GPU, the source is done with.
+		if (Advance(LoadStage::Gradient) == false) { return; }
+		std::vector<Word> ranges;
+		if (m_Sidecar.HasVolumes(m_Options.Layout))
+		{
+			m_VolumeMap = m_Sidecar.GetVolumeMap();
+			m_GradientMap = m_Sidecar.GetGradientMap();
+			m_NormalMap = m_Sidecar.GetNormalMap();
+		}
+		else
+		{
+			// Paged, the cell ranges come out of the same pass over the bricks when the sidecar needs them.
+			std::vector<Word>* pagedRanges = m_Options.UseSidecar ? &ranges : nullptr;
+			if (m_Options.Layout == VolumeLayout::Split)
+			{
+				if (paged)
+				{
+					VolumeGenerator::GenerateCompactVolumeCPU(m_Pager, m_Range, m_VolumeMap, m_NormalMap, &m_GradientMap, m_Options.CellSize, pagedRanges);
+				}
+				else
+				{
+					VolumeGenerator::GenerateCompactVolumeCPU(m_Source, m_Range, m_VolumeMap, m_NormalMap, &m_GradientMap);
+				}
+			}
+			else
+			{
+				m_VolumeMap = paged ? VolumeGenerator::GenerateVolumeCPU(m_Pager, m_Range, &m_GradientMap, m_Options.CellSize, pagedRanges) :
+									  VolumeGenerator::GenerateVolumeCPU(m_Source, m_Range, &m_GradientMap);
+			}
+
+			if (m_Options.CacheVolumes)
+			{
+				m_Sidecar.SetVolumes(m_Options.Layout, m_VolumeMap, m_GradientMap, m_NormalMap);
+			}
+		}
+
+		if (paged)
+		{
+			m_PagerStats = m_Pager.GetStats();
+			m_Pager.Release();
+		}
+		else
+		{
+			m_Source->Release();
+			m_Source.reset();
+		}
+
+		if (m_Options.UseSidecar)
+		{
+			if (m_Sidecar.HasCellRanges(m_Options.CellSize, m_VolumeMap->GetFormat()) == false)
+			{
+				if (ranges.empty())
+				{
+					VolumeOccupancy::ComputeCellRanges(m_VolumeMap, m_GradientMap, m_Options.CellSize, ranges);
+				}
+				m_Sidecar.SetCellRanges(m_Options.CellSize, m_VolumeMap->GetFormat(), ranges);
+			}
+
+			// Anything missing was made above, write it all for next time. A failed write only costs the next start.
+			if (m_Sidecar.IsDirty() && m_Cancel == false)
+			{
+				m_Sidecar.Save(m_SidecarPath);
+			}
+			m_Sidecar.DropVolumes();
+		}
+	}
+	else if (m_Options.UseSidecar)
+	{
+		// The gradients are the compute shader's, only the statistics are the worker's to keep.
+		if (m_Sidecar.IsDirty() && m_Cancel == false)
+		{
+			m_Sidecar.Save(m_SidecarPath);
+		}
+		m_Sidecar.DropVolumes();
+	}
+
+	Advance(LoadStage::Upload);
+}
+
+bool VolumeLoader::ReadVolume()
+{
+	std::string ext = m_VolumePath.substr(m_VolumePath.find_last_of(".") + 1);
+	std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+	bool isDicom = ext == "dcm";
+	bool isVolumeFile = VolumeFile::IsVolumeFile(ext);
+
+	// The brick cache is valid while it is newer than every file the volume came from.
+	std::string brickPath;
+	Uint64 sourceTime = 0;
+	if (isDicom)
+	{
+		// Headers are always read, they carry the spacing and rescale the brick file doesn't.
+		if (m_Dicom.Open(m_VolumePath) == false)
+		{
+			return false;
+		}
+
+		brickPath = m_VolumePath.substr(0, m_VolumePath.find_last_of("/\\") + 1) + m_Dicom.GetSeriesUID() + ".vbrick";
+		sourceTime = m_Dicom.GetLastWriteTime();
+	}
+	else if (isVolumeFile)
+	{
+		// Same as DICOM, the header carries the spacing so it is read even when the bricks are fresh.
+		if (m_VolumeFile.Open(m_VolumePath) == false)
+		{
+			return false;
+		}
+
+		brickPath = m_VolumePath.substr(0, m_VolumePath.find_last_of(".")) + ".vbrick";
+		sourceTime = m_VolumeFile.GetLastWriteTime();
+	}
+	else
+	{
+		if (File::Exists(m_VolumePath + ".meta") == false)
+		{
+			LogError("Missing meta file: " + m_VolumePath + ".meta");
+			return false;
+		}
+
+		brickPath = m_VolumePath.substr(0, m_VolumePath.find_last_of(".")) + ".vbrick";
+		sourceTime = std::max(BaseFile::LastWriteTime(m_VolumePath), BaseFile::LastWriteTime(m_VolumePath + ".meta"));
+	}
+
+	m_SidecarPath = VolumeSidecar::GetPath(brickPath);
+
+	ProgressCallback progress = [this](float fraction)
+	{
+		m_Progress = fraction;
+		return m_Cancel == false;
+	};
+
+	// A fresh brick file is paged by the worker gradient path, otherwise decoded on all cores instead of reading the source.
+	if (BaseFile::LastWriteTime(brickPath) >= sourceTime && m_Bricks.Open(brickPath))
+	{
+		// Any brick size pages. Only VolumePyramid::Build(pager) wants even bricks, and the pyramid is
+		// built on request from the component's pager, not here.
+		if (m_CpuGradients)
+		{
+			return true;
+		}
+
+		m_Source = std::make_shared<Texture>();
+		m_Source->Create3D(m_Bricks.GetWidth(), m_Bricks.GetHeight(), m_Bricks.GetDepth(), BufferUsage::Immutable, m_Bricks.GetFormat());
+
+		if (m_Bricks.ReadVolume(m_Source->GetData(), 0, progress))
+		{
+			return true;
+		}
+
+		m_Source.reset();
+		m_Bricks.Release();
+		if (m_Cancel) { return false; }
+	}
+
+	// Cold on the worker gradient path, DICOM and raw encoded NRRD/MetaImage are cooked a layer of bricks
+	// at a time straight from the slices and paged like a warm start, the source is never whole.
+	if (m_CpuGradients && (isDicom || (isVolumeFile && m_VolumeFile.CanReadSlices())))
+	{
+		bool cooked = false;
+		m_Progress = 0.0f;
+		if (isDicom)
+		{
+			cooked = m_Bricks.Build(m_Dicom.GetWidth(), m_Dicom.GetHeight(), m_Dicom.GetDepth(), m_Dicom.GetFormat(),
+				[this](Uint32 first, Uint32 count, Byte* slices) { return m_Dicom.ReadSlices(slices, first, count); }, brickPath, 32, progress);
+		}
+		else
+		{
+			const VolumeFileHeader& header = m_VolumeFile.GetHeader();
+			cooked = m_Bricks.Build(header.Width, header.Height, header.Depth, header.Format,
+				[this](Uint32 first, Uint32 count, Byte* slices) { return m_VolumeFile.ReadSlices(slices, first, count); }, brickPath, 32, progress);
+		}
+
+		if (cooked || m_Cancel)
+		{
+			return cooked;
+		}
+	}
+
+	m_Source = std::make_shared<Texture>();
+	if (isDicom)
+	{
+		// Slices decode straight into the texture's buffer.
+		m_Source->Create3D(m_Dicom.GetWidth(), m_Dicom.GetHeight(), m_Dicom.GetDepth(), BufferUsage::Immutable, m_Dicom.GetFormat());
+		if (m_Dicom.ReadVolume(m_Source->GetData(), progress) == false)
+		{
+			return false;
+		}
+	}
+	else if (isVolumeFile)
+	{
+		// Decompressed in chunks straight into the texture's buffer.
+		const VolumeFileHeader& header = m_VolumeFile.GetHeader();
+		m_Source->Create3D(header.Width, header.Height, header.Depth, BufferUsage::Immutable, header.Format);
+		if (m_VolumeFile.Read(m_Source->GetData(), progress) == false)
+		{
+			return false;
+		}
+	}
+	else
+	{
+		// Read (map) the raw, the GPU upload waits for the main thread.
+		m_Source->LoadFromFile(m_VolumePath, false);
+		if (m_Source->IsLoaded() == false || m_Source->GetData() == nullptr)
+		{
+			return false;
+		}
+	}
+
+	// Cook the bricked copy for next time, the load carries on without it if that fails.
+	m_Progress = 0.0f;
+	if (m_Bricks.Build(m_Source, brickPath, 32, progress) && m_CpuGradients)
+	{
+		// Paged from here like a warm start, the source (mapped raw or inflated) goes before the generated textures are made.
+		m_Source->Release();
+		m_Source.reset();
+	}
+	return m_Cancel == false;
+}
+
+bool VolumeLoader::Advance(LoadStage stage)
+{
+	if (m_Cancel)
+	{
+		return false;
+	}
+
+	m_Progress = 0.0f;
+	m_Stage = stage;
+	return true;
+}
+
+void VolumeLoader::Join()
+{
+	if (m_Worker.joinable())
+	{
+		m_Worker.join();
+	}
+}
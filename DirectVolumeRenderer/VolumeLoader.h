@@ -0,0 +1,137 @@
+//Note:
+/*
+	Loads a volume without stalling the frame. Reading or cooking and the range scan
+	run on a worker thread, the GPU stages (upload and gradient generation)
+	run one per Update on the main thread as the device context lives there. With CPU
+	gradients the gradient stage runs on the worker before the upload instead, which
+	drops the readback stall. Nothing the renderer uses is touched, the owner swaps the
+	result in once IsReady.
+	With the sidecar on, whatever a VolumeSidecar next to the volume holds for the same
+	voxels is read back instead of derived (statistics, cell ranges, the gradient stage's
+	textures) and a miss writes one for next time. Cell ranges and cached textures need
+	the generated textures on the CPU, so only CacheVolumes takes the worker gradient
+	path for the sidecar, on the compute shader path it keeps the statistics alone.
+	On the worker gradient path a fresh brick file is never decoded whole, the statistics,
+	gradients and cell ranges run a brick at a time through a BrickPager held to
+	the options' budget, only the generated textures are ever the size of the volume.
+	A cold load there cooks the brick file first and pages it the same way: DICOM and
+	raw encoded NRRD/MetaImage are read a layer of bricks at a time and never whole.
+	What still needs the dense volume:
+	- the compute shader gradient path, the whole source is uploaded;
+	- gzip/zlib NRRD/MetaImage, inflated whole (the output is the inflater's window)
+	  and dropped once cooked, before the generated textures are made;
+	- raw + .meta volumes, mapped rather than read, dropped once cooked the same way;
+	- any load whose cook fails, it carries on from the dense source;
+	- the generated textures, they are what the renderer samples: 4 bytes a voxel
+	  packed, 4 or 5 split (8 or 16 bit intensity).
+*/
+
+#pragma once
+#include "Math/Vector2.h"
+#include "Math/Vector3.h"
+#include "Content/VolumeFile.h"
+#include "BrickPager.h"
+#include "DicomSeries.h"
+#include "VolumeBricks.h"
+#include "VolumeGenerator.h"
+#include "VolumeSidecar.h"
+#include "VolumeStatistics.h"
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+
+enum class LoadStage { Idle, Read, Range, Upload, Gradient, Ready, Failed, Cancelled };
+
+struct VolumeLoadOptions
+{
+	bool		 CpuGradients = false;		// VolumeNormals on the worker instead of the compute shader
+	VolumeLayout Layout = VolumeLayout::Packed;	// Split is only made on the CPU, it takes the worker path
+	bool		 UseSidecar = true;			// Read and write the ".vstats" sidecar
+	bool		 CacheVolumes = false;		// Sidecar keeps the gradient stage's textures too, the size of the volume again; takes the worker path
+	Uint32		 CellSize[3] = { 4, 4, 4 };	// The occupancy cell size, for the sidecar's cell ranges
+	Uint64		 BrickBudget = 1024ull << 20;	// Brick cache budget for the passes that page the brick file
+};
+
+class VolumeLoader
+{
+private:
+	std::thread				 m_Worker;
+	std::atomic<LoadStage>	 m_Stage;
+	std::atomic<float>		 m_Progress;
+	std::atomic<bool>		 m_Cancel;
+	std::string				 m_VolumePath;
+	VolumeLoadOptions		 m_Options;
+	bool					 m_CpuGradients = false;	// Asked for, or needed by the layout or the sidecar
+	std::string				 m_SidecarPath;
+
+	// Worker owned until the stage reaches Upload, main thread owned after.
+	std::shared_ptr<Texture> m_Source;
+	VolumeBricks			 m_Bricks;
+	BrickPager				 m_Pager;		// Over m_Bricks while the worker pages it, m_Source stays null then
+	BrickPagerStats			 m_PagerStats;
+	DicomSeries				 m_Dicom;
+	VolumeFile				 m_VolumeFile;
+	VolumeStats				 m_Stats;
+	VolumeSidecar			 m_Sidecar;
+	Vector2					 m_Range;
+	std::shared_ptr<Texture> m_VolumeMap;
+	std::shared_ptr<Texture> m_GradientMap;
+	std::shared_ptr<Texture> m_NormalMap;		// Split layout only
+
+public:
+	VolumeLoader();
+	VolumeLoader(const VolumeLoader& loader) = delete;
+	~VolumeLoader();
+
+public:
+	void operator=(const VolumeLoader& loader) = delete;
+
+public:
+	// Cancels any load in flight and starts on volumePath.
+	void Start(const std::string& volumePath, const VolumeLoadOptions& options = VolumeLoadOptions());
+	// Blocks until the worker has stopped, drops anything half loaded.
+	void Cancel();
+	// Runs the next main thread stage, call once a frame.
+	void Update(VolumeGenerator& generator);
+	// Back to Idle, releases whatever is still held.
+	void Reset();
+	// For use with no GPU: blocks until the worker hands over instead of calling Update. True
+	// when it took the worker gradient path, the textures' CPU data is then there to read.
+	bool Wait();
+
+	bool		IsBusy()const;
+	bool		IsReady()const;
+	LoadStage	GetStage()const;
+	const char*	GetStageName()const;
+	// Fraction of the current stage, stages that can't report stay at 0.
+	float		GetProgress()const;
+	const std::string& GetVolumePath()const;
+
+	// Only valid once IsReady.
+	std::shared_ptr<Texture> GetVolumeMap()const;
+	// R8 gradient magnitude, the second axis of the transfer function.
+	std::shared_ptr<Texture> GetGradientMap()const;
+	// R8G8 octahedral normals for the split layout, null for packed.
+	std::shared_ptr<Texture> GetNormalMap()const;
+	VolumeLayout			 GetLayout()const;
+	const VolumeBricks&		 GetBricks()const;
+	// Cache counters of the last load that paged its bricks, zero when it read the whole volume.
+	const BrickPagerStats&	 GetPagerStats()const;
+	// Range, mean, variance and histogram of the stored values.
+	const VolumeStats&		 GetStats()const;
+	// Cell ranges for the options' cell size over GetVolumeMap, from the sidecar or made on the worker. Empty without the sidecar.
+	const std::vector<Word>& GetCellRanges()const;
+	const Uint32*			 GetCellSize()const;
+	// Voxel size in mm, 1 when the source doesn't say.
+	Vector3					 GetSpacing()const;
+	// Slope and intercept mapping stored values to modality units, (1, 0) when there is none.
+	Vector2					 GetRescale()const;
+
+private:
+	void Run();
+	bool ReadVolume();
+	// Moves to the next stage unless a cancel came in, false means stop.
+	bool Advance(LoadStage stage);
+	void Join();
+};
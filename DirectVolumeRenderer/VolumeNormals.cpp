@@ -0,0 +1,622 @@
+#include "VolumeNormals.h"
+#include "OctahedralNormals.h"
+#include "System/ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define NORMALS_SIMD
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#define NORMALS_TARGET(isa)
+#else
+#define NORMALS_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+namespace
+{
+	// 512 * 18 * 10 input rows of 16 bit plus the output is a few hundred KB, inside L2.
+	const Uint32 TileX = 512;
+	const Uint32 TileY = 16;
+	const Uint32 TileZ = 8;
+
+	struct NormalJob
+	{
+		const Byte* Volume = nullptr;
+		Byte*		Result = nullptr;
+		Byte*		Magnitude = nullptr;	// Optional R8 gradient magnitude
+		Uint32		Width = 0;
+		Uint32		Height = 0;
+		Uint32		Depth = 0;
+		float		MinValue = 0;
+		float		Range = 0;
+		float		InitialMax = 0;
+		const Byte* ZeroRow = nullptr;	// Stands in for the rows past the edges
+	};
+
+	// Neighbour rows of one output row, edges point at ZeroRow.
+	template<typename T>
+	struct RowSet
+	{
+		const T* Centre;
+		const T* YMinus;
+		const T* YPlus;
+		const T* ZMinus;
+		const T* ZPlus;
+		const T* Outside;	// The zero row.
+	};
+
+	// D3D float to uint (NaN and negatives go to 0), then the clamp of the 8 bit UAV store.
+	inline Dword ToByte(float value)
+	{
+		if (!(value > 0.0f)) { return 0; }
+		if (value >= 255.0f) { return 255; }
+		return (Dword)value;
+	}
+
+	// The shader body from the neighbour values on.
+	inline Dword ShadeVoxel(const NormalJob& job, float dx, float dy, float dz, float value, Byte& magnitude)
+	{
+		float length = std::sqrt(dx * dx + dy * dy + dz * dz);
+		float inverse = 1.0f / length;
+		magnitude = (Byte)ToByte(length * 0.5f / job.Range * 255.0f);
+		Dword r = ToByte((dx * inverse * 0.5f + 0.5f) * 255.0f);
+		Dword g = ToByte((dy * inverse * 0.5f + 0.5f) * 255.0f);
+		Dword b = ToByte((dz * inverse * 0.5f + 0.5f) * 255.0f);
+		Dword a = ToByte((value - job.MinValue) / job.Range * job.InitialMax);
+		return r | (g << 8) | (b << 16) | (a << 24);
+	}
+
+	inline void StoreTexel(Byte* result, Uint64 index, Dword texel)
+	{
+		memcpy(result + index * 4, &texel, sizeof(texel));
+	}
+
+	// Scalar over [x0, x1) of one row, any x including the edges.
+	template<typename T>
+	void ShadeRowScalar(const NormalJob& job, const RowSet<T>& rows, Uint32 x0, Uint32 x1, Byte* out, Byte* magnitudes)
+	{
+		for (Uint32 x = x0; x < x1; x++)
+		{
+			float left = x > 0 ? (float)rows.Centre[x - 1] : 0.0f;
+			float right = x + 1 < job.Width ? (float)rows.Centre[x + 1] : 0.0f;
+			float dx = right - left;
+			float dy = (float)rows.YPlus[x] - (float)rows.YMinus[x];
+			float dz = (float)rows.ZPlus[x] - (float)rows.ZMinus[x];
+			Byte magnitude;
+			StoreTexel(out, x, ShadeVoxel(job, dx, dy, dz, (float)rows.Centre[x], magnitude));
+			if (magnitudes) { magnitudes[x] = magnitude; }
+		}
+	}
+
+#if defined(NORMALS_SIMD)
+	// Four voxels widened to 32 bit lanes.
+	NORMALS_TARGET("sse4.1") inline __m128i Load4(const Byte* data)
+	{
+		int bits;
+		memcpy(&bits, data, sizeof(bits));
+		return _mm_cvtepu8_epi32(_mm_cvtsi32_si128(bits));
+	}
+
+	NORMALS_TARGET("sse4.1") inline __m128i Load4(const Word* data)
+	{
+		return _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i*)data));
+	}
+
+	NORMALS_TARGET("sse4.1") inline __m128i ToByte4(__m128 value)
+	{
+		// max returns the second operand for NaN, so NaN lands on 0 like the scalar path.
+		value = _mm_min_ps(_mm_max_ps(value, _mm_setzero_ps()), _mm_set1_ps(255.0f));
+		return _mm_cvttps_epi32(value);
+	}
+
+	template<typename T>
+	NORMALS_TARGET("sse4.1") void ShadeRowSSE41(const NormalJob& job, const RowSet<T>& rows, Uint32 x0, Uint32 x1, Byte* out, Byte* magnitudes)
+	{
+		// The vector loop reads x - 1 and x + 1 straight from the row, so it stays off the edges.
+		Uint32 begin = std::max(x0, (Uint32)1);
+		Uint32 end = std::min(x1, job.Width - 1);
+		if (begin >= end)
+		{
+			ShadeRowScalar(job, rows, x0, x1, out, magnitudes);
+			return;
+		}
+
+		ShadeRowScalar(job, rows, x0, begin, out, magnitudes);
+
+		const __m128 half = _mm_set1_ps(0.5f);
+		const __m128 scale = _mm_set1_ps(255.0f);
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 minValue = _mm_set1_ps(job.MinValue);
+		const __m128 range = _mm_set1_ps(job.Range);
+		const __m128 initialMax = _mm_set1_ps(job.InitialMax);
+
+		Uint32 x = begin;
+		for (; x + 4 <= end; x += 4)
+		{
+			__m128 dx = _mm_cvtepi32_ps(_mm_sub_epi32(Load4(rows.Centre + x + 1), Load4(rows.Centre + x - 1)));
+			__m128 dy = _mm_cvtepi32_ps(_mm_sub_epi32(Load4(rows.YPlus + x), Load4(rows.YMinus + x)));
+			__m128 dz = _mm_cvtepi32_ps(_mm_sub_epi32(Load4(rows.ZPlus + x), Load4(rows.ZMinus + x)));
+			__m128 value = _mm_cvtepi32_ps(Load4(rows.Centre + x));
+
+			__m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+			__m128 inverse = _mm_div_ps(one, length);
+
+			__m128i r = ToByte4(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(dx, inverse), half), half), scale));
+			__m128i g = ToByte4(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(dy, inverse), half), half), scale));
+			__m128i b = ToByte4(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(dz, inverse), half), half), scale));
+			__m128i a = ToByte4(_mm_mul_ps(_mm_div_ps(_mm_sub_ps(value, minValue), range), initialMax));
+
+			__m128i texels = _mm_or_si128(_mm_or_si128(r, _mm_slli_epi32(g, 8)), _mm_or_si128(_mm_slli_epi32(b, 16), _mm_slli_epi32(a, 24)));
+			_mm_storeu_si128((__m128i*)(out + (Uint64)x * 4), texels);
+
+			if (magnitudes)
+			{
+				__m128i m = ToByte4(_mm_mul_ps(_mm_div_ps(_mm_mul_ps(length, half), range), scale));
+				m = _mm_packus_epi16(_mm_packus_epi32(m, m), m);
+				int bytes = _mm_cvtsi128_si32(m);
+				memcpy(magnitudes + x, &bytes, sizeof(bytes));
+			}
+		}
+
+		ShadeRowScalar(job, rows, x, x1, out, magnitudes);
+	}
+
+	// Eight voxels widened to 32 bit lanes.
+	NORMALS_TARGET("avx2") inline __m256i Load8(const Byte* data)
+	{
+		return _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)data));
+	}
+
+	NORMALS_TARGET("avx2") inline __m256i Load8(const Word* data)
+	{
+		return _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)data));
+	}
+
+	NORMALS_TARGET("avx2") inline __m256i ToByte8(__m256 value)
+	{
+		value = _mm256_min_ps(_mm256_max_ps(value, _mm256_setzero_ps()), _mm256_set1_ps(255.0f));
+		return _mm256_cvttps_epi32(value);
+	}
+
+	// No FMA on purpose, a fused multiply add rounds once and would drift from the reference.
+	template<typename T>
+	NORMALS_TARGET("avx2") void ShadeRowAVX2(const NormalJob& job, const RowSet<T>& rows, Uint32 x0, Uint32 x1, Byte* out, Byte* magnitudes)
+	{
+		Uint32 begin = std::max(x0, (Uint32)1);
+		Uint32 end = std::min(x1, job.Width - 1);
+		if (begin >= end)
+		{
+			ShadeRowScalar(job, rows, x0, x1, out, magnitudes);
+			return;
+		}
+
+		ShadeRowScalar(job, rows, x0, begin, out, magnitudes);
+
+		const __m256 half = _mm256_set1_ps(0.5f);
+		const __m256 scale = _mm256_set1_ps(255.0f);
+		const __m256 one = _mm256_set1_ps(1.0f);
+		const __m256 minValue = _mm256_set1_ps(job.MinValue);
+		const __m256 range = _mm256_set1_ps(job.Range);
+		const __m256 initialMax = _mm256_set1_ps(job.InitialMax);
+
+		Uint32 x = begin;
+		for (; x + 8 <= end; x += 8)
+		{
+			__m256 dx = _mm256_cvtepi32_ps(_mm256_sub_epi32(Load8(rows.Centre + x + 1), Load8(rows.Centre + x - 1)));
+			__m256 dy = _mm256_cvtepi32_ps(_mm256_sub_epi32(Load8(rows.YPlus + x), Load8(rows.YMinus + x)));
+			__m256 dz = _mm256_cvtepi32_ps(_mm256_sub_epi32(Load8(rows.ZPlus + x), Load8(rows.ZMinus + x)));
+			__m256 value = _mm256_cvtepi32_ps(Load8(rows.Centre + x));
+
+			__m256 length = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz)));
+			__m256 inverse = _mm256_div_ps(one, length);
+
+			__m256i r = ToByte8(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(dx, inverse), half), half), scale));
+			__m256i g = ToByte8(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(dy, inverse), half), half), scale));
+			__m256i b = ToByte8(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(dz, inverse), half), half), scale));
+			__m256i a = ToByte8(_mm256_mul_ps(_mm256_div_ps(_mm256_sub_ps(value, minValue), range), initialMax));
+
+			__m256i texels = _mm256_or_si256(_mm256_or_si256(r, _mm256_slli_epi32(g, 8)), _mm256_or_si256(_mm256_slli_epi32(b, 16), _mm256_slli_epi32(a, 24)));
+			_mm256_storeu_si256((__m256i*)(out + (Uint64)x * 4), texels);
+
+			if (magnitudes)
+			{
+				__m256i m = ToByte8(_mm256_mul_ps(_mm256_div_ps(_mm256_mul_ps(length, half), range), scale));
+				__m128i words = _mm_packus_epi32(_mm256_castsi256_si128(m), _mm256_extracti128_si256(m, 1));
+				_mm_storel_epi64((__m128i*)(magnitudes + x), _mm_packus_epi16(words, words));
+			}
+		}
+
+		ShadeRowScalar(job, rows, x, x1, out, magnitudes);
+	}
+#endif
+
+	template<typename T>
+	RowSet<T> GetRows(const NormalJob& job, Uint32 y, Uint32 z)
+	{
+		const T* zero = (const T*)job.ZeroRow;
+		Uint64 rowPitch = job.Width;
+		Uint64 slicePitch = rowPitch * job.Height;
+		const T* row = (const T*)job.Volume + z * slicePitch + y * rowPitch;
+
+		RowSet<T> rows;
+		rows.Centre = row;
+		rows.YMinus = y > 0 ? row - rowPitch : zero;
+		rows.YPlus = y + 1 < job.Height ? row + rowPitch : zero;
+		rows.ZMinus = z > 0 ? row - slicePitch : zero;
+		rows.ZPlus = z + 1 < job.Depth ? row + slicePitch : zero;
+		rows.Outside = zero;
+		return rows;
+	}
+
+	template<typename T>
+	void ShadeTile(const NormalJob& job, Uint32 x0, Uint32 x1, Uint32 y0, Uint32 y1, Uint32 z0, Uint32 z1, SimdLevel level)
+	{
+		for (Uint32 z = z0; z < z1; z++)
+		{
+			for (Uint32 y = y0; y < y1; y++)
+			{
+				RowSet<T> rows = GetRows<T>(job, y, z);
+				Uint64 rowStart = ((Uint64)z * job.Height + y) * job.Width;
+				Byte* out = job.Result + rowStart * 4;
+				Byte* magnitudes = job.Magnitude ? job.Magnitude + rowStart : nullptr;
+				switch (level)
+				{
+#if defined(NORMALS_SIMD)
+				case SimdLevel::AVX2:	ShadeRowAVX2(job, rows, x0, x1, out, magnitudes); break;
+				case SimdLevel::SSE41:	ShadeRowSSE41(job, rows, x0, x1, out, magnitudes); break;
+#endif
+				default:				ShadeRowScalar(job, rows, x0, x1, out, magnitudes); break;
+				}
+			}
+		}
+	}
+
+	// Float central differences of a whole row, the same values ShadeVoxel is given.
+	// Plain loops, the compiler vectorizes them.
+	template<typename T>
+	void GradientRow(const NormalJob& job, const RowSet<T>& rows, float* dx, float* dy, float* dz)
+	{
+		const Uint32 width = job.Width;
+		const T* centre = rows.Centre;
+		// The outside voxel comes from the zero row rather than a 0.0f literal, the compiler
+		// may fold 0.0f - x to -x and a flat edge would encode as -0 (the other side of the fold).
+		const float outside = (float)rows.Outside[0];
+		dx[0] = (width > 1 ? (float)centre[1] : outside) - outside;
+		for (Uint32 x = 1; x + 1 < width; x++)
+		{
+			dx[x] = (float)centre[x + 1] - (float)centre[x - 1];
+		}
+		if (width > 1)
+		{
+			dx[width - 1] = outside - (float)centre[width - 2];
+		}
+
+		for (Uint32 x = 0; x < width; x++)
+		{
+			dy[x] = (float)rows.YPlus[x] - (float)rows.YMinus[x];
+			dz[x] = (float)rows.ZPlus[x] - (float)rows.ZMinus[x];
+		}
+	}
+
+	// As ToByte, clamped at the top of the intensity's own range (255 or 65535).
+	inline Dword ToIntensity(float value, float maxValue)
+	{
+		if (!(value > 0.0f)) { return 0; }
+		if (value >= maxValue) { return (Dword)maxValue; }
+		return (Dword)value;
+	}
+
+	template<typename T>
+	void CompactRow(const NormalJob& job, const RowSet<T>& rows, Uint64 rowStart, Byte* intensity, Word* normals, float* scratch, SimdLevel level)
+	{
+		const Uint32 width = job.Width;
+		float* dx = scratch;
+		float* dy = scratch + width;
+		float* dz = scratch + (size_t)width * 2;
+		GradientRow(job, rows, dx, dy, dz);
+		OctahedralNormals::Encode(dx, dy, dz, width, normals + rowStart, level);
+
+		T* out = (T*)intensity + rowStart;
+		for (Uint32 x = 0; x < width; x++)
+		{
+			out[x] = (T)ToIntensity(((float)rows.Centre[x] - job.MinValue) / job.Range * job.InitialMax, job.InitialMax);
+		}
+
+		if (job.Magnitude)
+		{
+			Byte* magnitudes = job.Magnitude + rowStart;
+			for (Uint32 x = 0; x < width; x++)
+			{
+				float length = std::sqrt(dx[x] * dx[x] + dy[x] * dy[x] + dz[x] * dz[x]);
+				magnitudes[x] = (Byte)ToByte(length * 0.5f / job.Range * 255.0f);
+			}
+		}
+	}
+
+	// Angle in degrees between a gradient and a decoded normal, both any length.
+	inline double AngleBetween(double ax, double ay, double az, double bx, double by, double bz)
+	{
+		double lengths = std::sqrt(ax * ax + ay * ay + az * az) * std::sqrt(bx * bx + by * by + bz * bz);
+		if (lengths == 0.0)
+		{
+			return 180.0;
+		}
+		double cosine = std::min(std::max((ax * bx + ay * by + az * bz) / lengths, -1.0), 1.0);
+		return std::acos(cosine) * (180.0 / 3.14159265358979323846);
+	}
+
+	void Accumulate(VolumeNormals::NormalError& total, double angle)
+	{
+		total.Count++;
+		total.MeanDegrees += angle;
+		total.MaxDegrees = std::max(total.MaxDegrees, angle);
+	}
+
+	void Merge(VolumeNormals::NormalError& total, const VolumeNormals::NormalError& part)
+	{
+		total.Count += part.Count;
+		total.MeanDegrees += part.MeanDegrees;
+		total.MaxDegrees = std::max(total.MaxDegrees, part.MaxDegrees);
+	}
+
+	template<typename T>
+	void MeasureRow(const NormalJob& job, const RowSet<T>& rows, Uint64 rowStart, const Byte* packed, const Word* octahedral, float* scratch,
+					VolumeNormals::NormalError& packedError, VolumeNormals::NormalError& octahedralError)
+	{
+		const Uint32 width = job.Width;
+		float* dx = scratch;
+		float* dy = scratch + width;
+		float* dz = scratch + (size_t)width * 2;
+		float* nx = scratch + (size_t)width * 3;
+		float* ny = scratch + (size_t)width * 4;
+		float* nz = scratch + (size_t)width * 5;
+		GradientRow(job, rows, dx, dy, dz);
+		if (octahedral)
+		{
+			OctahedralNormals::Decode(octahedral + rowStart, width, nx, ny, nz);
+		}
+
+		for (Uint32 x = 0; x < width; x++)
+		{
+			// No direction to get wrong, the renderers light these with a fallback.
+			if (dx[x] == 0.0f && dy[x] == 0.0f && dz[x] == 0.0f)
+			{
+				continue;
+			}
+
+			if (packed)
+			{
+				// As the shaders unpack it, 2 * rgb - 1.
+				const Byte* texel = packed + (rowStart + x) * 4;
+				Accumulate(packedError, AngleBetween(dx[x], dy[x], dz[x], texel[0] * (2.0 / 255.0) - 1.0, texel[1] * (2.0 / 255.0) - 1.0, texel[2] * (2.0 / 255.0) - 1.0));
+			}
+
+			if (octahedral)
+			{
+				Accumulate(octahedralError, AngleBetween(dx[x], dy[x], dz[x], nx[x], ny[x], nz[x]));
+			}
+		}
+	}
+
+	template<typename T>
+	void MeasureRows(const NormalJob& job, const Byte* packed, const Word* octahedral,
+					 VolumeNormals::NormalError& packedError, VolumeNormals::NormalError& octahedralError, Uint32 maxThreads)
+	{
+		std::mutex mutex;
+		ThreadPool::Instance().ParallelFor((Uint64)job.Height * job.Depth, [&](Uint64 begin, Uint64 end)
+		{
+			std::vector<float> scratch((size_t)job.Width * 6);
+			VolumeNormals::NormalError packedPart, octahedralPart;
+			for (Uint64 row = begin; row < end; row++)
+			{
+				RowSet<T> rows = GetRows<T>(job, (Uint32)(row % job.Height), (Uint32)(row / job.Height));
+				MeasureRow(job, rows, row * job.Width, packed, octahedral, &scratch[0], packedPart, octahedralPart);
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			Merge(packedError, packedPart);
+			Merge(octahedralError, octahedralPart);
+		}, 16, maxThreads);
+	}
+
+	// Whole rows across the pool, visit(rows, rowStart, scratch) with width * scratchRows floats of scratch.
+	template<typename T, typename Visit>
+	void ForEachRow(const NormalJob& job, Uint32 scratchRows, Uint32 maxThreads, Visit visit)
+	{
+		ThreadPool::Instance().ParallelFor((Uint64)job.Height * job.Depth, [&](Uint64 begin, Uint64 end)
+		{
+			std::vector<float> scratch((size_t)job.Width * scratchRows);
+			for (Uint64 row = begin; row < end; row++)
+			{
+				Uint32 y = (Uint32)(row % job.Height);
+				Uint32 z = (Uint32)(row / job.Height);
+				visit(GetRows<T>(job, y, z), row * job.Width, &scratch[0]);
+			}
+		}, 16, maxThreads);
+	}
+
+	NormalJob MakeJob(const Byte* volume, Uint32 width, Uint32 height, Uint32 depth, const DataRange& range, Byte* result, Byte* magnitude)
+	{
+		NormalJob job;
+		job.Volume = volume;
+		job.Result = result;
+		job.Magnitude = magnitude;
+		job.Width = width;
+		job.Height = height;
+		job.Depth = depth;
+		job.MinValue = range._MinValue;
+		job.Range = range._Range;
+		job.InitialMax = range._InitialValue;
+		return job;
+	}
+}
+
+//-----------------------------------------------------------------------------------
+
+bool VolumeNormals::IsSupported(SurfaceFormat format)
+{
+	switch (format)
+	{
+	case SurfaceFormat::R8_Uint:
+	case SurfaceFormat::R8_Sint:
+	case SurfaceFormat::R16_Uint:
+	case SurfaceFormat::R16_Sint:
+		return true;
+	default:
+		return false;
+	}
+}
+
+void VolumeNormals::Generate(const Byte* volume, Uint32 width, Uint32 height, Uint32 depth, SurfaceFormat format, const DataRange& range, Byte* result, Byte* magnitude, Uint32 maxThreads)
+{
+	Generate(volume, width, height, depth, format, range, result, magnitude, maxThreads, VolumeStatistics::GetSimdLevel());
+}
+
+void VolumeNormals::Generate(const Byte* volume, Uint32 width, Uint32 height, Uint32 depth, SurfaceFormat format, const DataRange& range, Byte* result, Byte* magnitude, Uint32 maxThreads, SimdLevel level)
+{
+	if (IsSupported(format) == false || width == 0 || height == 0 || depth == 0)
+	{
+		return;
+	}
+
+	bool wide = BytesPerBlock(format) == 2;
+	std::vector<Byte> zeroRow((size_t)width * BytesPerBlock(format), 0);
+
+	NormalJob job = MakeJob(volume, width, height, depth, range, result, magnitude);
+	job.ZeroRow = &zeroRow[0];
+	level = std::min(level, VolumeStatistics::GetSimdLevel());
+
+	Uint32 tilesX = (width + TileX - 1) / TileX;
+	Uint32 tilesY = (height + TileY - 1) / TileY;
+	Uint32 tilesZ = (depth + TileZ - 1) / TileZ;
+	Uint64 tileCount = (Uint64)tilesX * tilesY * tilesZ;
+
+	ThreadPool::Instance().ParallelFor(tileCount, [&](Uint64 begin, Uint64 end)
+	{
+		for (Uint64 tile = begin; tile < end; tile++)
+		{
+			Uint32 x0 = (Uint32)(tile % tilesX) * TileX;
+			Uint32 y0 = (Uint32)((tile / tilesX) % tilesY) * TileY;
+			Uint32 z0 = (Uint32)(tile / ((Uint64)tilesX * tilesY)) * TileZ;
+			Uint32 x1 = std::min(x0 + TileX, width);
+			Uint32 y1 = std::min(y0 + TileY, height);
+			Uint32 z1 = std::min(z0 + TileZ, depth);
+
+			if (wide)
+			{
+				ShadeTile<Word>(job, x0, x1, y0, y1, z0, z1, level);
+			}
+			else
+			{
+				ShadeTile<Byte>(job, x0, x1, y0, y1, z0, z1, level);
+			}
+		}
+	}, 1, maxThreads);
+}
+
+void VolumeNormals::GenerateReference(const Byte* volume, Uint32 width, Uint32 height, Uint32 depth, SurfaceFormat format, const DataRange& range, Byte* result, Byte* magnitude)
+{
+	if (IsSupported(format) == false)
+	{
+		return;
+	}
+
+	NormalJob job = MakeJob(volume, width, height, depth, range, result, magnitude);
+	bool wide = BytesPerBlock(format) == 2;
+
+	// Load with the out of range reads returning 0.
+	auto read = [&](Int64 x, Int64 y, Int64 z) -> float
+	{
+		if (x < 0 || y < 0 || z < 0 || x >= width || y >= height || z >= depth)
+		{
+			return 0.0f;
+		}
+
+		Uint64 index = ((Uint64)z * height + (Uint64)y) * width + (Uint64)x;
+		return wide ? (float)((const Word*)volume)[index] : (float)volume[index];
+	};
+
+	for (Int64 z = 0; z < depth; z++)
+	{
+		for (Int64 y = 0; y < height; y++)
+		{
+			for (Int64 x = 0; x < width; x++)
+			{
+				float dx = read(x + 1, y, z) - read(x - 1, y, z);
+				float dy = read(x, y + 1, z) - read(x, y - 1, z);
+				float dz = read(x, y, z + 1) - read(x, y, z - 1);
+				Uint64 index = ((Uint64)z * height + (Uint64)y) * width + (Uint64)x;
+				Byte length;
+				StoreTexel(result, index, ShadeVoxel(job, dx, dy, dz, read(x, y, z), length));
+				if (magnitude) { magnitude[index] = length; }
+			}
+		}
+	}
+}
+
+void VolumeNormals::GenerateCompact(const Byte* volume, Uint32 width, Uint32 height, Uint32 depth, SurfaceFormat format, const DataRange& range,
+									Byte* intensity, Word* normals, Byte* magnitude, Uint32 maxThreads)
+{
+	GenerateCompact(volume, width, height, depth, format, range, intensity, normals, magnitude, maxThreads, VolumeStatistics::GetSimdLevel());
+}
+
+void VolumeNormals::GenerateCompact(const Byte* volume, Uint32 width, Uint32 height, Uint32 depth, SurfaceFormat format, const DataRange& range,
+									Byte* intensity, Word* normals, Byte* magnitude, Uint32 maxThreads, SimdLevel level)
+{
+	if (IsSupported(format) == false || width == 0 || height == 0 || depth == 0)
+	{
+		return;
+	}
+
+	std::vector<Byte> zeroRow((size_t)width * BytesPerBlock(format), 0);
+	NormalJob job = MakeJob(volume, width, height, depth, range, nullptr, magnitude);
+	job.ZeroRow = &zeroRow[0];
+
+	if (BytesPerBlock(format) == 2)
+	{
+		ForEachRow<Word>(job, 3, maxThreads, [&](const RowSet<Word>& rows, Uint64 rowStart, float* scratch)
+		{
+			CompactRow(job, rows, rowStart, intensity, normals, scratch, level);
+		});
+	}
+	else
+	{
+		ForEachRow<Byte>(job, 3, maxThreads, [&](const RowSet<Byte>& rows, Uint64 rowStart, float* scratch)
+		{
+			CompactRow(job, rows, rowStart, intensity, normals, scratch, level);
+		});
+	}
+}
+
+void VolumeNormals::MeasureError(const Byte* volume, Uint32 width, Uint32 height, Uint32 depth, SurfaceFormat format, const Byte* packed,
+								 const Word* octahedral, NormalError& packedError, NormalError& octahedralError, Uint32 maxThreads)
+{
+	packedError = NormalError();
+	octahedralError = NormalError();
+	if (IsSupported(format) == false || width == 0 || height == 0 || depth == 0)
+	{
+		return;
+	}
+
+	std::vector<Byte> zeroRow((size_t)width * BytesPerBlock(format), 0);
+	NormalJob job = MakeJob(volume, width, height, depth, DataRange(), nullptr, nullptr);
+	job.ZeroRow = &zeroRow[0];
+
+	if (BytesPerBlock(format) == 2)
+	{
+		MeasureRows<Word>(job, packed, octahedral, packedError, octahedralError, maxThreads);
+	}
+	else
+	{
+		MeasureRows<Byte>(job, packed, octahedral, packedError, octahedralError, maxThreads);
+	}
+
+	// Summed so far.
+	packedError.MeanDegrees /= std::max(packedError.Count, (Uint64)1);
+	octahedralError.MeanDegrees /= std::max(octahedralError.Count, (Uint64)1);
+}
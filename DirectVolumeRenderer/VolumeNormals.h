@@ -0,0 +1,56 @@
+//Note:
+/*
+	CPU version of VolumeNormalGen.hlsl, for when there is no GPU to dispatch on (or
+	the readback stall isn't wanted). Central difference gradient packed to RGB and the
+	range remapped intensity to A, R8G8B8A8 like the shader's result. Neighbours off
+	the edge read 0 like an out of range Load. The float maths runs in the same order as
+	the shader and converts like a D3D float to uint store into an 8 bit UAV (NaN and
+	negatives to 0, clamped at 255), so every level gives the same bytes as the reference.
+	The Normals benchmark checks the reference against the shader's readback.
+	Work is split into tiles a few rows deep that stay in L2, tiles run across the pool.
+	The gradient magnitude can come out too, as a fraction of the data range per voxel
+	(|s2 - s1| * 0.5 / range) in 8 bits, the second axis of the 2D transfer function.
+	GenerateCompact is the split layout, a separate intensity volume and 16 bit
+	octahedral normals (OctahedralNormals), whole rows at a time across the pool.
+*/
+
+#pragma once
+#include "VolumeGenerator.h"
+#include "VolumeStatistics.h"
+
+namespace VolumeNormals
+{
+	// R8 and R16, signed formats are read as their raw bits like the shader's uint view.
+	bool IsSupported(SurfaceFormat format);
+
+	// Writes width * height * depth RGBA8 texels to result, and R8 magnitudes to magnitude
+	// when it isn't null. maxThreads 0 uses the whole pool.
+	void Generate(const Byte* volume, Uint32 width, Uint32 height, Uint32 depth, SurfaceFormat format,
+				  const DataRange& range, Byte* result, Byte* magnitude = nullptr, Uint32 maxThreads = 0);
+	void Generate(const Byte* volume, Uint32 width, Uint32 height, Uint32 depth, SurfaceFormat format,
+				  const DataRange& range, Byte* result, Byte* magnitude, Uint32 maxThreads, SimdLevel level);
+
+	// The compact layout: intensity in the source's own width (R8, or R16 remapped over the whole
+	// 0 to 65535 range) and octahedral R8G8 normals, 3 bytes a voxel for 8 bit data instead of 4.
+	// magnitude as Generate. Gives the same gradients, only the packing differs.
+	void GenerateCompact(const Byte* volume, Uint32 width, Uint32 height, Uint32 depth, SurfaceFormat format, const DataRange& range,
+						 Byte* intensity, Word* normals, Byte* magnitude = nullptr, Uint32 maxThreads = 0);
+	void GenerateCompact(const Byte* volume, Uint32 width, Uint32 height, Uint32 depth, SurfaceFormat format, const DataRange& range,
+						 Byte* intensity, Word* normals, Byte* magnitude, Uint32 maxThreads, SimdLevel level);
+
+	// Angles between the float gradient and each stored normal, over the voxels with a gradient at all.
+	struct NormalError
+	{
+		Uint64 Count = 0;
+		double MeanDegrees = 0;
+		double MaxDegrees = 0;
+	};
+
+	// packed is Generate's RGBA8, octahedral GenerateCompact's normals, either can be null.
+	void MeasureError(const Byte* volume, Uint32 width, Uint32 height, Uint32 depth, SurfaceFormat format, const Byte* packed,
+					  const Word* octahedral, NormalError& packedError, NormalError& octahedralError, Uint32 maxThreads = 0);
+
+	// One voxel at a time, straight from the shader. What Generate is checked against.
+	void GenerateReference(const Byte* volume, Uint32 width, Uint32 height, Uint32 depth, SurfaceFormat format,
+						   const DataRange& range, Byte* result, Byte* magnitude = nullptr);
+}
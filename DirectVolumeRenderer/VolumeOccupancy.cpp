@@ -1,8 +1,185 @@
 #include "VolumeOccupancy.h"
+#include "OccupancyTraversal.h"
+#include "TransferFunction.h"
 #include "Content/ContentManager.h"
 #include "Content/Shader.h"
+#include "System/ThreadPool.h"
+#include <cfloat>
+#include <cstdlib>
+#include <mutex>
 
-void VolumeOccupancy::Initialize(GraphicsDevice* device, ContentManager* contentManager, std::string computePath)
+namespace
+{
+	// Max over any span of the opacity bins in two lookups, row k holds the max of [i, i + 2^k).
+	class RangeMaxTable
+	{
+	private:
+		std::vector<std::vector<float>> m_Levels;
+
+	public:
+		explicit RangeMaxTable(const std::vector<float>& values)
+		{
+			m_Levels.push_back(values);
+			for (size_t span = 2; span <= values.size(); span *= 2)
+			{
+				const std::vector<float>& previous = m_Levels.back();
+				std::vector<float> level(values.size() - span + 1);
+				for (size_t i = 0; i < level.size(); i++)
+				{
+					level[i] = std::max(previous[i], previous[i + span / 2]);
+				}
+				m_Levels.push_back(level);
+			}
+		}
+
+		// Inclusive, first <= last.
+		float Max(Uint32 first, Uint32 last)const
+		{
+			Uint32 level = 0;
+			while ((2u << level) <= last - first + 1)
+			{
+				level++;
+			}
+			return std::max(m_Levels[level][first], m_Levels[level][last + 1 - (1u << level)]);
+		}
+	};
+
+	// A cell's byte from its range, the same bins the diffuse LUT is sampled at and the same
+	// byte the bake writes for them. Stored values go to bins as the shader's point sample
+	// does, floor(value / scale * bins), one to one for 8 bit data in the 255 wide LUT.
+	class CellClassifier
+	{
+	private:
+		RangeMaxTable m_Opacity;
+		std::vector<Word> m_Bins;	// Per stored value
+		float m_Weights[TransferFunction::GradientBins];
+
+	public:
+		CellClassifier(const TransferFunction& transfer, Uint32 scale) : m_Opacity(transfer.GetOpacity()), m_Bins((size_t)scale + 1)
+		{
+			const Uint64 bins = transfer.GetIntensityBins();
+			for (Uint64 value = 0; value <= scale; value++)
+			{
+				m_Bins[(size_t)value] = (Word)std::min(value * bins / scale, bins - 1);
+			}
+
+			for (Uint32 row = 0; row < TransferFunction::GradientBins; row++)
+			{
+				m_Weights[row] = transfer.GetGradientWeight(row);
+			}
+		}
+
+		Uint32 Bin(Uint32 value)const
+		{
+			return m_Bins[value];
+		}
+
+		Byte operator()(const Word* range)const
+		{
+			const Uint32 gradientBins = TransferFunction::GradientBins;
+			Uint32 row = std::min((Uint32)range[2] * gradientBins / 255, gradientBins - 1);
+			return (Byte)(m_Opacity.Max(m_Bins[range[0]], m_Bins[range[1]]) * m_Weights[row] * 255);
+		}
+	};
+
+	// A DDA step reads the grid once, about what an inner sample costs per texture.
+	const double CellStepCost = 1.0;
+	// Trials within this fraction of the cheapest count as a tie, and the smaller grid wins.
+	const double CostTolerance = 0.02;
+
+	// Every mip of the occupancy map, cell ranges and their buckets, for a grid of w x h x d cells.
+	Uint64 GridBytes(Uint32 width, Uint32 height, Uint32 depth)
+	{
+		Uint64 cells = (Uint64)width * height * depth;
+		Uint64 bytes = cells * 12;
+		while (true)
+		{
+			bytes += (Uint64)width * height * depth;
+			if (width == 1 && height == 1 && depth == 1)
+			{
+				return bytes;
+			}
+			width = std::max(width >> 1, (Uint32)1);
+			height = std::max(height >> 1, (Uint32)1);
+			depth = std::max(depth >> 1, (Uint32)1);
+		}
+	}
+
+	// Larger than any distance on a line, small enough that adding a coordinate can't overflow.
+	const Int32 Unreached = 1 << 24;
+
+	// Meijster et al. lower envelope for max(|x - i|, g(i)) along one line, the L-infinity case.
+	// s and t are scratch of n entries.
+	void ChebyshevLine(const Int32* g, Int32* result, Int32 n, Int32* s, Int32* t)
+	{
+		auto f = [g](Int32 x, Int32 i) { return std::max(std::abs(x - i), g[i]); };
+		auto sep = [g](Int32 i, Int32 u) { return (g[i] <= g[u]) ? std::max(i + g[u], (i + u) / 2) : std::min(u - g[i], (i + u) / 2); };
+
+		Int32 q = 0;
+		s[0] = 0;
+		t[0] = 0;
+		for (Int32 u = 1; u < n; u++)
+		{
+			while (q >= 0 && f(t[q], s[q]) > f(t[q], u))
+			{
+				q--;
+			}
+
+			if (q < 0)
+			{
+				q = 0;
+				s[0] = u;
+			}
+			else
+			{
+				Int32 w = 1 + sep(s[q], u);
+				if (w < n)
+				{
+					q++;
+					s[q] = u;
+					t[q] = w;
+				}
+			}
+		}
+
+		for (Int32 u = n - 1; u >= 0; u--)
+		{
+			result[u] = f(u, s[q]);
+			if (u == t[q])
+			{
+				q--;
+			}
+		}
+	}
+
+	// One pass of the transform, every line along an axis with the given stride, lines in parallel.
+	void ChebyshevPass(std::vector<Int32>& field, Uint32 length, Uint64 stride, Uint64 lineCount,
+					   Uint64 lineGroup, Uint64 groupStride, Uint32 maxThreads)
+	{
+		ThreadPool::Instance().ParallelFor(lineCount, [&](Uint64 begin, Uint64 end)
+		{
+			std::vector<Int32> g(length), result(length), s(length), t(length);
+			for (Uint64 line = begin; line < end; line++)
+			{
+				// Lines start at (line % lineGroup) + (line / lineGroup) * groupStride.
+				Int32* start = &field[0] + (line % lineGroup) + (line / lineGroup) * groupStride;
+				for (Uint32 i = 0; i < length; i++)
+				{
+					g[i] = start[i * stride];
+				}
+
+				ChebyshevLine(&g[0], &result[0], (Int32)length, &s[0], &t[0]);
+
+				for (Uint32 i = 0; i < length; i++)
+				{
+					start[i * stride] = result[i];
+				}
+			}
+		}, 64, maxThreads);
+	}
+}
+
+void VolumeOccupancy::Initialize(GraphicsDevice* device, ContentManager* contentManager, std::string computePath, std::string rangePath)
 {
 	if (m_ComputeShader == nullptr || computePath != m_ComputePath)
 	{
@@ -10,6 +187,7 @@ void VolumeOccupancy::Initialize(GraphicsDevice* device, ContentManager* content
 		m_ContentManager = contentManager;
 		m_ComputePath = computePath;
 		m_ComputeShader = m_ContentManager->Load<Shader>(m_ComputePath);
+		m_RangeShader = m_ContentManager->Load<Shader>(rangePath);
 
 		if (m_ConstantBuffer.IsValid() == false)
 		{
@@ -18,52 +196,426 @@ void VolumeOccupancy::Initialize(GraphicsDevice* device, ContentManager* content
 	}
 }
 
-void VolumeOccupancy::GenerateVolumeGrid(std::shared_ptr<Texture> source, std::shared_ptr<Texture> transfer)
+void VolumeOccupancy::GenerateVolumeGrid(std::shared_ptr<Texture> source, std::shared_ptr<Texture> gradient, std::shared_ptr<Texture> transfer)
 {
-	Uint32 width = source->GetWidth();
-	Uint32 height = source->GetHeight();
-	Uint32 depth = source->GetDepth();
-
-	m_GridData.m_VolumeDims.x = (float)width;
-	m_GridData.m_VolumeDims.y = (float)height;
-	m_GridData.m_VolumeDims.z = (float)depth;
-	m_GridData.m_VoxelsPerCell = Vector3(4, 4, 4);
-
-	m_GraphicsDevice->UpdateBuffer(m_ConstantBuffer, (Byte*)&m_GridData, sizeof(GridData));
-	m_GraphicsDevice->BindConstantBuffer(m_ConstantBuffer, 0);
+	SetGridData(source);
 
-	// Bind source & Transfer
+	// Bind source, Transfer & Gradient
 	source->Bind(0);
 	transfer->Bind(1);
+	gradient->Bind(2);
 
 	// Bind a UAV texture for Compute Result
 	Texture computeResult;
-	computeResult.Create3D(width / m_GridData.m_VoxelsPerCell.x, height / m_GridData.m_VoxelsPerCell.y, depth / m_GridData.m_VoxelsPerCell.z, BufferUsage::Default, SurfaceFormat::R8_Unorm);
+	computeResult.Create3D(m_CellsX, m_CellsY, m_CellsZ, BufferUsage::Default, SurfaceFormat::R8_Unorm);
 	computeResult.SetUnorderedAccess();
 	computeResult.Apply();
 	computeResult.Bind(0, ShaderType::CS);
 
-	// 8,8,8 threads per group so dispatch is  (size / voxels per cell) / 8 that way we know how many dispatchs to groups we need.
-	Vector3 dispatch = Vector3(((width / m_GridData.m_VoxelsPerCell.x) / 8), ((height / m_GridData.m_VoxelsPerCell.y) / 8),
-		((depth / m_GridData.m_VoxelsPerCell.z) / 8));
-
-	// Run Compute Shader
+	// Run Compute Shader, 8,8,8 threads per group, rounded up, the shader drops the spare threads.
 	m_ComputeShader->Bind();
-	m_GraphicsDevice->Dispatch((Uint32)dispatch.x, (Uint32)dispatch.y, (Uint32)dispatch.z);
-	//m_GraphicsDevice->Dispatch(width, height, depth);
+	m_GraphicsDevice->Dispatch((m_CellsX + 7) / 8, (m_CellsY + 7) / 8, (m_CellsZ + 7) / 8);
 
-	// Create a new occupancy map for storage.
-	if (m_OccupancyMap == nullptr)
+	CreateOccupancyMap();
+	computeResult.GetGPUData(m_OccupancyMap->GetSurfaceData(0), GetCellCount());
+	computeResult.Release();
+
+	const Uint32 lo[3] = { 0, 0, 0 };
+	const Uint32 hi[3] = { m_CellsX, m_CellsY, m_CellsZ };
+	BuildPyramid(0, lo, hi);
+	m_OccupancyMap->Apply(true);
+}
+
+void VolumeOccupancy::BuildCellRanges(std::shared_ptr<Texture> source, std::shared_ptr<Texture> gradient)
+{
+	SetGridData(source);
+
+	source->Bind(0);
+	gradient->Bind(2);
+
+	Texture computeResult;
+	computeResult.Create3D(m_CellsX, m_CellsY, m_CellsZ, BufferUsage::Default, SurfaceFormat::R16G16B16A16_Uint);
+	computeResult.SetUnorderedAccess();
+	computeResult.Apply();
+	computeResult.Bind(0, ShaderType::CS);
+
+	m_RangeShader->Bind();
+	m_GraphicsDevice->Dispatch((m_CellsX + 7) / 8, (m_CellsY + 7) / 8, (m_CellsZ + 7) / 8);
+
+	m_CellRanges.assign((size_t)GetCellCount() * 4, 0);
+	computeResult.GetGPUData((Byte*)&m_CellRanges[0], m_CellRanges.size() * sizeof(Word));
+	computeResult.Release();
+	BuildBuckets();
+}
+
+void VolumeOccupancy::SetCellRanges(std::shared_ptr<Texture> source, const std::vector<Word>& ranges)
+{
+	SetGridData(source);
+	if (ranges.size() != (size_t)GetCellCount() * 4)
 	{
-		m_OccupancyMap = std::make_shared<Texture>();
-		m_OccupancyMap->Create3D(width / m_GridData.m_VoxelsPerCell.x, height / m_GridData.m_VoxelsPerCell.y, depth / m_GridData.m_VoxelsPerCell.z, BufferUsage::Dynamic, SurfaceFormat::R8_Unorm);
-		m_OccupancyMap->SetFilter(FilterMode::MaximunMinMagMipLinear);
-		m_OccupancyMap->SetWrapMode(WrapMode::Clamp);
+		m_CellRanges.clear();
+		return;
+	}
+
+	m_CellRanges = ranges;
+	BuildBuckets();
+}
+
+void VolumeOccupancy::ComputeCellRanges(std::shared_ptr<Texture> source, std::shared_ptr<Texture> gradient, const Uint32 cellSize[3],
+										std::vector<Word>& ranges, Uint32 maxThreads)
+{
+	const Uint32 width = source->GetWidth();
+	const Uint32 height = source->GetHeight();
+	const Uint32 depth = source->GetDepth();
+	const Uint32 cellsX = (width + cellSize[0] - 1) / cellSize[0];
+	const Uint32 cellsY = (height + cellSize[1] - 1) / cellSize[1];
+	const Uint32 cellsZ = (depth + cellSize[2] - 1) / cellSize[2];
+
+	// Intensity is the alpha byte of packed RGBA8, else the only channel, as VolumeRangeGen reads it.
+	const SurfaceFormat format = source->GetFormat();
+	const bool wide = format == SurfaceFormat::R16_Unorm;
+	const Uint32 stride = format == SurfaceFormat::R8G8B8A8_Unorm ? 4 : 1;
+	const Uint32 channel = stride - 1;
+	const Byte* volume = source->GetData();
+	const Word* volume16 = (const Word*)volume;
+	const Byte* magnitude = gradient->GetData();
+
+	// A row of cells per task, each cell shares its far face with the next like the shader.
+	ranges.assign((size_t)cellsX * cellsY * cellsZ * 4, 0);
+	ThreadPool::Instance().ParallelFor((Uint64)cellsY * cellsZ, [&](Uint64 begin, Uint64 end)
+	{
+		for (Uint64 row = begin; row < end; row++)
+		{
+			Uint32 cy = (Uint32)(row % cellsY);
+			Uint32 cz = (Uint32)(row / cellsY);
+			Uint32 y0 = cy * cellSize[1], y1 = std::min(y0 + cellSize[1], height - 1);
+			Uint32 z0 = cz * cellSize[2], z1 = std::min(z0 + cellSize[2], depth - 1);
+
+			for (Uint32 cx = 0; cx < cellsX; cx++)
+			{
+				Uint32 x0 = cx * cellSize[0], x1 = std::min(x0 + cellSize[0], width - 1);
+				Uint32 low = 65535, high = 0, steepest = 0;
+				for (Uint32 z = z0; z <= z1; z++)
+				{
+					for (Uint32 y = y0; y <= y1; y++)
+					{
+						Uint64 voxel = ((Uint64)z * height + y) * width + x0;
+						for (Uint32 x = x0; x <= x1; x++, voxel++)
+						{
+							Uint32 value = wide ? volume16[voxel] : volume[voxel * stride + channel];
+							low = std::min(low, value);
+							high = std::max(high, value);
+							steepest = std::max(steepest, (Uint32)magnitude[voxel]);
+						}
+					}
+				}
+
+				Word* range = &ranges[(row * cellsX + cx) * 4];
+				range[0] = (Word)low;
+				range[1] = (Word)high;
+				range[2] = (Word)steepest;
+			}
+		}
+	}, 1, maxThreads);
+}
+
+void VolumeOccupancy::ResetCellRanges(const Uint32 volumeSize[3], const Uint32 cellSize[3], std::vector<Word>& ranges)
+{
+	Uint64 cellCount = (Uint64)((volumeSize[0] + cellSize[0] - 1) / cellSize[0]) * ((volumeSize[1] + cellSize[1] - 1) / cellSize[1]) *
+					   ((volumeSize[2] + cellSize[2] - 1) / cellSize[2]);
+
+	// Empty range, the first merge into a cell sets it.
+	ranges.assign((size_t)cellCount * 4, 0);
+	for (Uint64 cell = 0; cell < cellCount; cell++)
+	{
+		ranges[cell * 4] = 65535;
+	}
+}
+
+void VolumeOccupancy::MergeCellRanges(const CellRangeBlock& block, const Uint32 volumeSize[3], const Uint32 cellSize[3],
+									  std::vector<Word>& ranges, std::mutex& lock)
+{
+	const Uint32 cellsX = (volumeSize[0] + cellSize[0] - 1) / cellSize[0];
+	const Uint32 cellsY = (volumeSize[1] + cellSize[1] - 1) / cellSize[1];
+	const bool wide = block.Format == SurfaceFormat::R16_Unorm;
+	const Uint32 stride = block.Format == SurfaceFormat::R8G8B8A8_Unorm ? 4 : 1;
+	const Uint32 channel = stride - 1;
+	const Word* volume16 = (const Word*)block.Volume;
+
+	// Cells share their far face, so a block starting on a cell boundary also finishes the cell before it.
+	Uint32 first[3];
+	Uint32 last[3];
+	for (Uint32 axis = 0; axis < 3; axis++)
+	{
+		first[axis] = block.Lo[axis] / cellSize[axis];
+		if (block.Lo[axis] % cellSize[axis] == 0 && first[axis] > 0)
+		{
+			first[axis]--;
+		}
+		last[axis] = (block.Hi[axis] - 1) / cellSize[axis];
+	}
+
+	const Uint32 spanX = last[0] - first[0] + 1;
+	const Uint32 spanY = last[1] - first[1] + 1;
+	const Uint32 spanZ = last[2] - first[2] + 1;
+	std::vector<Word> local((size_t)spanX * spanY * spanZ * 3);
+	for (Uint32 cz = first[2]; cz <= last[2]; cz++)
+	{
+		Uint32 z0 = std::max(cz * cellSize[2], block.Lo[2]), z1 = std::min(cz * cellSize[2] + cellSize[2], block.Hi[2] - 1);
+		for (Uint32 cy = first[1]; cy <= last[1]; cy++)
+		{
+			Uint32 y0 = std::max(cy * cellSize[1], block.Lo[1]), y1 = std::min(cy * cellSize[1] + cellSize[1], block.Hi[1] - 1);
+			for (Uint32 cx = first[0]; cx <= last[0]; cx++)
+			{
+				Uint32 x0 = std::max(cx * cellSize[0], block.Lo[0]), x1 = std::min(cx * cellSize[0] + cellSize[0], block.Hi[0] - 1);
+				Uint32 low = 65535, high = 0, steepest = 0;
+				for (Uint32 z = z0; z <= z1; z++)
+				{
+					for (Uint32 y = y0; y <= y1; y++)
+					{
+						Uint64 voxel = ((Uint64)(z - block.Origin[2]) * block.Size[1] + (y - block.Origin[1])) * block.Size[0] + (x0 - block.Origin[0]);
+						for (Uint32 x = x0; x <= x1; x++, voxel++)
+						{
+							Uint32 value = wide ? volume16[voxel] : block.Volume[voxel * stride + channel];
+							low = std::min(low, value);
+							high = std::max(high, value);
+							steepest = std::max(steepest, (Uint32)block.Magnitude[voxel]);
+						}
+					}
+				}
+
+				Word* range = &local[(((size_t)(cz - first[2]) * spanY + (cy - first[1])) * spanX + (cx - first[0])) * 3];
+				range[0] = (Word)low;
+				range[1] = (Word)high;
+				range[2] = (Word)steepest;
+			}
+		}
+	}
+
+	std::lock_guard<std::mutex> guard(lock);
+	for (Uint32 cz = first[2]; cz <= last[2]; cz++)
+	{
+		for (Uint32 cy = first[1]; cy <= last[1]; cy++)
+		{
+			for (Uint32 cx = first[0]; cx <= last[0]; cx++)
+			{
+				const Word* part = &local[(((size_t)(cz - first[2]) * spanY + (cy - first[1])) * spanX + (cx - first[0])) * 3];
+				Word* range = &ranges[(((size_t)cz * cellsY + cy) * cellsX + cx) * 4];
+				range[0] = std::min(range[0], part[0]);
+				range[1] = std::max(range[1], part[1]);
+				range[2] = std::max(range[2], part[2]);
+			}
+		}
+	}
+}
+
+void VolumeOccupancy::BuildBuckets()
+{
+	// Counting sort of the cells by (min, max) intensity for Reclassify, on the top 8 bits of each.
+	const Uint64 cellCount = GetCellCount();
+	m_BucketStart.assign(256 * 256 + 1, 0);
+	for (Uint64 cell = 0; cell < cellCount; cell++)
+	{
+		m_BucketStart[BucketOf(&m_CellRanges[cell * 4]) + 1]++;
+	}
+
+	for (size_t bucket = 1; bucket < m_BucketStart.size(); bucket++)
+	{
+		m_BucketStart[bucket] += m_BucketStart[bucket - 1];
+	}
+
+	std::vector<Uint32> next(m_BucketStart.begin(), m_BucketStart.end() - 1);
+	m_BucketCells.resize((size_t)cellCount);
+	for (Uint64 cell = 0; cell < cellCount; cell++)
+	{
+		m_BucketCells[next[BucketOf(&m_CellRanges[cell * 4])]++] = (Uint32)cell;
+	}
+}
+
+void VolumeOccupancy::Classify(const TransferFunction& transfer, Uint32 maxThreads)
+{
+	if (HasCellRanges() == false)
+	{
+		return;
 	}
 
-	computeResult.GetGPUData(m_OccupancyMap->GetData(), m_OccupancyMap->GetByteCount());
+	CellClassifier classify(transfer, m_IntensityScale);
+	CreateOccupancyMap();
+	Byte* occupancy = m_OccupancyMap->GetData();
+	const Word* ranges = &m_CellRanges[0];
+
+	ThreadPool::Instance().ParallelFor(GetCellCount(), [&](Uint64 begin, Uint64 end)
+	{
+		for (Uint64 cell = begin; cell < end; cell++)
+		{
+			occupancy[cell] = classify(ranges + cell * 4);
+		}
+	}, 16384, maxThreads);
+
+	const Uint32 lo[3] = { 0, 0, 0 };
+	const Uint32 hi[3] = { m_CellsX, m_CellsY, m_CellsZ };
+	BuildPyramid(maxThreads, lo, hi);
 	m_OccupancyMap->Apply(true);
-	computeResult.Release();
+}
+
+Uint64 VolumeOccupancy::Reclassify(const TransferFunction& transfer, Uint32 first, Uint32 last, Uint32 maxThreads)
+{
+	if (HasCellRanges() == false)
+	{
+		return 0;
+	}
+
+	// No grid at this size yet, nothing to patch.
+	if (m_OccupancyMap == nullptr || m_OccupancyMap->GetWidth() != m_CellsX || m_OccupancyMap->GetHeight() != m_CellsY ||
+		m_OccupancyMap->GetDepth() != m_CellsZ || m_BucketCells.size() != GetCellCount())
+	{
+		Classify(transfer, maxThreads);
+		return GetCellCount();
+	}
+
+	last = std::min(last, transfer.GetIntensityBins() - 1);
+	if (first > last)
+	{
+		return 0;
+	}
+
+	CellClassifier classify(transfer, m_IntensityScale);
+	Byte* occupancy = m_OccupancyMap->GetData();
+	const Word* ranges = &m_CellRanges[0];
+	const Uint64 slice = (Uint64)m_CellsX * m_CellsY;
+
+	// Changed cells' bounds, the mips above them are redone.
+	std::mutex mutex;
+	Uint64 touched = 0;
+	Uint32 lo[3] = { m_CellsX, m_CellsY, m_CellsZ };
+	Uint32 hi[3] = { 0, 0, 0 };
+
+	// A cell's bins [min, max] meet the span when min <= last and max >= first, row per min key.
+	// A key covers a run of values, the test takes its widest so no cell that meets it is missed.
+	ThreadPool::Instance().ParallelFor(256, [&](Uint64 begin, Uint64 end)
+	{
+		Uint64 localTouched = 0;
+		Uint32 localLo[3] = { m_CellsX, m_CellsY, m_CellsZ };
+		Uint32 localHi[3] = { 0, 0, 0 };
+
+		for (Uint32 minKey = (Uint32)begin; minKey < (Uint32)end; minKey++)
+		{
+			if (classify.Bin(minKey << m_BucketShift) > last)
+			{
+				continue;
+			}
+
+			for (Uint32 maxKey = minKey; maxKey < 256; maxKey++)
+			{
+				if (classify.Bin(std::min(((maxKey + 1) << m_BucketShift) - 1, m_IntensityScale)) < first)
+				{
+					continue;
+				}
+
+				Uint32 bucket = minKey * 256 + maxKey;
+				for (Uint32 i = m_BucketStart[bucket]; i < m_BucketStart[bucket + 1]; i++)
+				{
+					Uint32 cell = m_BucketCells[i];
+					Byte value = classify(ranges + (Uint64)cell * 4);
+					localTouched++;
+					if (value == occupancy[cell])
+					{
+						continue;
+					}
+
+					occupancy[cell] = value;
+
+					const Uint32 position[3] = { (Uint32)(cell % m_CellsX), (Uint32)((cell / m_CellsX) % m_CellsY), (Uint32)(cell / slice) };
+					for (int axis = 0; axis < 3; axis++)
+					{
+						localLo[axis] = std::min(localLo[axis], position[axis]);
+						localHi[axis] = std::max(localHi[axis], position[axis] + 1);
+					}
+				}
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		touched += localTouched;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			lo[axis] = std::min(lo[axis], localLo[axis]);
+			hi[axis] = std::max(hi[axis], localHi[axis]);
+		}
+	}, 1, maxThreads);
+
+	if (lo[0] < hi[0])
+	{
+		BuildPyramid(maxThreads, lo, hi);
+		m_OccupancyMap->Apply(true);
+	}
+	return touched;
+}
+
+void VolumeOccupancy::BuildDistanceField(std::vector<Byte>& distance, Uint32 maxThreads) const
+{
+	distance.clear();
+	if (m_OccupancyMap == nullptr)
+	{
+		return;
+	}
+
+	const Uint64 cellCount = GetCellCount();
+	const Byte* occupancy = m_OccupancyMap->GetSurfaceData(0);
+	std::vector<Int32> field((size_t)cellCount);
+	for (Uint64 cell = 0; cell < cellCount; cell++)
+	{
+		field[cell] = occupancy[cell] != 0 ? 0 : Unreached;
+	}
+
+	// max(|dx|, |dy|, |dz|) splits by axis: x rows, then y columns, then z.
+	const Uint64 slice = (Uint64)m_CellsX * m_CellsY;
+	ChebyshevPass(field, m_CellsX, 1, (Uint64)m_CellsY * m_CellsZ, 1, m_CellsX, maxThreads);
+	ChebyshevPass(field, m_CellsY, m_CellsX, (Uint64)m_CellsX * m_CellsZ, m_CellsX, slice, maxThreads);
+	ChebyshevPass(field, m_CellsZ, slice, slice, slice, 0, maxThreads);
+
+	// Saturates, a 255 still promises 254 empty cells each way.
+	distance.resize((size_t)cellCount);
+	for (Uint64 cell = 0; cell < cellCount; cell++)
+	{
+		distance[cell] = (Byte)std::min(field[cell], (Int32)255);
+	}
+}
+
+bool VolumeOccupancy::HasCellRanges() const
+{
+	return m_CellRanges.empty() == false;
+}
+
+Uint64 VolumeOccupancy::GetCellCount() const
+{
+	return (Uint64)m_CellsX * m_CellsY * m_CellsZ;
+}
+
+std::vector<TextureLevel> VolumeOccupancy::GetLevels() const
+{
+	std::vector<TextureLevel> levels;
+	if (m_OccupancyMap == nullptr)
+	{
+		return levels;
+	}
+
+	Uint32 width = m_CellsX, height = m_CellsY, depth = m_CellsZ;
+	for (Uint32 mip = 0; mip < m_OccupancyMap->GetMipCount(); mip++)
+	{
+		TextureLevel level;
+		level.ptr = m_OccupancyMap->GetSurfaceData(mip);
+		level.width = width;
+		level.height = height;
+		level.depth = depth;
+		level.byteCount = (Uint64)width * height * depth;
+		levels.push_back(level);
+
+		width = std::max(width >> 1, (Uint32)1);
+		height = std::max(height >> 1, (Uint32)1);
+		depth = std::max(depth >> 1, (Uint32)1);
+	}
+	return levels;
 }
 
 std::shared_ptr<Texture> VolumeOccupancy::GetOccupancyTexture() const
@@ -76,6 +628,111 @@ Vector3 VolumeOccupancy::VoxelsPerCell() const
 	return m_GridData.m_VoxelsPerCell;
 }
 
+void VolumeOccupancy::SetCellSize(Uint32 x, Uint32 y, Uint32 z)
+{
+	m_CellSize[0] = std::max(x, (Uint32)1);
+	m_CellSize[1] = std::max(y, (Uint32)1);
+	m_CellSize[2] = std::max(z, (Uint32)1);
+}
+
+const Uint32* VolumeOccupancy::GetCellSize() const
+{
+	return m_CellSize;
+}
+
+std::vector<CellSizeTrial> VolumeOccupancy::TuneCellSize(std::shared_ptr<Texture> source, std::shared_ptr<Texture> gradient, const TransferFunction& transfer,
+														 Byte threshold, Uint64 memoryBudget, Uint32 rayCount)
+{
+	const Uint32 sizes[] = { 2, 4, 8, 16 };
+	const Uint32 width = source->GetWidth(), height = source->GetHeight(), depth = source->GetDepth();
+
+	// Voxel space rays with unit directions, so the span a trace spends in occupied cells is in voxels.
+	std::vector<Vector3> origins, directions;
+	OccupancyTraversal::MakeRays(Vector3((float)width, (float)height, (float)depth), rayCount, 1234, origins, directions);
+	std::vector<OccupancyTraversal::TraceResult> results(rayCount);
+
+	std::vector<CellSizeTrial> trials;
+	Uint32 built = (Uint32)-1;
+	for (Uint32 xy : sizes)
+	{
+		for (Uint32 z : sizes)
+		{
+			if (z > xy * 2 || xy > z * 2)
+			{
+				continue;
+			}
+
+			CellSizeTrial trial;
+			trial.CellSize[0] = xy;
+			trial.CellSize[1] = xy;
+			trial.CellSize[2] = z;
+			trial.GridBytes = GridBytes((width + xy - 1) / xy, (height + xy - 1) / xy, (depth + z - 1) / z);
+			trial.OverBudget = trial.GridBytes > memoryBudget;
+			if (trial.OverBudget)
+			{
+				trials.push_back(trial);
+				continue;
+			}
+
+			SetCellSize(xy, xy, z);
+			BuildCellRanges(source, gradient);
+			Classify(transfer);
+			built = (Uint32)trials.size();
+
+			// Same rays in this grid's cell units, the ray parameter is unchanged.
+			std::vector<TextureLevel> levels = GetLevels();
+			Vector3 scale(1.0f / xy, 1.0f / xy, 1.0f / z);
+			ThreadPool::Instance().ParallelFor(rayCount, [&](Uint64 begin, Uint64 end)
+			{
+				for (Uint64 i = begin; i < end; i++)
+				{
+					results[i] = OccupancyTraversal::Trace(levels, origins[i] * scale, directions[i] * scale, threshold, 0);
+				}
+			}, 64);
+
+			Uint64 steps = 0;
+			double sampled = 0;
+			for (const OccupancyTraversal::TraceResult& result : results)
+			{
+				steps += result.Steps;
+				sampled += result.OccupiedSpan;
+			}
+
+			trial.StepsPerRay = (double)steps / rayCount;
+			trial.SampledPerRay = sampled / rayCount;
+			trial.Cost = trial.StepsPerRay * CellStepCost + trial.SampledPerRay;
+			trials.push_back(trial);
+		}
+	}
+
+	// Cheapest to trace, then the smallest grid among the near ties. Nothing fits, the smallest grid.
+	size_t chosen = 0;
+	double cheapest = DBL_MAX;
+	for (const CellSizeTrial& trial : trials)
+	{
+		if (trial.OverBudget == false) { cheapest = std::min(cheapest, trial.Cost); }
+	}
+
+	for (size_t i = 0; i < trials.size(); i++)
+	{
+		bool candidate = cheapest == DBL_MAX || (trials[i].OverBudget == false && trials[i].Cost <= cheapest * (1.0 + CostTolerance));
+		if (candidate && (trials[chosen].Chosen == false || trials[i].GridBytes < trials[chosen].GridBytes))
+		{
+			trials[chosen].Chosen = false;
+			trials[i].Chosen = true;
+			chosen = i;
+		}
+	}
+
+	SetCellSize(trials[chosen].CellSize[0], trials[chosen].CellSize[1], trials[chosen].CellSize[2]);
+	if (built != chosen)
+	{
+		BuildCellRanges(source, gradient);
+		Classify(transfer);
+	}
+	return trials;
+}
+
 void VolumeOccupancy::Release()
 {
 	if (m_OccupancyMap && m_OccupancyMap->IsDisposed() == false)
@@ -84,4 +741,116 @@ void VolumeOccupancy::Release()
 		m_OccupancyMap.reset();
 	}
 
-}
\ No newline at end of file
+	m_CellRanges.clear();
+	m_CellRanges.shrink_to_fit();
+	m_BucketStart.clear();
+	m_BucketStart.shrink_to_fit();
+	m_BucketCells.clear();
+	m_BucketCells.shrink_to_fit();
+}
+
+//-----------------------------------------------------------------------------------
+
+void VolumeOccupancy::SetGridData(std::shared_ptr<Texture> source)
+{
+	m_GridData.m_VolumeDims.x = (float)source->GetWidth();
+	m_GridData.m_VolumeDims.y = (float)source->GetHeight();
+	m_GridData.m_VolumeDims.z = (float)source->GetDepth();
+	m_GridData.m_VoxelsPerCell = Vector3((float)m_CellSize[0], (float)m_CellSize[1], (float)m_CellSize[2]);
+
+	// Intensity is alpha of the packed RGBA8 volume, or all there is of a split R8/R16 one.
+	bool packed = source->GetFormat() == SurfaceFormat::R8G8B8A8_Unorm;
+	m_IntensityScale = source->GetFormat() == SurfaceFormat::R16_Unorm ? 65535 : 255;
+	m_BucketShift = m_IntensityScale > 255 ? 8 : 0;
+	m_GridData.m_IntensityScale = (float)m_IntensityScale;
+	m_GridData.m_IntensityMask = packed ? Vector4(0, 0, 0, 1) : Vector4(1, 0, 0, 0);
+
+	// Rounded up, the last cell on an axis can be partly outside the volume.
+	m_CellsX = (source->GetWidth() + m_CellSize[0] - 1) / m_CellSize[0];
+	m_CellsY = (source->GetHeight() + m_CellSize[1] - 1) / m_CellSize[1];
+	m_CellsZ = (source->GetDepth() + m_CellSize[2] - 1) / m_CellSize[2];
+
+	m_GraphicsDevice->UpdateBuffer(m_ConstantBuffer, (Byte*)&m_GridData, sizeof(GridData));
+	m_GraphicsDevice->BindConstantBuffer(m_ConstantBuffer, 0);
+}
+
+const std::vector<Word>& VolumeOccupancy::GetCellRanges() const
+{
+	return m_CellRanges;
+}
+
+Uint32 VolumeOccupancy::BucketOf(const Word* range)const
+{
+	return (range[0] >> m_BucketShift) * 256 + (range[1] >> m_BucketShift);
+}
+
+void VolumeOccupancy::CreateOccupancyMap()
+{
+	// Create a new occupancy map for storage, or remake it in place when the cell size
+	// changed so materials holding it see the new grid.
+	if (m_OccupancyMap == nullptr || m_OccupancyMap->GetWidth() != m_CellsX || m_OccupancyMap->GetHeight() != m_CellsY || m_OccupancyMap->GetDepth() != m_CellsZ)
+	{
+		if (m_OccupancyMap == nullptr)
+		{
+			m_OccupancyMap = std::make_shared<Texture>();
+		}
+		m_OccupancyMap->Release();
+		m_OccupancyMap->Create3D(m_CellsX, m_CellsY, m_CellsZ, true, BufferUsage::Default, SurfaceFormat::R8_Unorm);
+		m_OccupancyMap->SetFilter(FilterMode::MaximunMinMagMipLinear);
+		m_OccupancyMap->SetWrapMode(WrapMode::Clamp);
+	}
+}
+
+void VolumeOccupancy::BuildPyramid(Uint32 maxThreads, const Uint32 lo[3], const Uint32 hi[3])
+{
+	std::vector<TextureLevel> levels = GetLevels();
+	Uint32 regionLo[3] = { lo[0], lo[1], lo[2] };
+	Uint32 regionHi[3] = { hi[0], hi[1], hi[2] };
+
+	// Each texel is the max of its 2x2x2 children, on an odd axis the last texel
+	// also takes the child the halving drops so nothing falls outside the chain.
+	// Only the parents of the changed region are redone, level by level.
+	for (size_t mip = 1; mip < levels.size(); mip++)
+	{
+		const TextureLevel& child = levels[mip - 1];
+		const TextureLevel& parent = levels[mip];
+		const Uint32 parentSize[3] = { parent.width, parent.height, parent.depth };
+		for (int axis = 0; axis < 3; axis++)
+		{
+			regionLo[axis] = std::min(regionLo[axis] >> 1, parentSize[axis] - 1);
+			regionHi[axis] = std::min((regionHi[axis] - 1) >> 1, parentSize[axis] - 1) + 1;
+		}
+
+		const Uint32 rows = regionHi[1] - regionLo[1];
+		ThreadPool::Instance().ParallelFor((Uint64)rows * (regionHi[2] - regionLo[2]), [&](Uint64 begin, Uint64 end)
+		{
+			for (Uint64 row = begin; row < end; row++)
+			{
+				Uint32 y = regionLo[1] + (Uint32)(row % rows);
+				Uint32 z = regionLo[2] + (Uint32)(row / rows);
+				Uint32 y0 = y * 2, y1 = (y == parent.height - 1) ? child.height : y * 2 + 2;
+				Uint32 z0 = z * 2, z1 = (z == parent.depth - 1) ? child.depth : z * 2 + 2;
+
+				Byte* out = parent.ptr + ((Uint64)z * parent.height + y) * parent.width;
+				for (Uint32 x = regionLo[0]; x < regionHi[0]; x++)
+				{
+					Uint32 x0 = x * 2, x1 = (x == parent.width - 1) ? child.width : x * 2 + 2;
+
+					Byte value = 0;
+					for (Uint32 cz = z0; cz < z1; cz++)
+					{
+						for (Uint32 cy = y0; cy < y1; cy++)
+						{
+							const Byte* in = child.ptr + ((Uint64)cz * child.height + cy) * child.width;
+							for (Uint32 cx = x0; cx < x1; cx++)
+							{
+								value = std::max(value, in[cx]);
+							}
+						}
+					}
+					out[x] = value;
+				}
+			}
+		}, 64, maxThreads);
+	}
+}
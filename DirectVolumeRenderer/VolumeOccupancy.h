@@ -1,24 +1,70 @@
 //Note:
 /*
 	Class to hold and run the volume gen compute shader
+	The occupancy grid holds the max transfer alpha per cell for empty space skipping.
+	BuildCellRanges reduces each cell to its intensity range and largest gradient once
+	per volume (GPU, read back), after that Classify redoes the grid from those ranges
+	and the transfer function alone, a table lookup per cell instead of a pass over every
+	voxel. GenerateVolumeGrid is the old full rescan, kept as the reference.
+	The map carries a full mip chain, each mip the max of the one below, so a ray can
+	skip 2, 4, 8 ... cells at once where a coarse texel is empty (see OccupancyTraversal).
+	BuildDistanceField gives, on the CPU, per cell the Chebyshev distance in cells to the
+	nearest cell with any opacity, three separable passes on the pool. Nothing draws
+	with it, the benchmarks walk it (OccupancyTraversal) against the mip chain.
+	Cells are 4 voxels a side unless set per axis, the grid is rounded up so the last
+	cell on an axis can hang over the volume's edge. TuneCellSize picks a size for the
+	loaded volume by walking sample rays through the grid each size gives.
+	Ranges are kept as the volume stores them, 16 bit for an R16 intensity volume, so a
+	wide transfer LUT classifies at its own resolution. 8 bytes a cell either way.
 */
 
 #pragma once
 #include "Content/Shader.h"
 #include "Content/Texture.h"
 #include "Math/Vector3.h"
+#include "Math/Vector4.h"
 #include <memory>
+#include <mutex>
+#include <vector>
 
 struct GridData
 {
 	Vector3 m_VolumeDims;
 	float	_pad_01 = 0.0f;
 	Vector3 m_VoxelsPerCell;
-	float	_pad_02 = 0.0f;
+	float	m_IntensityScale = 255.0f;				// Stored values per unit, 255 or 65535
+	Vector4 m_IntensityMask = Vector4(0, 0, 0, 1);	// Channel the intensity is in
+};
+
+// One cell size TuneCellSize tried, costs are per sample ray.
+struct CellSizeTrial
+{
+	Uint32 CellSize[3] = { 0, 0, 0 };
+	Uint64 GridBytes = 0;		// Occupancy mips and cell ranges
+	double StepsPerRay = 0;		// Cells the plain DDA visits
+	double SampledPerRay = 0;	// Voxels inside occupied cells, what the inner loop marches
+	double Cost = 0;			// In inner samples, a cell step counted as one
+	bool   OverBudget = false;	// Not built
+	bool   Chosen = false;
+};
+
+// Part of a generated volume for building cell ranges a piece at a time. Volume (intensity as ComputeCellRanges
+// reads it) and Magnitude hold Size voxels, the first at Origin in the volume, which can be outside it for an apron.
+// Only the voxels from Lo up to Hi (volume coordinates) are taken.
+struct CellRangeBlock
+{
+	const Byte*	  Volume = nullptr;
+	const Byte*	  Magnitude = nullptr;
+	SurfaceFormat Format = SurfaceFormat::Unkown;
+	Uint32		  Size[3] = { 0, 0, 0 };
+	int			  Origin[3] = { 0, 0, 0 };
+	Uint32		  Lo[3] = { 0, 0, 0 };
+	Uint32		  Hi[3] = { 0, 0, 0 };
 };
 
 class ContentManager;
 class GraphicsDevice;
+class TransferFunction;
 class VolumeOccupancy
 {
 private:
@@ -27,14 +73,71 @@ private:
 	GraphicsDevice*			m_GraphicsDevice = nullptr;
 	ContentManager*			m_ContentManager = nullptr;
 	std::shared_ptr<Shader>	m_ComputeShader;
+	std::shared_ptr<Shader>	m_RangeShader;
 	std::string				m_ComputePath;
 	BufferHandle			m_ConstantBuffer;
 	std::shared_ptr<Texture> m_OccupancyMap;
 
+	Uint32					m_CellsX = 0;
+	Uint32					m_CellsY = 0;
+	Uint32					m_CellsZ = 0;
+	std::vector<Word>		m_CellRanges;	// Per cell: min and max intensity (stored values), max gradient byte, unused
+	Uint32					m_IntensityScale = 255;	// Largest stored intensity, 65535 for R16
+	Uint32					m_BucketShift = 0;		// Down to the 8 bits the buckets are keyed on
+	std::vector<Uint32>		m_BucketStart;	// Cells sorted by min * 256 + max intensity key, m_BucketCells offsets
+	std::vector<Uint32>		m_BucketCells;
+	Uint32					m_CellSize[3] = { 4, 4, 4 };
+
 public:
-	void Initialize(GraphicsDevice* device, ContentManager* contentManager, std::string computePath);
-	void GenerateVolumeGrid(std::shared_ptr<Texture> src, std::shared_ptr<Texture> transfer);
+	void Initialize(GraphicsDevice* device, ContentManager* contentManager, std::string computePath, std::string rangePath);
+	// Max transfer alpha per cell, from each cell's intensity range and largest gradient magnitude.
+	// Reads every voxel, see Classify for transfer edits.
+	void GenerateVolumeGrid(std::shared_ptr<Texture> src, std::shared_ptr<Texture> gradient, std::shared_ptr<Texture> transfer);
+	// Once per volume, the transfer function independent part of the grid.
+	void BuildCellRanges(std::shared_ptr<Texture> src, std::shared_ptr<Texture> gradient);
+	// Takes ranges made earlier (ComputeCellRanges, a sidecar) at the current cell size instead, no GPU work.
+	void SetCellRanges(std::shared_ptr<Texture> src, const std::vector<Word>& ranges);
+	// BuildCellRanges' result on the CPU from resident volume and gradient data, safe from a worker thread.
+	static void ComputeCellRanges(std::shared_ptr<Texture> src, std::shared_ptr<Texture> gradient, const Uint32 cellSize[3],
+								  std::vector<Word>& ranges, Uint32 maxThreads = 0);
+	// ComputeCellRanges' result built from blocks instead, for passes that never hold the whole volume. Reset first,
+	// then merge blocks covering the volume in any order from any thread, lock guards ranges.
+	static void ResetCellRanges(const Uint32 volumeSize[3], const Uint32 cellSize[3], std::vector<Word>& ranges);
+	static void MergeCellRanges(const CellRangeBlock& block, const Uint32 volumeSize[3], const Uint32 cellSize[3],
+								std::vector<Word>& ranges, std::mutex& lock);
+	// Same grid as GenerateVolumeGrid from the cell ranges, O(1) per cell. maxThreads 0 uses the whole pool.
+	void Classify(const TransferFunction& transfer, Uint32 maxThreads = 0);
+	// Redoes only the cells whose intensity range meets the bins [first, last], for an edit that
+	// changed opacity there alone. Cheap enough to run every frame of a drag. Returns the cells redone.
+	Uint64 Reclassify(const TransferFunction& transfer, Uint32 first, Uint32 last, Uint32 maxThreads = 0);
+	bool HasCellRanges()const;
+	// Per cell min, max, max gradient, unused.
+	const std::vector<Word>& GetCellRanges()const;
+	Uint64 GetCellCount()const;
+
+	// The occupancy map's mips on the CPU, level 0 is the cell grid.
+	std::vector<TextureLevel> GetLevels()const;
 	std::shared_ptr<Texture> GetOccupancyTexture()const;
+
+	// One byte per cell from the current level 0 cells, 0 where occupied, saturating at 255.
+	// Empty without a grid. Not kept up to date, a later Classify leaves it stale.
+	void BuildDistanceField(std::vector<Byte>& distance, Uint32 maxThreads = 0)const;
 	Vector3 VoxelsPerCell()const;
+	// Voxels per cell on each axis, takes effect at the next BuildCellRanges.
+	void SetCellSize(Uint32 x, Uint32 y, Uint32 z);
+	const Uint32* GetCellSize()const;
+	// Tries sizes 2 to 16 voxels (x and y together, z within a factor of 2 of them) against the
+	// transfer function, keeps the cheapest to trace that fits the budget and leaves the grid built at it.
+	std::vector<CellSizeTrial> TuneCellSize(std::shared_ptr<Texture> src, std::shared_ptr<Texture> gradient, const TransferFunction& transfer,
+											Byte threshold, Uint64 memoryBudget, Uint32 rayCount = 4096);
 	void Release();
-};
\ No newline at end of file
+
+private:
+	void SetGridData(std::shared_ptr<Texture> src);
+	void CreateOccupancyMap();
+	// Cells by intensity range key for Reclassify, from m_CellRanges.
+	void BuildBuckets();
+	Uint32 BucketOf(const Word* range)const;
+	// Max down the mip chain from the level 0 cells [lo, hi).
+	void BuildPyramid(Uint32 maxThreads, const Uint32 lo[3], const Uint32 hi[3]);
+};
@@ -0,0 +1,411 @@
+#include "VolumePyramid.h"
+#include "BrickPager.h"
+#include "System/Logger.h"
+#include "System/ThreadPool.h"
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define PYRAMID_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	// Signed voxels are flipped on the sign bit so they reduce as unsigned and keep their order.
+	Uint32 SignBias(SurfaceFormat format)
+	{
+		switch (format)
+		{
+		case SurfaceFormat::R8_Sint:	return 0x80;
+		case SurfaceFormat::R16_Sint:	return 0x8000;
+		default:						return 0;
+		}
+	}
+
+	// Handles whatever the vector loop left over, including the clamped last voxel of odd widths.
+	template<typename T>
+	void ReduceRowScalar(const T* const avgRows[4], const T* const maxRows[4], Uint32 inWidth, Uint32 outWidth, Uint32 bias, Uint32 x, T* average, T* maximum)
+	{
+		for (; x < outWidth; x++)
+		{
+			Uint32 x0 = x * 2;
+			Uint32 x1 = x0 + 1 < inWidth ? x0 + 1 : x0;
+			Uint32 sum = 0;
+			Uint32 max = 0;
+			for (Uint32 r = 0; r < 4; r++)
+			{
+				sum += (avgRows[r][x0] ^ bias) + (avgRows[r][x1] ^ bias);
+				Uint32 a = maxRows[r][x0] ^ bias;
+				Uint32 b = maxRows[r][x1] ^ bias;
+				max = a > max ? a : max;
+				max = b > max ? b : max;
+			}
+			average[x] = (T)(((sum + 4) >> 3) ^ bias);
+			maximum[x] = (T)(max ^ bias);
+		}
+	}
+
+	// Four input rows (the y and z pairs, clamped at the edge) reduce into one output row.
+	void ReduceRow(const Uint8* const avgRows[4], const Uint8* const maxRows[4], Uint32 inWidth, Uint32 outWidth, Uint32 bias, Uint8* average, Uint8* maximum)
+	{
+		Uint32 x = 0;
+#if defined(PYRAMID_SSE2)
+		const __m128i flip = _mm_set1_epi8((char)bias);
+		const __m128i low = _mm_set1_epi16(0xFF);
+		const __m128i round = _mm_set1_epi16(4);
+
+		// 32 input voxels to 16 outputs, pairs are split into the low and high byte of each 16 bit lane.
+		for (; x + 16 <= inWidth / 2; x += 16)
+		{
+			__m128i sum[2];
+			__m128i max[2];
+			for (Uint32 h = 0; h < 2; h++)
+			{
+				Uint32 offset = x * 2 + h * 16;
+				__m128i total = _mm_setzero_si128();
+				__m128i top = _mm_setzero_si128();
+				for (Uint32 r = 0; r < 4; r++)
+				{
+					__m128i a = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(avgRows[r] + offset)), flip);
+					total = _mm_add_epi16(total, _mm_add_epi16(_mm_and_si128(a, low), _mm_srli_epi16(a, 8)));
+					__m128i m = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(maxRows[r] + offset)), flip);
+					top = _mm_max_epu8(top, m);
+				}
+				sum[h] = _mm_srli_epi16(_mm_add_epi16(total, round), 3);
+				max[h] = _mm_max_epi16(_mm_and_si128(top, low), _mm_srli_epi16(top, 8));
+			}
+
+			_mm_storeu_si128((__m128i*)(average + x), _mm_xor_si128(_mm_packus_epi16(sum[0], sum[1]), flip));
+			_mm_storeu_si128((__m128i*)(maximum + x), _mm_xor_si128(_mm_packus_epi16(max[0], max[1]), flip));
+		}
+#endif
+		ReduceRowScalar(avgRows, maxRows, inWidth, outWidth, bias, x, average, maximum);
+	}
+
+	void ReduceRow(const Uint16* const avgRows[4], const Uint16* const maxRows[4], Uint32 inWidth, Uint32 outWidth, Uint32 bias, Uint16* average, Uint16* maximum)
+	{
+		Uint32 x = 0;
+#if defined(PYRAMID_SSE2)
+		// SSE2 only has signed 16 bit max and pack, so values are moved into signed range around them.
+		const __m128i flip = _mm_set1_epi16((short)bias);
+		const __m128i sign = _mm_set1_epi16((short)0x8000);
+		const __m128i low = _mm_set1_epi32(0xFFFF);
+		const __m128i round = _mm_set1_epi32(4);
+		const __m128i center = _mm_set1_epi32(0x8000);
+
+		// 16 input voxels to 8 outputs, pairs are split into the halves of each 32 bit lane.
+		for (; x + 8 <= inWidth / 2; x += 8)
+		{
+			__m128i sum[2];
+			__m128i max[2];
+			for (Uint32 h = 0; h < 2; h++)
+			{
+				Uint32 offset = x * 2 + h * 8;
+				__m128i total = _mm_setzero_si128();
+				__m128i top = _mm_set1_epi16((short)0x8000);
+				for (Uint32 r = 0; r < 4; r++)
+				{
+					__m128i a = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(avgRows[r] + offset)), flip);
+					total = _mm_add_epi32(total, _mm_add_epi32(_mm_and_si128(a, low), _mm_srli_epi32(a, 16)));
+					__m128i m = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(maxRows[r] + offset)), _mm_xor_si128(flip, sign));
+					top = _mm_max_epi16(top, m);
+				}
+				sum[h] = _mm_sub_epi32(_mm_srli_epi32(_mm_add_epi32(total, round), 3), center);
+				top = _mm_max_epi16(top, _mm_srli_epi32(top, 16));
+				max[h] = _mm_srai_epi32(_mm_slli_epi32(top, 16), 16);
+			}
+
+			__m128i unflip = _mm_xor_si128(flip, sign);
+			_mm_storeu_si128((__m128i*)(average + x), _mm_xor_si128(_mm_packs_epi32(sum[0], sum[1]), unflip));
+			_mm_storeu_si128((__m128i*)(maximum + x), _mm_xor_si128(_mm_packs_epi32(max[0], max[1]), unflip));
+		}
+#endif
+		ReduceRowScalar(avgRows, maxRows, inWidth, outWidth, bias, x, average, maximum);
+	}
+
+	// One level down, split over output slabs on the thread pool.
+	template<typename T>
+	void ReduceLevel(const T* avgIn, const T* maxIn, Uint32 width, Uint32 height, Uint32 depth, Uint32 bias, PyramidLevel& level)
+	{
+		Uint32 outWidth = level.Width;
+		Uint32 outHeight = level.Height;
+		T* average = (T*)&level.Intensity[0];
+		T* maximum = (T*)&level.Occupancy[0];
+
+		ThreadPool::Instance().ParallelFor(level.Depth, [&](Uint64 begin, Uint64 end)
+		{
+			for (Uint64 z = begin; z < end; z++)
+			{
+				Uint64 z0 = z * 2;
+				Uint64 z1 = z0 + 1 < depth ? z0 + 1 : z0;
+				for (Uint32 y = 0; y < outHeight; y++)
+				{
+					Uint64 y0 = (Uint64)y * 2;
+					Uint64 y1 = y0 + 1 < height ? y0 + 1 : y0;
+					Uint64 rows[4] = { (z0 * height + y0) * width, (z0 * height + y1) * width,
+									   (z1 * height + y0) * width, (z1 * height + y1) * width };
+
+					const T* avgRows[4] = { avgIn + rows[0], avgIn + rows[1], avgIn + rows[2], avgIn + rows[3] };
+					const T* maxRows[4] = { maxIn + rows[0], maxIn + rows[1], maxIn + rows[2], maxIn + rows[3] };
+					Uint64 out = (z * outHeight + y) * outWidth;
+					ReduceRow(avgRows, maxRows, width, outWidth, bias, average + out, maximum + out);
+				}
+			}
+		}, 1);
+	}
+}
+
+//-----------------------------------------------------------------------------------
+
+bool VolumePyramid::Build(const Byte* volume, Uint32 width, Uint32 height, Uint32 depth, SurfaceFormat format, Uint32 maxLevels)
+{
+	Release();
+
+	Uint32 bpv = BytesPerBlock(format);
+	if (volume == nullptr || width == 0 || height == 0 || depth == 0 || (bpv != 1 && bpv != 2))
+	{
+		LogError("Volume pyramid needs 8 or 16 bit voxel data.");
+		return false;
+	}
+
+	m_Width = width;
+	m_Height = height;
+	m_Depth = depth;
+	m_Format = format;
+	ReduceLevels(volume, volume, width, height, depth, maxLevels);
+	return true;
+}
+
+bool VolumePyramid::Build(std::shared_ptr<Texture> source, Uint32 maxLevels)
+{
+	if (source == nullptr || source->GetData() == nullptr)
+	{
+		LogError("Volume pyramid source has no CPU data.");
+		return false;
+	}
+
+	return Build(source->GetData(), source->GetWidth(), source->GetHeight(), source->GetDepth(), source->GetFormat(), maxLevels);
+}
+
+bool VolumePyramid::Build(BrickPager& pager, Uint32 maxLevels)
+{
+	Release();
+
+	const VolumeBricks* bricks = pager.GetBricks();
+	if (pager.IsValid() == false)
+	{
+		LogError("Volume pyramid has no bricks to build from.");
+		return false;
+	}
+
+	// Even bricks keep every 2x2x2 block inside one brick.
+	Uint32 bpv = BytesPerBlock(bricks->GetFormat());
+	if ((bpv != 1 && bpv != 2) || bricks->GetBrickSize() % 2 != 0)
+	{
+		LogError("Volume pyramid needs 8 or 16 bit voxel data in even sized bricks.");
+		return false;
+	}
+
+	m_Width = bricks->GetWidth();
+	m_Height = bricks->GetHeight();
+	m_Depth = bricks->GetDepth();
+	m_Format = bricks->GetFormat();
+	if (m_Width == 1 && m_Height == 1 && m_Depth == 1)
+	{
+		return true;
+	}
+
+	m_Levels.emplace_back();
+	PyramidLevel& level = m_Levels.back();
+	level.Width = (m_Width + 1) / 2;
+	level.Height = (m_Height + 1) / 2;
+	level.Depth = (m_Depth + 1) / 2;
+	Uint64 byteCount = (Uint64)level.Width * level.Height * level.Depth * bpv;
+	level.Intensity.resize((size_t)byteCount);
+	level.Occupancy.resize((size_t)byteCount);
+
+	// The first level a brick at a time, the far apron clamps like the edge of the whole volume does.
+	Uint32 bias = SignBias(m_Format);
+	Uint32 padded = bricks->GetPaddedBrickSize();
+	Uint32 apron = bricks->GetApron();
+	pager.ForEachBrick([&](const BrickData& brick)
+	{
+		Uint32 ox, oy, oz, coreX, coreY, coreZ;
+		bricks->GetBrickOrigin(brick.Index, ox, oy, oz);
+		bricks->GetBrickCore(brick.Index, coreX, coreY, coreZ);
+		Uint32 outWidth = (coreX + 1) / 2;
+		Uint32 outHeight = (coreY + 1) / 2;
+		Uint32 outDepth = (coreZ + 1) / 2;
+
+		for (Uint32 z = 0; z < outDepth; z++)
+		{
+			for (Uint32 y = 0; y < outHeight; y++)
+			{
+				Uint64 rows[4];
+				for (Uint32 r = 0; r < 4; r++)
+				{
+					Uint64 pz = z * 2 + (r >> 1) + apron;
+					Uint64 py = y * 2 + (r & 1) + apron;
+					rows[r] = ((pz * padded + py) * padded + apron) * bpv;
+				}
+
+				Uint64 out = (((Uint64)oz / 2 + z) * level.Height + oy / 2 + y) * level.Width + ox / 2;
+				if (bpv == 2)
+				{
+					const Uint16* in[4];
+					for (Uint32 r = 0; r < 4; r++) { in[r] = (const Uint16*)&brick.Voxels[(size_t)rows[r]]; }
+					ReduceRow(in, in, coreX + 1, outWidth, bias, (Uint16*)&level.Intensity[0] + out, (Uint16*)&level.Occupancy[0] + out);
+				}
+				else
+				{
+					const Uint8* in[4];
+					for (Uint32 r = 0; r < 4; r++) { in[r] = &brick.Voxels[(size_t)rows[r]]; }
+					ReduceRow(in, in, coreX + 1, outWidth, bias, &level.Intensity[0] + out, &level.Occupancy[0] + out);
+				}
+			}
+		}
+	});
+
+	ReduceLevels(&level.Intensity[0], &level.Occupancy[0], level.Width, level.Height, level.Depth, maxLevels);
+	return true;
+}
+
+void VolumePyramid::ReduceLevels(const Byte* avgIn, const Byte* maxIn, Uint32 width, Uint32 height, Uint32 depth, Uint32 maxLevels)
+{
+	Uint32 bpv = BytesPerBlock(m_Format);
+	Uint32 bias = SignBias(m_Format);
+	while ((width > 1 || height > 1 || depth > 1) && (maxLevels == 0 || m_Levels.size() < maxLevels))
+	{
+		m_Levels.emplace_back();
+		PyramidLevel& level = m_Levels.back();
+		level.Width = (width + 1) / 2;
+		level.Height = (height + 1) / 2;
+		level.Depth = (depth + 1) / 2;
+
+		Uint64 byteCount = (Uint64)level.Width * level.Height * level.Depth * bpv;
+		level.Intensity.resize((size_t)byteCount);
+		level.Occupancy.resize((size_t)byteCount);
+
+		if (bpv == 2)
+		{
+			ReduceLevel((const Uint16*)avgIn, (const Uint16*)maxIn, width, height, depth, bias, level);
+		}
+		else
+		{
+			ReduceLevel((const Uint8*)avgIn, (const Uint8*)maxIn, width, height, depth, bias, level);
+		}
+
+		// Each reduction builds on its own previous level.
+		avgIn = &level.Intensity[0];
+		maxIn = &level.Occupancy[0];
+		width = level.Width;
+		height = level.Height;
+		depth = level.Depth;
+	}
+}
+
+void VolumePyramid::Release()
+{
+	m_Levels.clear();
+	m_Levels.shrink_to_fit();
+	m_Width = m_Height = m_Depth = 0;
+	m_Format = SurfaceFormat::Unkown;
+}
+
+bool VolumePyramid::IsValid() const
+{
+	return m_Width > 0;
+}
+
+//-----------------------------------------------------------------------------------
+
+Uint32 VolumePyramid::GetLevelCount() const
+{
+	return IsValid() ? (Uint32)m_Levels.size() + 1 : 0;
+}
+
+void VolumePyramid::GetLevelSize(Uint32 level, Uint32& width, Uint32& height, Uint32& depth) const
+{
+	if (level == 0)
+	{
+		width = m_Width;
+		height = m_Height;
+		depth = m_Depth;
+		return;
+	}
+
+	const PyramidLevel& data = GetLevel(level);
+	width = data.Width;
+	height = data.Height;
+	depth = data.Depth;
+}
+
+const PyramidLevel& VolumePyramid::GetLevel(Uint32 level) const
+{
+	assert(level > 0 && level <= m_Levels.size() && "Pyramid level out of range");
+	return m_Levels[level - 1];
+}
+
+const Byte* VolumePyramid::GetLevelData(Uint32 level, PyramidReduce reduce) const
+{
+	const PyramidLevel& data = GetLevel(level);
+	return reduce == PyramidReduce::Max ? &data.Occupancy[0] : &data.Intensity[0];
+}
+
+Uint64 VolumePyramid::GetLevelByteCount(Uint32 level) const
+{
+	Uint32 width, height, depth;
+	GetLevelSize(level, width, height, depth);
+	return (Uint64)width * height * depth * BytesPerBlock(m_Format);
+}
+
+Uint64 VolumePyramid::GetTotalByteCount() const
+{
+	Uint64 total = 0;
+	for (const PyramidLevel& level : m_Levels)
+	{
+		total += level.Intensity.size() + level.Occupancy.size();
+	}
+	return total;
+}
+
+SurfaceFormat VolumePyramid::GetFormat() const
+{
+	return m_Format;
+}
+
+//-----------------------------------------------------------------------------------
+
+std::shared_ptr<Texture> VolumePyramid::CreateTexture(Uint32 level, PyramidReduce reduce) const
+{
+	if (level == 0 || level > m_Levels.size())
+	{
+		LogError("Pyramid level out of range.");
+		return nullptr;
+	}
+
+	const PyramidLevel& data = GetLevel(level);
+	std::shared_ptr<Texture> texture = std::make_shared<Texture>();
+	texture->Create3D(data.Width, data.Height, data.Depth, BufferUsage::Immutable, m_Format);
+	memcpy(texture->GetData(), GetLevelData(level, reduce), (size_t)GetLevelByteCount(level));
+	texture->Apply();
+	return texture;
+}
+
+void VolumePyramid::LogReport() const
+{
+	char line[128];
+	for (Uint32 level = 0; level < GetLevelCount(); level++)
+	{
+		Uint32 width, height, depth;
+		GetLevelSize(level, width, height, depth);
+		snprintf(line, sizeof(line), "Pyramid level %u: %ux%ux%u, %.1f KB%s", level, width, height, depth,
+			GetLevelByteCount(level) / 1024.0, level == 0 ? " (source)" : " x2");
+		LogInfo(line);
+	}
+
+	snprintf(line, sizeof(line), "Pyramid total: %.2f MB", GetTotalByteCount() / (1024.0 * 1024.0));
+	LogInfo(line);
+}
@@ -0,0 +1,69 @@
+//Note:
+/*
+	CPU built level of detail pyramid for a raw volume. Every level halves each
+	axis (rounding up so edge voxels are never dropped) and keeps two reductions
+	of the 2x2x2 block below it: the average, for drawing coarse views, and the
+	max, a conservative occupancy bound for skipping space at that scale.
+	Level 0 is the source volume itself and is not duplicated here.
+*/
+
+#pragma once
+#include "Content/Texture.h"
+#include <memory>
+#include <vector>
+
+class BrickPager;
+
+enum class PyramidReduce { Average, Max };
+
+struct PyramidLevel
+{
+	Uint32 Width = 0;
+	Uint32 Height = 0;
+	Uint32 Depth = 0;
+	std::vector<Byte> Intensity;	// Average of the block below
+	std::vector<Byte> Occupancy;	// Max of the block below
+};
+
+class VolumePyramid
+{
+private:
+	Uint32						m_Width = 0;
+	Uint32						m_Height = 0;
+	Uint32						m_Depth = 0;
+	SurfaceFormat				m_Format = SurfaceFormat::Unkown;
+	std::vector<PyramidLevel>	m_Levels; // m_Levels[0] is level 1
+
+public:
+	// Reduces down to a single voxel, or stops after maxLevels coarser levels when non zero.
+	bool Build(const Byte* volume, Uint32 width, Uint32 height, Uint32 depth, SurfaceFormat format, Uint32 maxLevels = 0);
+	// As above from a volume texture, its data must be resident on the CPU.
+	bool Build(std::shared_ptr<Texture> source, Uint32 maxLevels = 0);
+	// As above from the bricks a BrickPager serves, the first level is reduced a brick at a time so the
+	// source is never resident. Bricks must be an even size.
+	bool Build(BrickPager& pager, Uint32 maxLevels = 0);
+	void Release();
+	bool IsValid()const;
+
+	// Counts level 0, so a 256^3 volume has 9 levels.
+	Uint32 GetLevelCount()const;
+	// Level 0 returns the source dims.
+	void   GetLevelSize(Uint32 level, Uint32& width, Uint32& height, Uint32& depth)const;
+	// Level must be 1 or above, level 0 is owned by the caller.
+	const PyramidLevel& GetLevel(Uint32 level)const;
+	const Byte* GetLevelData(Uint32 level, PyramidReduce reduce)const;
+	// Bytes held for one reduction of a level, level 0 reports the source size.
+	Uint64 GetLevelByteCount(Uint32 level)const;
+	// Everything held by the pyramid, both reductions, level 0 excluded.
+	Uint64 GetTotalByteCount()const;
+	SurfaceFormat GetFormat()const;
+
+	// Uploads one level as an immutable 3D texture in the source format.
+	std::shared_ptr<Texture> CreateTexture(Uint32 level, PyramidReduce reduce)const;
+	// Writes the per level memory report to the log.
+	void LogReport()const;
+
+private:
+	// Adds levels below the one given until a single voxel or maxLevels in total.
+	void ReduceLevels(const Byte* avgIn, const Byte* maxIn, Uint32 width, Uint32 height, Uint32 depth, Uint32 maxLevels);
+};
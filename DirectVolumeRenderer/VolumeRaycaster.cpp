@@ -0,0 +1,1507 @@
+#include "VolumeRaycaster.h"
+#include "System/ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define RAYCASTER_SIMD
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#define RAYCASTER_TARGET(isa)
+#define RAYCASTER_INLINE __forceinline
+#else
+#define RAYCASTER_TARGET(isa) __attribute__((target(isa)))
+#define RAYCASTER_INLINE inline __attribute__((always_inline))
+#endif
+#endif
+
+namespace
+{
+	const float Pi = 3.14159265f;
+	const float Epsilon = 0.00001f;
+	const float Dielectric = 0.04f;
+	const float EarlyOut = 0.95f;
+
+	struct Float3
+	{
+		float x, y, z;
+	};
+
+	struct Float4
+	{
+		float x, y, z, w;
+	};
+
+	inline Float3 Make(float x, float y, float z) { return Float3{ x, y, z }; }
+	inline Float3 operator+(const Float3& a, const Float3& b) { return Make(a.x + b.x, a.y + b.y, a.z + b.z); }
+	inline Float3 operator-(const Float3& a, const Float3& b) { return Make(a.x - b.x, a.y - b.y, a.z - b.z); }
+	inline Float3 operator*(const Float3& a, const Float3& b) { return Make(a.x * b.x, a.y * b.y, a.z * b.z); }
+	inline Float3 operator*(const Float3& a, float s) { return Make(a.x * s, a.y * s, a.z * s); }
+	inline Float3 operator+(const Float3& a, float s) { return Make(a.x + s, a.y + s, a.z + s); }
+	inline float Dot(const Float3& a, const Float3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+	inline float Length(const Float3& a) { return std::sqrt(Dot(a, a)); }
+	inline Float3 Normalize(const Float3& a) { return a * (1.0f / Length(a)); }
+	inline Float3 Cross(const Float3& a, const Float3& b) { return Make(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x); }
+	inline Float3 Lerp(const Float3& a, const Float3& b, float t) { return a + (b - a) * t; }
+	inline Float3 FromVector(const Vector3& v) { return Make(v.x, v.y, v.z); }
+
+	// DecodeOctahedral on one R8G8 texel.
+	inline Float3 DecodeNormal(Word texel)
+	{
+		float ex = (float)(texel & 0xFF) * (2.0f / 255.0f) - 1.0f;
+		float ey = (float)(texel >> 8) * (2.0f / 255.0f) - 1.0f;
+		Float3 n = Make(ex, ey, 1.0f - std::fabs(ex) - std::fabs(ey));
+		if (n.z < 0.0f)
+		{
+			float x = (1.0f - std::fabs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+			float y = (1.0f - std::fabs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+			n.x = x;
+			n.y = y;
+		}
+		return Normalize(n);
+	}
+
+	struct Ray
+	{
+		Float3 Start;	// Texture space, where the ray enters the volume (or the camera inside it)
+		Float3 Dir;		// Unit, the same in local and texture space
+		float  Length;	// Texture space, to where it leaves
+	};
+
+	// RayBoxIntersection and GetRay from the shaders, local space cube [-1, 1] to texture space [0, 1].
+	bool MakeRay(const Float3& origin, const Float3& dir, Ray& ray)
+	{
+		const float o[3] = { origin.x, origin.y, origin.z };
+		const float d[3] = { dir.x, dir.y, dir.z };
+		float t0 = 0.0f;	// Dont sample behind camera.
+		float t1 = 3.402823466e+38f;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float inverse = 1.0f / d[axis];
+			float tA = (-1.0f - o[axis]) * inverse;
+			float tB = (1.0f - o[axis]) * inverse;
+			t0 = std::max(t0, std::min(tA, tB));
+			t1 = std::min(t1, std::max(tA, tB));
+		}
+
+		if (!(t1 > t0))
+		{
+			return false;
+		}
+
+		ray.Start = (origin + dir * t0) * 0.5f + 0.5f;
+		ray.Dir = dir;
+		ray.Length = (t1 - t0) * 0.5f;
+		return true;
+	}
+
+	inline bool Inside(const Float3& p)
+	{
+		return p.x >= 0.0f && p.y >= 0.0f && p.z >= 0.0f && p.x <= 1.0f && p.y <= 1.0f && p.z <= 1.0f;
+	}
+
+	// The PBR shader's screen hash.
+	inline float Jitter(float x, float y)
+	{
+		float value = std::sin(x * 12.9898f + y * 78.233f) * 43758.5453f;
+		return value - std::floor(value);
+	}
+
+	// Trilinear footprint of a texture space point, linear filtering with a zero border like the volume samplers.
+	struct Footprint
+	{
+		Int64 X, Y, Z;		// Low corner texel
+		Int64 Base;			// Its index
+		float Weights[8];	// Corner i is x + (i & 1), y + (i >> 1 & 1), z + (i >> 2)
+		bool  Inside;		// All eight corners in the volume, no border checks
+	};
+
+	class Sampler
+	{
+	private:
+		const RaycastVolume& m_Volume;
+		Int64 m_Offsets[8];
+
+	public:
+		explicit Sampler(const RaycastVolume& volume) : m_Volume(volume)
+		{
+			Int64 row = volume.Width;
+			Int64 slice = (Int64)volume.Width * volume.Height;
+			for (int i = 0; i < 8; i++)
+			{
+				m_Offsets[i] = (i & 1) + ((i >> 1) & 1) * row + (i >> 2) * slice;
+			}
+		}
+
+		Footprint Locate(const Float3& p)const
+		{
+			float u = p.x * m_Volume.Width - 0.5f;
+			float v = p.y * m_Volume.Height - 0.5f;
+			float w = p.z * m_Volume.Depth - 0.5f;
+			float fx = std::floor(u);
+			float fy = std::floor(v);
+			float fz = std::floor(w);
+
+			Footprint footprint;
+			footprint.X = (Int64)fx;
+			footprint.Y = (Int64)fy;
+			footprint.Z = (Int64)fz;
+			footprint.Base = (footprint.Z * m_Volume.Height + footprint.Y) * m_Volume.Width + footprint.X;
+			footprint.Inside = footprint.X >= 0 && footprint.Y >= 0 && footprint.Z >= 0 &&
+				footprint.X + 1 < m_Volume.Width && footprint.Y + 1 < m_Volume.Height && footprint.Z + 1 < m_Volume.Depth;
+
+			float tx = u - fx;
+			float ty = v - fy;
+			float tz = w - fz;
+			for (int i = 0; i < 8; i++)
+			{
+				footprint.Weights[i] = ((i & 1) ? tx : 1.0f - tx) * (((i >> 1) & 1) ? ty : 1.0f - ty) * ((i >> 2) ? tz : 1.0f - tz);
+			}
+			return footprint;
+		}
+
+		// visit(corner, index) for each corner in the volume, in corner order.
+		template<typename Visit>
+		void ForEachCorner(const Footprint& footprint, Visit visit)const
+		{
+			if (footprint.Inside)
+			{
+				for (int i = 0; i < 8; i++)
+				{
+					visit(i, footprint.Base + m_Offsets[i]);
+				}
+				return;
+			}
+
+			for (int i = 0; i < 8; i++)
+			{
+				Int64 x = footprint.X + (i & 1);
+				Int64 y = footprint.Y + ((i >> 1) & 1);
+				Int64 z = footprint.Z + (i >> 2);
+				if (x >= 0 && y >= 0 && z >= 0 && x < m_Volume.Width && y < m_Volume.Height && z < m_Volume.Depth)
+				{
+					visit(i, footprint.Base + m_Offsets[i]);
+				}
+			}
+		}
+
+		// fetch(index) for each corner in the volume, outside ones add 0.
+		template<typename Fetch>
+		float Filter(const Footprint& footprint, Fetch fetch)const
+		{
+			float sum = 0.0f;
+			ForEachCorner(footprint, [&](int corner, Int64 i) { sum += footprint.Weights[corner] * fetch(i); });
+			return sum;
+		}
+
+		// SampleVoxel's w.
+		float Intensity(const Footprint& footprint)const
+		{
+			const RaycastVolume& volume = m_Volume;
+			if (volume.Layout == VolumeLayout::Packed)
+			{
+				return Filter(footprint, [&](Int64 i) { return (float)volume.Packed[i * 4 + 3]; }) * (1.0f / 255.0f);
+			}
+			if (volume.Wide)
+			{
+				const Word* data = (const Word*)volume.Intensity;
+				return Filter(footprint, [&](Int64 i) { return (float)data[i]; }) * (1.0f / 65535.0f);
+			}
+			return Filter(footprint, [&](Int64 i) { return (float)volume.Intensity[i]; }) * (1.0f / 255.0f);
+		}
+
+		// SampleVoxel with normals, normal * 0.5 + 0.5 in xyz and intensity in w.
+		Float4 Voxel(const Footprint& footprint)const
+		{
+			const RaycastVolume& volume = m_Volume;
+			Float4 voxel;
+			voxel.w = Intensity(footprint);
+			if (volume.Layout == VolumeLayout::Packed)
+			{
+				voxel.x = Filter(footprint, [&](Int64 i) { return (float)volume.Packed[i * 4]; }) * (1.0f / 255.0f);
+				voxel.y = Filter(footprint, [&](Int64 i) { return (float)volume.Packed[i * 4 + 1]; }) * (1.0f / 255.0f);
+				voxel.z = Filter(footprint, [&](Int64 i) { return (float)volume.Packed[i * 4 + 2]; }) * (1.0f / 255.0f);
+				return voxel;
+			}
+
+			if (volume.Normals == nullptr)
+			{
+				voxel.x = voxel.y = voxel.z = 0.5f;
+				return voxel;
+			}
+
+			// SampleOctahedral, each corner decoded before the blend.
+			Float3 n = Make(0.0f, 0.0f, 0.0f);
+			ForEachCorner(footprint, [&](int corner, Int64 i) { n = n + DecodeNormal(volume.Normals[i]) * footprint.Weights[corner]; });
+			n = n * 0.5f + 0.5f;
+			voxel.x = n.x;
+			voxel.y = n.y;
+			voxel.z = n.z;
+			return voxel;
+		}
+
+		float Gradient(const Footprint& footprint)const
+		{
+			if (m_Volume.Gradient == nullptr)
+			{
+				return 0.0f;
+			}
+			const Byte* data = m_Volume.Gradient;
+			return Filter(footprint, [&](Int64 i) { return (float)data[i]; }) * (1.0f / 255.0f);
+		}
+	};
+
+	// Point sampled, clamped.
+	inline Uint32 LutTexel(float u, Uint32 size)
+	{
+		return std::min((Uint32)std::max(u * size, 0.0f), size - 1);
+	}
+
+	struct Material
+	{
+		Float3 Albedo;
+		float  Alpha;
+	};
+
+	inline Material Albedo(const RaycastVolume& volume, float intensity, float gradient)
+	{
+		Uint32 x = LutTexel(intensity, volume.IntensityBins);
+		Uint32 y = LutTexel(gradient, volume.GradientBins);
+		const Byte* texel = volume.Diffuse + ((size_t)y * volume.IntensityBins + x) * 4;
+		return Material{ Make(texel[0], texel[1], texel[2]) * (1.0f / 255.0f), texel[3] * (1.0f / 255.0f) };
+	}
+
+	float DistributionGGX(float NdotH, float roughness)
+	{
+		float a = NdotH * roughness;
+		float k = roughness / (1.0f - NdotH * NdotH + a * a);
+		return k * k * (1.0f / Pi);
+	}
+
+	float SchlickG1(float cosTheta, float k)
+	{
+		return cosTheta / (cosTheta * (1.0f - k) + k);
+	}
+
+	float GeometrySchlickSmith(float NdotL, float NdotV, float roughness)
+	{
+		float r = roughness + 1.0f;
+		float k = (r * r) / 8.0f;
+		return SchlickG1(NdotL, k) * SchlickG1(NdotV, k);
+	}
+
+	Float3 FresnelSchlick(float cosT, const Float3& F0)
+	{
+		float f = std::pow(1.0f - cosT, 5.0f);
+		return F0 + (Make(1, 1, 1) - F0) * f;
+	}
+
+	// Stands in for _SpecularBRDFLUT, the split sum scale and bias.
+	void EnvironmentBRDF(float NdotV, float roughness, float& scale, float& bias)
+	{
+		float r0 = roughness * -1.0f + 1.0f;
+		float r1 = roughness * -0.0275f + 0.0425f;
+		float r2 = roughness * -0.572f + 1.04f;
+		float r3 = roughness * 0.022f - 0.04f;
+		float a004 = std::min(r0 * r0, std::exp2(-9.28f * NdotV)) * r0 + r1;
+		scale = a004 * -1.04f + r2;
+		bias = a004 * 1.04f + r3;
+	}
+
+	// The shaders' lit sample, before the alpha premultiply.
+	Float3 Shade(const RaycastVolume& volume, const Material& material, float intensity, const Float3& N, const Float3& V, const Float3& ambient)
+	{
+		const Float3 L = Make(0.0f, 0.0f, -1.0f);
+		const Byte* surface = volume.Surface + (size_t)LutTexel(intensity, volume.IntensityBins) * 2;
+		float metalness = surface[0] * (1.0f / 255.0f);
+		float roughness = surface[1] * (1.0f / 255.0f);
+
+		Float3 H = Normalize(L + V);
+		float NdotL = std::max(Dot(N, L), 0.0f);
+		float NdotV = std::max(Dot(N, V), 0.0f);
+		float NdotH = std::max(Dot(N, H), 0.0f);
+		float VdotH = std::max(Dot(V, H), 0.0f);
+
+		Float3 F0 = Lerp(Make(Dielectric, Dielectric, Dielectric), material.Albedo, metalness);
+		float D = DistributionGGX(NdotH, roughness);
+		float G = GeometrySchlickSmith(NdotL, NdotV, roughness);
+		Float3 F = FresnelSchlick(VdotH, F0);
+
+		//--Diffuse and Specular--
+		Float3 KD = (Make(1, 1, 1) - F) * (1.0f - metalness);
+		Float3 diffuseBRDF = KD * material.Albedo;
+		Float3 specularBRDF = F * (D * G / std::max(Epsilon, 4.0f * NdotL * NdotV));
+		Float3 directLighting = (diffuseBRDF + specularBRDF) * NdotL;
+
+		//--Enviromental Lighting--
+		F = FresnelSchlick(NdotV, F0);
+		KD = (Make(1, 1, 1) - F) * (1.0f - metalness);
+		Float3 diffuseIBL = KD * material.Albedo * ambient;
+		float scale, bias;
+		EnvironmentBRDF(NdotV, roughness, scale, bias);
+		Float3 specularIBL = (F0 * scale + bias) * ambient;
+		return directLighting + diffuseIBL + specularIBL;
+	}
+
+	inline void Composite(Float4& color, const Float3& rgb, float alpha)
+	{
+		float weight = (1.0f - color.w) * alpha;
+		color.x += weight * rgb.x;
+		color.y += weight * rgb.y;
+		color.z += weight * rgb.z;
+		color.w += weight;
+	}
+
+	struct MarchContext
+	{
+		const RaycastVolume& Volume;
+		const RaycastSettings& Settings;
+		Sampler Samples;
+		float Step;			// Texture space
+		Float3 Ambient;
+		Byte Threshold;		// The iso value as an occupancy byte, PBR_ESS
+	};
+
+	struct MarchResult
+	{
+		Float4 Color = { 0, 0, 0, 0 };
+		Uint64 Samples = 0;
+		bool   Terminated = false;
+	};
+
+	// Lights a sample the transfer function kept and composites it, true once color is past the early out.
+	// PBR normalizes the normal (the light where there's none), ESS takes it as filtered.
+	bool LightSample(const MarchContext& context, const Float4& voxel, const Material& material, const Float3& V, bool normalize, Float4& color)
+	{
+		Float3 N = Make(1.0f - 2.0f * voxel.x, 1.0f - 2.0f * voxel.y, 1.0f - 2.0f * voxel.z);
+		if (normalize)
+		{
+			float lengthN = Length(N);
+			N = lengthN == 0.0f ? Make(0.0f, 0.0f, -1.0f) : N * (1.0f / lengthN);
+		}
+
+		Composite(color, Shade(context.Volume, material, voxel.w, N, V, context.Ambient), material.Alpha);
+		return color.w > EarlyOut;
+	}
+
+	// The ESS shader's DDA over the occupancy cells, from the cell the ray starts in.
+	class CellWalker
+	{
+	private:
+		const TextureLevel* m_Grid = nullptr;
+		Byte  m_Threshold = 0;
+		float m_Length = 0;
+		float m_Enter = 0;
+		Int64 m_Cell[3] = {};
+		Int64 m_Step[3] = {};
+		float m_Next[3] = {};
+		float m_Delta[3] = {};
+		bool  m_Done = true;
+
+		template<typename L> friend class PacketCellWalker;
+
+	public:
+		// The ray is scaled by the volume's extent in cells (the shader's _OccupancySize), not the grid's
+		// rounded up size, the last cell can stick out past the volume.
+		void Begin(const RaycastVolume& volume, Byte threshold, const Ray& ray)
+		{
+			const TextureLevel& grid = volume.Occupancy;
+			const Int64 size[3] = { (Int64)grid.width, (Int64)grid.height, (Int64)grid.depth };
+			const float extent[3] = { (float)volume.Width / volume.CellSize[0], (float)volume.Height / volume.CellSize[1],
+									  (float)volume.Depth / volume.CellSize[2] };
+			const float origin[3] = { ray.Start.x * extent[0], ray.Start.y * extent[1], ray.Start.z * extent[2] };
+			const float dir[3] = { ray.Dir.x * extent[0], ray.Dir.y * extent[1], ray.Dir.z * extent[2] };
+			const float infinity = 3.402823466e+38f;
+
+			m_Grid = &grid;
+			m_Threshold = threshold;
+			m_Length = ray.Length;
+			m_Enter = 0.0f;
+			m_Done = false;
+			for (int axis = 0; axis < 3; axis++)
+			{
+				m_Cell[axis] = std::min(std::max((Int64)std::floor(origin[axis]), (Int64)0), size[axis] - 1);
+				m_Step[axis] = dir[axis] > 0.0f ? 1 : -1;
+				m_Delta[axis] = dir[axis] != 0.0f ? 1.0f / std::fabs(dir[axis]) : infinity;
+				m_Next[axis] = dir[axis] > 0.0f ? ((float)(m_Cell[axis] + 1) - origin[axis]) / dir[axis]
+							 : dir[axis] < 0.0f ? ((float)m_Cell[axis] - origin[axis]) / dir[axis] : infinity;
+			}
+		}
+
+		// On to the next cell at or over the threshold, enter and exit are where the ray crosses it.
+		// False once the ray has left the grid.
+		bool Next(float& enter, float& exit)
+		{
+			const Int64 size[3] = { (Int64)m_Grid->width, (Int64)m_Grid->height, (Int64)m_Grid->depth };
+			while (m_Done == false)
+			{
+				int axis = m_Next[0] <= m_Next[1] && m_Next[0] <= m_Next[2] ? 0 : (m_Next[1] <= m_Next[2] ? 1 : 2);
+				enter = m_Enter;
+				exit = std::min(m_Next[axis], m_Length);
+				Byte occupancy = m_Grid->ptr[(m_Cell[2] * size[1] + m_Cell[1]) * size[0] + m_Cell[0]];
+
+				if (m_Next[axis] >= m_Length)
+				{
+					m_Done = true;
+				}
+				else
+				{
+					m_Enter = m_Next[axis];
+					m_Next[axis] += m_Delta[axis];
+					m_Cell[axis] += m_Step[axis];
+					m_Done = m_Cell[axis] < 0 || m_Cell[axis] >= size[axis];
+				}
+
+				if (occupancy >= m_Threshold)
+				{
+					return true;
+				}
+			}
+			return false;
+		}
+	};
+
+	// Mip_Volume: the largest intensity over the iso value.
+	void MarchMip(const MarchContext& context, const Ray& ray, float jitter, MarchResult& result)
+	{
+		Float3 delta = ray.Dir * context.Step;
+		Float3 p = ray.Start + delta * jitter;
+		float mip = 0.0f;
+		do
+		{
+			float intensity = context.Samples.Intensity(context.Samples.Locate(p));
+			result.Samples++;
+			if (intensity > context.Settings.IsoValue && intensity > mip)
+			{
+				mip = intensity;
+			}
+			p = p + delta;
+		} while (Inside(p));
+
+		result.Color = Float4{ mip, mip, mip, mip };
+	}
+
+	// Alpha_Volume: intensity as grey and opacity, scaled by AlphaAmount.
+	void MarchAlpha(const MarchContext& context, const Ray& ray, float jitter, MarchResult& result)
+	{
+		Float3 delta = ray.Dir * context.Step;
+		Float3 p = ray.Start + delta * jitter;
+		do
+		{
+			float intensity = context.Samples.Intensity(context.Samples.Locate(p));
+			result.Samples++;
+			if (intensity > context.Settings.IsoValue)
+			{
+				Composite(result.Color, Make(intensity, intensity, intensity), intensity * context.Settings.AlphaAmount);
+				if (result.Color.w > EarlyOut)
+				{
+					result.Terminated = true;
+					return;
+				}
+			}
+			p = p + delta;
+		} while (Inside(p));
+	}
+
+	// PBR_Volume: every step through the transfer function, lit where the opacity is over the iso value.
+	void MarchPBR(const MarchContext& context, const Ray& ray, float jitter, MarchResult& result)
+	{
+		const RaycastVolume& volume = context.Volume;
+		Float3 V = ray.Dir * -1.0f;
+		Float3 delta = ray.Dir * context.Step;
+		Float3 p = ray.Start + delta * jitter;
+		do
+		{
+			Footprint footprint = context.Samples.Locate(p);
+			Float4 voxel = context.Samples.Voxel(footprint);
+			result.Samples++;
+			Material material = Albedo(volume, voxel.w, context.Samples.Gradient(footprint));
+			if (material.Alpha > context.Settings.IsoValue && LightSample(context, voxel, material, V, true, result.Color))
+			{
+				result.Terminated = true;
+				return;
+			}
+			p = p + delta;
+		} while (Inside(p));
+	}
+
+	// PBR_Volume_ESS: a DDA over the occupancy cells, marching only those at or over the iso value.
+	void MarchESS(const MarchContext& context, const Ray& ray, MarchResult& result)
+	{
+		const RaycastVolume& volume = context.Volume;
+		CellWalker walker;
+		walker.Begin(volume, context.Threshold, ray);
+
+		Float3 V = ray.Dir * -1.0f;
+		Float3 stepDelta = ray.Dir * context.Step;
+		float enter, exit;
+		while (walker.Next(enter, exit))
+		{
+			Float3 p = ray.Start + ray.Dir * enter;
+			int innerSteps = (int)std::ceil((exit - enter) / context.Step);
+			for (int j = 0; j <= innerSteps; j++)
+			{
+				Footprint footprint = context.Samples.Locate(p);
+				Float4 voxel = context.Samples.Voxel(footprint);
+				result.Samples++;
+				Material material = Albedo(volume, voxel.w, context.Samples.Gradient(footprint));
+				if (material.Alpha >= context.Settings.IsoValue && LightSample(context, voxel, material, V, false, result.Color))
+				{
+					result.Terminated = true;
+					return;
+				}
+				p = p + stepDelta;
+			}
+		}
+	}
+
+	// What every tile shares.
+	struct TileJob
+	{
+		const MarchContext& Context;
+		Float3 Position;
+		Float3 Forward;
+		Float3 Right;
+		Float3 Up;
+		float  TanHalf;
+		float  Aspect;
+		Uint32 Width;
+		Uint32 Height;
+		float* Pixels;
+	};
+
+	struct TileCounts
+	{
+		Uint64 Rays = 0;
+		Uint64 Samples = 0;
+		Uint64 Terminated = 0;
+	};
+
+	// Through the centre of pixel (x, y), false if it misses the volume.
+	inline bool PixelRay(const TileJob& job, Uint32 x, Uint32 y, Ray& ray)
+	{
+		float ndcX = (2.0f * (x + 0.5f) / job.Width - 1.0f) * job.TanHalf * job.Aspect;
+		float ndcY = (1.0f - 2.0f * (y + 0.5f) / job.Height) * job.TanHalf;
+		return MakeRay(job.Position, Normalize(job.Forward + job.Right * ndcX + job.Up * ndcY), ray);
+	}
+
+	inline float PixelJitter(const TileJob& job, Uint32 x, Uint32 y)
+	{
+		return job.Context.Settings.Jitter ? Jitter(x + 0.5f, y + 0.5f) : 0.0f;
+	}
+
+	inline void WritePixel(const TileJob& job, Uint32 x, Uint32 y, const Float4& color)
+	{
+		float* pixel = &job.Pixels[((size_t)y * job.Width + x) * 4];
+		pixel[0] = color.x;
+		pixel[1] = color.y;
+		pixel[2] = color.z;
+		pixel[3] = color.w;
+	}
+
+	// One ray at a time.
+	void RenderTile(const TileJob& job, Uint32 x0, Uint32 y0, Uint32 x1, Uint32 y1, TileCounts& counts)
+	{
+		const MarchContext& context = job.Context;
+		for (Uint32 y = y0; y < y1; y++)
+		{
+			for (Uint32 x = x0; x < x1; x++)
+			{
+				Ray ray;
+				if (!PixelRay(job, x, y, ray))
+				{
+					continue;
+				}
+
+				float jitter = PixelJitter(job, x, y);
+				MarchResult result;
+				switch (context.Settings.Method)
+				{
+				case VolumeMethod::MIP:		MarchMip(context, ray, jitter, result); break;
+				case VolumeMethod::Alpha:	MarchAlpha(context, ray, jitter, result); break;
+				case VolumeMethod::PBR:		MarchPBR(context, ray, jitter, result); break;
+				case VolumeMethod::PBR_ESS:	MarchESS(context, ray, result); break;
+				}
+
+				WritePixel(job, x, y, result.Color);
+				counts.Rays++;
+				counts.Samples += result.Samples;
+				counts.Terminated += result.Terminated ? 1 : 0;
+			}
+		}
+	}
+
+	inline int CountBits(int bits)
+	{
+		int count = 0;
+		for (; bits != 0; bits &= bits - 1)
+		{
+			count++;
+		}
+		return count;
+	}
+
+#if defined(RAYCASTER_SIMD)
+	// Lane operations for the packet kernels, one set per instruction set. Masks are lanes of all ones.
+	struct Lanes4
+	{
+		typedef __m128	Float;
+		typedef __m128i Int;
+		static const int Count = 4;
+
+		static RAYCASTER_TARGET("sse4.1") Float Set(float value) { return _mm_set1_ps(value); }
+		static RAYCASTER_TARGET("sse4.1") Float Load(const float* data) { return _mm_loadu_ps(data); }
+		static RAYCASTER_TARGET("sse4.1") void  Store(float* data, Float a) { _mm_storeu_ps(data, a); }
+		static RAYCASTER_TARGET("sse4.1") Float Add(Float a, Float b) { return _mm_add_ps(a, b); }
+		static RAYCASTER_TARGET("sse4.1") Float Sub(Float a, Float b) { return _mm_sub_ps(a, b); }
+		static RAYCASTER_TARGET("sse4.1") Float Mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+		static RAYCASTER_TARGET("sse4.1") Float Div(Float a, Float b) { return _mm_div_ps(a, b); }
+		static RAYCASTER_TARGET("sse4.1") Float Max(Float a, Float b) { return _mm_max_ps(a, b); }
+		static RAYCASTER_TARGET("sse4.1") Float Floor(Float a) { return _mm_floor_ps(a); }
+		static RAYCASTER_TARGET("sse4.1") Float Sqrt(Float a) { return _mm_sqrt_ps(a); }
+		static RAYCASTER_TARGET("sse4.1") Float Abs(Float a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+		static RAYCASTER_TARGET("sse4.1") Float Greater(Float a, Float b) { return _mm_cmpgt_ps(a, b); }
+		static RAYCASTER_TARGET("sse4.1") Float GreaterEqual(Float a, Float b) { return _mm_cmpge_ps(a, b); }
+		static RAYCASTER_TARGET("sse4.1") Float LessEqual(Float a, Float b) { return _mm_cmple_ps(a, b); }
+		static RAYCASTER_TARGET("sse4.1") Float Less(Float a, Float b) { return _mm_cmplt_ps(a, b); }
+		static RAYCASTER_TARGET("sse4.1") Float And(Float a, Float b) { return _mm_and_ps(a, b); }
+		static RAYCASTER_TARGET("sse4.1") Float Select(Float mask, Float a, Float b) { return _mm_blendv_ps(b, a, mask); }
+		static RAYCASTER_TARGET("sse4.1") int   Bits(Float mask) { return _mm_movemask_ps(mask); }
+		static RAYCASTER_TARGET("sse4.1") Float FromBits(int bits)
+		{
+			__m128i lane = _mm_setr_epi32(1, 2, 4, 8);
+			return _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(bits), lane), lane));
+		}
+
+		static RAYCASTER_TARGET("sse4.1") Int   IntSet(int value) { return _mm_set1_epi32(value); }
+		static RAYCASTER_TARGET("sse4.1") Int   IntLoad(const int* data) { return _mm_loadu_si128((const __m128i*)data); }
+		static RAYCASTER_TARGET("sse4.1") void  IntStore(int* data, Int a) { _mm_storeu_si128((__m128i*)data, a); }
+		static RAYCASTER_TARGET("sse4.1") Int   IntAdd(Int a, Int b) { return _mm_add_epi32(a, b); }
+		static RAYCASTER_TARGET("sse4.1") Int   IntMul(Int a, Int b) { return _mm_mullo_epi32(a, b); }
+		static RAYCASTER_TARGET("sse4.1") Int   IntMin(Int a, Int b) { return _mm_min_epi32(a, b); }
+		static RAYCASTER_TARGET("sse4.1") Float IntGreater(Int a, Int b) { return _mm_castsi128_ps(_mm_cmpgt_epi32(a, b)); }
+		static RAYCASTER_TARGET("sse4.1") Int   ToInt(Float a) { return _mm_cvttps_epi32(a); }
+		static RAYCASTER_TARGET("sse4.1") Float ToFloat(Int a) { return _mm_cvtepi32_ps(a); }
+		// Byte shift / 8 of each lane.
+		static RAYCASTER_TARGET("sse4.1") Float ByteAt(Int a, int shift)
+		{
+			return _mm_cvtepi32_ps(_mm_and_si128(_mm_srl_epi32(a, _mm_cvtsi32_si128(shift)), _mm_set1_epi32(0xFF)));
+		}
+		// No gather before AVX2, lane by lane.
+		static RAYCASTER_TARGET("sse4.1") Int GatherDwords(const Dword* data, Int index, Float mask)
+		{
+			int bits = _mm_movemask_ps(mask);
+			return _mm_setr_epi32((bits & 1) ? (int)data[_mm_extract_epi32(index, 0)] : 0,
+								  (bits & 2) ? (int)data[_mm_extract_epi32(index, 1)] : 0,
+								  (bits & 4) ? (int)data[_mm_extract_epi32(index, 2)] : 0,
+								  (bits & 8) ? (int)data[_mm_extract_epi32(index, 3)] : 0);
+		}
+	};
+
+	struct Lanes8
+	{
+		typedef __m256	Float;
+		typedef __m256i Int;
+		static const int Count = 8;
+
+		static RAYCASTER_TARGET("avx2") Float Set(float value) { return _mm256_set1_ps(value); }
+		static RAYCASTER_TARGET("avx2") Float Load(const float* data) { return _mm256_loadu_ps(data); }
+		static RAYCASTER_TARGET("avx2") void  Store(float* data, Float a) { _mm256_storeu_ps(data, a); }
+		static RAYCASTER_TARGET("avx2") Float Add(Float a, Float b) { return _mm256_add_ps(a, b); }
+		static RAYCASTER_TARGET("avx2") Float Sub(Float a, Float b) { return _mm256_sub_ps(a, b); }
+		static RAYCASTER_TARGET("avx2") Float Mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+		static RAYCASTER_TARGET("avx2") Float Div(Float a, Float b) { return _mm256_div_ps(a, b); }
+		static RAYCASTER_TARGET("avx2") Float Max(Float a, Float b) { return _mm256_max_ps(a, b); }
+		static RAYCASTER_TARGET("avx2") Float Floor(Float a) { return _mm256_floor_ps(a); }
+		static RAYCASTER_TARGET("avx2") Float Sqrt(Float a) { return _mm256_sqrt_ps(a); }
+		static RAYCASTER_TARGET("avx2") Float Abs(Float a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+		static RAYCASTER_TARGET("avx2") Float Greater(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+		static RAYCASTER_TARGET("avx2") Float GreaterEqual(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+		static RAYCASTER_TARGET("avx2") Float LessEqual(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+		static RAYCASTER_TARGET("avx2") Float Less(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+		static RAYCASTER_TARGET("avx2") Float And(Float a, Float b) { return _mm256_and_ps(a, b); }
+		static RAYCASTER_TARGET("avx2") Float Select(Float mask, Float a, Float b) { return _mm256_blendv_ps(b, a, mask); }
+		static RAYCASTER_TARGET("avx2") int   Bits(Float mask) { return _mm256_movemask_ps(mask); }
+		static RAYCASTER_TARGET("avx2") Float FromBits(int bits)
+		{
+			__m256i lane = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+			return _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(bits), lane), lane));
+		}
+
+		static RAYCASTER_TARGET("avx2") Int   IntSet(int value) { return _mm256_set1_epi32(value); }
+		static RAYCASTER_TARGET("avx2") Int   IntLoad(const int* data) { return _mm256_loadu_si256((const __m256i*)data); }
+		static RAYCASTER_TARGET("avx2") void  IntStore(int* data, Int a) { _mm256_storeu_si256((__m256i*)data, a); }
+		static RAYCASTER_TARGET("avx2") Int   IntAdd(Int a, Int b) { return _mm256_add_epi32(a, b); }
+		static RAYCASTER_TARGET("avx2") Int   IntMul(Int a, Int b) { return _mm256_mullo_epi32(a, b); }
+		static RAYCASTER_TARGET("avx2") Int   IntMin(Int a, Int b) { return _mm256_min_epi32(a, b); }
+		static RAYCASTER_TARGET("avx2") Float IntGreater(Int a, Int b) { return _mm256_castsi256_ps(_mm256_cmpgt_epi32(a, b)); }
+		static RAYCASTER_TARGET("avx2") Int   ToInt(Float a) { return _mm256_cvttps_epi32(a); }
+		static RAYCASTER_TARGET("avx2") Float ToFloat(Int a) { return _mm256_cvtepi32_ps(a); }
+		static RAYCASTER_TARGET("avx2") Float ByteAt(Int a, int shift)
+		{
+			return _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srl_epi32(a, _mm_cvtsi32_si128(shift)), _mm256_set1_epi32(0xFF)));
+		}
+		static RAYCASTER_TARGET("avx2") Int GatherDwords(const Dword* data, Int index, Float mask)
+		{
+			return _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), (const int*)data, index, _mm256_castps_si256(mask), 4);
+		}
+	};
+
+	const int MaxLanes = 8;
+
+	// Lanes in bits read data[index], the rest 0. For the 8 and 16 bit textures, a 32 bit gather could read past their end.
+	template<typename L, typename T>
+	RAYCASTER_INLINE typename L::Int LoadLanes(const T* data, typename L::Int index, int bits)
+	{
+		alignas(32) int lanes[MaxLanes];
+		alignas(32) int values[MaxLanes] = {};
+		L::IntStore(lanes, index);
+		for (int lane = 0; lane < L::Count; lane++)
+		{
+			if (bits >> lane & 1)
+			{
+				values[lane] = (int)data[lanes[lane]];
+			}
+		}
+		return L::IntLoad(values);
+	}
+
+	// Footprint per lane, corners outside the volume or in dead lanes are masked off and read 0.
+	template<typename L>
+	struct PacketFootprint
+	{
+		typename L::Float Weights[8];
+		typename L::Int	  Index[8];
+		typename L::Float Mask[8];
+		int				  Bits[8];
+	};
+
+	template<typename L>
+	RAYCASTER_INLINE void LocatePacket(const RaycastVolume& volume, typename L::Float px, typename L::Float py, typename L::Float pz,
+									   typename L::Float active, PacketFootprint<L>& footprint)
+	{
+		typedef typename L::Float F;
+		typedef typename L::Int I;
+		F u = L::Sub(L::Mul(px, L::Set((float)volume.Width)), L::Set(0.5f));
+		F v = L::Sub(L::Mul(py, L::Set((float)volume.Height)), L::Set(0.5f));
+		F w = L::Sub(L::Mul(pz, L::Set((float)volume.Depth)), L::Set(0.5f));
+		F fx = L::Floor(u);
+		F fy = L::Floor(v);
+		F fz = L::Floor(w);
+		I x = L::ToInt(fx);
+		I y = L::ToInt(fy);
+		I z = L::ToInt(fz);
+
+		F one = L::Set(1.0f);
+		F tx = L::Sub(u, fx);
+		F ty = L::Sub(v, fy);
+		F tz = L::Sub(w, fz);
+		const F wx[2] = { L::Sub(one, tx), tx };
+		const F wy[2] = { L::Sub(one, ty), ty };
+		const F wz[2] = { L::Sub(one, tz), tz };
+
+		// Low and high corner inside along each axis, 0 <= c < size and 0 <= c + 1 < size.
+		I width = L::IntSet((int)volume.Width);
+		I height = L::IntSet((int)volume.Height);
+		I depth = L::IntSet((int)volume.Depth);
+		const F inX[2] = { L::And(L::IntGreater(x, L::IntSet(-1)), L::IntGreater(width, x)),
+						   L::And(L::IntGreater(x, L::IntSet(-2)), L::IntGreater(L::IntSet((int)volume.Width - 1), x)) };
+		const F inY[2] = { L::And(L::IntGreater(y, L::IntSet(-1)), L::IntGreater(height, y)),
+						   L::And(L::IntGreater(y, L::IntSet(-2)), L::IntGreater(L::IntSet((int)volume.Height - 1), y)) };
+		const F inZ[2] = { L::And(L::IntGreater(z, L::IntSet(-1)), L::IntGreater(depth, z)),
+						   L::And(L::IntGreater(z, L::IntSet(-2)), L::IntGreater(L::IntSet((int)volume.Depth - 1), z)) };
+
+		I base = L::IntAdd(L::IntMul(L::IntAdd(L::IntMul(z, height), y), width), x);
+		int row = (int)volume.Width;
+		int slice = (int)(volume.Width * volume.Height);
+		for (int i = 0; i < 8; i++)
+		{
+			int dx = i & 1, dy = (i >> 1) & 1, dz = i >> 2;
+			footprint.Weights[i] = L::Mul(L::Mul(wx[dx], wy[dy]), wz[dz]);
+			footprint.Mask[i] = L::And(L::And(L::And(inX[dx], inY[dy]), inZ[dz]), active);
+			footprint.Bits[i] = L::Bits(footprint.Mask[i]);
+			footprint.Index[i] = L::IntAdd(base, L::IntSet(dx + dy * row + dz * slice));
+		}
+	}
+
+	// Sampler::Filter's sum, corner by corner in the same order.
+	template<typename L>
+	RAYCASTER_INLINE typename L::Float FilterPacket(const PacketFootprint<L>& footprint, const typename L::Float values[8])
+	{
+		typename L::Float sum = L::Set(0.0f);
+		for (int i = 0; i < 8; i++)
+		{
+			sum = L::Add(sum, L::Mul(footprint.Weights[i], values[i]));
+		}
+		return sum;
+	}
+
+	// Sampler::Intensity, and Sampler::Voxel's xyz into rgb when it isn't null.
+	template<typename L>
+	RAYCASTER_INLINE typename L::Float SamplePacket(const RaycastVolume& volume, const PacketFootprint<L>& footprint, typename L::Float* rgb)
+	{
+		typedef typename L::Float F;
+		F r[8], g[8], b[8], a[8];
+		F one = L::Set(1.0f);
+		F half = L::Set(0.5f);
+		F byteScale = L::Set(1.0f / 255.0f);
+		if (volume.Layout == VolumeLayout::Packed)
+		{
+			// One 32 bit fetch a corner brings all four channels.
+			for (int i = 0; i < 8; i++)
+			{
+				typename L::Int texel = L::GatherDwords((const Dword*)volume.Packed, footprint.Index[i], footprint.Mask[i]);
+				a[i] = L::ByteAt(texel, 24);
+				if (rgb != nullptr)
+				{
+					r[i] = L::ByteAt(texel, 0);
+					g[i] = L::ByteAt(texel, 8);
+					b[i] = L::ByteAt(texel, 16);
+				}
+			}
+
+			if (rgb != nullptr)
+			{
+				rgb[0] = L::Mul(FilterPacket<L>(footprint, r), byteScale);
+				rgb[1] = L::Mul(FilterPacket<L>(footprint, g), byteScale);
+				rgb[2] = L::Mul(FilterPacket<L>(footprint, b), byteScale);
+			}
+			return L::Mul(FilterPacket<L>(footprint, a), byteScale);
+		}
+
+		F intensity;
+		if (volume.Wide)
+		{
+			for (int i = 0; i < 8; i++)
+			{
+				a[i] = L::ToFloat(LoadLanes<L>((const Word*)volume.Intensity, footprint.Index[i], footprint.Bits[i]));
+			}
+			intensity = L::Mul(FilterPacket<L>(footprint, a), L::Set(1.0f / 65535.0f));
+		}
+		else
+		{
+			for (int i = 0; i < 8; i++)
+			{
+				a[i] = L::ToFloat(LoadLanes<L>(volume.Intensity, footprint.Index[i], footprint.Bits[i]));
+			}
+			intensity = L::Mul(FilterPacket<L>(footprint, a), byteScale);
+		}
+
+		if (rgb == nullptr)
+		{
+			return intensity;
+		}
+
+		if (volume.Normals == nullptr)
+		{
+			rgb[0] = rgb[1] = rgb[2] = half;
+			return intensity;
+		}
+
+		// Sampler::Voxel's SampleOctahedral, masked corners decode to 0 so they add 0 like outside ones.
+		F zero = L::Set(0.0f);
+		F byteToSigned = L::Set(2.0f / 255.0f);
+		F x[8], y[8], z[8];
+		for (int i = 0; i < 8; i++)
+		{
+			typename L::Int encoded = LoadLanes<L>(volume.Normals, footprint.Index[i], footprint.Bits[i]);
+			F ex = L::Sub(L::Mul(L::ByteAt(encoded, 0), byteToSigned), one);
+			F ey = L::Sub(L::Mul(L::ByteAt(encoded, 8), byteToSigned), one);
+			F nz = L::Sub(L::Sub(one, L::Abs(ex)), L::Abs(ey));
+			F fold = L::Less(nz, zero);
+			F signX = L::Select(L::GreaterEqual(ex, zero), one, L::Set(-1.0f));
+			F signY = L::Select(L::GreaterEqual(ey, zero), one, L::Set(-1.0f));
+			F nx = L::Select(fold, L::Mul(L::Sub(one, L::Abs(ey)), signX), ex);
+			F ny = L::Select(fold, L::Mul(L::Sub(one, L::Abs(ex)), signY), ey);
+
+			F inverse = L::Div(one, L::Sqrt(L::Add(L::Add(L::Mul(nx, nx), L::Mul(ny, ny)), L::Mul(nz, nz))));
+			x[i] = L::And(L::Mul(nx, inverse), footprint.Mask[i]);
+			y[i] = L::And(L::Mul(ny, inverse), footprint.Mask[i]);
+			z[i] = L::And(L::Mul(nz, inverse), footprint.Mask[i]);
+		}
+
+		rgb[0] = L::Add(L::Mul(FilterPacket<L>(footprint, x), half), half);
+		rgb[1] = L::Add(L::Mul(FilterPacket<L>(footprint, y), half), half);
+		rgb[2] = L::Add(L::Mul(FilterPacket<L>(footprint, z), half), half);
+		return intensity;
+	}
+
+	template<typename L>
+	RAYCASTER_INLINE typename L::Float GradientPacket(const RaycastVolume& volume, const PacketFootprint<L>& footprint)
+	{
+		if (volume.Gradient == nullptr)
+		{
+			return L::Set(0.0f);
+		}
+
+		typename L::Float values[8];
+		for (int i = 0; i < 8; i++)
+		{
+			values[i] = L::ToFloat(LoadLanes<L>(volume.Gradient, footprint.Index[i], footprint.Bits[i]));
+		}
+		return L::Mul(FilterPacket<L>(footprint, values), L::Set(1.0f / 255.0f));
+	}
+
+	// The diffuse LUT's opacity at each lane's intensity and gradient, 0 in dead lanes.
+	template<typename L>
+	RAYCASTER_INLINE typename L::Float OpacityPacket(const RaycastVolume& volume, typename L::Float intensity, typename L::Float gradient, typename L::Float active)
+	{
+		typedef typename L::Int I;
+		const int gradientBins = (int)volume.GradientBins;
+		typename L::Float zero = L::Set(0.0f);
+		I x = L::IntMin(L::ToInt(L::Max(L::Mul(intensity, L::Set((float)volume.IntensityBins)), zero)), L::IntSet((int)volume.IntensityBins - 1));
+		I y = L::IntMin(L::ToInt(L::Max(L::Mul(gradient, L::Set((float)gradientBins)), zero)), L::IntSet(gradientBins - 1));
+		I texel = L::IntAdd(L::IntMul(y, L::IntSet((int)volume.IntensityBins)), x);
+		return L::Mul(L::ByteAt(L::GatherDwords((const Dword*)volume.Diffuse, texel, active), 24), L::Set(1.0f / 255.0f));
+	}
+
+	template<typename L>
+	RAYCASTER_INLINE int InsideBits(typename L::Float px, typename L::Float py, typename L::Float pz)
+	{
+		typename L::Float zero = L::Set(0.0f);
+		typename L::Float one = L::Set(1.0f);
+		typename L::Float x = L::And(L::GreaterEqual(px, zero), L::LessEqual(px, one));
+		typename L::Float y = L::And(L::GreaterEqual(py, zero), L::LessEqual(py, one));
+		typename L::Float z = L::And(L::GreaterEqual(pz, zero), L::LessEqual(pz, one));
+		return L::Bits(L::And(L::And(x, y), z));
+	}
+
+	// Neighbouring pixels' rays, marched a lane each.
+	struct Packet
+	{
+		int	   Active = 0;			// Lanes with a ray
+		int	   Terminated = 0;		// Lanes stopped by the early out
+		Uint64 Samples = 0;
+		Ray	   Rays[MaxLanes];
+		alignas(32) float Start[3][MaxLanes] = {};
+		alignas(32) float Dir[3][MaxLanes] = {};
+		alignas(32) float Jitter[MaxLanes] = {};
+		alignas(32) float Color[4][MaxLanes] = {};
+	};
+
+	// The hit lanes of a PBR or ESS step shaded one by one, the same LightSample as a single ray.
+	template<typename L>
+	RAYCASTER_INLINE void LightLanes(const MarchContext& context, Packet& packet, int hits, const typename L::Float rgb[3],
+									 typename L::Float intensity, typename L::Float gradient, bool normalize, int& alive)
+	{
+		alignas(32) float r[MaxLanes], g[MaxLanes], b[MaxLanes], w[MaxLanes], magnitude[MaxLanes];
+		L::Store(r, rgb[0]);
+		L::Store(g, rgb[1]);
+		L::Store(b, rgb[2]);
+		L::Store(w, intensity);
+		L::Store(magnitude, gradient);
+		for (int lane = 0; lane < L::Count; lane++)
+		{
+			if ((hits >> lane & 1) == 0)
+			{
+				continue;
+			}
+
+			Float4 voxel = { r[lane], g[lane], b[lane], w[lane] };
+			Float4 color = { packet.Color[0][lane], packet.Color[1][lane], packet.Color[2][lane], packet.Color[3][lane] };
+			Material material = Albedo(context.Volume, w[lane], magnitude[lane]);
+			bool done = LightSample(context, voxel, material, packet.Rays[lane].Dir * -1.0f, normalize, color);
+			packet.Color[0][lane] = color.x;
+			packet.Color[1][lane] = color.y;
+			packet.Color[2][lane] = color.z;
+			packet.Color[3][lane] = color.w;
+			if (done)
+			{
+				packet.Terminated |= 1 << lane;
+				alive &= ~(1 << lane);
+			}
+		}
+	}
+
+	template<typename L>
+	RAYCASTER_INLINE void MarchMipPacket(const MarchContext& context, Packet& packet)
+	{
+		typedef typename L::Float F;
+		F step = L::Set(context.Step);
+		F dx = L::Mul(L::Load(packet.Dir[0]), step);
+		F dy = L::Mul(L::Load(packet.Dir[1]), step);
+		F dz = L::Mul(L::Load(packet.Dir[2]), step);
+		F jitter = L::Load(packet.Jitter);
+		F px = L::Add(L::Load(packet.Start[0]), L::Mul(dx, jitter));
+		F py = L::Add(L::Load(packet.Start[1]), L::Mul(dy, jitter));
+		F pz = L::Add(L::Load(packet.Start[2]), L::Mul(dz, jitter));
+
+		F iso = L::Set(context.Settings.IsoValue);
+		F mip = L::Set(0.0f);
+		int alive = packet.Active;
+		while (alive != 0)
+		{
+			F active = L::FromBits(alive);
+			packet.Samples += CountBits(alive);
+			PacketFootprint<L> footprint;
+			LocatePacket<L>(context.Volume, px, py, pz, active, footprint);
+			F intensity = SamplePacket<L>(context.Volume, footprint, nullptr);
+
+			F hit = L::And(L::And(L::Greater(intensity, iso), L::Greater(intensity, mip)), active);
+			mip = L::Select(hit, intensity, mip);
+
+			px = L::Add(px, dx);
+			py = L::Add(py, dy);
+			pz = L::Add(pz, dz);
+			alive &= InsideBits<L>(px, py, pz);
+		}
+
+		for (int channel = 0; channel < 4; channel++)
+		{
+			L::Store(packet.Color[channel], mip);
+		}
+	}
+
+	template<typename L>
+	RAYCASTER_INLINE void MarchAlphaPacket(const MarchContext& context, Packet& packet)
+	{
+		typedef typename L::Float F;
+		F step = L::Set(context.Step);
+		F dx = L::Mul(L::Load(packet.Dir[0]), step);
+		F dy = L::Mul(L::Load(packet.Dir[1]), step);
+		F dz = L::Mul(L::Load(packet.Dir[2]), step);
+		F jitter = L::Load(packet.Jitter);
+		F px = L::Add(L::Load(packet.Start[0]), L::Mul(dx, jitter));
+		F py = L::Add(L::Load(packet.Start[1]), L::Mul(dy, jitter));
+		F pz = L::Add(L::Load(packet.Start[2]), L::Mul(dz, jitter));
+
+		F iso = L::Set(context.Settings.IsoValue);
+		F amount = L::Set(context.Settings.AlphaAmount);
+		F one = L::Set(1.0f);
+		F earlyOut = L::Set(EarlyOut);
+		F grey = L::Set(0.0f);
+		F alpha = L::Set(0.0f);
+		int alive = packet.Active;
+		while (alive != 0)
+		{
+			F active = L::FromBits(alive);
+			packet.Samples += CountBits(alive);
+			PacketFootprint<L> footprint;
+			LocatePacket<L>(context.Volume, px, py, pz, active, footprint);
+			F intensity = SamplePacket<L>(context.Volume, footprint, nullptr);
+
+			// Composite with grey in all three channels, they stay equal.
+			F hit = L::And(L::Greater(intensity, iso), active);
+			F weight = L::Mul(L::Sub(one, alpha), L::Mul(intensity, amount));
+			grey = L::Select(hit, L::Add(grey, L::Mul(weight, intensity)), grey);
+			alpha = L::Select(hit, L::Add(alpha, weight), alpha);
+
+			int done = L::Bits(L::And(hit, L::Greater(alpha, earlyOut)));
+			packet.Terminated |= done;
+			alive &= ~done;
+
+			px = L::Add(px, dx);
+			py = L::Add(py, dy);
+			pz = L::Add(pz, dz);
+			alive &= InsideBits<L>(px, py, pz);
+		}
+
+		L::Store(packet.Color[0], grey);
+		L::Store(packet.Color[1], grey);
+		L::Store(packet.Color[2], grey);
+		L::Store(packet.Color[3], alpha);
+	}
+
+	template<typename L>
+	RAYCASTER_INLINE void MarchPBRPacket(const MarchContext& context, Packet& packet)
+	{
+		typedef typename L::Float F;
+		F step = L::Set(context.Step);
+		F dx = L::Mul(L::Load(packet.Dir[0]), step);
+		F dy = L::Mul(L::Load(packet.Dir[1]), step);
+		F dz = L::Mul(L::Load(packet.Dir[2]), step);
+		F jitter = L::Load(packet.Jitter);
+		F px = L::Add(L::Load(packet.Start[0]), L::Mul(dx, jitter));
+		F py = L::Add(L::Load(packet.Start[1]), L::Mul(dy, jitter));
+		F pz = L::Add(L::Load(packet.Start[2]), L::Mul(dz, jitter));
+
+		F iso = L::Set(context.Settings.IsoValue);
+		int alive = packet.Active;
+		while (alive != 0)
+		{
+			F active = L::FromBits(alive);
+			packet.Samples += CountBits(alive);
+			PacketFootprint<L> footprint;
+			LocatePacket<L>(context.Volume, px, py, pz, active, footprint);
+			F rgb[3];
+			F intensity = SamplePacket<L>(context.Volume, footprint, rgb);
+			F gradient = GradientPacket<L>(context.Volume, footprint);
+			F opacity = OpacityPacket<L>(context.Volume, intensity, gradient, active);
+
+			int hits = L::Bits(L::And(L::Greater(opacity, iso), active));
+			if (hits != 0)
+			{
+				LightLanes<L>(context, packet, hits, rgb, intensity, gradient, true, alive);
+			}
+
+			px = L::Add(px, dx);
+			py = L::Add(py, dy);
+			pz = L::Add(pz, dz);
+			alive &= InsideBits<L>(px, py, pz);
+		}
+	}
+
+	// CellWalker for every lane of a packet at once, each lane's walk set up by CellWalker::Begin and then
+	// stepped in lanes with the same float ops, so it visits the same cells with the same enter and exit.
+	template<typename L>
+	class PacketCellWalker
+	{
+	private:
+		typedef typename L::Float F;
+		const TextureLevel* m_Grid = nullptr;
+		F	m_Threshold;
+		F	m_Size[3];
+		F	m_Length;
+		F	m_Enter;
+		F	m_Cell[3];	// Whole numbers, the grid is far under 2^24 cells an axis
+		F	m_Step[3];
+		F	m_Next[3];
+		F	m_Delta[3];
+		int	m_Done = 0;
+
+	public:
+		RAYCASTER_INLINE void Begin(const RaycastVolume& volume, Byte threshold, const Packet& packet)
+		{
+			alignas(32) float length[MaxLanes] = {}, enter[MaxLanes] = {};
+			alignas(32) float cell[3][MaxLanes] = {}, step[3][MaxLanes] = {}, next[3][MaxLanes] = {}, delta[3][MaxLanes] = {};
+			m_Done = 0;
+			for (int lane = 0; lane < L::Count; lane++)
+			{
+				if ((packet.Active >> lane & 1) == 0)
+				{
+					m_Done |= 1 << lane;
+					continue;
+				}
+
+				CellWalker walker;
+				walker.Begin(volume, threshold, packet.Rays[lane]);
+				length[lane] = walker.m_Length;
+				enter[lane] = walker.m_Enter;
+				for (int axis = 0; axis < 3; axis++)
+				{
+					cell[axis][lane] = (float)walker.m_Cell[axis];
+					step[axis][lane] = (float)walker.m_Step[axis];
+					next[axis][lane] = walker.m_Next[axis];
+					delta[axis][lane] = walker.m_Delta[axis];
+				}
+			}
+
+			m_Grid = &volume.Occupancy;
+			m_Threshold = L::Set((float)threshold);
+			m_Size[0] = L::Set((float)m_Grid->width);
+			m_Size[1] = L::Set((float)m_Grid->height);
+			m_Size[2] = L::Set((float)m_Grid->depth);
+			m_Length = L::Load(length);
+			m_Enter = L::Load(enter);
+			for (int axis = 0; axis < 3; axis++)
+			{
+				m_Cell[axis] = L::Load(cell[axis]);
+				m_Step[axis] = L::Load(step[axis]);
+				m_Next[axis] = L::Load(next[axis]);
+				m_Delta[axis] = L::Load(delta[axis]);
+			}
+		}
+
+		// CellWalker::Next for the lanes in seek. A pass tests the cell of every lane still seeking with one load
+		// and steps them all, until each has an occupied cell or has left the grid. Returns the lanes that found
+		// one, with where their ray crosses it in enter and exit, the lanes that left are cleared from alive.
+		RAYCASTER_INLINE int Next(int seek, int& alive, float* enter, float* exit)
+		{
+			const F zero = L::Set(0.0f);
+			const F ones = L::FromBits((1 << L::Count) - 1);
+			const typename L::Int width = L::IntSet((int)m_Grid->width);
+			const typename L::Int height = L::IntSet((int)m_Grid->height);
+			int found = 0;
+			for (;;)
+			{
+				int left = seek & m_Done;
+				alive &= ~left;
+				seek &= ~left;
+				if (seek == 0)
+				{
+					return found;
+				}
+
+				// The smallest crossing, ties to the lower axis as the scalar walk does.
+				F x = L::And(L::LessEqual(m_Next[0], m_Next[1]), L::LessEqual(m_Next[0], m_Next[2]));
+				F y = L::Select(x, zero, L::LessEqual(m_Next[1], m_Next[2]));
+				F z = L::Select(x, zero, L::Select(y, zero, ones));
+				F next = L::Select(x, m_Next[0], L::Select(y, m_Next[1], m_Next[2]));
+
+				typename L::Int index = L::IntAdd(L::IntMul(L::IntAdd(L::IntMul(L::ToInt(m_Cell[2]), height), L::ToInt(m_Cell[1])), width),
+												  L::ToInt(m_Cell[0]));
+				F occupancy = L::ToFloat(LoadLanes<L>(m_Grid->ptr, index, seek));
+				int hits = L::Bits(L::GreaterEqual(occupancy, m_Threshold)) & seek;
+				if (hits != 0)
+				{
+					alignas(32) float from[MaxLanes], to[MaxLanes];
+					L::Store(from, m_Enter);
+					L::Store(to, L::Select(L::Less(m_Length, next), m_Length, next));
+					for (int lane = 0; lane < L::Count; lane++)
+					{
+						if (hits >> lane & 1)
+						{
+							enter[lane] = from[lane];
+							exit[lane] = to[lane];
+						}
+					}
+				}
+
+				// Lanes whose ray ends in this cell are done after it, the rest step into the next one.
+				int ending = L::Bits(L::GreaterEqual(next, m_Length)) & seek;
+				m_Done |= ending;
+				F stepping = L::FromBits(seek & ~ending);
+				m_Enter = L::Select(stepping, next, m_Enter);
+				const F axes[3] = { x, y, z };
+				for (int axis = 0; axis < 3; axis++)
+				{
+					F moving = L::And(stepping, axes[axis]);
+					m_Next[axis] = L::Select(moving, L::Add(m_Next[axis], m_Delta[axis]), m_Next[axis]);
+					m_Cell[axis] = L::Select(moving, L::Add(m_Cell[axis], m_Step[axis]), m_Cell[axis]);
+					m_Done |= L::Bits(L::And(moving, L::Less(m_Cell[axis], zero))) | L::Bits(L::And(moving, L::GreaterEqual(m_Cell[axis], m_Size[axis])));
+				}
+
+				found |= hits;
+				seek &= ~hits;
+			}
+		}
+	};
+
+	// The lanes that need a cell walk to their next occupied one together with PacketCellWalker, one occupancy
+	// load a pass for the whole packet, then the packet samples together. Empty space is crossed without a fetch.
+	template<typename L>
+	RAYCASTER_INLINE void MarchESSPacket(const MarchContext& context, Packet& packet)
+	{
+		typedef typename L::Float F;
+		PacketCellWalker<L> walker;
+		walker.Begin(context.Volume, context.Threshold, packet);
+		int remaining[MaxLanes] = {};	// Samples left in the lane's cell
+		alignas(32) float p[3][MaxLanes] = {};
+
+		F step = L::Set(context.Step);
+		F dx = L::Mul(L::Load(packet.Dir[0]), step);
+		F dy = L::Mul(L::Load(packet.Dir[1]), step);
+		F dz = L::Mul(L::Load(packet.Dir[2]), step);
+		F iso = L::Set(context.Settings.IsoValue);
+		int alive = packet.Active;
+		for (;;)
+		{
+			int seek = 0;
+			for (int lane = 0; lane < L::Count; lane++)
+			{
+				seek |= (remaining[lane] <= 0) << lane;
+			}
+
+			float enter[MaxLanes], exit[MaxLanes];
+			int found = walker.Next(seek & alive, alive, enter, exit);
+			for (int lane = 0; lane < L::Count; lane++)
+			{
+				if (found >> lane & 1)
+				{
+					const Ray& ray = packet.Rays[lane];
+					Float3 start = ray.Start + ray.Dir * enter[lane];
+					p[0][lane] = start.x;
+					p[1][lane] = start.y;
+					p[2][lane] = start.z;
+					remaining[lane] = (int)std::ceil((exit[lane] - enter[lane]) / context.Step) + 1;
+				}
+			}
+
+			if (alive == 0)
+			{
+				break;
+			}
+
+			F active = L::FromBits(alive);
+			packet.Samples += CountBits(alive);
+			F px = L::Load(p[0]);
+			F py = L::Load(p[1]);
+			F pz = L::Load(p[2]);
+			PacketFootprint<L> footprint;
+			LocatePacket<L>(context.Volume, px, py, pz, active, footprint);
+			F rgb[3];
+			F intensity = SamplePacket<L>(context.Volume, footprint, rgb);
+			F gradient = GradientPacket<L>(context.Volume, footprint);
+			F opacity = OpacityPacket<L>(context.Volume, intensity, gradient, active);
+
+			int hits = L::Bits(L::And(L::GreaterEqual(opacity, iso), active));
+			if (hits != 0)
+			{
+				LightLanes<L>(context, packet, hits, rgb, intensity, gradient, false, alive);
+			}
+
+			L::Store(p[0], L::Add(px, dx));
+			L::Store(p[1], L::Add(py, dy));
+			L::Store(p[2], L::Add(pz, dz));
+			for (int lane = 0; lane < L::Count; lane++)
+			{
+				remaining[lane] -= alive >> lane & 1;
+			}
+		}
+	}
+
+	// L::Count pixels of a row a packet.
+	template<typename L>
+	RAYCASTER_INLINE void RenderTilePackets(const TileJob& job, Uint32 x0, Uint32 y0, Uint32 x1, Uint32 y1, TileCounts& counts)
+	{
+		const MarchContext& context = job.Context;
+		for (Uint32 y = y0; y < y1; y++)
+		{
+			for (Uint32 x = x0; x < x1; x += L::Count)
+			{
+				Packet packet;
+				for (int lane = 0; lane < L::Count; lane++)
+				{
+					Uint32 px = x + lane;
+					Ray& ray = packet.Rays[lane];
+					if (px >= x1 || !PixelRay(job, px, y, ray))
+					{
+						continue;
+					}
+
+					packet.Active |= 1 << lane;
+					packet.Start[0][lane] = ray.Start.x;
+					packet.Start[1][lane] = ray.Start.y;
+					packet.Start[2][lane] = ray.Start.z;
+					packet.Dir[0][lane] = ray.Dir.x;
+					packet.Dir[1][lane] = ray.Dir.y;
+					packet.Dir[2][lane] = ray.Dir.z;
+					packet.Jitter[lane] = PixelJitter(job, px, y);
+				}
+
+				if (packet.Active == 0)
+				{
+					continue;
+				}
+
+				switch (context.Settings.Method)
+				{
+				case VolumeMethod::MIP:		MarchMipPacket<L>(context, packet); break;
+				case VolumeMethod::Alpha:	MarchAlphaPacket<L>(context, packet); break;
+				case VolumeMethod::PBR:		MarchPBRPacket<L>(context, packet); break;
+				case VolumeMethod::PBR_ESS:	MarchESSPacket<L>(context, packet); break;
+				}
+
+				for (int lane = 0; lane < L::Count; lane++)
+				{
+					if (packet.Active >> lane & 1)
+					{
+						WritePixel(job, x + lane, y, Float4{ packet.Color[0][lane], packet.Color[1][lane], packet.Color[2][lane], packet.Color[3][lane] });
+					}
+				}
+				counts.Rays += CountBits(packet.Active);
+				counts.Samples += packet.Samples;
+				counts.Terminated += CountBits(packet.Terminated);
+			}
+		}
+	}
+
+	RAYCASTER_TARGET("sse4.1") void RenderTileSSE41(const TileJob& job, Uint32 x0, Uint32 y0, Uint32 x1, Uint32 y1, TileCounts& counts)
+	{
+		RenderTilePackets<Lanes4>(job, x0, y0, x1, y1, counts);
+	}
+
+	RAYCASTER_TARGET("avx2") void RenderTileAVX2(const TileJob& job, Uint32 x0, Uint32 y0, Uint32 x1, Uint32 y1, TileCounts& counts)
+	{
+		RenderTilePackets<Lanes8>(job, x0, y0, x1, y1, counts);
+	}
+#endif
+}
+
+bool VolumeRaycaster::SetVolume(const RaycastVolume& volume)
+{
+	bool valid = volume.Width > 0 && volume.Height > 0 && volume.Depth > 0 &&
+		volume.CellSize[0] > 0 && volume.CellSize[1] > 0 && volume.CellSize[2] > 0 &&
+		(volume.Layout == VolumeLayout::Packed ? volume.Packed != nullptr : volume.Intensity != nullptr);
+	m_Volume = valid ? volume : RaycastVolume();
+	return valid;
+}
+
+const RaycastVolume& VolumeRaycaster::GetVolume()const
+{
+	return m_Volume;
+}
+
+RaycastStats VolumeRaycaster::Render(const RaycastCamera& camera, const RaycastSettings& settings, Uint32 width, Uint32 height, std::vector<float>& rgba)const
+{
+	return Render(camera, settings, width, height, rgba, VolumeStatistics::GetSimdLevel());
+}
+
+RaycastStats VolumeRaycaster::Render(const RaycastCamera& camera, const RaycastSettings& settings, Uint32 width, Uint32 height, std::vector<float>& rgba, SimdLevel level)const
+{
+	RaycastStats stats;
+	rgba.assign((size_t)width * height * 4, 0.0f);
+
+	// The transfer driven methods need the LUTs, ESS the grid as well.
+	const RaycastVolume& volume = m_Volume;
+	bool lit = settings.Method == VolumeMethod::PBR || settings.Method == VolumeMethod::PBR_ESS;
+	if (volume.Width == 0 || width == 0 || height == 0 ||
+		(lit && (volume.Diffuse == nullptr || volume.Surface == nullptr || volume.IntensityBins == 0 || volume.GradientBins == 0)) ||
+		(settings.Method == VolumeMethod::PBR_ESS && volume.Occupancy.ptr == nullptr))
+	{
+		return stats;
+	}
+
+	// Packets index the volume with 32 bit lanes.
+	level = std::min(level, VolumeStatistics::GetSimdLevel());
+	if ((Uint64)volume.Width * volume.Height * volume.Depth > (Uint64)0x7FFFFFFF)
+	{
+		level = SimdLevel::Scalar;
+	}
+
+	// Left handed like the engine's view, x right, y up, looking down z.
+	Float3 position = FromVector(camera.Position);
+	Float3 forward = Normalize(FromVector(camera.Target) - position);
+	Float3 right = Normalize(Cross(FromVector(camera.Up), forward));
+	Float3 up = Cross(forward, right);
+
+	float maxSize = (float)std::max(volume.Width, std::max(volume.Height, volume.Depth));
+	Byte threshold = (Byte)std::min(std::ceil(settings.IsoValue * 255.0f), 255.0f);
+	MarchContext context = { volume, settings, Sampler(volume), settings.StepScale / maxSize, FromVector(settings.Ambient), threshold };
+	TileJob job = { context, position, forward, right, up, std::tan(camera.FieldOfView * 0.5f * Pi / 180.0f), (float)width / height,
+					width, height, rgba.data() };
+
+	Uint32 tilesX = (width + TileSize - 1) / TileSize;
+	Uint32 tilesY = (height + TileSize - 1) / TileSize;
+	std::atomic<Uint64> rays(0);
+	std::atomic<Uint64> samples(0);
+	std::atomic<Uint64> terminated(0);
+
+	auto start = std::chrono::high_resolution_clock::now();
+	ThreadPool::Instance().ParallelFor((Uint64)tilesX * tilesY, [&](Uint64 begin, Uint64 end)
+	{
+		TileCounts counts;
+		for (Uint64 tile = begin; tile < end; tile++)
+		{
+			Uint32 x0 = (Uint32)(tile % tilesX) * TileSize;
+			Uint32 y0 = (Uint32)(tile / tilesX) * TileSize;
+			Uint32 x1 = std::min(x0 + TileSize, width);
+			Uint32 y1 = std::min(y0 + TileSize, height);
+#if defined(RAYCASTER_SIMD)
+			if (level == SimdLevel::AVX2)
+			{
+				RenderTileAVX2(job, x0, y0, x1, y1, counts);
+				continue;
+			}
+			if (level == SimdLevel::SSE41)
+			{
+				RenderTileSSE41(job, x0, y0, x1, y1, counts);
+				continue;
+			}
+#endif
+			RenderTile(job, x0, y0, x1, y1, counts);
+		}
+
+		rays += counts.Rays;
+		samples += counts.Samples;
+		terminated += counts.Terminated;
+	}, 1, settings.MaxThreads);
+
+	stats.Seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	stats.Rays = rays;
+	stats.Samples = samples;
+	stats.Terminated = terminated;
+	return stats;
+}
@@ -0,0 +1,102 @@
+//Note:
+/*
+	The four volume shaders (MIP, Alpha, PBR, PBR_ESS) on the CPU, for rendering with no
+	GPU at all: render farm nodes, CI. Same ray setup as the proxy cube gives the shaders
+	(the volume is the cube [-1, 1] in its local space, rays start where they enter it),
+	same base step of 1 / the largest dimension, same trilinear volume and gradient
+	fetches with a zero border, point sampled transfer LUTs, front to back compositing
+	and the 0.95 early out. PBR_ESS walks the occupancy cells with a DDA and only marches
+	the cells at or above the iso value, the ray scaled by the volume's extent in cells
+	(dims / CellSize) as the shader's is, so a partial last cell sticks out past it.
+	Lighting is the shaders' with world space taken as the volume's local space. There's
+	no environment map, its irradiance and specular reflection are a constant Ambient
+	colour and the split sum BRDF lookup is the analytic fit (Karis 2014). The start
+	jitter is the PBR shader's screen hash for MIP, Alpha and PBR, where MIP and Alpha
+	read a noise texture. ESS rays are walked cell by cell from the cell they start in,
+	each cell's samples starting where the ray enters it.
+	The image is split into tiles run across the pool, the framebuffer is float RGBA,
+	premultiplied, row 0 at the top.
+	Rays go one at a time, or in packets of 8 (AVX2) or 4 (SSE4.1) neighbouring pixels
+	picked at runtime. A packet steps, filters and looks up the opacity of all its lanes
+	at once, lanes that are done masked off, and shades only the lanes the transfer
+	function keeps. ESS packets step the cell walk of every lane that needs a new cell
+	together, one occupancy load a cell for the whole packet. The result is the same bits
+	at every level.
+	There's no 16 lane AVX-512 kernel. SimdLevel stops at AVX2, the volume fetches are
+	byte and word loads a lane at a time (a dword gather could read past the end of the
+	8 and 16 bit textures) that a wider packet doesn't speed up, and 16 lanes would be a
+	whole tile row, so ESS lanes would diverge more than they share.
+*/
+
+#pragma once
+#include "VolumeGenerator.h"
+#include "VolumeStatistics.h"
+#include "Content/Texture.h"
+#include "Math/Vector3.h"
+#include <vector>
+
+// Views of CPU data, nothing is copied. The same textures VolumeComponent binds.
+struct RaycastVolume
+{
+	Uint32		 Width = 0;
+	Uint32		 Height = 0;
+	Uint32		 Depth = 0;
+	VolumeLayout Layout = VolumeLayout::Packed;
+	const Byte*	 Packed = nullptr;		// RGBA8, normal * 0.5 + 0.5 in rgb and intensity in a
+	const Byte*	 Intensity = nullptr;	// Split, R8 or R16 (Wide)
+	bool		 Wide = false;
+	const Word*	 Normals = nullptr;		// Split, octahedral R8G8
+	const Byte*	 Gradient = nullptr;	// R8 magnitude, the LUT's second axis. Null reads 0
+	TextureLevel Occupancy;				// Level 0 cells, R8, PBR_ESS only
+	Uint32		 CellSize[3] = { 1, 1, 1 };	// Voxels per occupancy cell
+	const Byte*	 Diffuse = nullptr;		// IntensityBins x GradientBins RGBA8
+	const Byte*	 Surface = nullptr;		// IntensityBins R8G8, metallic and roughness
+	Uint32		 IntensityBins = 0;
+	Uint32		 GradientBins = 0;		// TransferFunction::GradientBins for the component's LUTs
+};
+
+struct RaycastCamera
+{
+	Vector3 Position = Vector3(0, 0, -3);	// Volume local space
+	Vector3 Target = Vector3(0, 0, 0);
+	Vector3 Up = Vector3(0, 1, 0);
+	float	FieldOfView = 60.0f;			// Vertical, degrees
+};
+
+struct RaycastSettings
+{
+	VolumeMethod Method = VolumeMethod::PBR;
+	float		 IsoValue = 0.01f;		// The shaders' _Hounsfield
+	float		 AlphaAmount = 0.5f;
+	float		 StepScale = 1.0f;		// Base steps a sample, pair with TransferFunction's corrected LUT for it
+	Vector3		 Ambient = Vector3(0.3f, 0.3f, 0.3f);
+	bool		 Jitter = true;
+	Uint32		 MaxThreads = 0;		// 0 uses the whole pool
+};
+
+struct RaycastStats
+{
+	Uint64 Rays = 0;		// Pixels whose ray meets the volume
+	Uint64 Samples = 0;		// Volume fetches
+	Uint64 Terminated = 0;	// Rays stopped by the opacity early out
+	double Seconds = 0;
+};
+
+class VolumeRaycaster
+{
+public:
+	static const Uint32 TileSize = 16;
+
+private:
+	RaycastVolume m_Volume;
+
+public:
+	// False if a view the layout needs is missing.
+	bool SetVolume(const RaycastVolume& volume);
+	const RaycastVolume& GetVolume()const;
+
+	// Resizes rgba to width * height * 4. Volumes over 2^31 voxels always go one ray at a time.
+	RaycastStats Render(const RaycastCamera& camera, const RaycastSettings& settings, Uint32 width, Uint32 height, std::vector<float>& rgba)const;
+	RaycastStats Render(const RaycastCamera& camera, const RaycastSettings& settings, Uint32 width, Uint32 height, std::vector<float>& rgba,
+						SimdLevel level)const;
+};
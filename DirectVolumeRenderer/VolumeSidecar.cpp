@@ -0,0 +1,477 @@
+#include "VolumeSidecar.h"
+#include "System/File.h"
+#include "System/Logger.h"
+#include "System/MappedFile.h"
+#include "System/ThreadPool.h"
+#include <cstring>
+
+// Magic, Version, GeneratorVersion, HashLow, HashHigh, Width, Height, Depth, Format, SectionCount
+static const Uint64 HeaderSize = 10 * sizeof(Dword);
+
+const Dword VolumeSidecar::Magic;
+const Dword VolumeSidecar::Version;
+const Dword VolumeSidecar::GeneratorVersion;
+
+// Bounds checked walk over the mapped file.
+class SidecarReader
+{
+private:
+	const Byte* m_Data;
+	Uint64		m_Size;
+	Uint64		m_Offset;
+
+public:
+	SidecarReader(const Byte* data, Uint64 size, Uint64 offset) : m_Data(data), m_Size(size), m_Offset(offset) {}
+
+	bool Read(void* value, Uint64 byteCount)
+	{
+		if (byteCount > m_Size - m_Offset)
+		{
+			return false;
+		}
+
+		memcpy(value, m_Data + m_Offset, (size_t)byteCount);
+		m_Offset += byteCount;
+		return true;
+	}
+
+	// The caller checked byteCount against GetRemaining.
+	void Skip(Uint64 byteCount) { m_Offset += byteCount; }
+	Uint64 GetOffset()const { return m_Offset; }
+	Uint64 GetRemaining()const { return m_Size - m_Offset; }
+};
+
+namespace
+{
+	enum SidecarSection : Dword
+	{
+		SectionStats = 1,
+		SectionCellRanges = 2,
+		SectionVolumes = 3,
+	};
+
+	const Uint64 HashChunk = 1 << 20;
+	const Uint64 Prime1 = 0x9E3779B185EBCA87ull;
+	const Uint64 Prime2 = 0xC2B2AE3D27D4EB4Full;
+
+	Uint64 RotateLeft(Uint64 value, int bits)
+	{
+		return (value << bits) | (value >> (64 - bits));
+	}
+
+	Uint64 Mix(Uint64 lane, Uint64 value)
+	{
+		return RotateLeft(lane + value * Prime2, 31) * Prime1;
+	}
+
+	Uint64 Avalanche(Uint64 hash)
+	{
+		hash ^= hash >> 33;
+		hash *= Prime2;
+		hash ^= hash >> 29;
+		hash *= Prime1;
+		return hash ^ (hash >> 32);
+	}
+
+	// Four independent lanes over 8 byte words so the multiplies overlap, the tail a byte at a time.
+	Uint64 HashChunkData(const Byte* data, Uint64 byteCount, Uint64 seed)
+	{
+		Uint64 lanes[4] = { seed + Prime1, seed + Prime2, seed, seed - Prime1 };
+		Uint64 i = 0;
+		for (; i + 32 <= byteCount; i += 32)
+		{
+			Uint64 words[4];
+			memcpy(words, data + i, sizeof(words));
+			lanes[0] = Mix(lanes[0], words[0]);
+			lanes[1] = Mix(lanes[1], words[1]);
+			lanes[2] = Mix(lanes[2], words[2]);
+			lanes[3] = Mix(lanes[3], words[3]);
+		}
+
+		Uint64 hash = RotateLeft(lanes[0], 1) + RotateLeft(lanes[1], 7) + RotateLeft(lanes[2], 12) + RotateLeft(lanes[3], 18);
+		for (; i < byteCount; i++)
+		{
+			hash = Mix(hash, data[i]);
+		}
+		return Avalanche(hash ^ byteCount);
+	}
+
+	template<typename T>
+	bool WriteValue(BinaryFile& file, const T& value)
+	{
+		return file.WriteBuffer((const Byte*)&value, sizeof(T));
+	}
+
+	Uint64 VoxelBytes(std::shared_ptr<Texture> texture)
+	{
+		return (Uint64)texture->GetWidth() * texture->GetHeight() * texture->GetDepth() * BytesPerBlock(texture->GetFormat());
+	}
+
+	// Null when the stored format isn't the one the generators give for this texture.
+	std::shared_ptr<Texture> ReadTexture(SidecarReader& reader, Uint32 width, Uint32 height, Uint32 depth, SurfaceFormat expected)
+	{
+		Dword format = 0;
+		if (reader.Read(&format, sizeof(format)) == false || (SurfaceFormat)format != expected)
+		{
+			return nullptr;
+		}
+
+		std::shared_ptr<Texture> texture = std::make_shared<Texture>();
+		texture->Create3D(width, height, depth, BufferUsage::Immutable, expected);
+		if (reader.Read(texture->GetData(), VoxelBytes(texture)) == false)
+		{
+			return nullptr;
+		}
+		return texture;
+	}
+
+	bool WriteTexture(BinaryFile& file, std::shared_ptr<Texture> texture)
+	{
+		return WriteValue(file, (Dword)texture->GetFormat()) && file.WriteBuffer(texture->GetData(), VoxelBytes(texture));
+	}
+
+	Uint64 TextureBytes(std::shared_ptr<Texture> texture)
+	{
+		return texture ? sizeof(Dword) + VoxelBytes(texture) : 0;
+	}
+
+	bool WriteSectionHeader(BinaryFile& file, SidecarSection section, Uint64 byteCount)
+	{
+		return WriteValue(file, (Dword)section) && WriteValue(file, byteCount);
+	}
+}
+
+//-----------------------------------------------------------------------------------
+
+Uint64 VolumeSidecar::HashContent(const Byte* data, Uint64 byteCount, Uint32 maxThreads)
+{
+	Uint64 chunkCount = (byteCount + HashChunk - 1) / HashChunk;
+	std::vector<Uint64> chunks((size_t)chunkCount);
+	ThreadPool::Instance().ParallelFor(chunkCount, [&](Uint64 begin, Uint64 end)
+	{
+		for (Uint64 chunk = begin; chunk < end; chunk++)
+		{
+			Uint64 offset = chunk * HashChunk;
+			chunks[(size_t)chunk] = HashChunkData(data + offset, std::min(HashChunk, byteCount - offset), chunk);
+		}
+	}, 1, maxThreads);
+
+	Uint64 hash = Prime1 ^ byteCount;
+	for (Uint64 chunk : chunks)
+	{
+		hash = Mix(hash, chunk);
+	}
+	return Avalanche(hash);
+}
+
+std::string VolumeSidecar::GetPath(const std::string& brickPath)
+{
+	return brickPath.substr(0, brickPath.find_last_of(".")) + ".vstats";
+}
+
+void VolumeSidecar::Reset(std::shared_ptr<Texture> source, Uint64 contentHash)
+{
+	Reset(source->GetWidth(), source->GetHeight(), source->GetDepth(), source->GetFormat(), contentHash);
+}
+
+void VolumeSidecar::Reset(Uint32 width, Uint32 height, Uint32 depth, SurfaceFormat format, Uint64 contentHash)
+{
+	Release();
+	m_ContentHash = contentHash;
+	m_Width = width;
+	m_Height = height;
+	m_Depth = depth;
+	m_Format = format;
+}
+
+bool VolumeSidecar::Load(const std::string& path, std::shared_ptr<Texture> source, Uint64 contentHash)
+{
+	return Load(path, source->GetWidth(), source->GetHeight(), source->GetDepth(), source->GetFormat(), contentHash);
+}
+
+bool VolumeSidecar::Load(const std::string& path, Uint32 width, Uint32 height, Uint32 depth, SurfaceFormat format, Uint64 contentHash)
+{
+	Reset(width, height, depth, format, contentHash);
+
+	MappedFile file;
+	if (File::Exists(path) == false || file.Open(path.c_str()) == false || file.GetSize() < HeaderSize)
+	{
+		return false;
+	}
+
+	Dword header[10];
+	memcpy(header, file.GetData(), sizeof(header));
+	Uint64 hash = (Uint64)header[3] | ((Uint64)header[4] << 32);
+	if (header[0] != Magic || header[1] != Version || header[2] != GeneratorVersion)
+	{
+		LogInfo("Volume sidecar is out of date, it will be rebuilt: " + path);
+		return false;
+	}
+
+	if (hash != contentHash || header[5] != m_Width || header[6] != m_Height || header[7] != m_Depth || (SurfaceFormat)header[8] != m_Format)
+	{
+		LogInfo("Volume sidecar does not match its volume, it will be rebuilt: " + path);
+		return false;
+	}
+
+	// Each section is read whole or not at all. One that doesn't parse to exactly its byte count is stale and
+	// skipped, the loader rebuilds it and the sidecar is marked dirty so the file gets rewritten. Unknown ids
+	// are skipped untouched. A byte count past the end of the file ends the walk.
+	Dword sectionCount = header[9];
+	SidecarReader reader(file.GetData(), file.GetSize(), HeaderSize);
+	for (Dword i = 0; i < sectionCount; i++)
+	{
+		Dword id = 0;
+		Uint64 byteCount = 0;
+		if (reader.Read(&id, sizeof(id)) == false || reader.Read(&byteCount, sizeof(byteCount)) == false || byteCount > reader.GetRemaining())
+		{
+			LogWarning("Volume sidecar is truncated, the rest will be rebuilt: " + path);
+			m_Dirty = true;
+			break;
+		}
+
+		SidecarReader section(file.GetData(), reader.GetOffset() + byteCount, reader.GetOffset());
+		reader.Skip(byteCount);
+		bool valid = true;
+		switch (id)
+		{
+		case SectionStats:
+			valid = ReadStats(section);
+			break;
+		case SectionCellRanges:
+			valid = ReadCellRanges(section);
+			break;
+		case SectionVolumes:
+			valid = ReadVolumes(section);
+			break;
+		default:
+			continue;
+		}
+
+		if (valid == false || section.GetRemaining() != 0)
+		{
+			LogWarning("Volume sidecar has a stale section, it will be rebuilt: " + path);
+			DropSection(id);
+			m_Dirty = true;
+		}
+	}
+
+	return true;
+}
+
+bool VolumeSidecar::Save(const std::string& path)
+{
+	BinaryFile file(path.c_str(), FileMode::Write);
+	if (file.IsOpen() == false)
+	{
+		LogError("Failed to create volume sidecar: " + path);
+		return false;
+	}
+
+	Dword sections = (m_HasStats ? 1 : 0) + (m_CellRanges.empty() ? 0 : 1) + (m_VolumeMap ? 1 : 0);
+	bool written = file.WriteDword(Magic) && file.WriteDword(Version) && file.WriteDword(GeneratorVersion) &&
+				   file.WriteDword((Dword)m_ContentHash) && file.WriteDword((Dword)(m_ContentHash >> 32)) &&
+				   file.WriteDword(m_Width) && file.WriteDword(m_Height) && file.WriteDword(m_Depth) &&
+				   file.WriteDword((Dword)m_Format) && file.WriteDword(sections);
+
+	if (written && m_HasStats)
+	{
+		Uint64 binCount = m_Stats.Histogram.size();
+		Uint64 byteCount = sizeof(Dword) + 4 * sizeof(double) + 2 * sizeof(Uint64) + binCount * sizeof(Uint64);
+		written = WriteSectionHeader(file, SectionStats, byteCount) && WriteValue(file, (Dword)m_Stats.Format) && WriteValue(file, m_Stats.Min) && WriteValue(file, m_Stats.Max) &&
+				  WriteValue(file, m_Stats.Mean) && WriteValue(file, m_Stats.Variance) && WriteValue(file, m_Stats.Count) &&
+				  WriteValue(file, binCount) && (binCount == 0 || file.WriteBuffer((const Byte*)&m_Stats.Histogram[0], binCount * sizeof(Uint64)));
+	}
+
+	if (written && m_CellRanges.empty() == false)
+	{
+		Uint64 count = m_CellRanges.size();
+		Uint64 byteCount = sizeof(m_CellSize) + sizeof(Dword) + sizeof(Uint64) + count * sizeof(Word);
+		written = WriteSectionHeader(file, SectionCellRanges, byteCount) && file.WriteBuffer((const Byte*)m_CellSize, sizeof(m_CellSize)) && WriteValue(file, (Dword)m_RangeFormat) &&
+				  WriteValue(file, count) && file.WriteBuffer((const Byte*)&m_CellRanges[0], count * sizeof(Word));
+	}
+
+	if (written && m_VolumeMap)
+	{
+		bool packed = m_Layout == VolumeLayout::Packed;
+		Uint64 byteCount = sizeof(Dword) + TextureBytes(m_VolumeMap) + TextureBytes(m_GradientMap) + (packed ? 0 : TextureBytes(m_NormalMap));
+		written = WriteSectionHeader(file, SectionVolumes, byteCount) && WriteValue(file, (Dword)m_Layout) && WriteTexture(file, m_VolumeMap) && WriteTexture(file, m_GradientMap) &&
+				  (packed || WriteTexture(file, m_NormalMap));
+	}
+
+	file.Close();
+	if (written == false)
+	{
+		LogError("Failed to write volume sidecar: " + path);
+		BaseFile::Remove(path);
+		return false;
+	}
+
+	m_Dirty = false;
+	return true;
+}
+
+bool VolumeSidecar::ReadStats(SidecarReader& reader)
+{
+	Dword format = 0;
+	Uint64 binCount = 0;
+	bool valid = reader.Read(&format, sizeof(format)) && reader.Read(&m_Stats.Min, sizeof(double)) && reader.Read(&m_Stats.Max, sizeof(double)) &&
+				 reader.Read(&m_Stats.Mean, sizeof(double)) && reader.Read(&m_Stats.Variance, sizeof(double)) &&
+				 reader.Read(&m_Stats.Count, sizeof(Uint64)) && reader.Read(&binCount, sizeof(Uint64)) && binCount <= (1 << 16);
+	if (valid)
+	{
+		m_Stats.Format = (SurfaceFormat)format;
+		m_Stats.Histogram.resize((size_t)binCount);
+		valid = binCount == 0 || reader.Read(&m_Stats.Histogram[0], binCount * sizeof(Uint64));
+	}
+	m_HasStats = valid;
+	return valid;
+}
+
+bool VolumeSidecar::ReadCellRanges(SidecarReader& reader)
+{
+	Dword format = 0;
+	Uint64 count = 0;
+	bool valid = reader.Read(m_CellSize, sizeof(m_CellSize)) && reader.Read(&format, sizeof(format)) && reader.Read(&count, sizeof(count)) &&
+				 count * sizeof(Word) <= reader.GetRemaining();
+	if (valid)
+	{
+		m_RangeFormat = (SurfaceFormat)format;
+		m_CellRanges.resize((size_t)count);
+		valid = count == 0 || reader.Read(&m_CellRanges[0], count * sizeof(Word));
+	}
+	return valid;
+}
+
+bool VolumeSidecar::ReadVolumes(SidecarReader& reader)
+{
+	// Only the formats the generators give for the layout, see VolumeGenerator.cpp.
+	Dword layout = 0;
+	if (reader.Read(&layout, sizeof(layout)) == false || (layout != (Dword)VolumeLayout::Packed && layout != (Dword)VolumeLayout::Split))
+	{
+		return false;
+	}
+
+	m_Layout = (VolumeLayout)layout;
+	bool packed = m_Layout == VolumeLayout::Packed;
+	SurfaceFormat volumeFormat = packed ? SurfaceFormat::R8G8B8A8_Unorm : BytesPerBlock(m_Format) == 2 ? SurfaceFormat::R16_Unorm : SurfaceFormat::R8_Unorm;
+	m_VolumeMap = ReadTexture(reader, m_Width, m_Height, m_Depth, volumeFormat);
+	m_GradientMap = m_VolumeMap ? ReadTexture(reader, m_Width, m_Height, m_Depth, SurfaceFormat::R8_Unorm) : nullptr;
+	m_NormalMap = m_GradientMap && packed == false ? ReadTexture(reader, m_Width, m_Height, m_Depth, SurfaceFormat::R8G8_Unorm) : nullptr;
+	return m_GradientMap && (packed || m_NormalMap);
+}
+
+void VolumeSidecar::DropSection(Dword section)
+{
+	switch (section)
+	{
+	case SectionStats:
+		m_HasStats = false;
+		m_Stats = VolumeStats();
+		break;
+	case SectionCellRanges:
+		m_CellSize[0] = m_CellSize[1] = m_CellSize[2] = 0;
+		m_RangeFormat = SurfaceFormat::Unkown;
+		m_CellRanges.clear();
+		break;
+	case SectionVolumes:
+		DropVolumes();
+		break;
+	default:
+		break;
+	}
+}
+
+void VolumeSidecar::Release()
+{
+	m_ContentHash = 0;
+	m_Width = m_Height = m_Depth = 0;
+	m_Format = SurfaceFormat::Unkown;
+	m_Dirty = false;
+	m_HasStats = false;
+	m_Stats = VolumeStats();
+	m_CellSize[0] = m_CellSize[1] = m_CellSize[2] = 0;
+	m_RangeFormat = SurfaceFormat::Unkown;
+	m_CellRanges.clear();
+	m_CellRanges.shrink_to_fit();
+	DropVolumes();
+}
+
+bool VolumeSidecar::IsDirty() const
+{
+	return m_Dirty;
+}
+
+//-----------------------------------------------------------------------------------
+
+bool VolumeSidecar::HasStats() const
+{
+	return m_HasStats;
+}
+
+const VolumeStats& VolumeSidecar::GetStats() const
+{
+	return m_Stats;
+}
+
+void VolumeSidecar::SetStats(const VolumeStats& stats)
+{
+	m_Stats = stats;
+	m_HasStats = true;
+	m_Dirty = true;
+}
+
+bool VolumeSidecar::HasCellRanges(const Uint32 cellSize[3], SurfaceFormat volumeFormat) const
+{
+	return m_CellRanges.empty() == false && m_RangeFormat == volumeFormat &&
+		   m_CellSize[0] == cellSize[0] && m_CellSize[1] == cellSize[1] && m_CellSize[2] == cellSize[2];
+}
+
+const std::vector<Word>& VolumeSidecar::GetCellRanges() const
+{
+	return m_CellRanges;
+}
+
+void VolumeSidecar::SetCellRanges(const Uint32 cellSize[3], SurfaceFormat volumeFormat, const std::vector<Word>& ranges)
+{
+	memcpy(m_CellSize, cellSize, sizeof(m_CellSize));
+	m_RangeFormat = volumeFormat;
+	m_CellRanges = ranges;
+	m_Dirty = true;
+}
+
+bool VolumeSidecar::HasVolumes(VolumeLayout layout) const
+{
+	return m_VolumeMap && m_Layout == layout;
+}
+
+std::shared_ptr<Texture> VolumeSidecar::GetVolumeMap() const
+{
+	return m_VolumeMap;
+}
+
+std::shared_ptr<Texture> VolumeSidecar::GetGradientMap() const
+{
+	return m_GradientMap;
+}
+
+std::shared_ptr<Texture> VolumeSidecar::GetNormalMap() const
+{
+	return m_NormalMap;
+}
+
+void VolumeSidecar::SetVolumes(VolumeLayout layout, std::shared_ptr<Texture> volume, std::shared_ptr<Texture> gradient, std::shared_ptr<Texture> normals)
+{
+	m_Layout = layout;
+	m_VolumeMap = volume;
+	m_GradientMap = gradient;
+	m_NormalMap = normals;
+	m_Dirty = true;
+}
+
+void VolumeSidecar::DropVolumes()
+{
+	m_VolumeMap.reset();
+	m_GradientMap.reset();
+	m_NormalMap.reset();
+}
@@ -0,0 +1,104 @@
+//Note:
+/*
+	".vstats" sidecar next to a volume (beside its ".vbrick"), holding what the loader
+	derives from the voxels so a warm start only reads it back: the statistics (range,
+	histogram), the occupancy cell ranges for one cell size and, optionally, the
+	generated volume, gradient magnitude and normal textures for one layout.
+	It's keyed by a 64 bit hash of the voxels plus the dims and format, and by
+	GeneratorVersion, so an edited volume or a changed generator misses instead of
+	giving stale data. The loader hashes the brick file's bytes (it cooks one before the
+	hash on a first load) and the raw voxels only when there is none, both are lossless
+	copies of the voxels but hash differently, so a brick file cooked with another
+	codec or after a failed cook costs one miss. Sections are independent, a hit on the statistics with cell
+	ranges for another cell size reuses the one and rebuilds the other.
+
+	Layout: header dwords, then each present section (stats, cell ranges, volumes) as a
+	dword id and a 64 bit byte count before its data. Load skips ids it doesn't know, and a
+	section that doesn't parse to exactly its byte count or holds textures in formats the
+	generators don't give is dropped and rebuilt while the others are kept.
+*/
+
+#pragma once
+#include "VolumeGenerator.h"
+#include "VolumeStatistics.h"
+#include "Content/Texture.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+class SidecarReader;
+
+class VolumeSidecar
+{
+public:
+	static const Dword Magic = 0x54535656; // "VVST"
+	static const Dword Version = 2;
+	// Bump whenever VolumeStatistics, the gradient generators or the cell range pass would
+	// give different bytes for the same voxels, every sidecar written before then misses.
+	static const Dword GeneratorVersion = 1;
+
+private:
+	Uint64					 m_ContentHash = 0;
+	Uint32					 m_Width = 0;
+	Uint32					 m_Height = 0;
+	Uint32					 m_Depth = 0;
+	SurfaceFormat			 m_Format = SurfaceFormat::Unkown;
+	bool					 m_Dirty = false;	// Something was set since Load or Save
+
+	bool					 m_HasStats = false;
+	VolumeStats				 m_Stats;
+
+	Uint32					 m_CellSize[3] = { 0, 0, 0 };
+	SurfaceFormat			 m_RangeFormat = SurfaceFormat::Unkown;	// Of the volume the ranges were taken over
+	std::vector<Word>		 m_CellRanges;
+
+	VolumeLayout			 m_Layout = VolumeLayout::Packed;
+	std::shared_ptr<Texture> m_VolumeMap;
+	std::shared_ptr<Texture> m_GradientMap;
+	std::shared_ptr<Texture> m_NormalMap;	// Split layout only
+
+	// Section readers for Load, each fills its members or returns false.
+	bool ReadStats(SidecarReader& reader);
+	bool ReadCellRanges(SidecarReader& reader);
+	bool ReadVolumes(SidecarReader& reader);
+	void DropSection(Dword section);
+
+public:
+	// Fast content hash, chunks hashed on the pool and folded in order. maxThreads 0 uses the whole pool.
+	static Uint64 HashContent(const Byte* data, Uint64 byteCount, Uint32 maxThreads = 0);
+	// Sidecar path for a volume's brick file path.
+	static std::string GetPath(const std::string& brickPath);
+
+	// Empty, keyed to source (CPU data resident) and its hash.
+	void Reset(std::shared_ptr<Texture> source, Uint64 contentHash);
+	// As above for a volume that isn't resident, by its dims and format.
+	void Reset(Uint32 width, Uint32 height, Uint32 depth, SurfaceFormat format, Uint64 contentHash);
+	// False when there's no file or it was made from other voxels or by another generator, the
+	// sidecar is then left empty and keyed to source as Reset would. A hit may still lack stale
+	// sections, it's then dirty so the rebuilt ones get saved.
+	bool Load(const std::string& path, std::shared_ptr<Texture> source, Uint64 contentHash);
+	bool Load(const std::string& path, Uint32 width, Uint32 height, Uint32 depth, SurfaceFormat format, Uint64 contentHash);
+	// Writes every section held, a failed write removes the partial file.
+	bool Save(const std::string& path);
+	void Release();
+	bool IsDirty()const;
+
+	bool			   HasStats()const;
+	const VolumeStats& GetStats()const;
+	void			   SetStats(const VolumeStats& stats);
+
+	// For this cell size over a volume of this format.
+	bool					 HasCellRanges(const Uint32 cellSize[3], SurfaceFormat volumeFormat)const;
+	const std::vector<Word>& GetCellRanges()const;
+	void					 SetCellRanges(const Uint32 cellSize[3], SurfaceFormat volumeFormat, const std::vector<Word>& ranges);
+
+	// Textures from Load are CPU side only, for the caller to Apply. Set needs their CPU data until Save.
+	bool					 HasVolumes(VolumeLayout layout)const;
+	std::shared_ptr<Texture> GetVolumeMap()const;
+	std::shared_ptr<Texture> GetGradientMap()const;
+	std::shared_ptr<Texture> GetNormalMap()const;
+	void					 SetVolumes(VolumeLayout layout, std::shared_ptr<Texture> volume, std::shared_ptr<Texture> gradient,
+										std::shared_ptr<Texture> normals);
+	// Lets go of the textures, whoever took them keeps them.
+	void					 DropVolumes();
+};
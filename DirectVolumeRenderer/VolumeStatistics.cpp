@@ -0,0 +1,745 @@
+#include "VolumeStatistics.h"
+#include "BrickPager.h"
+#include "System/ThreadPool.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <mutex>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define STATS_SIMD
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define STATS_TARGET(isa)
+#else
+#define STATS_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+namespace
+{
+	const Uint64 BlockVoxels = 4096;			// Reduced then counted while in L1, keeps 32 bit lane sums from overflowing
+	const Uint64 MinSlabVoxels = 1ull << 20;
+	const Uint64 MaxSlabVoxels = 1ull << 24;	// Bin counts are 32 bit within a slab
+
+	enum class VoxelKind { U8, S8, U16, S16, F32 };
+
+	// Integer kinds reduce as signed 16 bit keys, U16 is moved down by 32768 so they all fit.
+	struct SlabResult
+	{
+		double Min = std::numeric_limits<double>::infinity();
+		double Max = -std::numeric_limits<double>::infinity();
+		double Sum = 0;
+		double SumSq = 0;
+		Uint64 Count = 0;
+
+		void Merge(const SlabResult& other)
+		{
+			Min = std::min(Min, other.Min);
+			Max = std::max(Max, other.Max);
+			Sum += other.Sum;
+			SumSq += other.SumSq;
+			Count += other.Count;
+		}
+	};
+
+	struct IntAccum
+	{
+		int	   MinKey = INT_MAX;
+		int	   MaxKey = INT_MIN;
+		Int64  Sum = 0;
+		Uint64 SumSq = 0;	// One block's worth, 4096 * 2^30 fits easily
+	};
+
+	struct FloatAccum
+	{
+		float  Min = std::numeric_limits<float>::infinity();
+		float  Max = -std::numeric_limits<float>::infinity();
+		double Sum = 0;
+		double SumSq = 0;
+		Uint64 Count = 0;
+	};
+
+	VoxelKind KindOf(SurfaceFormat format)
+	{
+		switch (format)
+		{
+		case SurfaceFormat::R8_Sint:	return VoxelKind::S8;
+		case SurfaceFormat::R16_Uint:	return VoxelKind::U16;
+		case SurfaceFormat::R16_Sint:	return VoxelKind::S16;
+		case SurfaceFormat::R32_Float:	return VoxelKind::F32;
+		default:						return VoxelKind::U8;
+		}
+	}
+
+	// Order preserving unsigned key, negative floats flip entirely and positives flip the sign bit.
+	inline Dword FloatKey(Dword bits)
+	{
+		return bits ^ ((bits & 0x80000000u) ? 0xFFFFFFFFu : 0x80000000u);
+	}
+
+	inline bool IsNaN(Dword bits)
+	{
+		return (bits & 0x7FFFFFFFu) > 0x7F800000u;
+	}
+
+	//-------------------------------------------------------------------------------
+	// Scalar
+
+	template<VoxelKind K>
+	inline int LoadKey(const Byte* data, Uint64 i)
+	{
+		switch (K)
+		{
+		case VoxelKind::U8:		return data[i];
+		case VoxelKind::S8:		return ((const Int8*)data)[i];
+		case VoxelKind::U16:	return (int)((const Uint16*)data)[i] - 32768;
+		default:				return ((const Int16*)data)[i];
+		}
+	}
+
+	template<VoxelKind K>
+	void ReduceIntScalar(const Byte* data, Uint64 begin, Uint64 end, IntAccum& accum)
+	{
+		for (Uint64 i = begin; i < end; i++)
+		{
+			int key = LoadKey<K>(data, i);
+			accum.MinKey = key < accum.MinKey ? key : accum.MinKey;
+			accum.MaxKey = key > accum.MaxKey ? key : accum.MaxKey;
+			accum.Sum += key;
+			accum.SumSq += (Uint64)(key * key);
+		}
+	}
+
+	void ReduceFloatScalar(const float* data, Uint64 begin, Uint64 end, FloatAccum& accum)
+	{
+		for (Uint64 i = begin; i < end; i++)
+		{
+			float value = data[i];
+			if (value != value)
+			{
+				continue;
+			}
+
+			accum.Min = value < accum.Min ? value : accum.Min;
+			accum.Max = value > accum.Max ? value : accum.Max;
+			accum.Sum += value;
+			accum.SumSq += (double)value * value;
+			accum.Count++;
+		}
+	}
+
+	// Bins for one block. 8 bit data spreads over four sub histograms so runs of equal values don't stall on one counter.
+	template<VoxelKind K>
+	void CountBins(const Byte* data, Uint64 begin, Uint64 end, Uint32* bins)
+	{
+		switch (K)
+		{
+		case VoxelKind::U8:
+		case VoxelKind::S8:
+		{
+			const Uint32 flip = K == VoxelKind::S8 ? 0x80 : 0;
+			Uint64 i = begin;
+			for (; i + 4 <= end; i += 4)
+			{
+				bins[(data[i] ^ flip)]++;
+				bins[256 + (data[i + 1] ^ flip)]++;
+				bins[512 + (data[i + 2] ^ flip)]++;
+				bins[768 + (data[i + 3] ^ flip)]++;
+			}
+			for (; i < end; i++)
+			{
+				bins[data[i] ^ flip]++;
+			}
+			break;
+		}
+		case VoxelKind::U16:
+		case VoxelKind::S16:
+		{
+			const Uint32 flip = K == VoxelKind::S16 ? 0x8000 : 0;
+			const Uint16* voxels = (const Uint16*)data;
+			for (Uint64 i = begin; i < end; i++)
+			{
+				bins[voxels[i] ^ flip]++;
+			}
+			break;
+		}
+		default:
+		{
+			const Dword* voxels = (const Dword*)data;
+			for (Uint64 i = begin; i < end; i++)
+			{
+				Dword bits = voxels[i];
+				if (IsNaN(bits) == false)
+				{
+					bins[FloatKey(bits) >> 16]++;
+				}
+			}
+			break;
+		}
+		}
+	}
+
+#if defined(STATS_SIMD)
+	//-------------------------------------------------------------------------------
+	// SSE4.1, 8 keys or 4 floats a step
+
+	template<VoxelKind K>
+	STATS_TARGET("sse4.1") inline __m128i LoadKeys(const Byte* data, Uint64 i)
+	{
+		switch (K)
+		{
+		case VoxelKind::U8:		return _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(data + i)));
+		case VoxelKind::S8:		return _mm_cvtepi8_epi16(_mm_loadl_epi64((const __m128i*)(data + i)));
+		case VoxelKind::U16:	return _mm_xor_si128(_mm_loadu_si128((const __m128i*)(data + i * 2)), _mm_set1_epi16((short)0x8000));
+		default:				return _mm_loadu_si128((const __m128i*)(data + i * 2));
+		}
+	}
+
+	template<VoxelKind K>
+	STATS_TARGET("sse4.1") void ReduceIntSSE41(const Byte* data, Uint64 begin, Uint64 end, IntAccum& accum)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i ones = _mm_set1_epi16(1);
+		__m128i minKeys = _mm_set1_epi16(SHRT_MAX);
+		__m128i maxKeys = _mm_set1_epi16(SHRT_MIN);
+		__m128i sums = zero;	// 4 x 32 bit
+		__m128i squares = zero; // 2 x 64 bit
+
+		Uint64 i = begin;
+		for (; i + 8 <= end; i += 8)
+		{
+			__m128i keys = LoadKeys<K>(data, i);
+			minKeys = _mm_min_epi16(minKeys, keys);
+			maxKeys = _mm_max_epi16(maxKeys, keys);
+			sums = _mm_add_epi32(sums, _mm_madd_epi16(keys, ones));
+			// A pair of squares fits 32 bits unsigned, widen before adding up.
+			__m128i pairs = _mm_madd_epi16(keys, keys);
+			squares = _mm_add_epi64(squares, _mm_add_epi64(_mm_unpacklo_epi32(pairs, zero), _mm_unpackhi_epi32(pairs, zero)));
+		}
+
+		alignas(16) Int16 minOut[8];
+		alignas(16) Int16 maxOut[8];
+		alignas(16) int sumOut[4];
+		alignas(16) Uint64 squareOut[2];
+		_mm_store_si128((__m128i*)minOut, minKeys);
+		_mm_store_si128((__m128i*)maxOut, maxKeys);
+		_mm_store_si128((__m128i*)sumOut, sums);
+		_mm_store_si128((__m128i*)squareOut, squares);
+
+		for (Uint32 lane = 0; lane < 8; lane++)
+		{
+			accum.MinKey = std::min(accum.MinKey, (int)minOut[lane]);
+			accum.MaxKey = std::max(accum.MaxKey, (int)maxOut[lane]);
+		}
+		accum.Sum += (Int64)sumOut[0] + sumOut[1] + sumOut[2] + sumOut[3];
+		accum.SumSq += squareOut[0] + squareOut[1];
+
+		ReduceIntScalar<K>(data, i, end, accum);
+	}
+
+	STATS_TARGET("sse4.1") void ReduceFloatSSE41(const float* data, Uint64 begin, Uint64 end, FloatAccum& accum)
+	{
+		__m128 minValues = _mm_set1_ps(accum.Min);
+		__m128 maxValues = _mm_set1_ps(accum.Max);
+		__m128d sums = _mm_setzero_pd();
+		__m128d squares = _mm_setzero_pd();
+		__m128i counts = _mm_setzero_si128();
+
+		Uint64 i = begin;
+		for (; i + 4 <= end; i += 4)
+		{
+			__m128 values = _mm_loadu_ps(data + i);
+			__m128 ordered = _mm_cmpord_ps(values, values);
+			// min/max return the second operand on NaN, so NaNs leave the running values alone.
+			minValues = _mm_min_ps(values, minValues);
+			maxValues = _mm_max_ps(values, maxValues);
+
+			values = _mm_and_ps(values, ordered);
+			__m128d low = _mm_cvtps_pd(values);
+			__m128d high = _mm_cvtps_pd(_mm_movehl_ps(values, values));
+			sums = _mm_add_pd(sums, _mm_add_pd(low, high));
+			squares = _mm_add_pd(squares, _mm_add_pd(_mm_mul_pd(low, low), _mm_mul_pd(high, high)));
+			counts = _mm_sub_epi32(counts, _mm_castps_si128(ordered));
+		}
+
+		alignas(16) float minOut[4];
+		alignas(16) float maxOut[4];
+		alignas(16) double sumOut[2];
+		alignas(16) double squareOut[2];
+		alignas(16) int countOut[4];
+		_mm_store_ps(minOut, minValues);
+		_mm_store_ps(maxOut, maxValues);
+		_mm_store_pd(sumOut, sums);
+		_mm_store_pd(squareOut, squares);
+		_mm_store_si128((__m128i*)countOut, counts);
+
+		for (Uint32 lane = 0; lane < 4; lane++)
+		{
+			accum.Min = std::min(accum.Min, minOut[lane]);
+			accum.Max = std::max(accum.Max, maxOut[lane]);
+			accum.Count += (Uint32)countOut[lane];
+		}
+		accum.Sum += sumOut[0] + sumOut[1];
+		accum.SumSq += squareOut[0] + squareOut[1];
+
+		ReduceFloatScalar(data, i, end, accum);
+	}
+
+	//-------------------------------------------------------------------------------
+	// AVX2, 16 keys or 8 floats a step
+
+	template<VoxelKind K>
+	STATS_TARGET("avx2") inline __m256i LoadKeysWide(const Byte* data, Uint64 i)
+	{
+		switch (K)
+		{
+		case VoxelKind::U8:		return _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(data + i)));
+		case VoxelKind::S8:		return _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)(data + i)));
+		case VoxelKind::U16:	return _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(data + i * 2)), _mm256_set1_epi16((short)0x8000));
+		default:				return _mm256_loadu_si256((const __m256i*)(data + i * 2));
+		}
+	}
+
+	template<VoxelKind K>
+	STATS_TARGET("avx2") void ReduceIntAVX2(const Byte* data, Uint64 begin, Uint64 end, IntAccum& accum)
+	{
+		const __m256i zero = _mm256_setzero_si256();
+		const __m256i ones = _mm256_set1_epi16(1);
+		__m256i minKeys = _mm256_set1_epi16(SHRT_MAX);
+		__m256i maxKeys = _mm256_set1_epi16(SHRT_MIN);
+		__m256i sums = zero;
+		__m256i squares = zero;
+
+		Uint64 i = begin;
+		for (; i + 16 <= end; i += 16)
+		{
+			__m256i keys = LoadKeysWide<K>(data, i);
+			minKeys = _mm256_min_epi16(minKeys, keys);
+			maxKeys = _mm256_max_epi16(maxKeys, keys);
+			sums = _mm256_add_epi32(sums, _mm256_madd_epi16(keys, ones));
+			__m256i pairs = _mm256_madd_epi16(keys, keys);
+			squares = _mm256_add_epi64(squares, _mm256_add_epi64(_mm256_unpacklo_epi32(pairs, zero), _mm256_unpackhi_epi32(pairs, zero)));
+		}
+
+		alignas(32) Int16 minOut[16];
+		alignas(32) Int16 maxOut[16];
+		alignas(32) int sumOut[8];
+		alignas(32) Uint64 squareOut[4];
+		_mm256_store_si256((__m256i*)minOut, minKeys);
+		_mm256_store_si256((__m256i*)maxOut, maxKeys);
+		_mm256_store_si256((__m256i*)sumOut, sums);
+		_mm256_store_si256((__m256i*)squareOut, squares);
+
+		for (Uint32 lane = 0; lane < 16; lane++)
+		{
+			accum.MinKey = std::min(accum.MinKey, (int)minOut[lane]);
+			accum.MaxKey = std::max(accum.MaxKey, (int)maxOut[lane]);
+		}
+		for (Uint32 lane = 0; lane < 8; lane++)
+		{
+			accum.Sum += sumOut[lane];
+		}
+		accum.SumSq += squareOut[0] + squareOut[1] + squareOut[2] + squareOut[3];
+
+		ReduceIntScalar<K>(data, i, end, accum);
+	}
+
+	STATS_TARGET("avx2") void ReduceFloatAVX2(const float* data, Uint64 begin, Uint64 end, FloatAccum& accum)
+	{
+		__m256 minValues = _mm256_set1_ps(accum.Min);
+		__m256 maxValues = _mm256_set1_ps(accum.Max);
+		__m256d sums = _mm256_setzero_pd();
+		__m256d squares = _mm256_setzero_pd();
+		__m256i counts = _mm256_setzero_si256();
+
+		Uint64 i = begin;
+		for (; i + 8 <= end; i += 8)
+		{
+			__m256 values = _mm256_loadu_ps(data + i);
+			__m256 ordered = _mm256_cmp_ps(values, values, _CMP_ORD_Q);
+			minValues = _mm256_min_ps(values, minValues);
+			maxValues = _mm256_max_ps(values, maxValues);
+
+			values = _mm256_and_ps(values, ordered);
+			__m256d low = _mm256_cvtps_pd(_mm256_castps256_ps128(values));
+			__m256d high = _mm256_cvtps_pd(_mm256_extractf128_ps(values, 1));
+			sums = _mm256_add_pd(sums, _mm256_add_pd(low, high));
+			squares = _mm256_add_pd(squares, _mm256_add_pd(_mm256_mul_pd(low, low), _mm256_mul_pd(high, high)));
+			counts = _mm256_sub_epi32(counts, _mm256_castps_si256(ordered));
+		}
+
+		alignas(32) float minOut[8];
+		alignas(32) float maxOut[8];
+		alignas(32) double sumOut[4];
+		alignas(32) double squareOut[4];
+		alignas(32) int countOut[8];
+		_mm256_store_ps(minOut, minValues);
+		_mm256_store_ps(maxOut, maxValues);
+		_mm256_store_pd(sumOut, sums);
+		_mm256_store_pd(squareOut, squares);
+		_mm256_store_si256((__m256i*)countOut, counts);
+
+		for (Uint32 lane = 0; lane < 8; lane++)
+		{
+			accum.Min = std::min(accum.Min, minOut[lane]);
+			accum.Max = std::max(accum.Max, maxOut[lane]);
+			accum.Count += (Uint32)countOut[lane];
+		}
+		accum.Sum += sumOut[0] + sumOut[1] + sumOut[2] + sumOut[3];
+		accum.SumSq += squareOut[0] + squareOut[1] + squareOut[2] + squareOut[3];
+
+		// Tail is 7 or less, SSE would only take 4 of them.
+		ReduceFloatScalar(data, i, end, accum);
+	}
+#endif
+
+	//-------------------------------------------------------------------------------
+
+	template<VoxelKind K>
+	void ScanIntSlab(const Byte* data, Uint64 begin, Uint64 end, SimdLevel level, Uint32* bins, SlabResult& result)
+	{
+		IntAccum accum;
+		for (Uint64 block = begin; block < end; block += BlockVoxels)
+		{
+			Uint64 blockEnd = std::min(block + BlockVoxels, end);
+			switch (level)
+			{
+#if defined(STATS_SIMD)
+			case SimdLevel::AVX2:	ReduceIntAVX2<K>(data, block, blockEnd, accum); break;
+			case SimdLevel::SSE41:	ReduceIntSSE41<K>(data, block, blockEnd, accum); break;
+#endif
+			default:				ReduceIntScalar<K>(data, block, blockEnd, accum); break;
+			}
+			CountBins<K>(data, block, blockEnd, bins);
+
+			result.SumSq += (double)accum.SumSq;
+			accum.SumSq = 0;
+		}
+
+		result.Min = accum.MinKey;
+		result.Max = accum.MaxKey;
+		result.Sum = (double)accum.Sum;
+		result.Count = end - begin;
+	}
+
+	void ScanFloatSlab(const Byte* data, Uint64 begin, Uint64 end, SimdLevel level, Uint32* bins, SlabResult& result)
+	{
+		FloatAccum accum;
+		for (Uint64 block = begin; block < end; block += BlockVoxels)
+		{
+			Uint64 blockEnd = std::min(block + BlockVoxels, end);
+			switch (level)
+			{
+#if defined(STATS_SIMD)
+			case SimdLevel::AVX2:	ReduceFloatAVX2((const float*)data, block, blockEnd, accum); break;
+			case SimdLevel::SSE41:	ReduceFloatSSE41((const float*)data, block, blockEnd, accum); break;
+#endif
+			default:				ReduceFloatScalar((const float*)data, block, blockEnd, accum); break;
+			}
+			CountBins<VoxelKind::F32>(data, block, blockEnd, bins);
+		}
+
+		result.Min = accum.Min;
+		result.Max = accum.Max;
+		result.Sum = accum.Sum;
+		result.SumSq = accum.SumSq;
+		result.Count = accum.Count;
+	}
+
+	void ScanSlab(VoxelKind kind, const Byte* data, Uint64 begin, Uint64 end, SimdLevel level, Uint32* bins, SlabResult& result)
+	{
+		switch (kind)
+		{
+		case VoxelKind::U8:		ScanIntSlab<VoxelKind::U8>(data, begin, end, level, bins, result); break;
+		case VoxelKind::S8:		ScanIntSlab<VoxelKind::S8>(data, begin, end, level, bins, result); break;
+		case VoxelKind::U16:	ScanIntSlab<VoxelKind::U16>(data, begin, end, level, bins, result); break;
+		case VoxelKind::S16:	ScanIntSlab<VoxelKind::S16>(data, begin, end, level, bins, result); break;
+		default:				ScanFloatSlab(data, begin, end, level, bins, result); break;
+		}
+	}
+
+	void FinishStats(VoxelKind kind, const SlabResult& total, VolumeStats& stats)
+	{
+		stats.Count = total.Count;
+		if (total.Count == 0)
+		{
+			return;
+		}
+
+		// Sums were taken on the keys, shifting back only moves the mean.
+		double offset = kind == VoxelKind::U16 ? 32768.0 : 0.0;
+		double meanKey = total.Sum / total.Count;
+		stats.Min = total.Min + offset;
+		stats.Max = total.Max + offset;
+		stats.Mean = meanKey + offset;
+		stats.Variance = std::max(total.SumSq / total.Count - meanKey * meanKey, 0.0);
+	}
+
+	SimdLevel DetectSimdLevel()
+	{
+#if defined(STATS_SIMD)
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		int maxLeaf = info[0];
+		__cpuid(info, 1);
+		bool sse41 = (info[2] & (1 << 19)) != 0;
+		// AVX needs the OS to save the upper halves too (OSXSAVE then XCR0 bits 1 and 2).
+		bool avx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+		bool avx2 = false;
+		if (avx && maxLeaf >= 7)
+		{
+			__cpuidex(info, 7, 0);
+			avx2 = (info[1] & (1 << 5)) != 0;
+		}
+#else
+		__builtin_cpu_init();
+		bool sse41 = __builtin_cpu_supports("sse4.1") != 0;
+		bool avx2 = __builtin_cpu_supports("avx2") != 0;
+#endif
+		if (avx2) { return SimdLevel::AVX2; }
+		if (sse41) { return SimdLevel::SSE41; }
+#endif
+		return SimdLevel::Scalar;
+	}
+}
+
+//-----------------------------------------------------------------------------------
+
+double VolumeStats::GetBinValue(Uint32 bin) const
+{
+	switch (Format)
+	{
+	case SurfaceFormat::R8_Sint:	return (double)bin - 128.0;
+	case SurfaceFormat::R16_Sint:	return (double)bin - 32768.0;
+	case SurfaceFormat::R32_Float:
+	{
+		Dword key = (Dword)bin << 16;
+		Dword bits = (key & 0x80000000u) ? key ^ 0x80000000u : ~key;
+		float value;
+		memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+	default:						return bin;
+	}
+}
+
+Uint32 VolumeStats::GetBin(double value) const
+{
+	if (Histogram.empty())
+	{
+		return 0;
+	}
+
+	if (Format == SurfaceFormat::R32_Float)
+	{
+		float single = (float)value;
+		Dword bits;
+		memcpy(&bits, &single, sizeof(bits));
+		return FloatKey(bits) >> 16;
+	}
+
+	double offset = Format == SurfaceFormat::R8_Sint ? 128.0 : (Format == SurfaceFormat::R16_Sint ? 32768.0 : 0.0);
+	double bin = std::floor(value + offset);
+	return (Uint32)std::min(std::max(bin, 0.0), (double)(Histogram.size() - 1));
+}
+
+bool VolumeStatistics::IsSupported(SurfaceFormat format)
+{
+	switch (format)
+	{
+	case SurfaceFormat::R8_Uint:
+	case SurfaceFormat::R8_Sint:
+	case SurfaceFormat::R16_Uint:
+	case SurfaceFormat::R16_Sint:
+	case SurfaceFormat::R32_Float:
+		return true;
+	default:
+		return false;
+	}
+}
+
+SimdLevel VolumeStatistics::GetSimdLevel()
+{
+	static const SimdLevel level = DetectSimdLevel();
+	return level;
+}
+
+const char* VolumeStatistics::GetSimdName(SimdLevel level)
+{
+	switch (level)
+	{
+	case SimdLevel::AVX2:	return "AVX2";
+	case SimdLevel::SSE41:	return "SSE4.1";
+	default:				return "Scalar";
+	}
+}
+
+VolumeStats VolumeStatistics::Scan(const Byte* data, Uint64 voxelCount, SurfaceFormat format, Uint32 maxThreads)
+{
+	return Scan(data, voxelCount, format, maxThreads, GetSimdLevel());
+}
+
+VolumeStats VolumeStatistics::Scan(const Byte* data, Uint64 voxelCount, SurfaceFormat format, Uint32 maxThreads, SimdLevel level)
+{
+	VolumeStats stats;
+	stats.Format = format;
+	if (IsSupported(format) == false || data == nullptr)
+	{
+		return stats;
+	}
+
+	VoxelKind kind = KindOf(format);
+	level = std::min(level, GetSimdLevel());
+	Uint32 binCount = BytesPerBlock(format) == 1 ? 256 : 65536;
+	Uint32 binCopies = BytesPerBlock(format) == 1 ? 4 : 1;
+	stats.Histogram.assign(binCount, 0);
+
+	// A few slabs per thread, each with its own 32 bit bins that flush into the shared histogram.
+	ThreadPool& pool = ThreadPool::Instance();
+	Uint32 threads = maxThreads > 0 ? maxThreads : pool.GetThreadCount() + 1;
+	Uint64 slabVoxels = std::min(std::max(voxelCount / ((Uint64)threads * 4), MinSlabVoxels), MaxSlabVoxels);
+	Uint64 slabCount = (voxelCount + slabVoxels - 1) / slabVoxels;
+
+	SlabResult total;
+	std::mutex mutex;
+	pool.ParallelFor(slabCount, [&](Uint64 begin, Uint64 end)
+	{
+		std::vector<Uint32> bins((size_t)binCount * binCopies);
+		for (Uint64 slab = begin; slab < end; slab++)
+		{
+			SlabResult result;
+			std::fill(bins.begin(), bins.end(), 0);
+			ScanSlab(kind, data, slab * slabVoxels, std::min((slab + 1) * slabVoxels, voxelCount), level, &bins[0], result);
+
+			std::lock_guard<std::mutex> lock(mutex);
+			total.Merge(result);
+			for (Uint32 copy = 0; copy < binCopies; copy++)
+			{
+				const Uint32* copyBins = &bins[(size_t)copy * binCount];
+				for (Uint32 bin = 0; bin < binCount; bin++)
+				{
+					stats.Histogram[bin] += copyBins[bin];
+				}
+			}
+		}
+	}, 1, maxThreads);
+
+	FinishStats(kind, total, stats);
+	return stats;
+}
+
+VolumeStats VolumeStatistics::Scan(BrickPager& pager)
+{
+	VolumeStats stats;
+	const VolumeBricks* bricks = pager.GetBricks();
+	if (pager.IsValid() == false)
+	{
+		return stats;
+	}
+
+	SurfaceFormat format = bricks->GetFormat();
+	stats.Format = format;
+	if (IsSupported(format) == false)
+	{
+		return stats;
+	}
+
+	VoxelKind kind = KindOf(format);
+	SimdLevel level = GetSimdLevel();
+	Uint32 bpv = BytesPerBlock(format);
+	Uint32 binCount = bpv == 1 ? 256 : 65536;
+	Uint32 binCopies = bpv == 1 ? 4 : 1;
+	Uint32 padded = bricks->GetPaddedBrickSize();
+	Uint32 apron = bricks->GetApron();
+	stats.Histogram.assign(binCount, 0);
+
+	// One of these per worker at a time, the 32 bit bins flush into the histogram before a slab's worth of voxels.
+	struct BrickScan
+	{
+		SlabResult			Total;
+		std::vector<Uint32> Bins;
+		std::vector<Byte>	Core;
+		Uint64				Pending = 0;
+	};
+
+	std::vector<std::unique_ptr<BrickScan>> scans;
+	std::vector<BrickScan*> idle;
+	std::mutex mutex;
+
+	// Caller holds mutex.
+	auto flush = [&](BrickScan& scan)
+	{
+		for (Uint32 copy = 0; copy < binCopies; copy++)
+		{
+			const Uint32* copyBins = &scan.Bins[(size_t)copy * binCount];
+			for (Uint32 bin = 0; bin < binCount; bin++)
+			{
+				stats.Histogram[bin] += copyBins[bin];
+			}
+		}
+		std::fill(scan.Bins.begin(), scan.Bins.end(), 0);
+		scan.Pending = 0;
+	};
+
+	pager.ForEachBrick([&](const BrickData& brick)
+	{
+		BrickScan* scan = nullptr;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (idle.empty())
+			{
+				scans.push_back(std::make_unique<BrickScan>());
+				scans.back()->Bins.assign((size_t)binCount * binCopies, 0);
+				idle.push_back(scans.back().get());
+			}
+			scan = idle.back();
+			idle.pop_back();
+		}
+
+		// The apron belongs to the neighbours, the core is gathered into one run and scanned like a slab.
+		Uint32 coreX, coreY, coreZ;
+		bricks->GetBrickCore(brick.Index, coreX, coreY, coreZ);
+		Uint64 voxelCount = (Uint64)coreX * coreY * coreZ;
+		scan->Core.resize((size_t)(voxelCount * bpv));
+		Byte* core = &scan->Core[0];
+		for (Uint32 z = 0; z < coreZ; z++)
+		{
+			for (Uint32 y = 0; y < coreY; y++)
+			{
+				const Byte* row = &brick.Voxels[0] + (((Uint64)(z + apron) * padded + (y + apron)) * padded + apron) * bpv;
+				memcpy(core, row, (size_t)coreX * bpv);
+				core += (size_t)coreX * bpv;
+			}
+		}
+
+		if (scan->Pending + voxelCount > MaxSlabVoxels)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			flush(*scan);
+		}
+
+		SlabResult result;
+		ScanSlab(kind, &scan->Core[0], 0, voxelCount, level, &scan->Bins[0], result);
+		scan->Total.Merge(result);
+		scan->Pending += voxelCount;
+
+		std::lock_guard<std::mutex> lock(mutex);
+		idle.push_back(scan);
+	});
+
+	SlabResult total;
+	for (std::unique_ptr<BrickScan>& scan : scans)
+	{
+		flush(*scan);
+		total.Merge(scan->Total);
+	}
+
+	FinishStats(kind, total, stats);
+	return stats;
+}
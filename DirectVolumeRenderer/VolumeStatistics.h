@@ -0,0 +1,49 @@
+//Note:
+/*
+	Single pass min, max, mean, variance and histogram over a whole volume. Blocks of
+	voxels are reduced with AVX2 or SSE4.1 (picked at runtime, scalar otherwise) and
+	counted into the histogram while still in L1, slabs run across the thread pool
+	and merge at the end. Integer formats get one bin per value (256 or 65536 bins).
+	Float32 is binned on the top 16 bits of an order preserving key, a bfloat16
+	resolution histogram that needs no range pass first. NaNs are left out.
+*/
+
+#pragma once
+#include "Graphics/Graphics.h"
+#include "System/Types.h"
+#include <vector>
+
+enum class SimdLevel { Scalar, SSE41, AVX2 };
+
+class BrickPager;
+
+struct VolumeStats
+{
+	SurfaceFormat		Format = SurfaceFormat::Unkown;
+	double				Min = 0;
+	double				Max = 0;
+	double				Mean = 0;
+	double				Variance = 0;
+	Uint64				Count = 0;	// Voxels counted
+	std::vector<Uint64> Histogram;
+
+	// Smallest value that lands in bin.
+	double GetBinValue(Uint32 bin)const;
+	Uint32 GetBin(double value)const;
+};
+
+namespace VolumeStatistics
+{
+	// R8/R16 Uint and Sint, R32_Float.
+	bool		IsSupported(SurfaceFormat format);
+	// Best level the CPU and OS support.
+	SimdLevel	GetSimdLevel();
+	const char* GetSimdName(SimdLevel level);
+
+	// maxThreads 0 uses the whole pool, a level above GetSimdLevel is clamped down to it.
+	VolumeStats Scan(const Byte* data, Uint64 voxelCount, SurfaceFormat format, Uint32 maxThreads = 0);
+	VolumeStats Scan(const Byte* data, Uint64 voxelCount, SurfaceFormat format, Uint32 maxThreads, SimdLevel level);
+	// The same over the bricks the pager serves, so only its budget of the volume is ever resident.
+	// Integer formats give the same stats as a dense scan, float sums can differ in the last bits.
+	VolumeStats Scan(BrickPager& pager);
+}
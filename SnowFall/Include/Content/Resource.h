@@ -24,7 +24,7 @@ protected:
     std::string	m_FilePath = "";
     Uint32	    m_Type = 0;    // Magic
     LoadState	m_LoadState = LoadState::Unloaded;
-    Uint32		m_Size = 0;	 // Size in bytes of resource
+    Uint64		m_Size = 0;	 // Size in bytes of resource
 
 public:
     Resource();
@@ -36,7 +36,7 @@ public:
     void        SetResourcePath(std::string path);
     bool		IsLoaded()const;
     LoadState	LoadState()const;
-    Uint32		Size()const;
+    Uint64		Size()const;
 
     virtual void LoadFromFile(const std::string& filePath) = 0;
     virtual bool SaveToFile(std::string fileName) = 0; // Editor only?
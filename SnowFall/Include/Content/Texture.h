@@ -20,10 +20,11 @@ struct TextureLevel
 	Uint32 width = 0;
 	Uint32 height = 0;
 	Uint32 depth = 0;
-	Uint32 byteCount = 0;
+	Uint64 byteCount = 0;
 };
 
 class GraphicsDevice;
+class MappedFile;
 class Texture : public Resource
 {
 protected:
@@ -38,6 +39,7 @@ protected:
 
 	//--CPU Data--
 	Byte* m_Data = nullptr;
+	MappedFile* m_MappedFile = nullptr; // When set m_Data points into the mapping not the heap.
 	std::vector<TextureLevel> m_LookUpTable;
 
 public:
@@ -50,6 +52,7 @@ public:
 	void Create1D(Uint32 width, Uint32 arraySize, BufferUsage usage, SurfaceFormat SurfaceFormat, TextureType type = TextureType::Texture1D);
 	void Create2D(Uint32 width, Uint32 height, Uint32 arraySize = 1, bool mips = false, BufferUsage usage = BufferUsage::Immutable, SurfaceFormat SurfaceFormat = SurfaceFormat::R8G8B8A8_Unorm, TextureType type = TextureType::Texture2D);
 	void Create3D(Uint32 width, Uint32 height, Uint32 depth, BufferUsage usage, SurfaceFormat SurfaceFormat, TextureType type = TextureType::Texture2D);
+	void Create3D(Uint32 width, Uint32 height, Uint32 depth, bool mips, BufferUsage usage, SurfaceFormat SurfaceFormat);
 
 public:
 	void operator=(const Texture& texture) = delete;
@@ -72,9 +75,10 @@ public:
 	bool			IsCube()const;
 	bool			IsSRGB()const;
 	bool			HasMips()const;
-	Uint32			GetByteCount()const;
+	Uint64			GetByteCount()const;
 	Byte*			GetData()const;
-	void			GetGPUData(Byte* data, Uint32 byteCount);
+	bool			IsMapped()const;
+	void			GetGPUData(Byte* data, Uint64 byteCount);
 	void			SetData(Byte* data);
 	Byte*			GetSurfaceData(Uint32 mipLevel = 0, Uint32 arrayLevel = 0)const;
 	void			SetSurfaceData(Byte* data, Uint32 mipLevel = 0, Uint32 arrayLevel = 0);
@@ -87,8 +91,13 @@ public:
 
 	// Submits data to low-level GPU interface if required.
 	void Apply(bool keepResident = false);
+	// Uploads only a rectangle of a 2D Default texture's top level from the CPU data, which stays resident.
+	// Anything else (not yet created, Dynamic, mips) falls back to a full Apply.
+	void ApplyRegion(Uint32 x, Uint32 y, Uint32 width, Uint32 height);
 	void Bind(int slot, ShaderType stage = ShaderType::PS);
 	void LoadFromFile(const std::string& fileName);
+	// upload = false only reads into CPU memory, safe off the main thread, Apply later to upload.
+	void LoadFromFile(const std::string& fileName, bool upload);
 	bool SaveToFile(std::string filePath);
 	void Reload();
 	void Release();
@@ -106,8 +115,11 @@ public:
 protected:
 	void LoadFromSource(std::string fileName);
 	void LoadFromRaw(std::string fileName);
+	// NRRD and MetaImage, see VolumeFile.
+	void LoadFromVolumeFile(std::string fileName);
 	void LoadFromDDS(std::string fileName);
 	void LoadFromBinary(std::string fileName);
 	void GenerateLookUpTable();
+	void FreeCPUData();
 
 };
\ No newline at end of file
@@ -0,0 +1,72 @@
+//NOTE:
+/*
+	Reader for NRRD (.nrrd/.nhdr) and MetaImage (.mha/.mhd) volumes, with the data
+	attached or in a separate file (.raw/.zraw/.gz). Raw, gzip and zlib encodings are
+	supported for 8 and 16 bit single channel data. Compressed data is inflated in
+	chunks straight into the destination while the OS pages the next chunk in, and
+	BGZF style multi member gzip is split across the thread pool.
+	Signed data is offset to unsigned like DicomSeries, as the volume shaders read uint.
+*/
+
+#pragma once
+#include "Graphics/Graphics.h"
+#include "Math/Vector3.h"
+#include "System/ThreadPool.h"
+#include <string>
+
+enum class VolumeEncoding { Raw, Gzip, Zlib };
+
+struct VolumeFileHeader
+{
+	Uint32			Width = 0;
+	Uint32			Height = 1;
+	Uint32			Depth = 1;
+	SurfaceFormat	Format = SurfaceFormat::Unkown;	// Always the unsigned format, see Signed
+	bool			Signed = false;					// Stored signed, offset to unsigned on read
+	Vector3			Spacing = Vector3(1, 1, 1);
+	bool			BigEndian = false;
+	VolumeEncoding	Encoding = VolumeEncoding::Raw;
+	std::string		DataPath;			// File holding the voxels, the header itself when attached
+	Uint64			DataOffset = 0;
+	bool			DataAtEnd = false;	// Raw data ends the file (byte skip: -1, HeaderSize = -1)
+};
+
+class MappedFile;
+class VolumeFile
+{
+private:
+	std::string		 m_FilePath;
+	VolumeFileHeader m_Header;
+	bool			 m_Valid = false;
+
+public:
+	// Parses the header only, the data file is left alone until Read.
+	bool Open(const std::string& filePath);
+	void Release();
+	bool IsValid()const;
+
+	// Decodes Width * Height * Depth voxels into volume in native (little endian) order.
+	bool Read(Byte* volume, const ProgressCallback& progress = nullptr)const;
+	// The slices [first, first + count) only, data must hold count * Width * Height voxels.
+	// Raw encoding only, compressed data is one stream that has to be inflated from the start.
+	bool ReadSlices(Byte* data, Uint32 first, Uint32 count)const;
+	bool CanReadSlices()const;
+
+	const VolumeFileHeader& GetHeader()const;
+	Uint64					GetByteCount()const;
+	// Newest of the header and data file, for cache invalidation.
+	Uint64					GetLastWriteTime()const;
+
+	static bool IsVolumeFile(const std::string& extension);
+
+private:
+	bool ParseNrrd(const char* text, Uint64 size);
+	bool ParseMeta(const char* text, Uint64 size);
+	// Maps the data file and finds where the voxels start.
+	bool MapData(MappedFile& file, Uint64& offset)const;
+	bool ReadRaw(const MappedFile& file, Uint64 offset, Uint64 byteCount, Byte* volume, const ProgressCallback& progress)const;
+	bool ReadCompressed(const MappedFile& file, Uint64 offset, Byte* volume, const ProgressCallback& progress)const;
+	bool ReadMembers(const MappedFile& file, Uint64 offset, Byte* volume, const ProgressCallback& progress)const;
+	// Byte swaps and unbiases [begin, end) of the volume in place, both voxel aligned.
+	void FixVoxels(Byte* volume, Uint64 begin, Uint64 end)const;
+};
@@ -424,10 +424,12 @@ public:
 
     //--Update Resources--
     void UpdateBuffer(const BufferHandle buffer, const Byte* data, Uint32 byteCount, CommandList cmd = 0);
-    void UpdateTexture(const TextureHandle texture, const Byte* data, Uint32 byteCount, CommandList cmd = 0);
+    void UpdateTexture(const TextureHandle texture, const Byte* data, Uint64 byteCount, CommandList cmd = 0);
+    // Default usage only, a rectangle of the top mip. data is the whole level, rows of the texture's pitch.
+    void UpdateTextureRegion(const TextureHandle texture, const Byte* data, Uint32 x, Uint32 y, Uint32 width, Uint32 height, CommandList cmd = 0);
     void CopyTextureResource(const TextureHandle dest, const TextureHandle src, CommandList cmd = 0);
     void CopyBufferResource(const BufferHandle dest, const BufferHandle src, CommandList cmd = 0);
-    void GetTextureData(const TextureHandle texture, Byte* data, Uint32 byteCount, CommandList cmd = 0);
+    void GetTextureData(const TextureHandle texture, Byte* data, Uint64 byteCount, CommandList cmd = 0);
 
     //--Bind Resources--
     void BindRenderTarget(RenderHandle renderTarget = RenderHandle(), DepthHandle depthTarget = DepthHandle(), CommandList cmd = 0);
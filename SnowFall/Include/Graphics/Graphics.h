@@ -419,7 +419,7 @@ struct TextureDesc
 	Uint32			MiscFlags = 0;
 	TextureType		Type = TextureType::Texture2D;
 	Uint32			Pitch = 0;
-	Uint32			ByteCount = 0;
+	Uint64			ByteCount = 0;
 	Int16			SRGB = 1;
 };
 
@@ -731,8 +731,8 @@ inline Uint32 CalculateSurfaceSize(SurfaceFormat format, Uint32 width, Uint32 he
 // Pitch of the textue, the size in bytes of a single row
 unsigned int CalculatePitchSize(SurfaceFormat format, Uint32 width, Uint32 height = 1);
 // Total Memory consumed by a texture
-Uint32 CalculateTotalBytes(Uint32 width, Uint32 height, Uint32 depth, Uint32 mipCount, Uint32 arraySize, SurfaceFormat format);
-Uint32 CalculateTotalBytesFromDesc(TextureDesc& desc);
+Uint64 CalculateTotalBytes(Uint32 width, Uint32 height, Uint32 depth, Uint32 mipCount, Uint32 arraySize, SurfaceFormat format);
+Uint64 CalculateTotalBytesFromDesc(TextureDesc& desc);
 // How many mips the texture contains including top level.
 Uint32 CalculateMipCount(Uint32 width, Uint32 height);
 // Retruns true if the format is a compressed format
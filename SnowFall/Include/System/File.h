@@ -8,9 +8,11 @@
 #include "System/Types.h"
 #include <cstdio>
 #include <string>
+#include <vector>
 
 enum class FileMode { Read, Write };
 enum class FileType { Text, Binary };
+enum class SeekOrigin { Begin, Current, End };
 
 //----------Base File----------
 class BaseFile
@@ -31,7 +33,16 @@ public:
 	bool Close();
 	bool IsOpen()const;
 	bool IsFileEnd()const;
+	// 64 bit offsets, fseek/ftell are limited to 2GB on windows.
+	bool   Seek(Int64 offset, SeekOrigin origin = SeekOrigin::Begin);
+	Uint64 Tell()const;
+	Uint64 GetSize()const;
 	static bool Exists(std::string fileName);
+	// Seconds since epoch, 0 if the file is missing.
+	static Uint64 LastWriteTime(const std::string& fileName);
+	static bool   Remove(const std::string& fileName);
+	// Marks the open file sparse so seeking past the end leaves a hole rather than writing zeros.
+	bool SetSparse();
 };
 
 //----------Text File----------
@@ -56,6 +67,12 @@ public:
 
 	// Maybe i need a Directory class?
 	static bool DirectoryExists(const char* path);
+	// Full paths of the files directly inside directory, sub directories are skipped.
+	static std::vector<std::string> GetFiles(const std::string& directory);
+	// True if the directory was made or already exists, parents must exist.
+	static bool MakeDirectory(const std::string& path);
+	// The directory must be empty.
+	static bool DeleteDirectory(const std::string& path);
 
 };
 
@@ -81,15 +98,15 @@ public:
 	float ReadFloat();
 
 	//--Write Buffer--
-	bool WriteBuffer(const Byte* data, unsigned int byteCount);
-	bool ReadBuffer(Byte* data, unsigned int byteCount);
+	bool WriteBuffer(const Byte* data, Uint64 byteCount);
+	bool ReadBuffer(Byte* data, Uint64 byteCount);
 
 	//--Write String--
 	bool WriteString(const std::string& string);
 	std::string ReadString();
 
 public:
-	static bool Load(const char* fileName, Byte* data, Uint32 bufferSize);
-	static bool Save(const char* fileName, const Byte* data, Uint32 bufferSize);
-	static bool Append(const char* fileName, const Byte* data, Uint32 bufferSize);
+	static bool Load(const char* fileName, Byte* data, Uint64 bufferSize);
+	static bool Save(const char* fileName, const Byte* data, Uint64 bufferSize);
+	static bool Append(const char* fileName, const Byte* data, Uint64 bufferSize);
 };
\ No newline at end of file
@@ -0,0 +1,76 @@
+//NOTE:
+/*
+	DEFLATE decoder (RFC 1951) that writes straight into the final buffer, so the
+	whole output doubles as the 32KB history window and no scratch copy is needed.
+	Decode stops after outputLimit bytes at a symbol boundary and picks up from there
+	on the next call, letting the caller work in chunks (progress, prefetch, cancel).
+	Gzip (RFC 1952) and zlib (RFC 1950) wrappers are handled by the helpers below,
+	the caller checks their trailers with Crc32 / Adler32 as the output lands.
+*/
+
+#pragma once
+#include "System/Types.h"
+
+enum class InflateStatus { Done, Partial, Error };
+
+class Inflater
+{
+private:
+	static const Uint32 FastBits = 10;
+
+	struct HuffmanTable
+	{
+		Uint16 Fast[1 << FastBits];	// (length << 9) | symbol, 0 falls back to the slow path
+		Uint16 FirstCode[17];
+		Uint16 FirstSymbol[17];
+		Uint32 MaxCode[18];			// Exclusive, left aligned to 16 bits
+		Byte   Lengths[288];
+		Uint16 Symbols[288];
+	};
+
+	enum class BlockType { Header, Stored, Huffman };
+
+	const Byte*  m_Input = nullptr;
+	Uint64		 m_InputSize = 0;
+	Uint64		 m_InputPosition = 0;
+	Uint64		 m_BitBuffer = 0;
+	Uint32		 m_BitCount = 0;
+	Uint32		 m_Overrun = 0;			// Zero bytes fed in past the end of the input
+	Byte*		 m_Output = nullptr;
+	Uint64		 m_OutputSize = 0;
+	Uint64		 m_OutputPosition = 0;
+	BlockType	 m_Block = BlockType::Header;
+	Uint32		 m_StoredRemaining = 0;
+	bool		 m_FinalBlock = false;
+	bool		 m_Done = false;
+	HuffmanTable m_Literals;
+	HuffmanTable m_Distances;
+
+public:
+	// Starts on a raw deflate stream, output must be large enough for all of it.
+	void Begin(const Byte* input, Uint64 inputSize, Byte* output, Uint64 outputSize);
+	// Decodes until at least outputLimit bytes are written or the stream ends, a match may run past the limit.
+	InflateStatus Decode(Uint64 outputLimit);
+
+	// Whole bytes consumed, exact once Decode returns Done.
+	Uint64 GetInputPosition()const;
+	Uint64 GetOutputPosition()const;
+
+	// Size of the gzip member header at data, 0 if it isn't one. blockSize gets the BGZF member size when present.
+	static Uint64 ReadGzipHeader(const Byte* data, Uint64 size, Uint64* blockSize = nullptr);
+	// Size of the zlib header at data (always 2), 0 if it isn't one or needs a preset dictionary.
+	static Uint64 ReadZlibHeader(const Byte* data, Uint64 size);
+	// The wrappers' trailer checksums, carried on across calls. Crc32 starts from 0, Adler32 from 1.
+	static Uint32 Crc32(Uint32 crc, const Byte* data, Uint64 size);
+	static Uint32 Adler32(Uint32 adler, const Byte* data, Uint64 size);
+
+private:
+	bool   BuildTable(HuffmanTable& table, const Byte* lengths, Uint32 count);
+	bool   ReadBlockHeader();
+	bool   ReadDynamicTables();
+	void   Refill();
+	Uint32 GetBits(Uint32 count);
+	int	   DecodeSymbol(const HuffmanTable& table);
+	bool   CopyStored(Uint64 outputLimit);
+	bool   InputOverrun()const;
+};
@@ -1,4 +1,5 @@
 #pragma once
+#include <mutex>
 #include <set>
 #include <string>
 
@@ -26,6 +27,7 @@ class LogHandler
 {
 private:
 	std::set<LogObserver*> m_Observers;
+	std::mutex			   m_Mutex; // Volume loads log from worker threads
 
 public:
 	static LogHandler& Instance();
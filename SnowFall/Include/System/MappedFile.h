@@ -0,0 +1,41 @@
+//NOTE:
+/*
+	Read only memory mapped view of a file. Pages are shared with the OS file cache,
+	so a large file (raw volume) is addressable straight away without a heap copy.
+	The view is copy-on-write, writing to it never touches the file on disk.
+*/
+
+#pragma once
+#include "System/Types.h"
+#include <string>
+
+// Tells the OS how the mapping will be walked (madvise style hints)
+enum class MappedAccess { Normal, Sequential, Random };
+
+class MappedFile
+{
+private:
+	void*		m_FileHandle = nullptr;
+	void*		m_MappingHandle = nullptr;
+	Byte*		m_Data = nullptr;
+	Uint64		m_Size = 0;
+	std::string m_FileName = "";
+
+public:
+	MappedFile();
+	MappedFile(const char* fileName, MappedAccess access = MappedAccess::Sequential);
+	MappedFile(const MappedFile& file) = delete;
+	~MappedFile();
+
+public:
+	void operator=(const MappedFile& file) = delete;
+
+public:
+	bool   Open(const char* fileName, MappedAccess access = MappedAccess::Sequential);
+	void   Close();
+	bool   IsOpen()const;
+	Byte*  GetData()const;
+	Uint64 GetSize()const;
+	// Asks the OS to start paging in the range now (WillNeed), returns immediately.
+	void   Prefetch(Uint64 offset, Uint64 byteCount)const;
+};
@@ -0,0 +1,57 @@
+//NOTE:
+/*
+	Fixed set of worker threads pulling jobs from a shared queue. ParallelFor splits
+	a range into chunks, the calling thread works on chunks too so it is safe to call
+	from inside a job.
+*/
+
+#pragma once
+#include "System/Types.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Reports the fraction done, returning false asks the work to stop. May be called from any pool thread.
+typedef std::function<bool(float)> ProgressCallback;
+
+class ThreadPool
+{
+private:
+	std::vector<std::thread>			m_Workers;
+	std::deque<std::function<void()>>	m_Jobs;
+	std::mutex							m_Mutex;
+	std::condition_variable				m_JobSignal;
+	std::condition_variable				m_IdleSignal;
+	Uint32								m_Active = 0;
+	bool								m_Quit = false;
+
+public:
+	ThreadPool();
+	ThreadPool(Uint32 threadCount);
+	ThreadPool(const ThreadPool& pool) = delete;
+	~ThreadPool();
+
+public:
+	void operator=(const ThreadPool& pool) = delete;
+
+public:
+	// Shared pool sized to the hardware, created on first use.
+	static ThreadPool& Instance();
+	static Uint32 HardwareThreads();
+
+	// 0 uses one worker per hardware thread.
+	void   Initialize(Uint32 threadCount = 0);
+	void   Shutdown();
+	Uint32 GetThreadCount()const;
+	void   Submit(std::function<void()> job);
+	// Blocks until the queue is empty and no job is running.
+	void   Wait();
+	// Runs job(begin, end) over [0, count) in chunks of grain, using at most maxThreads (0 = all).
+	void   ParallelFor(Uint64 count, const std::function<void(Uint64, Uint64)>& job, Uint64 grain = 0, Uint32 maxThreads = 0);
+
+private:
+	void WorkerLoop();
+};
@@ -34,7 +34,7 @@ LoadState Resource::LoadState() const
 	return m_LoadState;
 }
 
-Uint32 Resource::Size() const
+Uint64 Resource::Size() const
 {
 	return m_Size;
 }
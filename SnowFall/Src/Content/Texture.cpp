@@ -1,13 +1,16 @@
 #pragma once
 #include "Content/Texture.h"
+#include "Content/VolumeFile.h"
 #include "Graphics/GraphicsDevice.h"
 #include "Graphics/CommonStates.h"
 #include "System/File.h"
+#include "System/MappedFile.h"
 #include "System/Logger.h"
 #include "System/Window.h"
 #include "Math/Mathf.h"
 #include "Application/Application.h"
 #include "System/Assert.h"
+#include <algorithm>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb/stb_image.h"
@@ -30,11 +33,13 @@ Texture::Texture(Texture&& texture)noexcept : Resource(std::move(texture))
 	m_TextureHandle = texture.m_TextureHandle;
 	m_SamplerHandle = texture.m_SamplerHandle;
 	m_Data			= texture.m_Data;
+	m_MappedFile	= texture.m_MappedFile;
 	m_LookUpTable	= std::move(texture.m_LookUpTable);
 
 	// Clear other.
 	texture.m_GraphicsDevice	= nullptr;
 	texture.m_Data				= nullptr;
+	texture.m_MappedFile		= nullptr;
 	texture.m_TextureHandle		= TextureHandle();
 	texture.m_SamplerHandle		= SamplerHandle();
 	texture.m_TextureDesc		= {};
@@ -43,12 +48,7 @@ Texture::Texture(Texture&& texture)noexcept : Resource(std::move(texture))
 
 Texture::~Texture()
 {
-	if (m_Data)
-	{
-		delete[] m_Data;
-		m_Data = nullptr;
-		m_LookUpTable.clear();
-	}
+	FreeCPUData();
 
 	if (m_GraphicsDevice)
 	{
@@ -175,12 +175,18 @@ void Texture::Create2D(Uint32 width, Uint32 height, Uint32 arraySize, bool mips,
 }
 
 void Texture::Create3D( Uint32 width, Uint32 height, Uint32 depth, BufferUsage usage, SurfaceFormat format, TextureType type)
+{
+	Create3D(width, height, depth, false, usage, format);
+}
+
+void Texture::Create3D(Uint32 width, Uint32 height, Uint32 depth, bool mips, BufferUsage usage, SurfaceFormat format)
 {
 	m_TextureDesc.Width = width;
 	m_TextureDesc.Height = height;
 	m_TextureDesc.Depth = depth;
 	m_TextureDesc.ArraySize = 1;
-	m_TextureDesc.MipLevels = 1;
+	// Full chain down to 1x1x1, D3D won't map a Dynamic texture with mips so use Default.
+	m_TextureDesc.MipLevels = mips ? CalculateMipCount(std::max(width, depth), height) : 1;
 	m_TextureDesc.Format = format;
 	m_TextureDesc.Usage = usage;
 	m_TextureDesc.Type = TextureType::Texture3D;
@@ -211,7 +217,7 @@ void Texture::Create3D( Uint32 width, Uint32 height, Uint32 depth, BufferUsage u
 	GenerateLookUpTable();
 }
 
-void Texture::GetGPUData(Byte* data, Uint32 byteCount)
+void Texture::GetGPUData(Byte* data, Uint64 byteCount)
 {
 	m_GraphicsDevice->GetTextureData(m_TextureHandle, data, byteCount);
 }
@@ -220,9 +226,17 @@ void Texture::SetData(Byte* data)
 {
 	if (m_TextureDesc.ByteCount == 0) { LogError("No Bytes to set."); return; }
 
+	// Dont write through a file mapping, the whole view would be copied page by page.
+	if (m_MappedFile)
+	{
+		FreeCPUData();
+	}
+
 	if (!m_Data)
 	{
 		m_Data = new Byte[m_TextureDesc.ByteCount];
+		m_LookUpTable.clear();
+		GenerateLookUpTable();
 	}
 
 	memcpy(m_Data, data, m_TextureDesc.ByteCount);
@@ -230,6 +244,8 @@ void Texture::SetData(Byte* data)
 
 void Texture::operator=(Texture&& texture) noexcept
 {
+	FreeCPUData();
+
 	// Copy
 	m_GraphicsDevice = texture.m_GraphicsDevice;
 	m_TextureDesc	 = texture.m_TextureDesc;
@@ -237,11 +253,13 @@ void Texture::operator=(Texture&& texture) noexcept
 	m_TextureHandle  = texture.m_TextureHandle;
 	m_SamplerHandle  = texture.m_SamplerHandle;
 	m_Data			 = texture.m_Data;
+	m_MappedFile	 = texture.m_MappedFile;
 	m_LookUpTable	 = std::move(texture.m_LookUpTable);
 
 	// Clear other.
 	texture.m_GraphicsDevice = nullptr;
 	texture.m_Data = nullptr;
+	texture.m_MappedFile = nullptr;
 	texture.m_TextureHandle = TextureHandle();
 	texture.m_SamplerHandle = SamplerHandle();
 	texture.m_TextureDesc = {};
@@ -330,7 +348,7 @@ bool Texture::HasMips() const
 	return m_TextureDesc.MipLevels > 1;
 }
 
-Uint32 Texture::GetByteCount()const
+Uint64 Texture::GetByteCount()const
 {
 	return m_TextureDesc.ByteCount;
 }
@@ -340,6 +358,11 @@ Byte* Texture::GetData()const
 	return m_Data;
 }
 
+bool Texture::IsMapped() const
+{
+	return m_MappedFile != nullptr;
+}
+
 void Texture::SetSurfaceData(Byte* data, Uint32 mipLevel, Uint32 arrayLevel)
 {
 	if (m_TextureDesc.ByteCount == 0) { LogWarning("No Bytes to set."); return; }
@@ -373,7 +396,7 @@ void Texture::SetSurfaceArrayData(Byte* data, Uint32 arrayLevel)
 	if (arrayLevel > m_TextureDesc.ArraySize) { LogWarning("ArrayLevel is too high."); return; }
 
 	// How many bytes to copy over
-	Uint32 byteCount = CalculateTotalBytes(m_TextureDesc.Width, m_TextureDesc.Height, m_TextureDesc.Depth, m_TextureDesc.MipLevels, 1, m_TextureDesc.Format);
+	Uint64 byteCount = CalculateTotalBytes(m_TextureDesc.Width, m_TextureDesc.Height, m_TextureDesc.Depth, m_TextureDesc.MipLevels, 1, m_TextureDesc.Format);
 	// The start location to overwrite from
 	TextureLevel* surface = &m_LookUpTable[(arrayLevel * m_TextureDesc.MipLevels)];
 	memcpy(surface->ptr, data, byteCount);
@@ -381,7 +404,7 @@ void Texture::SetSurfaceArrayData(Byte* data, Uint32 arrayLevel)
 
 Color Texture::GetPixel(Uint32 x, Uint32 y, Uint32 z, Uint32 array, Uint32 mip)
 {
-	Uint32 index = ((y * m_TextureDesc.Width) + x) * z * BytesPerBlock(m_TextureDesc.Format);
+	Uint64 index = (((Uint64)y * m_TextureDesc.Width) + x) * z * BytesPerBlock(m_TextureDesc.Format);
 	float R = 1.0f / 255;
 
 	Color color;
@@ -395,7 +418,7 @@ Color Texture::GetPixel(Uint32 x, Uint32 y, Uint32 z, Uint32 array, Uint32 mip)
 
 void Texture::SetPixel(Color& color, Uint32 x, Uint32 y, Uint32 z, Uint32 array, Uint32 mip)
 {
-	Uint32 index = ((y * m_TextureDesc.Width) + x) * z * BytesPerBlock(m_TextureDesc.Format);
+	Uint64 index = (((Uint64)y * m_TextureDesc.Width) + x) * z * BytesPerBlock(m_TextureDesc.Format);
 
 	m_Data[index] = (Byte)(color.r * 255);
 	m_Data[index + sizeof(Byte)] = (Byte)(color.g * 255);
@@ -410,11 +433,7 @@ void Texture::SetUnorderedAccess()
 
 void Texture::ClearCPUData()
 {
-	if (m_Data)
-	{
-		delete[] m_Data;
-		m_LookUpTable.clear();
-	}
+	FreeCPUData();
 }
 
 void Texture::Apply(bool keepResident)
@@ -437,13 +456,27 @@ void Texture::Apply(bool keepResident)
 		m_SamplerHandle = m_GraphicsDevice->CreateSamplerState(&m_SamplerDesc);
 	}
 
-	if (keepResident == false)
+	// A mapped file costs no private memory, its pages belong to the file cache,
+	// so keep it around for CPU readers like the volume range scan.
+	if (keepResident == false && m_MappedFile == nullptr)
 	{
-		delete[] m_Data;
-		m_Data = nullptr;
+		FreeCPUData();
 	}
 }
 
+void Texture::ApplyRegion(Uint32 x, Uint32 y, Uint32 width, Uint32 height)
+{
+	if (m_GraphicsDevice == nullptr || m_Data == nullptr) { return; }
+
+	if (m_TextureHandle.IsValid() == false || m_TextureDesc.Usage != BufferUsage::Default || m_TextureDesc.MipLevels > 1 || m_TextureDesc.Depth > 1 || m_TextureDesc.ArraySize > 1)
+	{
+		Apply(true);
+		return;
+	}
+
+	m_GraphicsDevice->UpdateTextureRegion(m_TextureHandle, m_Data, x, y, width, height);
+}
+
 void Texture::Bind(int slot, ShaderType stage)
 {
 	assert(m_GraphicsDevice != nullptr);
@@ -460,6 +493,11 @@ void Texture::Bind(int slot, ShaderType stage)
 }
 
 void Texture::LoadFromFile(const std::string& fileName)
+{
+	LoadFromFile(fileName, true);
+}
+
+void Texture::LoadFromFile(const std::string& fileName, bool upload)
 {
 	// Breaks SRP Completely
 	// Make sure this object isnt loaded
@@ -496,6 +534,10 @@ void Texture::LoadFromFile(const std::string& fileName)
 			{
 				LoadFromRaw(fileName);
 			}
+			else if (VolumeFile::IsVolumeFile(ext))
+			{
+				LoadFromVolumeFile(fileName);
+			}
 			else if (ext == "dds")
 			{
 				LoadFromDDS(fileName);
@@ -514,7 +556,11 @@ void Texture::LoadFromFile(const std::string& fileName)
 	m_Size = m_TextureDesc.ByteCount;
 	m_LoadState = LoadState::Loaded;
 	GenerateLookUpTable();
-	Apply(); // Submit to GPU
+
+	if (upload)
+	{
+		Apply(); // Submit to GPU
+	}
 }
 
 void Texture::Reload()
@@ -539,12 +585,7 @@ void Texture::Reload()
 
 void Texture::Release()
 {
-	if (m_Data != nullptr)
-	{
-		delete[] m_Data;
-		m_Data = nullptr;
-		m_LookUpTable.clear();
-	}
+	FreeCPUData();
 
 	if (m_TextureHandle.IsValid())
 	{
@@ -609,19 +650,26 @@ bool Texture::SaveToFile(std::string filePath)
 
 		if (ext == "texture" | ext == "Texture")
 		{
+			// Header stores sizes as dwords, anything over 4GB has to stay in its source format.
+			if (m_TextureDesc.ByteCount + 48 > 0xFFFFFFFFull)
+			{
+				LogError("Texture too large for .texture format: " + filePath);
+				return false;
+			}
+
 			//--Get Extension--
 			BinaryFile file(filePath.c_str(), FileMode::Write);
 			assert(file.IsOpen() && "Failed to open texture file");
 
 			//--Write Header--
-			file.WriteDword(48 + m_TextureDesc.ByteCount); // FileSize
+			file.WriteDword((Dword)(48 + m_TextureDesc.ByteCount)); // FileSize
 			file.WriteDword(m_TextureDesc.Width);
 			file.WriteDword(m_TextureDesc.Height);
 			file.WriteDword(m_TextureDesc.Depth);
 			file.WriteDword(m_TextureDesc.ArraySize);
 			file.WriteDword(m_TextureDesc.MipLevels);
 			file.WriteDword(m_TextureDesc.Pitch);
-			file.WriteDword(m_TextureDesc.ByteCount);
+			file.WriteDword((Dword)m_TextureDesc.ByteCount);
 			file.WriteDword((Dword)m_TextureDesc.Format);
 			file.WriteDword((Dword)m_TextureDesc.Type);
 			file.WriteDword(m_TextureDesc.MiscFlags);
@@ -639,15 +687,15 @@ bool Texture::SaveToFile(std::string filePath)
 		}
 		else if (ext == "png" | ext == "PNG")
 		{
-			stbi_write_png(filePath.c_str(), m_TextureDesc.Width, m_TextureDesc.Height, 4, m_Data, m_TextureDesc.Pitch);
+			return stbi_write_png(filePath.c_str(), m_TextureDesc.Width, m_TextureDesc.Height, 4, m_Data, m_TextureDesc.Pitch) != 0;
 		}
 		else if (ext == "jpg" | ext == "JPG")
 		{
-			stbi_write_jpg(filePath.c_str(), m_TextureDesc.Width, m_TextureDesc.Height, 4, m_Data, 80);
+			return stbi_write_jpg(filePath.c_str(), m_TextureDesc.Width, m_TextureDesc.Height, 4, m_Data, 80) != 0;
 		}
 		else if (ext == "bmp" | ext == "BMP")
 		{
-			stbi_write_bmp(filePath.c_str(), m_TextureDesc.Width, m_TextureDesc.Height, 4, m_Data);
+			return stbi_write_bmp(filePath.c_str(), m_TextureDesc.Width, m_TextureDesc.Height, 4, m_Data) != 0;
 		}
 	}
 	return false;
@@ -865,6 +913,20 @@ void Texture::LoadFromRaw(std::string fileName)
 	m_TextureDesc.CPUAccessFlags = CpuAccess::Immutable;
 	m_TextureDesc.Usage = BufferUsage::Immutable;
 
+	// Map the raw file rather than copying it, the data is shared with the file cache.
+	m_MappedFile = new MappedFile();
+	if (m_MappedFile->Open(fileName.c_str(), MappedAccess::Sequential) && m_MappedFile->GetSize() >= m_TextureDesc.ByteCount)
+	{
+		// Start paging it in now, the GPU upload walks the whole file straight after.
+		m_MappedFile->Prefetch(0, m_TextureDesc.ByteCount);
+		m_Data = m_MappedFile->GetData();
+		return;
+	}
+
+	LogWarning("Failed to map raw file, falling back to a full read.");
+	delete m_MappedFile;
+	m_MappedFile = nullptr;
+
 	BinaryFile file(fileName.c_str(), FileMode::Read);
 
 	if (file.IsOpen())
@@ -880,6 +942,39 @@ void Texture::LoadFromRaw(std::string fileName)
 	}
 }
 
+void Texture::LoadFromVolumeFile(std::string fileName)
+{
+	VolumeFile volumeFile;
+	if (volumeFile.Open(fileName) == false)
+	{
+		m_LoadState = LoadState::Failed;
+		return;
+	}
+
+	const VolumeFileHeader& header = volumeFile.GetHeader();
+	m_TextureDesc.Width = header.Width;
+	m_TextureDesc.Height = header.Height;
+	m_TextureDesc.Depth = header.Depth;
+	m_TextureDesc.Format = header.Format;
+	m_TextureDesc.Type = header.Depth > 1 ? TextureType::Texture3D : (header.Height > 1 ? TextureType::Texture2D : TextureType::Texture1D);
+	m_TextureDesc.ArraySize = 1;
+	m_TextureDesc.MipLevels = 1;
+	m_TextureDesc.Pitch = CalculatePitchSize(m_TextureDesc.Format, m_TextureDesc.Width);
+	m_TextureDesc.ByteCount = volumeFile.GetByteCount();
+	m_TextureDesc.BindFlags = (Uint32)BindFlag::ShaderResource;
+	m_TextureDesc.CPUAccessFlags = CpuAccess::Immutable;
+	m_TextureDesc.Usage = BufferUsage::Immutable;
+
+	// Decoded straight into the texture's buffer, compressed data never gets a full staging copy.
+	m_Data = new Byte[m_TextureDesc.ByteCount];
+	if (volumeFile.Read(m_Data) == false)
+	{
+		delete[] m_Data;
+		m_Data = nullptr;
+		m_LoadState = LoadState::Failed;
+	}
+}
+
 void Texture::LoadFromDDS(std::string fileName)
 {
 	DDSFile image;
@@ -966,7 +1061,7 @@ void Texture::GenerateLookUpTable()
 			level.height = h;
 			level.depth = d;
 			level.ptr = ptr;
-			level.byteCount = CalculateSurfaceSize(m_TextureDesc.Format, w, h) * d;
+			level.byteCount = (Uint64)CalculateSurfaceSize(m_TextureDesc.Format, w, h) * d;
 			m_LookUpTable.push_back(level);
 
 			ptr += level.byteCount;
@@ -978,6 +1073,24 @@ void Texture::GenerateLookUpTable()
 	}
 }
 
+void Texture::FreeCPUData()
+{
+	if (m_MappedFile)
+	{
+		// Data lives in the mapping, unmapping frees it.
+		delete m_MappedFile;
+		m_MappedFile = nullptr;
+		m_Data = nullptr;
+	}
+	else if (m_Data)
+	{
+		delete[] m_Data;
+		m_Data = nullptr;
+	}
+
+	m_LookUpTable.clear();
+}
+
 // This works, but is probably too expensive to justify it...
 inline Uint32 TextureOffset(const TextureDesc& info, Uint32 mipLevel, Uint32 arraySlice, Uint32 byteCount)
 {
@@ -0,0 +1,752 @@
+#include "Content/VolumeFile.h"
+#include "System/File.h"
+#include "System/Inflate.h"
+#include "System/Logger.h"
+#include "System/MappedFile.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+	const Uint64 ChunkBytes = 4ull << 20;		// Output decoded between progress/cancel checks
+	const Uint64 PrefetchBytes = 16ull << 20;	// Input paged in ahead of the decoder
+
+	// Splits text into lines, position moves past the line ending.
+	bool NextLine(const char* text, Uint64 size, Uint64& position, std::string& line)
+	{
+		if (position >= size)
+		{
+			return false;
+		}
+
+		Uint64 end = position;
+		while (end < size && text[end] != '\n') { end++; }
+
+		line.assign(text + position, (size_t)(end - position));
+		if (line.empty() == false && line.back() == '\r') { line.pop_back(); }
+		position = end < size ? end + 1 : end;
+		return true;
+	}
+
+	std::string Trim(const std::string& text)
+	{
+		size_t first = text.find_first_not_of(" \t");
+		if (first == std::string::npos) { return ""; }
+		size_t last = text.find_last_not_of(" \t");
+		return text.substr(first, last - first + 1);
+	}
+
+	std::string Lower(std::string text)
+	{
+		std::transform(text.begin(), text.end(), text.begin(), ::tolower);
+		return text;
+	}
+
+	// Whitespace separated numbers, returns how many were read.
+	Uint32 ParseNumbers(const std::string& text, double* values, Uint32 count)
+	{
+		const char* cursor = text.c_str();
+		Uint32 parsed = 0;
+		while (parsed < count)
+		{
+			char* end = nullptr;
+			double value = strtod(cursor, &end);
+			if (end == cursor) { break; }
+			values[parsed++] = value;
+			cursor = end;
+		}
+		return parsed;
+	}
+
+	// Voxel spacing, anything not finite and positive keeps the value already there (1 by default).
+	void ParseSpacing(const std::string& text, double spacing[3])
+	{
+		double parsed[3] = { 1, 1, 1 };
+		Uint32 count = ParseNumbers(text, parsed, 3);
+		for (Uint32 i = 0; i < count; i++)
+		{
+			spacing[i] = std::isfinite(parsed[i]) && parsed[i] > 0 ? parsed[i] : spacing[i];
+		}
+	}
+
+	// NRRD space directions, "(x,y,z) (x,y,z) none", each axis spacing is the vector length.
+	Uint32 ParseDirections(const std::string& text, double* spacing, Uint32 count)
+	{
+		Uint32 parsed = 0;
+		size_t position = 0;
+		while (parsed < count && position < text.size())
+		{
+			size_t open = text.find_first_not_of(" \t", position);
+			if (open == std::string::npos) { break; }
+
+			if (text.compare(open, 4, "none") == 0)
+			{
+				position = open + 4;
+				continue;
+			}
+
+			size_t close = text.find(')', open);
+			if (text[open] != '(' || close == std::string::npos) { break; }
+
+			std::string vector = text.substr(open + 1, close - open - 1);
+			std::replace(vector.begin(), vector.end(), ',', ' ');
+			double axis[3] = { 0, 0, 0 };
+			Uint32 components = ParseNumbers(vector, axis, 3);
+			double length = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+			spacing[parsed] = std::isfinite(length) && length > 0 ? length : spacing[parsed];
+			parsed++;
+			position = close + 1;
+			if (components == 0) { break; }
+		}
+		return parsed;
+	}
+
+	bool ParseType(const std::string& type, SurfaceFormat& format, bool& isSigned)
+	{
+		static const char* unsigned8[] = { "uchar", "unsigned char", "uint8", "uint8_t", "met_uchar" };
+		static const char* signed8[] = { "signed char", "int8", "int8_t", "met_char" };
+		static const char* unsigned16[] = { "ushort", "unsigned short", "unsigned short int", "uint16", "uint16_t", "met_ushort" };
+		static const char* signed16[] = { "short", "short int", "signed short", "signed short int", "int16", "int16_t", "met_short" };
+
+		for (const char* name : unsigned8)  { if (type == name) { format = SurfaceFormat::R8_Uint;  isSigned = false; return true; } }
+		for (const char* name : signed8)	{ if (type == name) { format = SurfaceFormat::R8_Uint;  isSigned = true;  return true; } }
+		for (const char* name : unsigned16) { if (type == name) { format = SurfaceFormat::R16_Uint; isSigned = false; return true; } }
+		for (const char* name : signed16)	{ if (type == name) { format = SurfaceFormat::R16_Uint; isSigned = true;  return true; } }
+		return false;
+	}
+
+	// Detached data files are relative to the header.
+	std::string ResolvePath(const std::string& headerPath, const std::string& dataFile)
+	{
+		bool absolute = dataFile.empty() == false && (dataFile[0] == '/' || dataFile[0] == '\\' || (dataFile.size() > 1 && dataFile[1] == ':'));
+		return absolute ? dataFile : headerPath.substr(0, headerPath.find_last_of("/\\") + 1) + dataFile;
+	}
+
+	Uint32 ReadU32(const Byte* data)
+	{
+		return (Uint32)data[0] | ((Uint32)data[1] << 8) | ((Uint32)data[2] << 16) | ((Uint32)data[3] << 24);
+	}
+}
+
+//-----------------------------------------------------------------------------------
+
+bool VolumeFile::Open(const std::string& filePath)
+{
+	Release();
+
+	MappedFile file;
+	if (file.Open(filePath.c_str(), MappedAccess::Random) == false)
+	{
+		LogError("Failed to open volume file: " + filePath);
+		return false;
+	}
+
+	m_FilePath = filePath;
+	const char* text = (const char*)file.GetData();
+	if (file.GetSize() >= 4 && memcmp(text, "NRRD", 4) == 0)
+	{
+		m_Valid = ParseNrrd(text, file.GetSize());
+	}
+	else
+	{
+		m_Valid = ParseMeta(text, file.GetSize());
+	}
+
+	if (m_Valid == false)
+	{
+		LogError("Not a supported NRRD or MetaImage volume: " + filePath);
+		Release();
+	}
+	return m_Valid;
+}
+
+void VolumeFile::Release()
+{
+	m_FilePath.clear();
+	m_Header = VolumeFileHeader();
+	m_Valid = false;
+}
+
+bool VolumeFile::IsValid() const
+{
+	return m_Valid;
+}
+
+bool VolumeFile::Read(Byte* volume, const ProgressCallback& progress) const
+{
+	MappedFile file;
+	Uint64 offset = 0;
+	if (m_Valid == false || MapData(file, offset) == false)
+	{
+		return false;
+	}
+
+	switch (m_Header.Encoding)
+	{
+	case VolumeEncoding::Raw:	return ReadRaw(file, offset, GetByteCount(), volume, progress);
+	default:					return ReadCompressed(file, offset, volume, progress);
+	}
+}
+
+bool VolumeFile::ReadSlices(Byte* data, Uint32 first, Uint32 count) const
+{
+	if (CanReadSlices() == false || first > m_Header.Depth || count > m_Header.Depth - first)
+	{
+		return false;
+	}
+
+	MappedFile file;
+	Uint64 offset = 0;
+	if (MapData(file, offset) == false)
+	{
+		return false;
+	}
+
+	Uint64 sliceBytes = (Uint64)m_Header.Width * m_Header.Height * BytesPerBlock(m_Header.Format);
+	return ReadRaw(file, offset + first * sliceBytes, count * sliceBytes, data, nullptr);
+}
+
+bool VolumeFile::CanReadSlices() const
+{
+	return m_Valid && m_Header.Encoding == VolumeEncoding::Raw;
+}
+
+const VolumeFileHeader& VolumeFile::GetHeader() const
+{
+	return m_Header;
+}
+
+Uint64 VolumeFile::GetByteCount() const
+{
+	return (Uint64)m_Header.Width * m_Header.Height * m_Header.Depth * BytesPerBlock(m_Header.Format);
+}
+
+Uint64 VolumeFile::GetLastWriteTime() const
+{
+	return std::max(BaseFile::LastWriteTime(m_FilePath), BaseFile::LastWriteTime(m_Header.DataPath));
+}
+
+bool VolumeFile::IsVolumeFile(const std::string& extension)
+{
+	std::string ext = Lower(extension);
+	return ext == "nrrd" || ext == "nhdr" || ext == "mha" || ext == "mhd";
+}
+
+//-----------------------------------------------------------------------------------
+
+bool VolumeFile::ParseNrrd(const char* text, Uint64 size)
+{
+	Uint64 position = 0;
+	std::string line;
+	NextLine(text, size, position, line); // NRRD000x magic
+
+	Uint32 dimension = 0;
+	double sizes[3] = { 0, 1, 1 };
+	double spacing[3] = { 1, 1, 1 };
+	std::string dataFile;
+	std::string type;
+	Int64 byteSkip = 0;
+	bool attached = true;
+
+	while (NextLine(text, size, position, line))
+	{
+		// A blank line ends the header, attached data starts straight after it.
+		if (line.empty())
+		{
+			break;
+		}
+
+		size_t separator = line.find(": ");
+		if (line[0] == '#' || separator == std::string::npos)
+		{
+			continue; // Comments and key:=value pairs
+		}
+
+		std::string key = Lower(line.substr(0, separator));
+		std::string value = Trim(line.substr(separator + 2));
+
+		if (key == "type")
+		{
+			type = Lower(value);
+		}
+		else if (key == "dimension")
+		{
+			dimension = (Uint32)atoi(value.c_str());
+		}
+		else if (key == "sizes")
+		{
+			ParseNumbers(value, sizes, 3);
+		}
+		else if (key == "spacings")
+		{
+			ParseSpacing(value, spacing);
+		}
+		else if (key == "space directions")
+		{
+			ParseDirections(value, spacing, 3);
+		}
+		else if (key == "endian")
+		{
+			m_Header.BigEndian = Lower(value) == "big";
+		}
+		else if (key == "encoding")
+		{
+			std::string encoding = Lower(value);
+			if (encoding == "raw")
+			{
+				m_Header.Encoding = VolumeEncoding::Raw;
+			}
+			else if (encoding == "gzip" || encoding == "gz")
+			{
+				m_Header.Encoding = VolumeEncoding::Gzip;
+			}
+			else
+			{
+				LogError("Unsupported NRRD encoding " + value + ": " + m_FilePath);
+				return false;
+			}
+		}
+		else if (key == "byte skip")
+		{
+			byteSkip = atoll(value.c_str());
+		}
+		else if (key == "line skip")
+		{
+			if (atoi(value.c_str()) != 0)
+			{
+				LogError("NRRD line skip isn't supported: " + m_FilePath);
+				return false;
+			}
+		}
+		else if (key == "data file" || key == "datafile")
+		{
+			if (value.find("LIST") == 0 || value.find('%') != std::string::npos)
+			{
+				LogError("Multi file NRRD data isn't supported: " + m_FilePath);
+				return false;
+			}
+			dataFile = value;
+			attached = false;
+		}
+	}
+
+	if (dimension < 1 || dimension > 3 || ParseType(type, m_Header.Format, m_Header.Signed) == false)
+	{
+		LogError("Only single channel 8 or 16 bit NRRD volumes are supported: " + m_FilePath);
+		return false;
+	}
+
+	// Byte skip on compressed data counts decompressed bytes, which would need a staging copy.
+	if (byteSkip != 0 && m_Header.Encoding != VolumeEncoding::Raw)
+	{
+		LogError("NRRD byte skip is only supported for raw encoding: " + m_FilePath);
+		return false;
+	}
+
+	m_Header.Width = (Uint32)sizes[0];
+	m_Header.Height = dimension > 1 ? (Uint32)sizes[1] : 1;
+	m_Header.Depth = dimension > 2 ? (Uint32)sizes[2] : 1;
+	m_Header.Spacing = Vector3((float)spacing[0], (float)spacing[1], (float)spacing[2]);
+	m_Header.DataPath = attached ? m_FilePath : ResolvePath(m_FilePath, dataFile);
+	m_Header.DataOffset = attached ? position : 0;
+	m_Header.DataAtEnd = byteSkip < 0;
+	if (byteSkip > 0)
+	{
+		m_Header.DataOffset += (Uint64)byteSkip;
+	}
+
+	return m_Header.Width > 0 && m_Header.Height > 0 && m_Header.Depth > 0;
+}
+
+bool VolumeFile::ParseMeta(const char* text, Uint64 size)
+{
+	Uint64 position = 0;
+	std::string line;
+
+	Uint32 dimension = 0;
+	double sizes[3] = { 0, 1, 1 };
+	double spacing[3] = { 1, 1, 1 };
+	std::string dataFile;
+	std::string type;
+	Int64 headerSize = 0;
+	Uint32 channels = 1;
+	bool compressed = false;
+	bool hasSpacing = false;
+
+	while (NextLine(text, size, position, line))
+	{
+		size_t separator = line.find('=');
+		if (separator == std::string::npos)
+		{
+			// Anything that isn't key = value before ElementDataFile means this isn't MetaImage text.
+			if (Trim(line).empty()) { continue; }
+			return false;
+		}
+
+		std::string key = Lower(Trim(line.substr(0, separator)));
+		std::string value = Trim(line.substr(separator + 1));
+
+		if (key == "objecttype")
+		{
+			if (Lower(value) != "image") { return false; }
+		}
+		else if (key == "ndims")
+		{
+			dimension = (Uint32)atoi(value.c_str());
+		}
+		else if (key == "dimsize")
+		{
+			ParseNumbers(value, sizes, 3);
+		}
+		else if (key == "elementspacing")
+		{
+			ParseSpacing(value, spacing);
+			hasSpacing = true;
+		}
+		else if (key == "elementsize" && hasSpacing == false)
+		{
+			// Voxel extent, only stands in for the spacing when there isn't one.
+			ParseSpacing(value, spacing);
+		}
+		else if (key == "elementtype")
+		{
+			type = Lower(value);
+		}
+		else if (key == "elementnumberofchannels")
+		{
+			channels = (Uint32)atoi(value.c_str());
+		}
+		else if (key == "binarydatabyteordermsb" || key == "elementbyteordermsb" || key == "byteordermsb")
+		{
+			m_Header.BigEndian = Lower(value) == "true";
+		}
+		else if (key == "compresseddata")
+		{
+			compressed = Lower(value) == "true";
+		}
+		else if (key == "headersize")
+		{
+			headerSize = atoll(value.c_str());
+		}
+		else if (key == "elementdatafile")
+		{
+			// Always the last field, LOCAL data starts on the next byte.
+			dataFile = value;
+			break;
+		}
+	}
+
+	if (dataFile.empty() || dimension < 1 || dimension > 3 || channels != 1 || ParseType(type, m_Header.Format, m_Header.Signed) == false)
+	{
+		LogError("Only single channel 8 or 16 bit MetaImage volumes are supported: " + m_FilePath);
+		return false;
+	}
+
+	if (dataFile == "LIST" || dataFile.find('%') != std::string::npos)
+	{
+		LogError("Multi file MetaImage data isn't supported: " + m_FilePath);
+		return false;
+	}
+
+	bool attached = Lower(dataFile) == "local";
+	m_Header.Encoding = compressed ? VolumeEncoding::Zlib : VolumeEncoding::Raw;
+	m_Header.Width = (Uint32)sizes[0];
+	m_Header.Height = dimension > 1 ? (Uint32)sizes[1] : 1;
+	m_Header.Depth = dimension > 2 ? (Uint32)sizes[2] : 1;
+	m_Header.Spacing = Vector3((float)spacing[0], (float)spacing[1], (float)spacing[2]);
+	m_Header.DataPath = attached ? m_FilePath : ResolvePath(m_FilePath, dataFile);
+	m_Header.DataOffset = attached ? position : 0;
+	m_Header.DataAtEnd = headerSize < 0 && compressed == false;
+	if (headerSize > 0 && attached == false)
+	{
+		m_Header.DataOffset = (Uint64)headerSize;
+	}
+
+	return m_Header.Width > 0 && m_Header.Height > 0 && m_Header.Depth > 0;
+}
+
+bool VolumeFile::MapData(MappedFile& file, Uint64& offset) const
+{
+	if (file.Open(m_Header.DataPath.c_str(), MappedAccess::Sequential) == false)
+	{
+		LogError("Failed to open volume data: " + m_Header.DataPath);
+		return false;
+	}
+
+	offset = m_Header.DataOffset;
+	if (m_Header.DataAtEnd)
+	{
+		offset = file.GetSize() >= GetByteCount() ? file.GetSize() - GetByteCount() : file.GetSize() + 1;
+	}
+
+	if (offset > file.GetSize())
+	{
+		LogError("Volume data is truncated: " + m_Header.DataPath);
+		return false;
+	}
+	return true;
+}
+
+bool VolumeFile::ReadRaw(const MappedFile& file, Uint64 offset, Uint64 byteCount, Byte* volume, const ProgressCallback& progress) const
+{
+	if (offset > file.GetSize() || file.GetSize() - offset < byteCount)
+	{
+		LogError("Volume data is truncated: " + m_Header.DataPath);
+		return false;
+	}
+
+	// Chunks copy out of the mapping in parallel, page faults on one overlap the copies on the others.
+	const Byte* data = file.GetData() + offset;
+	Uint64 chunkCount = (byteCount + ChunkBytes - 1) / ChunkBytes;
+	std::atomic<Uint64> done(0);
+	std::atomic<bool> cancelled(false);
+
+	ThreadPool::Instance().ParallelFor(chunkCount, [&](Uint64 begin, Uint64 end)
+	{
+		for (Uint64 i = begin; i < end && cancelled == false; i++)
+		{
+			Uint64 first = i * ChunkBytes;
+			Uint64 last = std::min(first + ChunkBytes, byteCount);
+			memcpy(volume + first, data + first, (size_t)(last - first));
+			FixVoxels(volume, first, last);
+
+			if (progress && progress((float)(done += last - first) / byteCount) == false)
+			{
+				cancelled = true;
+			}
+		}
+	}, 1);
+
+	return cancelled == false;
+}
+
+bool VolumeFile::ReadCompressed(const MappedFile& file, Uint64 offset, Byte* volume, const ProgressCallback& progress) const
+{
+	const Byte* data = file.GetData();
+	Uint64 size = file.GetSize();
+	Uint64 byteCount = GetByteCount();
+	Uint64 voxelMask = ~(Uint64)(BytesPerBlock(m_Header.Format) - 1);
+	// Some MetaImage writers gzip rather than zlib their .zraw, the magic tells them apart.
+	bool gzip = m_Header.Encoding == VolumeEncoding::Gzip || (size - offset >= 2 && data[offset] == 0x1F && data[offset + 1] == 0x8B);
+
+	if (gzip)
+	{
+		Uint64 blockSize = 0;
+		if (Inflater::ReadGzipHeader(data + offset, size - offset, &blockSize) > 0 && blockSize > 0)
+		{
+			return ReadMembers(file, offset, volume, progress);
+		}
+	}
+
+	// One deflate stream can only be walked in order, so it is decoded a chunk at a time straight
+	// into the volume while the next stretch of input is paged in. Concatenated gzip members follow on.
+	Inflater inflater;
+	Uint64 written = 0;
+	Uint64 fixed = 0;
+	Uint32 adler = 1;	// zlib sums the whole stream, gzip checks each member on its own
+	while (written < byteCount)
+	{
+		Uint64 headerSize = gzip ? Inflater::ReadGzipHeader(data + offset, size - offset) : Inflater::ReadZlibHeader(data + offset, size - offset);
+		if (headerSize == 0)
+		{
+			LogError("Volume data is truncated or not " + std::string(gzip ? "gzip" : "zlib") + ": " + m_Header.DataPath);
+			return false;
+		}
+
+		Uint64 start = offset + headerSize;
+		inflater.Begin(data + start, size - start, volume + written, byteCount - written);
+
+		Uint32 crc = 0;
+		Uint64 summed = 0;
+		InflateStatus status = InflateStatus::Partial;
+		while (status == InflateStatus::Partial)
+		{
+			file.Prefetch(start + inflater.GetInputPosition(), PrefetchBytes);
+			status = inflater.Decode(inflater.GetOutputPosition() + ChunkBytes);
+			if (status == InflateStatus::Error)
+			{
+				LogError("Corrupt compressed volume data: " + m_Header.DataPath);
+				return false;
+			}
+
+			// Checksums run over the bytes as decoded, before the fix up touches them.
+			const Byte* landed = volume + written + summed;
+			Uint64 landedSize = inflater.GetOutputPosition() - summed;
+			if (gzip) { crc = Inflater::Crc32(crc, landed, landedSize); }
+			else	  { adler = Inflater::Adler32(adler, landed, landedSize); }
+			summed = inflater.GetOutputPosition();
+
+			// Fix whole voxels as they land, a voxel split across members waits for the rest.
+			Uint64 ready = (written + inflater.GetOutputPosition()) & voxelMask;
+			FixVoxels(volume, fixed, ready);
+			fixed = ready;
+
+			if (progress && progress((float)(written + inflater.GetOutputPosition()) / byteCount) == false)
+			{
+				return false;
+			}
+		}
+
+		// Trailer, CRC32 and ISIZE little endian for gzip, Adler32 big endian for zlib.
+		Uint64 trailer = start + inflater.GetInputPosition();
+		Uint64 trailerSize = gzip ? 8 : 4;
+		if (size - trailer < trailerSize)
+		{
+			LogError("Volume data is missing its " + std::string(gzip ? "gzip" : "zlib") + " trailer: " + m_Header.DataPath);
+			return false;
+		}
+
+		const Byte* check = data + trailer;
+		bool valid = gzip ? ReadU32(check) == crc && ReadU32(check + 4) == (inflater.GetOutputPosition() & 0xFFFFFFFF) :
+							(((Uint32)check[0] << 24) | ((Uint32)check[1] << 16) | ((Uint32)check[2] << 8) | (Uint32)check[3]) == adler;
+		if (valid == false)
+		{
+			LogError("Compressed volume data fails its checksum: " + m_Header.DataPath);
+			return false;
+		}
+
+		written += inflater.GetOutputPosition();
+		offset = trailer + trailerSize;
+		if (gzip == false)
+		{
+			break;
+		}
+	}
+
+	if (written != byteCount)
+	{
+		LogError("Compressed volume data is smaller than its header says: " + m_Header.DataPath);
+		return false;
+	}
+	return true;
+}
+
+bool VolumeFile::ReadMembers(const MappedFile& file, Uint64 offset, Byte* volume, const ProgressCallback& progress) const
+{
+	struct Member
+	{
+		Uint64 Input = 0;		// Deflate data
+		Uint64 InputSize = 0;
+		Uint64 Output = 0;
+		Uint64 OutputSize = 0;
+		Uint32 Crc = 0;			// From the trailer, of the member's output
+	};
+
+	// BGZF headers carry each member's size and the trailer its output size,
+	// so every member's place in the volume is known before any are decoded.
+	const Byte* data = file.GetData();
+	Uint64 size = file.GetSize();
+	Uint64 byteCount = GetByteCount();
+	std::vector<Member> members;
+	Uint64 output = 0;
+	while (offset < size && output < byteCount)
+	{
+		Uint64 blockSize = 0;
+		Uint64 headerSize = Inflater::ReadGzipHeader(data + offset, size - offset, &blockSize);
+		if (headerSize == 0 || blockSize < headerSize + 8 || blockSize > size - offset)
+		{
+			LogError("Corrupt BGZF volume data: " + m_Header.DataPath);
+			return false;
+		}
+
+		Member member;
+		member.Input = offset + headerSize;
+		member.InputSize = blockSize - headerSize - 8;
+		member.Output = output;
+		member.Crc = ReadU32(data + offset + blockSize - 8);
+		member.OutputSize = ReadU32(data + offset + blockSize - 4);
+		if (member.OutputSize > 0)
+		{
+			members.push_back(member);
+		}
+
+		output += member.OutputSize;
+		offset += blockSize;
+	}
+
+	if (output != byteCount)
+	{
+		LogError("Compressed volume data doesn't match its header size: " + m_Header.DataPath);
+		return false;
+	}
+
+	std::atomic<Uint64> done(0);
+	std::atomic<bool> failed(false);
+	std::atomic<bool> cancelled(false);
+
+	ThreadPool::Instance().ParallelFor(members.size(), [&](Uint64 begin, Uint64 end)
+	{
+		Inflater inflater;
+		for (Uint64 i = begin; i < end && failed == false && cancelled == false; i++)
+		{
+			const Member& member = members[(size_t)i];
+			inflater.Begin(data + member.Input, member.InputSize, volume + member.Output, member.OutputSize);
+			if (inflater.Decode(member.OutputSize) == InflateStatus::Error || inflater.GetOutputPosition() != member.OutputSize ||
+				Inflater::Crc32(0, volume + member.Output, member.OutputSize) != member.Crc)
+			{
+				failed = true;
+				break;
+			}
+
+			if (progress && progress((float)(done += member.OutputSize) / byteCount) == false)
+			{
+				cancelled = true;
+			}
+		}
+	}, 16);
+
+	if (failed)
+	{
+		LogError("Corrupt compressed volume data: " + m_Header.DataPath);
+		return false;
+	}
+
+	if (cancelled)
+	{
+		return false;
+	}
+
+	// Members aren't voxel aligned, so the fix up is its own pass.
+	if (m_Header.Signed || (m_Header.BigEndian && BytesPerBlock(m_Header.Format) == 2))
+	{
+		Uint64 chunkCount = (byteCount + ChunkBytes - 1) / ChunkBytes;
+		ThreadPool::Instance().ParallelFor(chunkCount, [&](Uint64 begin, Uint64 end)
+		{
+			FixVoxels(volume, begin * ChunkBytes, std::min(end * ChunkBytes, byteCount));
+		}, 1);
+	}
+	return true;
+}
+
+void VolumeFile::FixVoxels(Byte* volume, Uint64 begin, Uint64 end) const
+{
+	bool swap = m_Header.BigEndian && BytesPerBlock(m_Header.Format) == 2;
+	if (swap == false && m_Header.Signed == false)
+	{
+		return;
+	}
+
+	if (BytesPerBlock(m_Header.Format) == 2)
+	{
+		// Swap to little endian, then flip the sign bit so signed order maps onto unsigned.
+		Uint16* voxels = (Uint16*)(volume + begin);
+		Uint64 count = (end - begin) / 2;
+		Uint16 bias = m_Header.Signed ? 0x8000 : 0;
+		for (Uint64 i = 0; i < count; i++)
+		{
+			Uint16 value = swap ? (Uint16)((voxels[i] >> 8) | (voxels[i] << 8)) : voxels[i];
+			voxels[i] = value ^ bias;
+		}
+	}
+	else
+	{
+		for (Uint64 i = begin; i < end; i++)
+		{
+			volume[i] ^= 0x80;
+		}
+	}
+}
@@ -596,8 +596,8 @@ TextureHandle GraphicsDevice::CreateTexture(const TextureDesc* pDesc, const Byte
     if (data)
     {
         subData = new D3D11_SUBRESOURCE_DATA[(size_t)pDesc->MipLevels * pDesc->ArraySize];
-        Uint32 src = 0;
-        Uint32 end = pDesc->ByteCount;
+        Uint64 src = 0;
+        Uint64 end = pDesc->ByteCount;
 
         int index = 0;
         for (Uint32 i = 0; i < pDesc->ArraySize; ++i)
@@ -615,7 +615,7 @@ TextureHandle GraphicsDevice::CreateTexture(const TextureDesc* pDesc, const Byte
                 ++index;
 
                 // 3D mip is a cube i.e w * h * d Bytes
-                src += pitch * h * d;
+                src += (Uint64)pitch * h * d;
                 if (src > end)
                 {
                     delete[] subData;
@@ -981,7 +981,7 @@ void GraphicsDevice::UpdateBuffer(const BufferHandle buffer, const Byte* data, U
     }
 }
 
-void GraphicsDevice::UpdateTexture(const TextureHandle texture, const Byte* data, Uint32 byteCount, CommandList cmd)
+void GraphicsDevice::UpdateTexture(const TextureHandle texture, const Byte* data, Uint64 byteCount, CommandList cmd)
 {
     GraphicsTexture* pTexture = m_Textures[texture];
     if (pTexture && pTexture->m_Desc.Usage != BufferUsage::Immutable && byteCount > 0)
@@ -992,14 +992,48 @@ void GraphicsDevice::UpdateTexture(const TextureHandle texture, const Byte* data
             return;
         }
 
+        // Default textures cant be mapped, and are the only ones that can carry mips,
+        // so write each subresource from the packed mip chain like CreateTexture reads it.
+        // Dynamic and Staging are mapped instead, UpdateSubresource rejects them.
+        if (pTexture->m_Desc.Usage == BufferUsage::Default)
+        {
+            Uint64 src = 0;
+            for (Uint32 i = 0; i < pTexture->m_Desc.ArraySize; ++i)
+            {
+                Uint32 w = pTexture->m_Desc.Width;
+                Uint32 h = pTexture->m_Desc.Height;
+                Uint32 d = pTexture->m_Desc.Depth;
+
+                for (Uint32 j = 0; j < pTexture->m_Desc.MipLevels; ++j)
+                {
+                    Uint32 pitch = CalculatePitchSize(pTexture->m_Desc.Format, w);
+                    Uint64 size = (Uint64)pitch * h * d;
+                    if (src + size > byteCount)
+                    {
+                        return;
+                    }
+
+                    Uint32 subresource = D3D11CalcSubresource(j, i, pTexture->m_Desc.MipLevels);
+                    m_DeviceContexts[cmd]->UpdateSubresource((ID3D11Resource*)pTexture->m_Resource, subresource, nullptr, data + src, pitch, pitch * h);
+                    src += size;
+
+                    w = std::max<Uint32>(w >> 1, 1);
+                    h = std::max<Uint32>(h >> 1, 1);
+                    d = std::max<Uint32>(d >> 1, 1);
+                }
+            }
+            return;
+        }
+
+        // Discard is only allowed on Dynamic, Staging is written in place.
+        D3D11_MAP mapType = pTexture->m_Desc.Usage == BufferUsage::Dynamic ? D3D11_MAP_WRITE_DISCARD : D3D11_MAP_WRITE;
         D3D11_MAPPED_SUBRESOURCE mappedResource;
-        if (SUCCEEDED(m_DeviceContexts[cmd]->Map((ID3D11Resource*)pTexture->m_Resource, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource)))
+        if (SUCCEEDED(m_DeviceContexts[cmd]->Map((ID3D11Resource*)pTexture->m_Resource, 0, mapType, 0, &mappedResource)))
         {
             // Set the data and unmap
             Byte* sptr = (Byte*)data;
             Byte* dptr = (Byte*)mappedResource.pData;
             Uint32 rowCount = mappedResource.DepthPitch / mappedResource.RowPitch;
-            Uint32 sliceCount = byteCount / mappedResource.DepthPitch;
 
             size_t msize = std::min<size_t>(pTexture->m_Desc.Pitch, mappedResource.RowPitch);
             for (size_t d = 0; d < pTexture->m_Desc.Depth; d++)
@@ -1020,6 +1054,28 @@ void GraphicsDevice::UpdateTexture(const TextureHandle texture, const Byte* data
     }
 }
 
+void GraphicsDevice::UpdateTextureRegion(const TextureHandle texture, const Byte* data, Uint32 x, Uint32 y, Uint32 width, Uint32 height, CommandList cmd)
+{
+    GraphicsTexture* pTexture = m_Textures[texture];
+    if (pTexture == nullptr || pTexture->m_Desc.Usage != BufferUsage::Default || width == 0 || height == 0)
+    {
+        return;
+    }
+
+    if (x + width > pTexture->m_Desc.Width || y + height > pTexture->m_Desc.Height)
+    {
+        LogError("Texture region update out of bounds");
+        return;
+    }
+
+    // Mapped textures discard on write, only UpdateSubresource can touch part of one.
+    Uint32 pitch = CalculatePitchSize(pTexture->m_Desc.Format, pTexture->m_Desc.Width);
+    Uint32 texelBytes = BytesPerBlock(pTexture->m_Desc.Format);
+    D3D11_BOX box = { x, y, 0, x + width, y + height, 1 };
+    const Byte* src = data + (Uint64)y * pitch + (Uint64)x * texelBytes;
+    m_DeviceContexts[cmd]->UpdateSubresource((ID3D11Resource*)pTexture->m_Resource, 0, &box, src, pitch, pitch * height);
+}
+
 void GraphicsDevice::CopyTextureResource(const TextureHandle dest, const TextureHandle src, CommandList cmd)
 {
     GraphicsTexture* pDest = m_Textures[dest];
@@ -1042,7 +1098,7 @@ void GraphicsDevice::CopyBufferResource(const BufferHandle dest, const BufferHan
     }
 }
 
-void GraphicsDevice::GetTextureData(const TextureHandle texture, Byte* data, Uint32 byteCount, CommandList cmd)
+void GraphicsDevice::GetTextureData(const TextureHandle texture, Byte* data, Uint64 byteCount, CommandList cmd)
 {
     GraphicsTexture* pTexture = m_Textures[texture];
     TextureDesc* pDesc = &pTexture->m_Desc;
@@ -1116,7 +1172,6 @@ void GraphicsDevice::GetTextureData(const TextureHandle texture, Byte* data, Uin
     Byte* sptr = (Byte*)stream.pData;
     Byte* dptr = (Byte*)data;
     Uint32 rowCount = stream.DepthPitch / stream.RowPitch;
-    Uint32 sliceCount = byteCount / stream.DepthPitch;
 
     size_t msize = std::min<size_t>(pDesc->Pitch, stream.RowPitch);
     for (size_t d = 0; d < pDesc->Depth; d++)
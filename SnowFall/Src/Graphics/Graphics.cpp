@@ -344,27 +344,28 @@ unsigned int CalculatePitchSize(SurfaceFormat format, Uint32 width, Uint32 heigh
 	}
 }
 
-Uint32 CalculateTotalBytes(Uint32 width, Uint32 height, Uint32 depth, Uint32 mipCount, Uint32 arraySize, SurfaceFormat format)
+Uint64 CalculateTotalBytes(Uint32 width, Uint32 height, Uint32 depth, Uint32 mipCount, Uint32 arraySize, SurfaceFormat format)
 {
-	Uint32 totalBytes = 0;
+	// 64 bit, a single 3D surface can be larger than 4GB.
+	Uint64 totalBytes = 0;
 
 	for (Uint32 i = 0; i < mipCount; i++)
 	{
-		//Shift right == divide each time.
-		totalBytes += CalculateSurfaceSize(format, width >> i, height >> i) * (depth >> i);
+		//Shift right == divide each time, a mip is never smaller than 1 texel on any axis.
+		totalBytes += CalculateSurfaceSize(format, Mathf::Max(width >> i, 1), Mathf::Max(height >> i, 1)) * (Uint64)Mathf::Max(depth >> i, 1);
 	}
 
 	return totalBytes * arraySize;
 }
 
-Uint32 CalculateTotalBytesFromDesc(TextureDesc& desc)
+Uint64 CalculateTotalBytesFromDesc(TextureDesc& desc)
 {
-	Uint32 totalBytes = 0;
+	Uint64 totalBytes = 0;
 
 	for (Uint32 i = 0; i < desc.MipLevels; i++)
 	{
-		//Shift right == divide each time.
-		totalBytes += CalculateSurfaceSize(desc.Format, desc.Width >> i, desc.Height >> i) * (desc.Depth >> i);
+		//Shift right == divide each time, a mip is never smaller than 1 texel on any axis.
+		totalBytes += CalculateSurfaceSize(desc.Format, Mathf::Max(desc.Width >> i, 1), Mathf::Max(desc.Height >> i, 1)) * (Uint64)Mathf::Max(desc.Depth >> i, 1);
 	}
 
 	return totalBytes * desc.ArraySize;
@@ -1,6 +1,37 @@
 #include "System/File.h"
 #include <sys/stat.h>
 
+// fread/fwrite take a size_t which is 32 bit on x86, so large buffers go through in chunks.
+static const Uint64 MaxChunkSize = 1ull << 30;
+
+//-----------------------------------------------------------------------------
+static Uint64 ReadChunked(Byte* data, Uint64 byteCount, FILE* file)
+{
+	Uint64 total = 0;
+	while (total < byteCount)
+	{
+		size_t chunk = (size_t)(byteCount - total < MaxChunkSize ? byteCount - total : MaxChunkSize);
+		size_t read = fread(data + total, 1, chunk, file);
+		total += read;
+		if (read < chunk) { break; }
+	}
+	return total;
+}
+
+//-----------------------------------------------------------------------------
+static Uint64 WriteChunked(const Byte* data, Uint64 byteCount, FILE* file)
+{
+	Uint64 total = 0;
+	while (total < byteCount)
+	{
+		size_t chunk = (size_t)(byteCount - total < MaxChunkSize ? byteCount - total : MaxChunkSize);
+		size_t written = fwrite(data + total, 1, chunk, file);
+		total += written;
+		if (written < chunk) { break; }
+	}
+	return total;
+}
+
 //-----------------------------------------------------------------------------
 BaseFile::BaseFile()
 {
@@ -88,6 +119,42 @@ bool BaseFile::IsFileEnd() const
 	return false;
 }
 
+//-----------------------------------------------------------------------------
+bool BaseFile::Seek(Int64 offset, SeekOrigin origin)
+{
+	if (m_File)
+	{
+		int whence = origin == SeekOrigin::Begin ? SEEK_SET : origin == SeekOrigin::Current ? SEEK_CUR : SEEK_END;
+		return _fseeki64(m_File, offset, whence) == 0;
+	}
+	return false;
+}
+
+//-----------------------------------------------------------------------------
+Uint64 BaseFile::Tell() const
+{
+	if (m_File)
+	{
+		Int64 position = _ftelli64(m_File);
+		return position < 0 ? 0 : (Uint64)position;
+	}
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+Uint64 BaseFile::GetSize() const
+{
+	if (m_File)
+	{
+		Int64 position = _ftelli64(m_File);
+		_fseeki64(m_File, 0, SEEK_END);
+		Int64 size = _ftelli64(m_File);
+		_fseeki64(m_File, position, SEEK_SET);
+		return size < 0 ? 0 : (Uint64)size;
+	}
+	return 0;
+}
+
 bool BaseFile::Exists(std::string fileName)
 {
 	FILE* file;
@@ -102,6 +169,23 @@ bool BaseFile::Exists(std::string fileName)
 	return 0;
 }
 
+//-----------------------------------------------------------------------------
+Uint64 BaseFile::LastWriteTime(const std::string& fileName)
+{
+	struct stat info;
+	if (stat(fileName.c_str(), &info) != 0)
+	{
+		return 0;
+	}
+
+	return (Uint64)info.st_mtime;
+}
+
+bool BaseFile::Remove(const std::string& fileName)
+{
+	return std::remove(fileName.c_str()) == 0;
+}
+
 //-----------------------------------------------------------------------------
 File::File()
 {
@@ -323,7 +407,7 @@ bool BinaryFile::WriteDword(const Dword& value)
 //-----------------------------------------------------------------------------
 bool BinaryFile::WriteFloat(const float& value)
 {
-	if (m_File && m_Mode != FileMode::Write)
+	if (m_File && m_Mode == FileMode::Write)
 	{
 		//Type pruning hack?
 		union u
@@ -333,7 +417,7 @@ bool BinaryFile::WriteFloat(const float& value)
 		}bytes;
 		bytes.f = value;
 
-		fwrite(&bytes, sizeof(u), sizeof(bytes), m_File);
+		fwrite(bytes.data, 1, sizeof(bytes.data), m_File);
 		return true;
 	}
 
@@ -393,23 +477,22 @@ float BinaryFile::ReadFloat()
 }
 
 //-----------------------------------------------------------------------------
-bool BinaryFile::WriteBuffer(const Byte* data, unsigned int byteCount)
+bool BinaryFile::WriteBuffer(const Byte* data, Uint64 byteCount)
 {
 	if (m_File && m_Mode == FileMode::Write)
 	{
-		fwrite(data, 1, byteCount, m_File);
-		return true;
+		return WriteChunked(data, byteCount, m_File) >= byteCount;
 	}
 
 	return false;
 }
 
 //-----------------------------------------------------------------------------
-bool BinaryFile::ReadBuffer(Byte* data, unsigned int byteCount)
+bool BinaryFile::ReadBuffer(Byte* data, Uint64 byteCount)
 {
 	if (m_File && m_Mode == FileMode::Read)
 	{
-		if (fread(data, 1, byteCount, m_File) >= byteCount)
+		if (ReadChunked(data, byteCount, m_File) >= byteCount)
 		{
 			return true;
 		}
@@ -447,14 +530,14 @@ std::string BinaryFile::ReadString()
 }
 
 //-----------------------------------------------------------------------------
-bool BinaryFile::Load(const char* fileName, Byte* data, Uint32 bufferSize)
+bool BinaryFile::Load(const char* fileName, Byte* data, Uint64 bufferSize)
 {
 	FILE* file = nullptr;
 	fopen_s(&file, fileName, "rb");
 
 	if (file != nullptr)
 	{
-		fread((char*)&data, sizeof(Byte), bufferSize, file);
+		ReadChunked(data, bufferSize, file);
 		fclose(file);
 		return true;
 	}
@@ -463,36 +546,32 @@ bool BinaryFile::Load(const char* fileName, Byte* data, Uint32 bufferSize)
 }
 
 //-----------------------------------------------------------------------------
-bool BinaryFile::Save(const char* fileName, const Byte* data, Uint32 bufferSize)
+bool BinaryFile::Save(const char* fileName, const Byte* data, Uint64 bufferSize)
 {
 	FILE* file = nullptr;
-	fopen_s(&file, fileName, "rb");
+	fopen_s(&file, fileName, "wb");
 
 	if (file != nullptr)
 	{
-		if (fwrite((char*)&data, sizeof(Byte), bufferSize, file) >= bufferSize)
-		{
-			fclose(file);
-			return true;
-		}
+		bool result = WriteChunked(data, bufferSize, file) >= bufferSize;
+		fclose(file);
+		return result;
 	}
 
 	return false;
 }
 
 //-----------------------------------------------------------------------------
-bool BinaryFile::Append(const char* fileName, const Byte* data, Uint32 bufferSize)
+bool BinaryFile::Append(const char* fileName, const Byte* data, Uint64 bufferSize)
 {
 	FILE* file = nullptr;
 	fopen_s(&file, fileName, "ab");
 
 	if (file != nullptr)
 	{
-		if (fwrite(data, 1, bufferSize, file) >= bufferSize)
-		{
-			fclose(file);
-			return true;
-		}
+		bool result = WriteChunked(data, bufferSize, file) >= bufferSize;
+		fclose(file);
+		return result;
 	}
 
 	return false;
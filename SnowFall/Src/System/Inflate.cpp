@@ -0,0 +1,576 @@
+#include "System/Inflate.h"
+#include <cstring>
+#include <initializer_list>
+
+namespace
+{
+	const Uint16 LengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+	const Byte	 LengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+	const Uint16 DistanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+	const Byte	 DistanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+	const Byte	 CodeLengthOrder[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+	Uint32 Reverse16(Uint32 value)
+	{
+		value = ((value & 0xAAAA) >> 1) | ((value & 0x5555) << 1);
+		value = ((value & 0xCCCC) >> 2) | ((value & 0x3333) << 2);
+		value = ((value & 0xF0F0) >> 4) | ((value & 0x0F0F) << 4);
+		value = ((value & 0xFF00) >> 8) | ((value & 0x00FF) << 8);
+		return value;
+	}
+
+	// Slicing by 8, table k advances a byte k places further back, eight bytes fold in per step.
+	struct CrcTables
+	{
+		Uint32 Table[8][256];
+
+		CrcTables()
+		{
+			for (Uint32 i = 0; i < 256; i++)
+			{
+				Uint32 crc = i;
+				for (int bit = 0; bit < 8; bit++)
+				{
+					crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+				}
+				Table[0][i] = crc;
+			}
+
+			for (Uint32 i = 0; i < 256; i++)
+			{
+				for (int k = 1; k < 8; k++)
+				{
+					Table[k][i] = (Table[k - 1][i] >> 8) ^ Table[0][Table[k - 1][i] & 0xFF];
+				}
+			}
+		}
+	};
+
+	const CrcTables Crc;
+
+	// Largest run of bytes before the Adler sums could overflow 32 bits.
+	const Uint64 AdlerRun = 5552;
+	const Uint32 AdlerBase = 65521;
+}
+
+//-----------------------------------------------------------------------------
+void Inflater::Begin(const Byte* input, Uint64 inputSize, Byte* output, Uint64 outputSize)
+{
+	m_Input = input;
+	m_InputSize = inputSize;
+	m_InputPosition = 0;
+	m_BitBuffer = 0;
+	m_BitCount = 0;
+	m_Overrun = 0;
+	m_Output = output;
+	m_OutputSize = outputSize;
+	m_OutputPosition = 0;
+	m_Block = BlockType::Header;
+	m_StoredRemaining = 0;
+	m_FinalBlock = false;
+	m_Done = false;
+}
+
+//-----------------------------------------------------------------------------
+InflateStatus Inflater::Decode(Uint64 outputLimit)
+{
+	while (m_Done == false)
+	{
+		if (m_OutputPosition >= outputLimit)
+		{
+			return InflateStatus::Partial;
+		}
+
+		if (m_Block == BlockType::Header)
+		{
+			if (m_FinalBlock)
+			{
+				// Hand back whole bytes still sitting in the bit buffer.
+				Uint32 held = m_BitCount / 8;
+				if (m_Overrun > held) { return InflateStatus::Error; }
+				m_InputPosition -= held - m_Overrun;
+				m_BitBuffer = 0;
+				m_BitCount = 0;
+				m_Overrun = 0;
+				m_Done = true;
+				break;
+			}
+
+			if (ReadBlockHeader() == false)
+			{
+				return InflateStatus::Error;
+			}
+			continue;
+		}
+
+		if (m_Block == BlockType::Stored)
+		{
+			if (CopyStored(outputLimit) == false)
+			{
+				return InflateStatus::Error;
+			}
+			continue;
+		}
+
+		// Huffman block, one literal or match per pass.
+		Refill();
+		int symbol = DecodeSymbol(m_Literals);
+		if (symbol < 0)
+		{
+			return InflateStatus::Error;
+		}
+
+		if (symbol < 256)
+		{
+			if (m_OutputPosition >= m_OutputSize) { return InflateStatus::Error; }
+			m_Output[m_OutputPosition++] = (Byte)symbol;
+		}
+		else if (symbol == 256)
+		{
+			if (InputOverrun()) { return InflateStatus::Error; }
+			m_Block = BlockType::Header;
+		}
+		else
+		{
+			symbol -= 257;
+			if (symbol >= 29) { return InflateStatus::Error; }
+			Uint32 length = LengthBase[symbol] + GetBits(LengthExtra[symbol]);
+
+			Refill();
+			int distanceSymbol = DecodeSymbol(m_Distances);
+			if (distanceSymbol < 0 || distanceSymbol >= 30) { return InflateStatus::Error; }
+			Uint32 distance = DistanceBase[distanceSymbol] + GetBits(DistanceExtra[distanceSymbol]);
+
+			if (distance > m_OutputPosition || length > m_OutputSize - m_OutputPosition)
+			{
+				return InflateStatus::Error;
+			}
+
+			Byte* dst = m_Output + m_OutputPosition;
+			const Byte* src = dst - distance;
+			if (distance >= length)
+			{
+				memcpy(dst, src, length);
+			}
+			else if (distance == 1)
+			{
+				memset(dst, *src, length);
+			}
+			else
+			{
+				// Overlapping run, has to go a byte at a time.
+				for (Uint32 i = 0; i < length; i++)
+				{
+					dst[i] = src[i];
+				}
+			}
+			m_OutputPosition += length;
+		}
+	}
+
+	return InflateStatus::Done;
+}
+
+//-----------------------------------------------------------------------------
+Uint64 Inflater::GetInputPosition() const
+{
+	return m_InputPosition;
+}
+
+//-----------------------------------------------------------------------------
+Uint64 Inflater::GetOutputPosition() const
+{
+	return m_OutputPosition;
+}
+
+//-----------------------------------------------------------------------------
+Uint64 Inflater::ReadGzipHeader(const Byte* data, Uint64 size, Uint64* blockSize)
+{
+	const Byte FlagCRC = 0x02, FlagExtra = 0x04, FlagName = 0x08, FlagComment = 0x10;
+
+	if (blockSize) { *blockSize = 0; }
+	if (size < 18 || data[0] != 0x1F || data[1] != 0x8B || data[2] != 8)
+	{
+		return 0;
+	}
+
+	Byte flags = data[3];
+	Uint64 position = 10;
+
+	if (flags & FlagExtra)
+	{
+		if (position + 2 > size) { return 0; }
+		Uint32 extraSize = data[position] | (data[position + 1] << 8);
+		position += 2;
+		if (position + extraSize > size) { return 0; }
+
+		// BGZF stores the member size in a 'BC' subfield, which lets members be found without decoding.
+		Uint64 sub = position;
+		while (sub + 4 <= position + extraSize)
+		{
+			Uint32 subSize = data[sub + 2] | (data[sub + 3] << 8);
+			if (data[sub] == 'B' && data[sub + 1] == 'C' && subSize == 2 && sub + 6 <= position + extraSize && blockSize)
+			{
+				*blockSize = (Uint64)(data[sub + 4] | (data[sub + 5] << 8)) + 1;
+			}
+			sub += 4 + subSize;
+		}
+		position += extraSize;
+	}
+
+	for (Byte flag : { FlagName, FlagComment })
+	{
+		if (flags & flag)
+		{
+			while (position < size && data[position] != 0) { position++; }
+			position++;
+		}
+	}
+
+	if (flags & FlagCRC)
+	{
+		position += 2;
+	}
+
+	return position < size ? position : 0;
+}
+
+//-----------------------------------------------------------------------------
+Uint64 Inflater::ReadZlibHeader(const Byte* data, Uint64 size)
+{
+	if (size < 6)
+	{
+		return 0;
+	}
+
+	Uint32 method = data[0] & 0x0F;
+	Uint32 window = data[0] >> 4;
+	bool presetDictionary = (data[1] & 0x20) != 0;
+	if (method != 8 || window > 7 || presetDictionary || ((data[0] << 8) | data[1]) % 31 != 0)
+	{
+		return 0;
+	}
+
+	return 2;
+}
+
+Uint32 Inflater::Crc32(Uint32 crc, const Byte* data, Uint64 size)
+{
+	Uint32 value = (Uint32)(crc ^ 0xFFFFFFFF);
+	for (; size >= 8; size -= 8, data += 8)
+	{
+		Uint32 low = value ^ ((Uint32)data[0] | ((Uint32)data[1] << 8) | ((Uint32)data[2] << 16) | ((Uint32)data[3] << 24));
+		value = Crc.Table[7][low & 0xFF] ^ Crc.Table[6][(low >> 8) & 0xFF] ^ Crc.Table[5][(low >> 16) & 0xFF] ^ Crc.Table[4][(low >> 24) & 0xFF] ^
+				Crc.Table[3][data[4]] ^ Crc.Table[2][data[5]] ^ Crc.Table[1][data[6]] ^ Crc.Table[0][data[7]];
+	}
+
+	for (; size > 0; size--)
+	{
+		value = (value >> 8) ^ Crc.Table[0][(value ^ *data++) & 0xFF];
+	}
+	return (Uint32)(value ^ 0xFFFFFFFF);
+}
+
+Uint32 Inflater::Adler32(Uint32 adler, const Byte* data, Uint64 size)
+{
+	Uint32 a = adler & 0xFFFF;
+	Uint32 b = (adler >> 16) & 0xFFFF;
+	while (size > 0)
+	{
+		Uint64 run = size < AdlerRun ? size : AdlerRun;
+		size -= run;
+		for (; run > 0; run--)
+		{
+			a += *data++;
+			b += a;
+		}
+		a %= AdlerBase;
+		b %= AdlerBase;
+	}
+	return (b << 16) | a;
+}
+
+//-----------------------------------------------------------------------------
+bool Inflater::BuildTable(HuffmanTable& table, const Byte* lengths, Uint32 count)
+{
+	Uint32 counts[16] = {};
+	Uint32 nextCode[16] = {};
+
+	memset(table.Fast, 0, sizeof(table.Fast));
+	for (Uint32 i = 0; i < count; i++)
+	{
+		counts[lengths[i]]++;
+	}
+	counts[0] = 0;
+
+	// Canonical codes, left aligned MaxCode lets the slow path compare reversed bits directly.
+	Uint32 code = 0;
+	Uint32 symbol = 0;
+	for (Uint32 i = 1; i < 16; i++)
+	{
+		nextCode[i] = code;
+		table.FirstCode[i] = (Uint16)code;
+		table.FirstSymbol[i] = (Uint16)symbol;
+		code += counts[i];
+		if (counts[i] && code - 1 >= (1u << i))
+		{
+			return false; // Over subscribed
+		}
+		table.MaxCode[i] = code << (16 - i);
+		code <<= 1;
+		symbol += counts[i];
+	}
+	table.MaxCode[16] = 0x10000;
+	table.MaxCode[17] = 0x10000;
+
+	for (Uint32 i = 0; i < count; i++)
+	{
+		Uint32 length = lengths[i];
+		if (length == 0)
+		{
+			continue;
+		}
+
+		Uint32 slot = table.FirstSymbol[length] + (nextCode[length] - table.FirstCode[length]);
+		table.Lengths[slot] = (Byte)length;
+		table.Symbols[slot] = (Uint16)i;
+
+		if (length <= FastBits)
+		{
+			Uint32 reversed = Reverse16(nextCode[length]) >> (16 - length);
+			while (reversed < (1u << FastBits))
+			{
+				table.Fast[reversed] = (Uint16)((length << 9) | i);
+				reversed += 1u << length;
+			}
+		}
+		nextCode[length]++;
+	}
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+bool Inflater::ReadBlockHeader()
+{
+	Refill();
+	m_FinalBlock = GetBits(1) != 0;
+	Uint32 type = GetBits(2);
+
+	if (type == 0)
+	{
+		// Stored, realign to the byte and hand the bit buffer back to the input.
+		GetBits(m_BitCount & 7);
+		Uint32 length = GetBits(16);
+		Uint32 inverse = GetBits(16);
+		if ((length ^ 0xFFFF) != inverse)
+		{
+			return false;
+		}
+
+		Uint32 held = m_BitCount / 8;
+		if (m_Overrun > held) { return false; }
+		m_InputPosition -= held - m_Overrun;
+		m_BitBuffer = 0;
+		m_BitCount = 0;
+		m_Overrun = 0;
+
+		m_StoredRemaining = length;
+		m_Block = BlockType::Stored;
+		return true;
+	}
+
+	if (type == 1)
+	{
+		Byte lengths[288 + 32];
+		memset(lengths, 8, 144);
+		memset(lengths + 144, 9, 112);
+		memset(lengths + 256, 7, 24);
+		memset(lengths + 280, 8, 8);
+		memset(lengths + 288, 5, 32);
+		if (BuildTable(m_Literals, lengths, 288) == false || BuildTable(m_Distances, lengths + 288, 32) == false)
+		{
+			return false;
+		}
+		m_Block = BlockType::Huffman;
+		return true;
+	}
+
+	if (type == 2 && ReadDynamicTables())
+	{
+		m_Block = BlockType::Huffman;
+		return true;
+	}
+
+	return false;
+}
+
+//-----------------------------------------------------------------------------
+bool Inflater::ReadDynamicTables()
+{
+	Refill();
+	Uint32 literalCount = GetBits(5) + 257;
+	Uint32 distanceCount = GetBits(5) + 1;
+	Uint32 codeLengthCount = GetBits(4) + 4;
+	if (literalCount > 286 || distanceCount > 30)
+	{
+		return false;
+	}
+
+	Byte codeLengths[19] = {};
+	for (Uint32 i = 0; i < codeLengthCount; i++)
+	{
+		Refill();
+		codeLengths[CodeLengthOrder[i]] = (Byte)GetBits(3);
+	}
+
+	HuffmanTable codeLengthTable;
+	if (BuildTable(codeLengthTable, codeLengths, 19) == false)
+	{
+		return false;
+	}
+
+	// Literal and distance lengths are one run, repeats may cross between them.
+	Byte lengths[286 + 30];
+	Uint32 total = literalCount + distanceCount;
+	Uint32 filled = 0;
+	while (filled < total)
+	{
+		Refill();
+		int symbol = DecodeSymbol(codeLengthTable);
+		if (symbol < 0)
+		{
+			return false;
+		}
+
+		if (symbol < 16)
+		{
+			lengths[filled++] = (Byte)symbol;
+			continue;
+		}
+
+		Byte value = 0;
+		Uint32 repeat = 0;
+		if (symbol == 16)
+		{
+			if (filled == 0) { return false; }
+			value = lengths[filled - 1];
+			repeat = 3 + GetBits(2);
+		}
+		else if (symbol == 17)
+		{
+			repeat = 3 + GetBits(3);
+		}
+		else
+		{
+			repeat = 11 + GetBits(7);
+		}
+
+		if (filled + repeat > total)
+		{
+			return false;
+		}
+		memset(lengths + filled, value, repeat);
+		filled += repeat;
+	}
+
+	if (lengths[256] == 0)
+	{
+		return false; // No end of block code
+	}
+
+	return BuildTable(m_Literals, lengths, literalCount) && BuildTable(m_Distances, lengths + literalCount, distanceCount) && InputOverrun() == false;
+}
+
+//-----------------------------------------------------------------------------
+void Inflater::Refill()
+{
+	while (m_BitCount <= 56)
+	{
+		if (m_InputPosition < m_InputSize)
+		{
+			m_BitBuffer |= (Uint64)m_Input[m_InputPosition++] << m_BitCount;
+		}
+		else
+		{
+			// Zeros past the end, only an error if they get used.
+			m_Overrun++;
+		}
+		m_BitCount += 8;
+	}
+}
+
+//-----------------------------------------------------------------------------
+Uint32 Inflater::GetBits(Uint32 count)
+{
+	Uint32 bits = (Uint32)(m_BitBuffer & ((1ull << count) - 1));
+	m_BitBuffer >>= count;
+	m_BitCount -= count;
+	return bits;
+}
+
+//-----------------------------------------------------------------------------
+int Inflater::DecodeSymbol(const HuffmanTable& table)
+{
+	Uint16 fast = table.Fast[m_BitBuffer & ((1 << FastBits) - 1)];
+	if (fast)
+	{
+		GetBits(fast >> 9);
+		return fast & 511;
+	}
+
+	// Longer than FastBits, walk the lengths until the code fits.
+	Uint32 reversed = Reverse16((Uint32)(m_BitBuffer & 0xFFFF));
+	Uint32 length = FastBits + 1;
+	while (reversed >= table.MaxCode[length])
+	{
+		length++;
+	}
+
+	if (length >= 16)
+	{
+		return -1;
+	}
+
+	Uint32 slot = (reversed >> (16 - length)) - table.FirstCode[length] + table.FirstSymbol[length];
+	if (slot >= 288 || table.Lengths[slot] != length)
+	{
+		return -1;
+	}
+
+	GetBits(length);
+	return table.Symbols[slot];
+}
+
+//-----------------------------------------------------------------------------
+bool Inflater::CopyStored(Uint64 outputLimit)
+{
+	Uint64 count = m_StoredRemaining;
+	if (outputLimit > m_OutputPosition && outputLimit - m_OutputPosition < count)
+	{
+		count = outputLimit - m_OutputPosition;
+	}
+
+	if (count > m_InputSize - m_InputPosition || count > m_OutputSize - m_OutputPosition)
+	{
+		return false;
+	}
+
+	memcpy(m_Output + m_OutputPosition, m_Input + m_InputPosition, count);
+	m_InputPosition += count;
+	m_OutputPosition += count;
+	m_StoredRemaining -= (Uint32)count;
+
+	if (m_StoredRemaining == 0)
+	{
+		m_Block = BlockType::Header;
+	}
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+bool Inflater::InputOverrun() const
+{
+	// More zero padding used than is still held means bits came from past the end.
+	return m_Overrun > m_BitCount / 8;
+}
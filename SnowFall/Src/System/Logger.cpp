@@ -22,6 +22,7 @@ LogHandler& LogHandler::Instance()
 
 void LogHandler::NotifyObservers(LogType type, const char* message)
 {
+	std::lock_guard<std::mutex> lock(m_Mutex);
 	for (LogObserver* observer : m_Observers)
 	{
 		// Only output if you have correct level output!
@@ -43,6 +44,7 @@ void LogHandler::Subscribe(LogObserver* observer)
 {
 	if (observer)
 	{
+		std::lock_guard<std::mutex> lock(Instance().m_Mutex);
 		Instance().m_Observers.insert(observer);
 	}
 }
@@ -51,6 +53,7 @@ void LogHandler::Unsubscribe(LogObserver* observer)
 {
 	if (observer)
 	{
+		std::lock_guard<std::mutex> lock(Instance().m_Mutex);
 		Instance().m_Observers.erase(observer);
 	}
 }
@@ -82,6 +85,7 @@ void LogHandler::WriteMessage(LogType type, const std::string& message)
 
 void LogHandler::FlushObervers()
 {
+	std::lock_guard<std::mutex> lock(Instance().m_Mutex);
 	std::set<LogObserver*>& observerSet = Instance().m_Observers;
 
 	for (LogObserver* observer : observerSet)
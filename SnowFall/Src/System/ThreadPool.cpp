@@ -0,0 +1,197 @@
+#include "System/ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+//-----------------------------------------------------------------------------
+ThreadPool::ThreadPool()
+{
+}
+
+//-----------------------------------------------------------------------------
+ThreadPool::ThreadPool(Uint32 threadCount)
+{
+	Initialize(threadCount);
+}
+
+//-----------------------------------------------------------------------------
+ThreadPool::~ThreadPool()
+{
+	Shutdown();
+}
+
+//-----------------------------------------------------------------------------
+ThreadPool& ThreadPool::Instance()
+{
+	static ThreadPool pool(0);
+	return pool;
+}
+
+//-----------------------------------------------------------------------------
+Uint32 ThreadPool::HardwareThreads()
+{
+	Uint32 count = std::thread::hardware_concurrency();
+	return count > 0 ? count : 1;
+}
+
+//-----------------------------------------------------------------------------
+void ThreadPool::Initialize(Uint32 threadCount)
+{
+	Shutdown();
+
+	if (threadCount == 0)
+	{
+		threadCount = HardwareThreads();
+	}
+
+	m_Quit = false;
+	for (Uint32 i = 0; i < threadCount; i++)
+	{
+		m_Workers.emplace_back(&ThreadPool::WorkerLoop, this);
+	}
+}
+
+//-----------------------------------------------------------------------------
+void ThreadPool::Shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Quit = true;
+	}
+	m_JobSignal.notify_all();
+
+	for (std::thread& worker : m_Workers)
+	{
+		worker.join();
+	}
+
+	m_Workers.clear();
+	m_Jobs.clear();
+}
+
+//-----------------------------------------------------------------------------
+Uint32 ThreadPool::GetThreadCount() const
+{
+	return (Uint32)m_Workers.size();
+}
+
+//-----------------------------------------------------------------------------
+void ThreadPool::Submit(std::function<void()> job)
+{
+	if (m_Workers.empty())
+	{
+		job();
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Jobs.push_back(std::move(job));
+	}
+	m_JobSignal.notify_one();
+}
+
+//-----------------------------------------------------------------------------
+void ThreadPool::Wait()
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	m_IdleSignal.wait(lock, [this]() { return m_Jobs.empty() && m_Active == 0; });
+}
+
+//-----------------------------------------------------------------------------
+void ThreadPool::ParallelFor(Uint64 count, const std::function<void(Uint64, Uint64)>& job, Uint64 grain, Uint32 maxThreads)
+{
+	if (count == 0) { return; }
+
+	Uint32 threads = (Uint32)m_Workers.size() + 1; // Caller helps out
+	if (maxThreads > 0)
+	{
+		threads = std::min(threads, maxThreads);
+	}
+
+	if (grain == 0)
+	{
+		// A few chunks per thread so uneven chunks balance out.
+		grain = std::max<Uint64>(1, count / ((Uint64)threads * 4));
+	}
+
+	Uint64 chunkCount = (count + grain - 1) / grain;
+	if (threads <= 1 || chunkCount <= 1)
+	{
+		job(0, count);
+		return;
+	}
+
+	// Shared so helpers that start after the work is finished still see valid state.
+	struct Batch
+	{
+		std::atomic<Uint64>		next;
+		std::atomic<Uint64>		done;
+		std::mutex				mutex;
+		std::condition_variable signal;
+	};
+	std::shared_ptr<Batch> batch = std::make_shared<Batch>();
+	batch->next = 0;
+	batch->done = 0;
+
+	const std::function<void(Uint64, Uint64)>* work = &job;
+	auto run = [batch, work, count, grain, chunkCount]()
+	{
+		Uint64 chunk;
+		while ((chunk = batch->next.fetch_add(1)) < chunkCount)
+		{
+			Uint64 begin = chunk * grain;
+			(*work)(begin, std::min(begin + grain, count));
+
+			if (batch->done.fetch_add(1) + 1 == chunkCount)
+			{
+				std::lock_guard<std::mutex> lock(batch->mutex);
+				batch->signal.notify_all();
+			}
+		}
+	};
+
+	Uint32 helpers = (Uint32)std::min<Uint64>(threads - 1, chunkCount - 1);
+	for (Uint32 i = 0; i < helpers; i++)
+	{
+		Submit(run);
+	}
+
+	run();
+
+	std::unique_lock<std::mutex> lock(batch->mutex);
+	batch->signal.wait(lock, [&batch, chunkCount]() { return batch->done.load() == chunkCount; });
+}
+
+//-----------------------------------------------------------------------------
+void ThreadPool::WorkerLoop()
+{
+	while (true)
+	{
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_JobSignal.wait(lock, [this]() { return m_Quit || m_Jobs.empty() == false; });
+
+			if (m_Quit && m_Jobs.empty())
+			{
+				return;
+			}
+
+			job = std::move(m_Jobs.front());
+			m_Jobs.pop_front();
+			m_Active++;
+		}
+
+		job();
+
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Active--;
+			if (m_Jobs.empty() && m_Active == 0)
+			{
+				m_IdleSignal.notify_all();
+			}
+		}
+	}
+}
@@ -0,0 +1,62 @@
+#include "System/File.h"
+#include <windows.h>
+#include <winioctl.h>
+#include <io.h>
+
+//-----------------------------------------------------------------------------
+std::vector<std::string> File::GetFiles(const std::string& directory)
+{
+	std::vector<std::string> files;
+	std::string root = directory;
+	if (root.empty() == false && root.back() != '/' && root.back() != '\\')
+	{
+		root += "\\";
+	}
+
+	WIN32_FIND_DATAA findData;
+	HANDLE find = FindFirstFileA((root + "*").c_str(), &findData);
+	if (find == INVALID_HANDLE_VALUE)
+	{
+		return files;
+	}
+
+	do
+	{
+		if ((findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0)
+		{
+			files.push_back(root + findData.cFileName);
+		}
+	} while (FindNextFileA(find, &findData));
+
+	FindClose(find);
+	return files;
+}
+
+bool File::MakeDirectory(const std::string& path)
+{
+	return CreateDirectoryA(path.c_str(), nullptr) != FALSE || GetLastError() == ERROR_ALREADY_EXISTS;
+}
+
+bool File::DeleteDirectory(const std::string& path)
+{
+	return RemoveDirectoryA(path.c_str()) != FALSE;
+}
+
+//-----------------------------------------------------------------------------
+bool BaseFile::SetSparse()
+{
+	if (m_File == nullptr)
+	{
+		return false;
+	}
+
+	fflush(m_File);
+	HANDLE file = (HANDLE)_get_osfhandle(_fileno(m_File));
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	DWORD returned = 0;
+	return DeviceIoControl(file, FSCTL_SET_SPARSE, nullptr, 0, nullptr, 0, &returned, nullptr) != FALSE;
+}
@@ -0,0 +1,136 @@
+#include "System/MappedFile.h"
+#include "System/Logger.h"
+#include <windows.h>
+
+//-----------------------------------------------------------------------------
+MappedFile::MappedFile()
+{
+}
+
+//-----------------------------------------------------------------------------
+MappedFile::MappedFile(const char* fileName, MappedAccess access)
+{
+	Open(fileName, access);
+}
+
+//-----------------------------------------------------------------------------
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+//-----------------------------------------------------------------------------
+bool MappedFile::Open(const char* fileName, MappedAccess access)
+{
+	Close();
+	m_FileName = fileName;
+
+	// Sequential/Random are the Win32 equivalent of madvise, they steer the cache managers read ahead.
+	DWORD flags = FILE_ATTRIBUTE_NORMAL;
+	if (access == MappedAccess::Sequential)
+	{
+		flags |= FILE_FLAG_SEQUENTIAL_SCAN;
+	}
+	else if (access == MappedAccess::Random)
+	{
+		flags |= FILE_FLAG_RANDOM_ACCESS;
+	}
+
+	HANDLE file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, flags, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		LogError("Failed to open file for mapping: " + m_FileName);
+		return false;
+	}
+
+	LARGE_INTEGER size = {};
+	if (GetFileSizeEx(file, &size) == FALSE || size.QuadPart == 0)
+	{
+		// Cant map an empty file.
+		CloseHandle(file);
+		return false;
+	}
+
+	// Write copy so callers can patch the data in place without it reaching disk.
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+	if (mapping == nullptr)
+	{
+		LogError("Failed to create file mapping: " + m_FileName);
+		CloseHandle(file);
+		return false;
+	}
+
+	void* view = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+	if (view == nullptr)
+	{
+		LogError("Failed to map view of file: " + m_FileName);
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+
+	m_FileHandle	= file;
+	m_MappingHandle = mapping;
+	m_Data			= (Byte*)view;
+	m_Size			= (Uint64)size.QuadPart;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+void MappedFile::Close()
+{
+	if (m_Data)
+	{
+		UnmapViewOfFile(m_Data);
+		m_Data = nullptr;
+	}
+
+	if (m_MappingHandle)
+	{
+		CloseHandle((HANDLE)m_MappingHandle);
+		m_MappingHandle = nullptr;
+	}
+
+	if (m_FileHandle)
+	{
+		CloseHandle((HANDLE)m_FileHandle);
+		m_FileHandle = nullptr;
+	}
+
+	m_Size = 0;
+}
+
+//-----------------------------------------------------------------------------
+bool MappedFile::IsOpen() const
+{
+	return m_Data != nullptr;
+}
+
+//-----------------------------------------------------------------------------
+Byte* MappedFile::GetData() const
+{
+	return m_Data;
+}
+
+//-----------------------------------------------------------------------------
+Uint64 MappedFile::GetSize() const
+{
+	return m_Size;
+}
+
+//-----------------------------------------------------------------------------
+void MappedFile::Prefetch(Uint64 offset, Uint64 byteCount) const
+{
+	if (m_Data == nullptr || offset >= m_Size) { return; }
+
+	if (offset + byteCount > m_Size)
+	{
+		byteCount = m_Size - offset;
+	}
+
+	// Win32 version of madvise(MADV_WILLNEED), its only a hint so failure is harmless.
+	WIN32_MEMORY_RANGE_ENTRY range;
+	range.VirtualAddress = m_Data + offset;
+	range.NumberOfBytes  = (SIZE_T)byteCount;
+	PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+}
@@ -133,6 +133,11 @@ void ForwardRenderer::RenderCamera(Scene* scene, std::shared_ptr<Camera> camera,
 
 	for (size_t i = 0; i < renderList.size(); ++i)
 	{
+		if (renderList[i]->m_Enabled == false)
+		{
+			continue;
+		}
+
 		if (renderList[i]->GetRenderQueue() == RenderType::Opaque)
 		{
 			RenderItem& item = geometryQueue.Alocate();
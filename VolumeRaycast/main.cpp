@@ -0,0 +1,286 @@
+// Renders a volume with the CPU raycaster and writes the image, no window and no GPU.
+//
+//	VolumeRaycast <volume> <image.png|bmp|jpg> [options]
+//		-method mip|alpha|pbr|ess	(pbr)
+//		-layout packed|split		(packed)
+//		-size <width> <height>		(512 512)
+//		-ramp <low> <high>			Opacity ramp over the normalized intensity (0.2 0.6)
+//		-iso <value>				(0.01)
+//		-step <scale>				Base steps a sample (1)
+//		-cell <voxels>				Occupancy cell size for ess (4)
+//		-camera <x> <y> <z>			Volume local space, looking at the centre (0 0 -3)
+//		-threads <count>			0 uses the whole pool (0)
+//
+// The volume goes through VolumeLoader on its worker gradient path, so every format the app
+// reads works here and the brick file and sidecar are shared with it. The transfer function is
+// a white opacity ramp, the image is the premultiplied framebuffer over black.
+
+#include "VolumeLoader.h"
+#include "VolumeOccupancy.h"
+#include "VolumeRaycaster.h"
+#include "Content/Texture.h"
+#include "System/Logger.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace
+{
+	const Uint32 IntensityBins = 256;
+	const Uint32 GradientBins = 64;
+
+	class ConsoleLog : public LogObserver
+	{
+	public:
+		void OutputLog(const std::string& message)
+		{
+			printf("%s\n", message.c_str());
+		}
+	};
+
+	struct Options
+	{
+		std::string	   VolumePath;
+		std::string	   ImagePath;
+		VolumeLayout   Layout = VolumeLayout::Packed;
+		Uint32		   Width = 512;
+		Uint32		   Height = 512;
+		float		   RampLow = 0.2f;
+		float		   RampHigh = 0.6f;
+		Uint32		   CellSize = 4;
+		RaycastCamera  Camera;
+		RaycastSettings Settings;
+	};
+
+	void PrintUsage()
+	{
+		printf("VolumeRaycast <volume> <image.png|bmp|jpg> [-method mip|alpha|pbr|ess] [-layout packed|split]\n"
+			   "              [-size w h] [-ramp low high] [-iso value] [-step scale] [-cell voxels]\n"
+			   "              [-camera x y z] [-threads count]\n");
+	}
+
+	bool ParseArguments(int argc, char** argv, Options& options)
+	{
+		if (argc < 3)
+		{
+			return false;
+		}
+
+		options.VolumePath = argv[1];
+		options.ImagePath = argv[2];
+		for (int i = 3; i < argc; i++)
+		{
+			std::string name = argv[i];
+			int left = argc - i - 1;
+			if (name == "-method" && left >= 1)
+			{
+				std::string method = argv[++i];
+				if (method == "mip")		{ options.Settings.Method = VolumeMethod::MIP; }
+				else if (method == "alpha")	{ options.Settings.Method = VolumeMethod::Alpha; }
+				else if (method == "pbr")	{ options.Settings.Method = VolumeMethod::PBR; }
+				else if (method == "ess")	{ options.Settings.Method = VolumeMethod::PBR_ESS; }
+				else						{ return false; }
+			}
+			else if (name == "-layout" && left >= 1)
+			{
+				std::string layout = argv[++i];
+				if (layout == "packed")		{ options.Layout = VolumeLayout::Packed; }
+				else if (layout == "split")	{ options.Layout = VolumeLayout::Split; }
+				else						{ return false; }
+			}
+			else if (name == "-size" && left >= 2)
+			{
+				options.Width = (Uint32)std::max(atoi(argv[++i]), 1);
+				options.Height = (Uint32)std::max(atoi(argv[++i]), 1);
+			}
+			else if (name == "-ramp" && left >= 2)
+			{
+				options.RampLow = (float)atof(argv[++i]);
+				options.RampHigh = (float)atof(argv[++i]);
+			}
+			else if (name == "-iso" && left >= 1)
+			{
+				options.Settings.IsoValue = (float)atof(argv[++i]);
+			}
+			else if (name == "-step" && left >= 1)
+			{
+				options.Settings.StepScale = std::max((float)atof(argv[++i]), 0.01f);
+			}
+			else if (name == "-cell" && left >= 1)
+			{
+				options.CellSize = (Uint32)std::max(atoi(argv[++i]), 1);
+			}
+			else if (name == "-camera" && left >= 3)
+			{
+				float x = (float)atof(argv[++i]);
+				float y = (float)atof(argv[++i]);
+				float z = (float)atof(argv[++i]);
+				options.Camera.Position = Vector3(x, y, z);
+			}
+			else if (name == "-threads" && left >= 1)
+			{
+				options.Settings.MaxThreads = (Uint32)std::max(atoi(argv[++i]), 0);
+			}
+			else
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// White, opacity ramping from low to high over the normalized intensity, at every gradient.
+	void BuildRamp(float low, float high, std::vector<Byte>& diffuse, std::vector<Byte>& surface)
+	{
+		diffuse.assign((size_t)IntensityBins * GradientBins * 4, 255);
+		surface.assign((size_t)IntensityBins * 2, 0);
+		float width = std::max(high - low, 1e-6f);
+		for (Uint32 bin = 0; bin < IntensityBins; bin++)
+		{
+			float t = std::min(std::max(((bin + 0.5f) / IntensityBins - low) / width, 0.0f), 1.0f);
+			Byte alpha = (Byte)(t * 255.0f + 0.5f);
+			for (Uint32 row = 0; row < GradientBins; row++)
+			{
+				diffuse[((size_t)row * IntensityBins + bin) * 4 + 3] = alpha;
+			}
+			surface[(size_t)bin * 2 + 1] = 128;	// Metallic 0, roughness 0.5
+		}
+	}
+
+	// Level 0 of the occupancy grid from the cell ranges, each cell the ramp's largest opacity over
+	// its intensity range (the ramp doesn't depend on the gradient).
+	void ClassifyCells(const std::vector<Word>& ranges, Uint32 scale, const std::vector<Byte>& diffuse, std::vector<Byte>& occupancy)
+	{
+		occupancy.resize(ranges.size() / 4);
+		for (size_t cell = 0; cell < occupancy.size(); cell++)
+		{
+			const Word* range = &ranges[cell * 4];
+			Uint32 first = std::min((Uint32)((Uint64)range[0] * IntensityBins / scale), IntensityBins - 1);
+			Uint32 last = std::min((Uint32)((Uint64)range[1] * IntensityBins / scale), IntensityBins - 1);
+			Byte opacity = 0;
+			for (Uint32 bin = first; bin <= last; bin++)
+			{
+				opacity = std::max(opacity, diffuse[(size_t)bin * 4 + 3]);
+			}
+			occupancy[cell] = opacity;
+		}
+	}
+
+	bool WriteImage(const std::string& path, Uint32 width, Uint32 height, const std::vector<float>& rgba)
+	{
+		Texture image;
+		image.Create2D(width, height, 1, false, BufferUsage::Immutable, SurfaceFormat::R8G8B8A8_Unorm);
+		Byte* pixels = image.GetData();
+		for (size_t i = 0; i < rgba.size(); i++)
+		{
+			pixels[i] = (Byte)(std::min(std::max(rgba[i], 0.0f), 1.0f) * 255.0f + 0.5f);
+		}
+		bool written = image.SaveToFile(path);
+		image.Release();
+		return written;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if (ParseArguments(argc, argv, options) == false)
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	ConsoleLog console;
+	LogHandler::Subscribe(&console);
+
+	VolumeLoadOptions loadOptions;
+	loadOptions.CpuGradients = true;
+	loadOptions.Layout = options.Layout;
+	loadOptions.CellSize[0] = loadOptions.CellSize[1] = loadOptions.CellSize[2] = options.CellSize;
+
+	VolumeLoader loader;
+	loader.Start(options.VolumePath, loadOptions);
+	if (loader.Wait() == false)
+	{
+		fprintf(stderr, "Failed to load %s\n", options.VolumePath.c_str());
+		LogHandler::Unsubscribe(&console);
+		return 1;
+	}
+
+	std::shared_ptr<Texture> volumeMap = loader.GetVolumeMap();
+	std::shared_ptr<Texture> gradientMap = loader.GetGradientMap();
+	std::shared_ptr<Texture> normalMap = loader.GetNormalMap();
+
+	std::vector<Byte> diffuse, surface;
+	BuildRamp(options.RampLow, options.RampHigh, diffuse, surface);
+
+	RaycastVolume scene;
+	scene.Width = volumeMap->GetWidth();
+	scene.Height = volumeMap->GetHeight();
+	scene.Depth = volumeMap->GetDepth();
+	scene.Layout = options.Layout;
+	if (options.Layout == VolumeLayout::Packed)
+	{
+		scene.Packed = volumeMap->GetData();
+	}
+	else
+	{
+		scene.Intensity = volumeMap->GetData();
+		scene.Wide = volumeMap->GetFormat() == SurfaceFormat::R16_Unorm;
+		scene.Normals = (const Word*)normalMap->GetData();
+	}
+	scene.Gradient = gradientMap->GetData();
+	scene.Diffuse = &diffuse[0];
+	scene.Surface = &surface[0];
+	scene.IntensityBins = IntensityBins;
+	scene.GradientBins = GradientBins;
+
+	// The sidecar's cell ranges when the loader has them for this cell size.
+	std::vector<Byte> occupancy;
+	if (options.Settings.Method == VolumeMethod::PBR_ESS)
+	{
+		std::vector<Word> ranges = loader.GetCellRanges();
+		if (ranges.empty())
+		{
+			VolumeOccupancy::ComputeCellRanges(volumeMap, gradientMap, loadOptions.CellSize, ranges);
+		}
+		ClassifyCells(ranges, scene.Wide ? 65535 : 255, diffuse, occupancy);
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			scene.CellSize[axis] = options.CellSize;
+		}
+		scene.Occupancy.ptr = &occupancy[0];
+		scene.Occupancy.width = (scene.Width + options.CellSize - 1) / options.CellSize;
+		scene.Occupancy.height = (scene.Height + options.CellSize - 1) / options.CellSize;
+		scene.Occupancy.depth = (scene.Depth + options.CellSize - 1) / options.CellSize;
+		scene.Occupancy.byteCount = occupancy.size();
+	}
+
+	VolumeRaycaster raycaster;
+	if (raycaster.SetVolume(scene) == false)
+	{
+		fprintf(stderr, "Loaded volume is missing data for the %s layout\n", options.Layout == VolumeLayout::Packed ? "packed" : "split");
+		LogHandler::Unsubscribe(&console);
+		return 1;
+	}
+
+	std::vector<float> rgba;
+	RaycastStats stats = raycaster.Render(options.Camera, options.Settings, options.Width, options.Height, rgba);
+	printf("%ux%ux%u, %ux%u image: %.2f ms, %llu rays, %llu samples, %llu terminated\n", scene.Width, scene.Height, scene.Depth,
+		options.Width, options.Height, stats.Seconds * 1000.0, stats.Rays, stats.Samples, stats.Terminated);
+
+	bool written = WriteImage(options.ImagePath, options.Width, options.Height, rgba);
+	if (written == false)
+	{
+		fprintf(stderr, "Failed to write %s (png, bmp or jpg)\n", options.ImagePath.c_str());
+	}
+
+	loader.Reset();
+	LogHandler::Unsubscribe(&console);
+	return written ? 0 : 1;
+}